@@ -0,0 +1,137 @@
+// Fill and copy bandwidth of field storage as the number of NUMA nodes used
+// grows. For each count of nodes the process is restricted to their CPUs and a
+// pool with a worker per CPU but one is created, pinned per node when there are
+// several, the calling thread being the last. Fill and copy run with
+// parallelForPinned(), the split used by the ScalarField passes, on memory
+// first touched by the same split, so every thread streams through memory of
+// its own node and the bandwidth should grow with the nodes. The copy is also
+// run with parallelForGrain(), whose ranges go to whichever worker steals them
+// and mostly cross nodes.
+//
+// Usage: field_bandwidth_benchmark [MB per buffer, 512 by default]
+
+#include "scalar_field/field_storage.hpp"
+#include "utils/parallel.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace {
+
+constexpr int REPETITIONS{5};
+
+// Best time of the repetitions in seconds
+double measure(const std::function<void()> &pass) {
+  double best{0.};
+  for (int r{0}; r != REPETITIONS; ++r) {
+    const auto start{std::chrono::steady_clock::now()};
+    pass();
+    const double seconds{std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count()};
+    best = r == 0 ? seconds : std::min(best, seconds);
+  }
+  return best;
+}
+
+// Restrict the calling thread, and the threads it creates, to the CPUs
+void restrictToCpus(const std::vector<unsigned int> &cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const unsigned int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  static_cast<void>(::sched_setaffinity(0, sizeof(set), &set));
+#else
+  static_cast<void>(cpus);
+#endif
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  std::size_t megabytes{512};
+  if (argc > 1) {
+    const char *const end{argv[1] + std::strlen(argv[1])};
+    if (std::from_chars(argv[1], end, megabytes).ptr != end ||
+        megabytes == 0) {
+      fmt::print(stderr, "Usage: {} [MB per buffer]\n", argv[0]);
+      return 1;
+    }
+  }
+  const std::size_t size{(megabytes << 20u) / sizeof(float)};
+  const double gigabytes{static_cast<double>(size * sizeof(float)) / 1e9};
+
+  const std::vector<std::vector<unsigned int>> nodes{Gecko::cpusPerNode()};
+  std::vector<unsigned int> all_cpus;
+  for (const std::vector<unsigned int> &cpus : nodes) {
+    all_cpus.insert(all_cpus.end(), cpus.begin(), cpus.end());
+  }
+
+  fmt::print("{} MB per buffer, {} NUMA nodes\n", megabytes, nodes.size());
+  fmt::print("{:>6} {:>8} {:>14} {:>16} {:>16}\n", "nodes", "threads",
+             "fill GB/s", "pinned copy GB/s", "stolen copy GB/s");
+  std::vector<unsigned int> cpus;
+  for (std::size_t n{0}; n != nodes.size(); ++n) {
+    cpus.insert(cpus.end(), nodes[n].begin(), nodes[n].end());
+    restrictToCpus(cpus);
+    {
+      Gecko::ThreadPool pool{static_cast<unsigned int>(cpus.size() - 1)};
+      auto source{Gecko::FieldStorage<float>::allocate(size)};
+      auto destination{Gecko::FieldStorage<float>::allocate(size)};
+      const auto fill{[&](Gecko::FieldStorage<float> &storage,
+                          const float value) -> void {
+        Gecko::parallelForPinned(
+            0, size,
+            [&](const std::size_t first, const std::size_t last) -> void {
+              std::fill(storage.data() + first, storage.data() + last, value);
+            },
+            pool);
+      }};
+      // First touch places the pages
+      fill(source, 1.f);
+      fill(destination, 0.f);
+
+      const double fill_seconds{
+          measure([&]() -> void { fill(source, 2.f); })};
+      const double pinned_seconds{measure([&]() -> void {
+        Gecko::parallelForPinned(
+            0, size,
+            [&](const std::size_t first, const std::size_t last) -> void {
+              std::copy(source.data() + first, source.data() + last,
+                        destination.data() + first);
+            },
+            pool);
+      })};
+      constexpr static std::size_t GRAIN{1u << 16u};
+      const double stolen_seconds{measure([&]() -> void {
+        Gecko::parallelForGrain(
+            0, size, GRAIN,
+            [&](const std::size_t first, const std::size_t last) -> void {
+              std::copy(source.data() + first, source.data() + last,
+                        destination.data() + first);
+            },
+            pool);
+      })};
+      // A copy reads and writes every byte
+      fmt::print("{:>6} {:>8} {:>14.2f} {:>16.2f} {:>16.2f}\n", n + 1,
+                 cpus.size(), gigabytes / fill_seconds,
+                 2. * gigabytes / pinned_seconds,
+                 2. * gigabytes / stolen_seconds);
+    }
+  }
+  restrictToCpus(all_cpus);
+  return 0;
+}
@@ -0,0 +1,210 @@
+// Compares the linear and the bricked layout of a field on the accesses of the
+// field passes and of the CPU raymarcher: a 7-point stencil, as used by the
+// normals, visiting each layout in its storage order, walks along z, where the
+// linear layout moves a whole slice between samples, and trilinear samples
+// along rays of random directions. Runs on the calling thread only, so the
+// times show the memory locality of the layouts and not the thread pool.
+//
+// Usage: layout_benchmark [elements per side, 384 by default]
+
+#include "scalar_field/scalar_field.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Bricked = Gecko::BrickedLayout<3>;
+
+constexpr int REPETITIONS{3};
+constexpr std::size_t NUM_RAYS{1u << 16u};
+
+// Best time of the repetitions in milliseconds, the result of the pass is
+// returned in checksum so it can not be optimized away and can be compared
+// between the layouts
+double measure(const std::function<double()> &pass, double &checksum) {
+  double best{0.};
+  for (int r{0}; r != REPETITIONS; ++r) {
+    const auto start{std::chrono::steady_clock::now()};
+    checksum = pass();
+    const double milliseconds{std::chrono::duration<double, std::milli>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count()};
+    best = r == 0 ? milliseconds : std::min(best, milliseconds);
+  }
+  return best;
+}
+
+template <typename Layout>
+[[nodiscard]] double stencilAt(const Gecko::ScalarField<float, Layout> &field,
+                               const int i, const int j, const int k) {
+  return static_cast<double>(6.f * field(i, j, k) - field(i - 1, j, k) -
+                             field(i + 1, j, k) - field(i, j - 1, k) -
+                             field(i, j + 1, k) - field(i, j, k - 1) -
+                             field(i, j, k + 1));
+}
+
+[[nodiscard]] bool isInterior(const int i, const int j, const int k,
+                              const int size) {
+  return i > 0 && j > 0 && k > 0 && i < size - 1 && j < size - 1 &&
+         k < size - 1;
+}
+
+// Stencil over the interior in (i, j, k) order
+[[nodiscard]] double stencil(const Gecko::ScalarField<float> &field) {
+  const int size{field.xSize()};
+  double sum{0.};
+  for (int k{1}; k < size - 1; ++k) {
+    for (int j{1}; j < size - 1; ++j) {
+      for (int i{1}; i < size - 1; ++i) {
+        sum += stencilAt(field, i, j, k);
+      }
+    }
+  }
+  return sum;
+}
+
+// Stencil over the interior brick by brick, the neighbours inside the brick
+// read from the brick and only those across its faces through the index
+[[nodiscard]] double
+stencil(const Gecko::ScalarField<float, Bricked> &field) {
+  constexpr int B{Bricked::BRICK_SIZE};
+  const int size{field.xSize()};
+  double sum{0.};
+  field.forEachBrick([&](const glm::ivec3 &origin,
+                         const float *brick) -> void {
+    for (int z{0}; z != B; ++z) {
+      for (int y{0}; y != B; ++y) {
+        for (int x{0}; x != B; ++x) {
+          const glm::ivec3 e{origin + glm::ivec3{x, y, z}};
+          if (!isInterior(e.x, e.y, e.z, size)) {
+            continue;
+          }
+          if (x == 0 || y == 0 || z == 0 || x == B - 1 || y == B - 1 ||
+              z == B - 1) {
+            sum += stencilAt(field, e.x, e.y, e.z);
+            continue;
+          }
+          const float *const c{brick + x + B * (y + B * z)};
+          sum += static_cast<double>(6.f * c[0] - c[-1] - c[1] - c[-B] -
+                                     c[B] - c[-B * B] - c[B * B]);
+        }
+      }
+    }
+  });
+  return sum;
+}
+
+// Every column of a coarse grid of columns walked along z
+template <typename Layout>
+[[nodiscard]] double
+zWalks(const Gecko::ScalarField<float, Layout> &field) {
+  constexpr int COLUMN_SPACING{3};
+  const int size{field.xSize()};
+  double sum{0.};
+  for (int j{0}; j < size; j += COLUMN_SPACING) {
+    for (int i{0}; i < size; i += COLUMN_SPACING) {
+      for (int k{0}; k != size; ++k) {
+        sum += static_cast<double>(field(i, j, k));
+      }
+    }
+  }
+  return sum;
+}
+
+// Rays crossing the field in random directions, sampled every half voxel
+template <typename Layout>
+[[nodiscard]] double
+rayWalks(const Gecko::ScalarField<float, Layout> &field,
+         const std::vector<glm::vec3> &origins,
+         const std::vector<glm::vec3> &directions) {
+  const float step{0.5f * field.getVoxelSize().x};
+  const float length{glm::length(field.max() - field.min())};
+  double sum{0.};
+  for (std::size_t r{0}; r != origins.size(); ++r) {
+    for (float t{0.f}; t < length; t += step) {
+      const glm::vec3 position{origins[r] + t * directions[r]};
+      if (glm::any(glm::lessThan(position, field.min())) ||
+          glm::any(glm::greaterThan(position, field.max()))) {
+        break;
+      }
+      sum += static_cast<double>(field.sample(position));
+    }
+  }
+  return sum;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  int size{384};
+  if (argc > 1) {
+    const char *const end{argv[1] + std::strlen(argv[1])};
+    if (std::from_chars(argv[1], end, size).ptr != end || size < 3) {
+      fmt::print(stderr, "Usage: {} [elements per side]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  auto linear{Gecko::ScalarField<float>::createUninitialized(
+      glm::vec3{0.f}, glm::vec3{1.f}, size, size, size)};
+  for (int k{0}; k != size; ++k) {
+    for (int j{0}; j != size; ++j) {
+      for (int i{0}; i != size; ++i) {
+        linear(i, j, k) = std::sin(0.05f * static_cast<float>(i)) *
+                          std::cos(0.03f * static_cast<float>(j + 2 * k));
+      }
+    }
+  }
+  const auto bricked{linear.convertLayout<Bricked>()};
+
+  std::mt19937 generator{42};
+  std::uniform_real_distribution<float> uniform{0.f, 1.f};
+  std::normal_distribution<float> normal{};
+  std::vector<glm::vec3> origins(NUM_RAYS);
+  std::vector<glm::vec3> directions(NUM_RAYS);
+  for (std::size_t r{0}; r != NUM_RAYS; ++r) {
+    origins[r] = glm::vec3{uniform(generator), uniform(generator),
+                           uniform(generator)};
+    directions[r] = glm::normalize(
+        glm::vec3{normal(generator), normal(generator), normal(generator)});
+  }
+
+  const auto compare{[](const char *name, const std::function<double()> &a,
+                        const std::function<double()> &b) -> void {
+    double checksum_a{0.};
+    double checksum_b{0.};
+    const double linear_ms{measure(a, checksum_a)};
+    const double bricked_ms{measure(b, checksum_b)};
+    fmt::print("{:<16} {:>12.1f} {:>12.1f} {:>9.2f}x{}\n", name, linear_ms,
+               bricked_ms, linear_ms / bricked_ms,
+               // The stencil sums in a different order per layout
+               std::abs(checksum_a - checksum_b) <=
+                       1e-6 * (std::abs(checksum_a) + std::abs(checksum_b))
+                   ? ""
+                   : " (results differ)");
+  }};
+
+  fmt::print("{}^3 elements, bricks of {}^3\n", size, Bricked::BRICK_SIZE);
+  fmt::print("{:<16} {:>12} {:>12} {:>10}\n", "pass", "linear ms",
+             "bricked ms", "speedup");
+  compare(
+      "7-point stencil", [&]() -> double { return stencil(linear); },
+      [&]() -> double { return stencil(bricked); });
+  compare(
+      "z walks", [&]() -> double { return zWalks(linear); },
+      [&]() -> double { return zWalks(bricked); });
+  compare(
+      "random rays",
+      [&]() -> double { return rayWalks(linear, origins, directions); },
+      [&]() -> double { return rayWalks(bricked, origins, directions); });
+  return 0;
+}
@@ -0,0 +1,206 @@
+// Throughput of OutOfCoreScalarField on one and more threads, trilinear
+// samples along rays of random directions and elements read along columns,
+// next to the same accesses on the field in memory. The cache holds the whole
+// field, read once up front, so the times show the cost of the brick lookups
+// and of the threads contending for the cache, not the I/O.
+//
+// Usage: out_of_core_benchmark [elements per side, 256 by default]
+
+#include "io/gvol.hpp"
+#include "io/out_of_core_field.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int REPETITIONS{3};
+constexpr int BRICK_SIZE_LOG2{5};
+constexpr std::size_t NUM_RAYS{1u << 14u};
+
+// Best time in milliseconds of running pass(t, num_threads) on num_threads
+// threads, with the sum of their results in checksum
+double measure(const std::function<double(unsigned, unsigned)> &pass,
+               const unsigned num_threads, double &checksum) {
+  double best{0.};
+  for (int r{0}; r != REPETITIONS; ++r) {
+    std::vector<double> sums(num_threads);
+    std::vector<std::thread> threads;
+    const auto start{std::chrono::steady_clock::now()};
+    for (unsigned t{1}; t < num_threads; ++t) {
+      threads.emplace_back(
+          [&, t]() -> void { sums[t] = pass(t, num_threads); });
+    }
+    sums[0] = pass(0, num_threads);
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    const double milliseconds{std::chrono::duration<double, std::milli>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count()};
+    best = r == 0 ? milliseconds : std::min(best, milliseconds);
+    checksum = 0.;
+    for (const double sum : sums) {
+      checksum += sum;
+    }
+  }
+  return best;
+}
+
+// Rays t, t + num_threads, ... sampled every half voxel
+template <typename Field>
+[[nodiscard]] double rayWalks(const Field &field,
+                              const std::vector<glm::vec3> &origins,
+                              const std::vector<glm::vec3> &directions,
+                              const unsigned t, const unsigned num_threads) {
+  const float step{0.5f * field.getVoxelSize().x};
+  const float length{glm::length(field.max() - field.min())};
+  double sum{0.};
+  for (std::size_t r{t}; r < origins.size(); r += num_threads) {
+    for (float s{0.f}; s < length; s += step) {
+      const glm::vec3 position{origins[r] + s * directions[r]};
+      if (glm::any(glm::lessThan(position, field.min())) ||
+          glm::any(glm::greaterThan(position, field.max()))) {
+        break;
+      }
+      sum += static_cast<double>(field.sample(position));
+    }
+  }
+  return sum;
+}
+
+// Columns along z of a coarse grid, the ones of row j taken by thread
+// j % num_threads
+template <typename Field>
+[[nodiscard]] double zWalks(const Field &field, const unsigned t,
+                            const unsigned num_threads) {
+  constexpr int COLUMN_SPACING{3};
+  double sum{0.};
+  for (int j{static_cast<int>(t) * COLUMN_SPACING}; j < field.ySize();
+       j += static_cast<int>(num_threads) * COLUMN_SPACING) {
+    for (int i{0}; i < field.xSize(); i += COLUMN_SPACING) {
+      for (int k{0}; k != field.zSize(); ++k) {
+        sum += static_cast<double>(field(i, j, k));
+      }
+    }
+  }
+  return sum;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  int size{256};
+  if (argc > 1) {
+    const char *const end{argv[1] + std::strlen(argv[1])};
+    if (std::from_chars(argv[1], end, size).ptr != end || size < 2) {
+      fmt::print(stderr, "Usage: {} [elements per side]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  auto field{Gecko::ScalarField<float>::createUninitialized(
+      glm::vec3{0.f}, glm::vec3{1.f}, size, size, size)};
+  for (int k{0}; k != size; ++k) {
+    for (int j{0}; j != size; ++j) {
+      for (int i{0}; i != size; ++i) {
+        field(i, j, k) = std::sin(0.05f * static_cast<float>(i)) *
+                         std::cos(0.03f * static_cast<float>(j + 2 * k));
+      }
+    }
+  }
+  const std::string filename{
+      (std::filesystem::temp_directory_path() / "gecko_out_of_core.gvol")
+          .string()};
+  Gecko::GVolFile::writeToFile(filename, field, nullptr, BRICK_SIZE_LOG2);
+  Gecko::OutOfCoreScalarField::Settings settings;
+  settings.memory_budget = std::max(settings.memory_budget,
+                                    2 * field.totalElements() * sizeof(float));
+  const auto out_of_core{
+      Gecko::OutOfCoreScalarField::createFromFile(filename, settings)};
+
+  std::mt19937 generator{42};
+  std::uniform_real_distribution<float> uniform{0.f, 1.f};
+  std::normal_distribution<float> normal{};
+  std::vector<glm::vec3> origins(NUM_RAYS);
+  std::vector<glm::vec3> directions(NUM_RAYS);
+  for (std::size_t r{0}; r != NUM_RAYS; ++r) {
+    origins[r] = glm::vec3{uniform(generator), uniform(generator),
+                           uniform(generator)};
+    directions[r] = glm::normalize(
+        glm::vec3{normal(generator), normal(generator), normal(generator)});
+  }
+  // Loads every brick, so that the passes only hit
+  std::vector<float> values(field.totalElements());
+  out_of_core->readRegion(glm::ivec3{0}, glm::ivec3{size}, values.data());
+
+  const unsigned max_threads{std::max(1u, std::thread::hardware_concurrency())};
+  std::vector<unsigned> thread_counts;
+  for (unsigned n{1}; n < max_threads; n *= 2) {
+    thread_counts.push_back(n);
+  }
+  thread_counts.push_back(max_threads);
+
+  const auto compare{[&](const char *name,
+                         const std::function<double(unsigned, unsigned)> &a,
+                         const std::function<double(unsigned, unsigned)> &b,
+                         const double accesses) -> void {
+    for (const unsigned num_threads : thread_counts) {
+      double checksum_a{0.};
+      double checksum_b{0.};
+      const double memory_ms{measure(a, num_threads, checksum_a)};
+      const double out_of_core_ms{measure(b, num_threads, checksum_b)};
+      fmt::print("{:<14} {:>7} {:>12.1f} {:>14.1f} {:>9.2f}x{}\n", name,
+                 num_threads, accesses / memory_ms * 1e-3,
+                 accesses / out_of_core_ms * 1e-3,
+                 out_of_core_ms / memory_ms,
+                 checksum_a == checksum_b ? "" : " (results differ)");
+    }
+  }};
+
+  // Accesses of each pass, the sums of the passes over a field of ones
+  const auto ones{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{0.f}, glm::vec3{1.f}, size, size, size, 1.f)};
+  const double ray_samples{rayWalks(ones, origins, directions, 0, 1)};
+  const double column_elements{zWalks(ones, 0, 1)};
+
+  fmt::print("{}^3 elements, bricks of {}^3, cache of {} bricks\n", size,
+             out_of_core->brickSize(), out_of_core->maxCachedBricks());
+  fmt::print("{:<14} {:>7} {:>12} {:>14} {:>10}\n", "pass", "threads",
+             "memory M/s", "out of core M/s", "slowdown");
+  compare(
+      "random rays",
+      [&](const unsigned t, const unsigned num_threads) -> double {
+        return rayWalks(field, origins, directions, t, num_threads);
+      },
+      [&](const unsigned t, const unsigned num_threads) -> double {
+        return rayWalks(*out_of_core, origins, directions, t, num_threads);
+      },
+      ray_samples);
+  compare(
+      "z walks",
+      [&](const unsigned t, const unsigned num_threads) -> double {
+        return zWalks(field, t, num_threads);
+      },
+      [&](const unsigned t, const unsigned num_threads) -> double {
+        return zWalks(*out_of_core, t, num_threads);
+      },
+      column_elements);
+  const Gecko::OutOfCoreScalarField::Statistics statistics{
+      out_of_core->statistics()};
+  fmt::print("cache hits {}, misses {}\n", statistics.hits, statistics.misses);
+  std::remove(filename.c_str());
+  return 0;
+}
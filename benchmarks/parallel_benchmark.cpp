@@ -0,0 +1,118 @@
+// Compares the thread pool loops with the static partition on one std::thread
+// per range that parallelFor() used before, on loops of uniform cost, of cost
+// growing along the range, like rays crossing more and more of the volume, and
+// on many short loops, where starting the threads dominates.
+
+#include "utils/parallel.hpp"
+
+#include "fmt/format.h"
+
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// The static partition, one thread per range
+template <typename Func>
+void staticFor(const std::size_t begin, const std::size_t end, Func &&func,
+               const unsigned int num_threads) {
+  const std::size_t count{end - begin};
+  std::vector<std::exception_ptr> exceptions(num_threads);
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  const auto run_range{[&](const std::size_t r) -> void {
+    try {
+      func(begin + r * count / num_threads,
+           begin + (r + 1) * count / num_threads);
+    } catch (...) {
+      exceptions[r] = std::current_exception();
+    }
+  }};
+  for (std::size_t r{1}; r != num_threads; ++r) {
+    threads.emplace_back(run_range, r);
+  }
+  run_range(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+// Work of element i, iterations of it
+float work(const std::size_t i, const std::size_t iterations) {
+  float value{static_cast<float>(i)};
+  for (std::size_t k{0}; k != iterations; ++k) {
+    value = std::sqrt(value + 1.f);
+  }
+  return value;
+}
+
+struct Workload {
+  std::string name;
+  std::size_t num_elements;
+  std::size_t num_calls;
+  std::function<std::size_t(std::size_t)> iterations;
+};
+
+using Loop = std::function<void(
+    std::size_t, const std::function<void(std::size_t, std::size_t)> &)>;
+
+double measure(const Workload &workload, const Loop &loop) {
+  std::vector<float> results(workload.num_elements);
+  const auto body{[&](const std::size_t first, const std::size_t last) -> void {
+    for (std::size_t i{first}; i != last; ++i) {
+      results[i] = work(i, workload.iterations(i));
+    }
+  }};
+  const auto start{std::chrono::steady_clock::now()};
+  for (std::size_t c{0}; c != workload.num_calls; ++c) {
+    loop(workload.num_elements, body);
+  }
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+int main() {
+  const std::vector<Workload> workloads{
+      {"uniform", 1 << 16, 4, [](std::size_t) -> std::size_t { return 64; }},
+      {"skewed", 1 << 16, 4,
+       [](const std::size_t i) -> std::size_t { return i * i >> 24; }},
+      {"small calls", 1 << 10, 2000,
+       [](std::size_t) -> std::size_t { return 16; }}};
+
+  std::vector<unsigned int> thread_counts{1, 2, 4};
+  if (Gecko::defaultThreadCount() > 4) {
+    thread_counts.push_back(Gecko::defaultThreadCount());
+  }
+
+  fmt::print("{:<12} {:>8} {:>12} {:>12} {:>12}\n", "workload", "threads",
+             "static ms", "pool ms", "grain ms");
+  for (const unsigned int num_threads : thread_counts) {
+    // The calling thread is the last one
+    Gecko::ThreadPool pool{num_threads - 1};
+    for (const Workload &workload : workloads) {
+      const double static_ms{measure(
+          workload, [&](const std::size_t count, const auto &body) -> void {
+            staticFor(0, count, body, num_threads);
+          })};
+      const double pool_ms{measure(
+          workload, [&](const std::size_t count, const auto &body) -> void {
+            Gecko::parallelFor(0, count, body, num_threads, pool);
+          })};
+      const double grain_ms{measure(
+          workload, [&](const std::size_t count, const auto &body) -> void {
+            Gecko::parallelForGrain(0, count, 256, body, pool);
+          })};
+      fmt::print("{:<12} {:>8} {:>12.2f} {:>12.2f} {:>12.2f}\n", workload.name,
+                 num_threads, static_ms, pool_ms, grain_ms);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "camera/orbit_camera.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Camera animation from keyframes at given frame numbers. A keyframe either
+// places an OrbitCamera from its parameters or looks from an explicit eye at a
+// point. Between two orbit keyframes the parameters are interpolated, so the
+// camera keeps orbiting, phi along the shorter way around; in any other case
+// eye and target are interpolated linearly.
+class CameraPath {
+public:
+  // Factory functions
+  // Text file with one keyframe per line, angles in degrees:
+  //   <frame> orbit <at x> <at y> <at z> <phi> <theta> <radius>
+  //   <frame> look <eye x> <eye y> <eye z> <at x> <at y> <at z>
+  // Frames must be increasing, empty lines and lines starting with # are
+  // skipped. Throws std::runtime_error on malformed files.
+  [[nodiscard]] static CameraPath createFromFile(const std::string &filename);
+
+  // Frames from 0 to the last keyframe, frames before the first keyframe
+  // use it
+  [[nodiscard]] std::size_t numFrames() const noexcept {
+    return _keyframes.back().frame + 1;
+  }
+
+  // Eye and view matrix of a frame, as OrbitCamera::getEyeAndViewMatrix()
+  [[nodiscard]] std::pair<glm::vec3, glm::mat4>
+  getEyeAndViewMatrix(std::size_t frame) const noexcept;
+
+private:
+  struct Keyframe {
+    std::size_t frame;
+    bool orbit;
+    OrbitCamera camera;
+    // Eye and target, also set for orbit keyframes
+    glm::vec3 eye, at;
+  };
+
+  explicit CameraPath(std::vector<Keyframe> keyframes) noexcept
+      : _keyframes{std::move(keyframes)} {}
+
+  std::vector<Keyframe> _keyframes;
+};
+
+} // namespace Gecko
@@ -15,6 +15,16 @@ public:
 
   OrbitCamera(const glm::vec3 &from, const glm::vec3 &at) noexcept;
 
+  // Orbit around at with the given angles in radians, phi in [0, 2 pi] and
+  // theta in [0, pi]
+  OrbitCamera(const glm::vec3 &at, float phi, float theta,
+              float radius) noexcept;
+
+  [[nodiscard]] const glm::vec3 &at() const noexcept { return _at; }
+  [[nodiscard]] float phi() const noexcept { return _phi; }
+  [[nodiscard]] float theta() const noexcept { return _theta; }
+  [[nodiscard]] float radius() const noexcept { return _radius; }
+
   [[nodiscard]] glm::mat4 getViewMatrix() const noexcept {
     const glm::vec3 v{_radius * std::cos(_phi), _radius * std::cos(_theta),
                       _radius * std::sin(_phi)};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Gecko {
+
+// Writes rendered frames to image files without stalling the render loop.
+// Each frame is read back into the next pixel pack buffer of a ring, which
+// returns immediately, and a fence tells when the copy is done. Finished
+// buffers are mapped and handed to a pool of writer threads that encode the
+// image straight from the mapped memory, the buffer is unmapped and reused
+// once written. The render loop only waits when every buffer is still in use,
+// that is when readback or writing can not keep up with rendering.
+//
+// Construction, all the member functions and destruction must happen on the
+// GL thread.
+class FrameRecorder {
+public:
+  struct Settings {
+    // Frames in flight between rendering and writing
+    std::size_t readback_buffers{4};
+    // 0 for one per hardware thread
+    unsigned int writer_threads{0};
+  };
+
+  struct Statistics {
+    std::uint64_t recorded_frames, written_frames;
+    // Times record() had to wait for a buffer
+    std::uint64_t stalls;
+  };
+
+  // Frames are 8 bit RGBA images of the given size
+  FrameRecorder(int width, int height, const Settings &settings);
+
+  // Frames not written yet are dropped, call finish() to keep them
+  ~FrameRecorder();
+
+  // Not copyable or assignable
+  FrameRecorder(const FrameRecorder &) = delete;
+  FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+  // Start reading back the color attachment 0 of the framebuffer, to be
+  // written to filename in a format supported by writeImage(). Rethrows the
+  // first error of the writers.
+  void record(GLuint framebuffer, std::string filename);
+
+  // Hand the frames read back to the writers and reuse the buffers of the
+  // frames written, without waiting. Rethrows the first error of the writers.
+  void update();
+
+  // Wait until all the frames recorded are written
+  void finish();
+
+  [[nodiscard]] Statistics statistics() const noexcept {
+    return {_recorded_frames, _written_frames, _stalls};
+  }
+
+private:
+  enum class SlotState { Idle, Reading, Writing, Written };
+
+  struct Slot {
+    GLuint buffer{0};
+    GLsync fence{nullptr};
+    // Mapped while being written
+    const void *pixels{nullptr};
+    std::string filename;
+    SlotState state{SlotState::Idle};
+  };
+
+  // Hand the slot to the writers if its readback is done, waiting for it if
+  // asked to
+  void dispatchSlot(Slot &slot, bool wait);
+
+  // Unmap the buffers of the frames written
+  void recycleSlots();
+
+  void rethrowWriterException();
+
+  void writerLoop();
+
+  int _width, _height;
+  std::vector<Slot> _slots;
+  // Slots in the order of the frames, the oldest first
+  std::deque<std::size_t> _order;
+  std::uint64_t _recorded_frames{0}, _written_frames{0}, _stalls{0};
+
+  // Shared with the writers
+  std::mutex _mutex;
+  std::condition_variable _pending_condition, _written_condition;
+  std::deque<std::size_t> _pending_slots, _written_slots;
+  std::exception_ptr _writer_exception;
+  bool _stop{false};
+  std::vector<std::thread> _writers;
+};
+
+} // namespace Gecko
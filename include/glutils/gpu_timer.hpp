@@ -0,0 +1,43 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace Gecko {
+
+// GPU time of the commands between begin() and end(), measured with timer
+// queries. Results are read back frames later, once available, so that
+// measuring never waits for the GPU.
+class GpuTimer {
+public:
+  // Up to num_queries measures wait for their result at the same time
+  explicit GpuTimer(std::size_t num_queries = 4);
+
+  ~GpuTimer();
+
+  // Not copyable or assignable
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+
+  // Start measuring, false if all the queries are waiting for their result,
+  // the commands until end() are then not measured
+  bool begin();
+
+  void end();
+
+  // Milliseconds of the oldest measure with its result available, measures
+  // are returned in the order they were taken
+  [[nodiscard]] std::optional<double> poll();
+
+private:
+  std::vector<GLuint> _queries;
+  // Oldest query waiting for its result and number of queries waiting
+  std::size_t _first{0};
+  std::size_t _count{0};
+  bool _measuring{false};
+};
+
+} // namespace Gecko
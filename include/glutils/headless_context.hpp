@@ -0,0 +1,37 @@
+#pragma once
+
+namespace Gecko {
+
+// OpenGL 4.3 core context without a window or a surface, created through EGL,
+// for rendering to framebuffer objects on machines without a display. The
+// display is the first EGL device if the implementation enumerates devices,
+// then Mesa's surfaceless platform, then the default display. On Mesa,
+// LIBGL_ALWAYS_SOFTWARE=1 selects llvmpipe on machines without a GPU.
+class HeadlessContext {
+public:
+  // Factory functions
+  // Create the context, make it current on the calling thread and load the GL
+  // functions. Throws std::runtime_error if any step fails.
+  [[nodiscard]] static HeadlessContext create();
+
+  ~HeadlessContext();
+
+  HeadlessContext(HeadlessContext &&other) noexcept;
+  HeadlessContext &operator=(HeadlessContext &&other) noexcept;
+
+  // Not copyable
+  HeadlessContext(const HeadlessContext &) = delete;
+  HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+private:
+  HeadlessContext(void *display, void *context) noexcept
+      : _display{display}, _context{context} {}
+
+  void destroy() noexcept;
+
+  // EGLDisplay and EGLContext, EGL headers stay out of this header
+  void *_display;
+  void *_context;
+};
+
+} // namespace Gecko
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Gecko {
+
+// Framebuffer object with an RGBA color texture and a depth attachment, the
+// render target when there is no window or for images drawn again later
+class OffscreenFramebuffer {
+public:
+  // The color texture has the given internal format and linear filtering.
+  // Throws std::runtime_error if the framebuffer is not complete.
+  OffscreenFramebuffer(int width, int height,
+                       GLenum color_format = GL_RGBA8);
+
+  ~OffscreenFramebuffer();
+
+  // Not copyable or assignable
+  OffscreenFramebuffer(const OffscreenFramebuffer &) = delete;
+  OffscreenFramebuffer &operator=(const OffscreenFramebuffer &) = delete;
+
+  [[nodiscard]] GLuint id() const noexcept { return _framebuffer; }
+  [[nodiscard]] GLuint colorTexture() const noexcept { return _color_texture; }
+  [[nodiscard]] int width() const noexcept { return _width; }
+  [[nodiscard]] int height() const noexcept { return _height; }
+
+  // Bind for drawing and reading and set the viewport to cover it
+  void bind() const noexcept;
+
+  // Read the color attachment back, 4 bytes per pixel with rows from bottom
+  // to top as glReadPixels() returns them. Waits for rendering to finish.
+  void readPixels(std::vector<std::uint8_t> &pixels) const;
+
+private:
+  int _width, _height;
+  GLuint _framebuffer{0};
+  GLuint _color_texture{0};
+  GLuint _depth_renderbuffer{0};
+};
+
+} // namespace Gecko
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "glutils/gpu_timer.hpp"
+#include "glutils/offscreen_framebuffer.hpp"
+#include "glutils/program.hpp"
+
+#include "glad/glad.h"
+
+#include "glm/glm.hpp"
+
+#include <deque>
+#include <memory>
+#include <optional>
+
+namespace Gecko {
+
+// Interaction aware quality of the volume rendering. While the view changes,
+// frames are drawn at a fraction of the resolution with longer steps and
+// upsampled, so they keep up with the input. At rest, full resolution frames
+// with the pixels and the samples along the rays moved by a different
+// fraction each are averaged, until max_samples of them are, after which
+// nothing needs to be drawn until the next change.
+//
+// With a frame budget, the GPU time of every frame drawn is measured and the
+// resolution and step size of the frames drawn while interacting follow it.
+// The cost of a frame is modeled as proportional to its pixels over its step
+// multiplier, the quality, with the cost of a unit of quality filtered over
+// the measures. The quality fitting the budget lowers the resolution first,
+// down to min_scale, then lengthens the steps, up to max_step_multiplier.
+class ProgressiveRenderer {
+public:
+  struct Settings {
+    // Resolution scale and step size multiplier of the frames drawn while
+    // interacting, until the first measure with a frame budget
+    float interaction_scale{0.5f};
+    float interaction_step_multiplier{2.f};
+    // GPU milliseconds of the frames drawn while interacting, 0 to keep the
+    // scale and multiplier above
+    double frame_budget{0.};
+    float min_scale{0.25f};
+    float max_step_multiplier{4.f};
+    // Frames averaged at rest
+    int max_samples{16};
+  };
+
+  // Frame to draw, a single full quality frame with the default values
+  struct Frame {
+    GLuint framebuffer{0};
+    int width{0}, height{0};
+    float step_multiplier{1.f};
+    // Offset of the pixel centers in pixels, to apply to the projection
+    glm::vec2 pixel_offset{0.f};
+    // Offset of the samples along the rays, in steps
+    float sample_offset{0.f};
+  };
+
+  // copy_program draws its image texture over the viewport, as with
+  // copy_image.vert and copy_image.frag
+  ProgressiveRenderer(const GLSLProgram &copy_program,
+                      const Settings &settings);
+
+  ~ProgressiveRenderer();
+
+  // Not copyable or assignable
+  ProgressiveRenderer(const ProgressiveRenderer &) = delete;
+  ProgressiveRenderer &operator=(const ProgressiveRenderer &) = delete;
+
+  // Start again from a single sample, the image changed
+  void reset() noexcept { _samples = 0; }
+
+  // Frame to draw for an image of width x height pixels, std::nullopt if the
+  // image is converged. Changing size starts again.
+  [[nodiscard]] std::optional<Frame> beginFrame(int width, int height,
+                                                bool interacting);
+
+  // Add the frame drawn since beginFrame() to the image
+  void endFrame();
+
+  // Draw the image over the viewport of the given framebuffer, of width x
+  // height pixels
+  void present(GLuint framebuffer, int width, int height) const;
+
+  // Frames averaged at rest, 0 while interacting
+  [[nodiscard]] int samples() const noexcept { return _samples; }
+  [[nodiscard]] bool converged() const noexcept {
+    return _samples >= _settings.max_samples;
+  }
+
+  // Current resolution scale and step multiplier of the frames drawn while
+  // interacting
+  [[nodiscard]] float interactionScale() const noexcept {
+    return _interaction_scale;
+  }
+  [[nodiscard]] float interactionStepMultiplier() const noexcept {
+    return _interaction_step_multiplier;
+  }
+
+  // GPU milliseconds of the last frame measured, 0 before the first one
+  [[nodiscard]] double lastFrameTime() const noexcept {
+    return _last_frame_time;
+  }
+
+private:
+  // Update the cost model with the measures available and the interaction
+  // settings with it
+  void adaptInteraction();
+
+  // Draw the part of the texture given by uv_scale over the viewport of the
+  // bound framebuffer, reading no coordinates past uv_max
+  void drawImage(GLuint texture, const glm::vec2 &uv_scale,
+                 const glm::vec2 &uv_max) const;
+
+  const GLSLProgram &_copy_program;
+  Settings _settings;
+  GLuint _vao{0};
+  int _width{0}, _height{0};
+  // Target of the frames drawn at rest, averaged into the accumulation
+  // buffer, and of the frames drawn while interacting, at full size with the
+  // frames drawn in its lower left corner of _coarse_size
+  std::unique_ptr<OffscreenFramebuffer> _sample;
+  std::unique_ptr<OffscreenFramebuffer> _accumulation;
+  std::unique_ptr<OffscreenFramebuffer> _coarse;
+  glm::ivec2 _coarse_size{0};
+  int _samples{0};
+  // Whether the last frame was drawn while interacting
+  bool _interacting{false};
+
+  float _interaction_scale;
+  float _interaction_step_multiplier;
+  GpuTimer _timer;
+  // Quality of the frames measured and waiting for their result
+  std::deque<float> _measured_qualities;
+  // Filtered milliseconds per unit of quality, 0 before the first measure
+  double _quality_cost{0.};
+  double _last_frame_time{0.};
+};
+
+} // namespace Gecko
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "glutils/utils.hpp"
+#include "io/time_series.hpp"
+#include "scalar_field/macrocell_grid.hpp"
+#include "scalar_field/normal_encoding.hpp"
+#include "scalar_field/quantization.hpp"
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Plays a time varying volume at a fixed number of steps per second. A
+// background I/O thread reads the steps following the next one to show into
+// a ring of mapped pixel buffer objects, already in the texture formats.
+// Textures are double buffered: as soon as the next step is read it is
+// uploaded from its buffer to the set of textures not being rendered, and the
+// sets are swapped when the step is due and a fence says the upload is done,
+// so the render loop never waits for I/O or for an upload.
+//
+// Playback waits for steps not ready when due instead of skipping them, those
+// steps are counted as late. Construction, all the member functions and
+// destruction must happen on the GL thread.
+class TimeSeriesPlayer {
+public:
+  struct Settings {
+    VolumeFormat volume_format{VolumeFormat::Float32};
+    NormalFormat normal_format{NormalFormat::Float32};
+    // Compute the normals from the gradient even for steps storing them
+    bool derive_normals{false};
+    int macrocell_size{8};
+    double steps_per_second{10.};
+    // Steps read ahead, each one takes a buffer holding a whole step in the
+    // texture formats
+    std::size_t prefetch_steps{3};
+  };
+
+  struct Statistics {
+    std::uint64_t shown_steps, late_steps;
+    // Average time to read and prepare a step, in seconds
+    double average_read_time;
+    // Steps read and waiting for their turn, including the uploaded one
+    std::size_t buffered_steps;
+  };
+
+  // All the steps must have the size and bounds of the first one
+  TimeSeriesPlayer(TimeSeries series, const Settings &settings);
+
+  ~TimeSeriesPlayer();
+
+  // Not copyable or assignable
+  TimeSeriesPlayer(const TimeSeriesPlayer &) = delete;
+  TimeSeriesPlayer &operator=(const TimeSeriesPlayer &) = delete;
+
+  [[nodiscard]] const glm::vec3 &boundsMin() const noexcept {
+    return _bounds_min;
+  }
+  [[nodiscard]] const glm::vec3 &boundsMax() const noexcept {
+    return _bounds_max;
+  }
+  [[nodiscard]] const glm::ivec3 &numElements() const noexcept {
+    return _num_elements;
+  }
+
+  [[nodiscard]] std::size_t numSteps() const noexcept {
+    return _series.numSteps();
+  }
+
+  // Step shown, -1 until the first one is ready
+  [[nodiscard]] std::int64_t currentStep() const noexcept {
+    return _front.step;
+  }
+
+  // Textures of the step shown, they change when steps are swapped
+  [[nodiscard]] GLuint volumeTexture() const noexcept {
+    return _front.volume_texture;
+  }
+  [[nodiscard]] GLuint normalTexture() const noexcept {
+    return _front.normal_texture;
+  }
+  [[nodiscard]] GLuint macrocellTexture() const noexcept {
+    return _front.macrocell_texture;
+  }
+
+  // (scale, offset) mapping the values of the volume texture back to the
+  // values of the step shown, see computeQuantization()
+  [[nodiscard]] const std::pair<float, float> &quantization() const noexcept {
+    return _front.quantization;
+  }
+
+  [[nodiscard]] bool playing() const noexcept { return _playing; }
+  // time is on the same clock as the one given to update()
+  void setPlaying(bool playing, double time) noexcept;
+
+  [[nodiscard]] double stepsPerSecond() const noexcept {
+    return _settings.steps_per_second;
+  }
+  void setStepsPerSecond(double steps_per_second) noexcept;
+
+  // Show the given step as soon as it is read, playing or not, and continue
+  // from there
+  void seek(std::size_t step);
+
+  // Upload the steps read since the last call, schedule the next reads and
+  // swap to the next step if it is due. time is in seconds on a monotonic
+  // clock.
+  void update(double time);
+
+  [[nodiscard]] Statistics statistics() const noexcept;
+
+private:
+  enum class SlotState { Idle, Reading, Read };
+
+  // Pixel buffers and mapped memory for a step read ahead
+  struct Slot {
+    GLuint scalar_buffer{0}, normal_buffer{0};
+    // Elements in the volume and normal texture formats, mapped until the
+    // step is uploaded
+    void *scalars{nullptr};
+    void *normals{nullptr};
+    SlotState state{SlotState::Idle};
+    std::size_t step{0};
+    std::pair<float, float> quantization;
+    std::vector<glm::vec2> macrocell_ranges;
+    double read_time{0.};
+  };
+
+  struct TextureSet {
+    GLuint volume_texture{0}, normal_texture{0}, macrocell_texture{0};
+    // Step uploaded, -1 if none
+    std::int64_t step{-1};
+    std::pair<float, float> quantization{1.f, 0.f};
+  };
+
+  [[nodiscard]] double stepInterval() const noexcept {
+    return 1. / _settings.steps_per_second;
+  }
+
+  // Steps to read ahead, in the order they are needed
+  [[nodiscard]] std::vector<std::size_t> wantedSteps() const;
+
+  // Hand the steps wanted and not read yet to the I/O thread, reusing slots
+  // of steps not wanted anymore
+  void scheduleReads();
+
+  // Upload a read slot to the back texture set and fence the upload
+  void uploadSlot(Slot &slot);
+
+  // True once the back texture set holds the next step and its upload is done
+  [[nodiscard]] bool backReady();
+
+  void workerLoop();
+
+  // Read the step of the slot and prepare it in the texture formats
+  void readSlot(Slot &slot, std::vector<float> &scalars_scratch,
+                std::vector<glm::vec3> &normals_scratch) const;
+
+  TimeSeries _series;
+  Settings _settings;
+  Utils::VolumeTextureFormat _volume_texture_format, _normal_texture_format;
+  glm::vec3 _bounds_min, _bounds_max;
+  glm::ivec3 _num_elements;
+  // Only used for its size, ranges are computed per step
+  std::optional<MacrocellGrid> _macrocells;
+  std::vector<Slot> _slots;
+  TextureSet _front, _back;
+  GLsync _back_fence{nullptr};
+
+  // Playback state
+  std::size_t _next_step{0};
+  bool _playing{true};
+  // Show the next step as soon as it is ready, at the start and after a seek
+  bool _show_next{true};
+  // The next step was not ready when due
+  bool _late{false};
+  double _next_step_time{0.};
+  std::uint64_t _shown_steps{0}, _late_steps{0}, _read_steps{0};
+  double _total_read_time{0.};
+
+  // Shared with the I/O thread
+  std::mutex _mutex;
+  std::condition_variable _pending_condition;
+  std::deque<std::size_t> _pending_slots, _completed_slots;
+  std::exception_ptr _worker_exception;
+  bool _stop{false};
+  std::thread _worker;
+};
+
+} // namespace Gecko
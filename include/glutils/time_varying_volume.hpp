@@ -0,0 +1,98 @@
+#pragma once
+
+#include "glutils/utils.hpp"
+#include "io/gtvol.hpp"
+#include "scalar_field/macrocell_grid.hpp"
+#include "scalar_field/normal_encoding.hpp"
+#include "scalar_field/quantization.hpp"
+#include "scalar_field/scalar_field.hpp"
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Shows the steps of a .gtvol file in a single set of textures. Changing step
+// decodes only the bricks stored for the steps in between and re-uploads only
+// the bricks whose values changed, together with the normals and macrocell
+// ranges they affect, so reads and uploads are proportional to what changed
+// rather than to the volume size. Normals are always derived from the field.
+//
+// The current step is kept decoded in memory, the previous steps are needed to
+// apply the bricks of a step. Construction, all the member functions and
+// destruction must happen on the GL thread.
+class TimeVaryingVolume {
+public:
+  struct Settings {
+    VolumeFormat volume_format{VolumeFormat::Float32};
+    NormalFormat normal_format{NormalFormat::Float32};
+    int macrocell_size{8};
+  };
+
+  // Work done by the last setStep()
+  struct Statistics {
+    std::size_t read_bricks, uploaded_bricks;
+    std::uint64_t read_bytes, uploaded_bytes;
+  };
+
+  // Show the first step. If macrocell_texture is not 0 it must be the texture
+  // of a MacrocellGrid with cell size macrocell_size, the ranges of the step
+  // shown are written to it.
+  TimeVaryingVolume(GTVolFile file, GLuint macrocell_texture,
+                    const Settings &settings);
+
+  ~TimeVaryingVolume();
+
+  // Not copyable or assignable
+  TimeVaryingVolume(const TimeVaryingVolume &) = delete;
+  TimeVaryingVolume &operator=(const TimeVaryingVolume &) = delete;
+
+  [[nodiscard]] GLuint volumeTexture() const noexcept {
+    return _volume_texture;
+  }
+  [[nodiscard]] GLuint normalTexture() const noexcept {
+    return _normal_texture;
+  }
+
+  // (scale, offset) mapping the values of the volume texture back to field
+  // values, the same for all the steps
+  [[nodiscard]] const std::pair<float, float> &quantization() const noexcept {
+    return _quantization;
+  }
+
+  [[nodiscard]] std::size_t numSteps() const noexcept {
+    return _file.numSteps();
+  }
+  [[nodiscard]] std::size_t currentStep() const noexcept { return _step; }
+
+  // Update the textures to the given step, from the step shown if it is
+  // before it and no keyframe is in between, otherwise from the last keyframe.
+  // The textures bound to the active unit change.
+  void setStep(std::size_t step);
+
+  [[nodiscard]] const Statistics &statistics() const noexcept {
+    return _statistics;
+  }
+
+private:
+  // Upload the scalars, normals and macrocell ranges of the given bricks
+  // from the decoded field
+  void uploadBricks(const std::vector<std::size_t> &bricks);
+
+  GTVolFile _file;
+  GLuint _macrocell_texture;
+  Settings _settings;
+  Utils::VolumeTextureFormat _volume_format, _normal_format;
+  std::pair<float, float> _quantization;
+  ScalarField<float> _field;
+  MacrocellGrid _macrocells;
+  GLuint _volume_texture{0}, _normal_texture{0};
+  std::size_t _step{0};
+  Statistics _statistics{};
+};
+
+} // namespace Gecko
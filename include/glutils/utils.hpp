@@ -1,7 +1,14 @@
 #pragma once
 
+#include "scalar_field/normal_encoding.hpp"
+#include "scalar_field/quantization.hpp"
+
 #include "glad/glad.h"
 
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
 namespace Gecko::Utils {
 
 void APIENTRY GLDebugCallback(GLenum source, GLenum type, GLuint id,
@@ -9,4 +16,31 @@ void APIENTRY GLDebugCallback(GLenum source, GLenum type, GLuint id,
                               const GLchar *message,
                               const void *param) noexcept;
 
+// Texture internal format and pixel transfer parameters of a volume format
+struct VolumeTextureFormat {
+  GLenum internal_format, format, type;
+  std::size_t element_size;
+};
+
+[[nodiscard]] VolumeTextureFormat
+volumeTextureFormat(VolumeFormat format) noexcept;
+
+[[nodiscard]] VolumeTextureFormat
+normalTextureFormat(NormalFormat format) noexcept;
+
+// Create a 3D texture with the given filtering and clamping to edge, storage
+// is allocated but left undefined. The texture is left bound to the active
+// unit.
+[[nodiscard]] GLuint createVolumeTexture(GLenum internal_format,
+                                         const glm::ivec3 &size,
+                                         GLenum filter = GL_LINEAR);
+
+// Upload a whole volume to the texture bound to the active unit. The upload is
+// split in z slabs of bounded size, single uploads of several GB overflow the
+// 32 bit byte counts of some drivers. element_size is the size in bytes of an
+// element of the given format and type. With a pixel unpack buffer bound,
+// data is the offset of the volume in the buffer.
+void uploadVolumeTexture(GLenum format, GLenum type, const glm::ivec3 &size,
+                         std::size_t element_size, const void *data);
+
 } // namespace Gecko::Utils
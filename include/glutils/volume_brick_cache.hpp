@@ -0,0 +1,198 @@
+#pragma once
+
+#include "glutils/utils.hpp"
+#include "io/out_of_core_field.hpp"
+#include "scalar_field/compressed_field.hpp"
+#include "scalar_field/field_storage.hpp"
+#include "scalar_field/normal_encoding.hpp"
+#include "scalar_field/quantization.hpp"
+#include "scalar_field/scalar_field.hpp"
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Keeps the bricks of a volume needed for the current view in a fixed size
+// pool on the GPU, so that volumes larger than the GPU memory can be
+// rendered.
+//
+// Brick b along an axis covers elements [b * brick_size, (b + 1) * brick_size]
+// like the cells of a MacrocellGrid, the last element being an apron shared
+// with the next brick so that hardware trilinear filtering inside a brick is
+// exact. Bricks live in slots of a 3D atlas texture for scalars and one for
+// normals. A page table texture with one texel per brick stores
+// (slot x, slot y, slot z, state), constant bricks store their value in
+// place of the slot and use no slot at all.
+//
+// The shader reports bricks through a low resolution feedback pass: the first
+// missing brick along each ray, or one of the resident bricks it sampled.
+// Missing bricks are loaded by priority, resident ones are marked as used,
+// and the least recently used bricks are evicted when the pool is full.
+// Construction, all the member functions and destruction must happen on the
+// GL thread.
+class VolumeBrickCache {
+public:
+  // Page table states, see volume_render.frag
+  enum class BrickState : std::uint32_t {
+    Missing = 0,
+    Resident = 1,
+    Constant = 2
+  };
+
+  struct Settings {
+    int brick_size{32};
+    // GPU memory for the scalar and normal atlases together, in bytes
+    std::size_t memory_budget{std::size_t{1} << 30u};
+    VolumeFormat volume_format{VolumeFormat::Float32};
+    // (scale, offset) from computeQuantization()
+    std::pair<float, float> quantization{1.f, 0.f};
+    NormalFormat normal_format{NormalFormat::Float32};
+    // Bricks loaded per update(), bounds the time spent in a frame
+    std::size_t max_loads_per_update{32};
+    // Feedback is rendered at 1 / feedback_downscale of the viewport size
+    int feedback_downscale{4};
+  };
+
+  // The field and normals must outlive the cache, they are only read when
+  // bricks are loaded. normals can be empty, then they are derived from the
+  // field for each brick. If macrocell_texture is not 0 it must be the
+  // texture of a MacrocellGrid with cell size brick_size, the ranges of
+  // loaded bricks are written to it.
+  VolumeBrickCache(const ScalarField<float> &field,
+                   const FieldStorage<glm::vec3> &normals,
+                   GLuint macrocell_texture, const Settings &settings);
+
+  // Same as above for a field kept compressed, bricks are decoded when they
+  // are loaded and normals are always derived
+  VolumeBrickCache(const CompressedScalarField &field,
+                   GLuint macrocell_texture, const Settings &settings);
+
+  // Same as above for a field read from a bricked file, bricks are read when
+  // they are loaded and normals are always derived
+  VolumeBrickCache(const OutOfCoreScalarField &field,
+                   GLuint macrocell_texture, const Settings &settings);
+
+  ~VolumeBrickCache();
+
+  // Not copyable or assignable
+  VolumeBrickCache(const VolumeBrickCache &) = delete;
+  VolumeBrickCache &operator=(const VolumeBrickCache &) = delete;
+
+  [[nodiscard]] GLuint scalarAtlas() const noexcept { return _scalar_atlas; }
+  [[nodiscard]] GLuint normalAtlas() const noexcept { return _normal_atlas; }
+  [[nodiscard]] GLuint pageTable() const noexcept { return _page_table; }
+
+  // Size of the atlases in elements
+  [[nodiscard]] glm::ivec3 atlasSize() const noexcept {
+    return _atlas_slots * (_settings.brick_size + 1);
+  }
+
+  [[nodiscard]] std::size_t residentBricks() const noexcept {
+    return _slots.size() - _free_slots.size();
+  }
+  [[nodiscard]] std::size_t totalSlots() const noexcept {
+    return _slots.size();
+  }
+
+  // Bind the feedback framebuffer, sized for a viewport of the given size,
+  // and set the viewport to cover it
+  void beginFeedback(int viewport_width, int viewport_height);
+
+  // Start reading back the feedback rendered since beginFeedback(), it is
+  // processed by the next update(). Binds the default framebuffer.
+  void endFeedback();
+
+  // Process the last feedback read back and load the most requested missing
+  // bricks, true if any was loaded
+  bool update();
+
+private:
+  struct Slot {
+    // Brick in the slot, -1 if free
+    std::int64_t brick{-1};
+    std::uint64_t last_used{0};
+    // Position in _lru when the slot is used
+    std::list<std::size_t>::iterator lru_position;
+  };
+
+  // Scalars and normals of a brick in the texture formats
+  struct BrickData {
+    std::size_t brick;
+    std::vector<unsigned char> scalars, normals;
+    glm::vec2 range;
+    bool constant;
+  };
+
+  // Buffers reused across the bricks loaded by a thread
+  struct BrickScratch {
+    std::vector<float> scalars, region;
+    std::vector<glm::vec3> normals, region_normals;
+  };
+
+  // Exactly one of field, compressed_field and out_of_core_field is not
+  // null, normals is null when they are derived
+  VolumeBrickCache(const ScalarField<float> *field,
+                   const CompressedScalarField *compressed_field,
+                   const OutOfCoreScalarField *out_of_core_field,
+                   const FieldStorage<glm::vec3> *normals,
+                   const glm::ivec3 &num_elements, const glm::vec3 &voxel_size,
+                   GLuint macrocell_texture, const Settings &settings);
+
+  [[nodiscard]] glm::ivec3 brickCoordinates(std::size_t brick) const noexcept;
+
+  // Copy the elements of the box [origin, origin + size) of the field to
+  // values, x fastest
+  void readRegion(const glm::ivec3 &origin, const glm::ivec3 &size,
+                  float *values) const;
+
+  // Extract, encode and reduce a brick, can run concurrently
+  void loadBrick(BrickData &data, BrickScratch &scratch) const;
+
+  // Slot for a new brick, evicting the least recently used one if the pool
+  // is full. Returns false if all the slots were used by the last feedback.
+  [[nodiscard]] bool acquireSlot(std::size_t &slot_index);
+
+  void touchSlot(std::size_t slot_index) noexcept;
+
+  // Upload a loaded brick and update its page table entry
+  void storeBrick(const BrickData &data);
+
+  void setPageEntry(std::size_t brick, const glm::uvec4 &entry);
+
+  const ScalarField<float> *_field;
+  const CompressedScalarField *_compressed_field;
+  const OutOfCoreScalarField *_out_of_core_field;
+  const FieldStorage<glm::vec3> *_normals;
+  glm::ivec3 _num_elements;
+  glm::vec3 _voxel_size;
+  GLuint _macrocell_texture;
+  Settings _settings;
+  Utils::VolumeTextureFormat _scalar_format, _normal_format;
+  glm::ivec3 _num_bricks;
+  glm::ivec3 _atlas_slots;
+  GLuint _scalar_atlas{0}, _normal_atlas{0}, _page_table{0};
+
+  std::vector<Slot> _slots;
+  std::vector<std::size_t> _free_slots;
+  // Used slots, most recently used first
+  std::list<std::size_t> _lru;
+  std::vector<glm::uvec4> _page_entries;
+  std::uint64_t _frame{0};
+
+  // Feedback framebuffer and buffers its content is read back to, one being
+  // written while the other is read
+  GLuint _feedback_framebuffer{0}, _feedback_renderbuffer{0};
+  glm::ivec2 _feedback_size{0};
+  std::array<GLuint, 2> _feedback_buffers{};
+  std::array<glm::ivec2, 2> _feedback_buffer_sizes{};
+  std::size_t _feedback_index{0};
+};
+
+} // namespace Gecko
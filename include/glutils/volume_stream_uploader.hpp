@@ -0,0 +1,129 @@
+#pragma once
+
+#include "glutils/utils.hpp"
+#include "io/slab_reader.hpp"
+#include "scalar_field/macrocell_grid.hpp"
+#include "scalar_field/normal_encoding.hpp"
+#include "scalar_field/quantization.hpp"
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Streams a volume into 3D textures slab by slab. Worker threads read slabs
+// straight into mapped pixel buffer objects while the GL thread uploads the
+// completed ones with glTexSubImage3D, so reading and uploading overlap and
+// the volume shows up progressively instead of after a full load.
+// Construction, update() and destruction must happen on the GL thread.
+class VolumeStreamUploader {
+public:
+  // Textures must already have storage for the whole volume
+  struct Settings {
+    GLuint volume_texture{0};
+    // Scalars are quantized to the format of the volume texture by the
+    // workers, with the (scale, offset) given by computeQuantization()
+    VolumeFormat volume_format{VolumeFormat::Float32};
+    std::pair<float, float> quantization{1.f, 0.f};
+    // 0 if normals are not needed, normals are encoded to the format of the
+    // texture by the workers
+    GLuint normal_texture{0};
+    NormalFormat normal_format{NormalFormat::Float32};
+    // Compute the normals from the scalars of each slab (plus one slice on
+    // each side) instead of reading them
+    bool derive_normals{false};
+    // If not 0 a MacrocellGrid with the given cell size is built as slabs
+    // arrive and kept up to date in it, the texture must have storage for the
+    // whole grid. Ranges are of the values before quantization.
+    GLuint macrocell_texture{0};
+    int macrocell_size{8};
+    int slab_depth{1};
+    std::size_t num_buffers{2};
+  };
+
+  VolumeStreamUploader(std::shared_ptr<const SlabReader> reader,
+                       const Settings &settings);
+
+  ~VolumeStreamUploader();
+
+  // Not copyable or assignable
+  VolumeStreamUploader(const VolumeStreamUploader &) = delete;
+  VolumeStreamUploader &operator=(const VolumeStreamUploader &) = delete;
+
+  // Upload the slabs read since the last call and schedule the next ones,
+  // returns true once the whole volume is on the GPU
+  bool update();
+
+  [[nodiscard]] bool finished() const noexcept {
+    return _uploaded_slices == _reader->numElements().z;
+  }
+
+  [[nodiscard]] float progress() const noexcept {
+    return static_cast<float>(_uploaded_slices) /
+           static_cast<float>(_reader->numElements().z);
+  }
+
+  // Range of the values uploaded so far
+  [[nodiscard]] const std::pair<float, float> &valueRange() const noexcept {
+    return _value_range;
+  }
+
+private:
+  // Pixel buffers and mapped memory for a slab in flight
+  struct Slot {
+    GLuint scalar_buffer{0}, normal_buffer{0};
+    // Elements in the volume and normal texture formats
+    void *scalars{nullptr};
+    void *normals{nullptr};
+    int z_begin{0}, z_end{0};
+    std::pair<float, float> value_range;
+    // Ranges of the macrocell layers touched by the slab
+    std::pair<int, int> macrocell_layers;
+    std::vector<glm::vec2> macrocell_ranges;
+  };
+
+  // Map the slot buffers and hand the next slab to the workers
+  void schedule(std::size_t slot_index);
+
+  void workerLoop();
+
+  // Read the slab of the slot and compute what depends on its values. Scalars
+  // and normals are read to the scratch buffers first when needed, as the
+  // mapped buffers are write only and encoding needs a separate output.
+  [[nodiscard]] std::pair<float, float>
+  readSlot(Slot &slot, std::vector<float> &scalars_scratch,
+           std::vector<glm::vec3> &normals_scratch) const;
+
+  void uploadMacrocellLayers(int layer_begin, int layer_end) const;
+
+  std::shared_ptr<const SlabReader> _reader;
+  Settings _settings;
+  Utils::VolumeTextureFormat _volume_texture_format, _normal_texture_format;
+  // Only the grid ranges are written after construction, by the GL thread,
+  // workers only read its size
+  std::optional<MacrocellGrid> _macrocells;
+  int _next_slice{0};
+  int _uploaded_slices{0};
+  std::pair<float, float> _value_range;
+  std::vector<Slot> _slots;
+
+  // Shared with the workers
+  std::mutex _mutex;
+  std::condition_variable _pending_condition;
+  std::deque<std::size_t> _pending_slots, _completed_slots;
+  std::exception_ptr _worker_exception;
+  bool _stop{false};
+  std::vector<std::thread> _workers;
+};
+
+} // namespace Gecko
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "scalar_field/scalar_field.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace Gecko {
+
+// Lossless codec for bricks of floats. The bit patterns of consecutive values
+// are delta coded as integers, which leaves mostly zero high bytes on smooth
+// data, then the bytes are shuffled into four planes (all the lowest bytes
+// first) and the planes are run length encoded.
+//
+// Runs are coded as a control byte c followed by data: c < 128 copies the next
+// c + 1 bytes, c >= 128 repeats the next byte c - 125 times.
+
+// Append the encoding of count values to encoded, returns the number of bytes
+// appended
+std::size_t compressBrick(const float *values, std::size_t count,
+                          std::vector<unsigned char> &encoded);
+
+// Decode exactly count values, scratch is reused across calls to avoid
+// allocations. Throws std::runtime_error if the data is not a valid encoding.
+void decompressBrick(const unsigned char *encoded, std::size_t size,
+                     float *values, std::size_t count,
+                     std::vector<unsigned char> &scratch);
+
+// Copy the brick_size^3 elements of the brick with the given origin out of the
+// field, x fastest. Elements past the end of the field repeat the last one.
+void extractBrick(const ScalarField<float> &field, const glm::ivec3 &origin,
+                  int brick_size, float *brick);
+
+} // namespace Gecko
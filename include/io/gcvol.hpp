@@ -0,0 +1,171 @@
+#pragma once
+
+#include "io/mapped_file.hpp"
+#include "io/slab_reader.hpp"
+#include "scalar_field/scalar_field.hpp"
+#include "utils/parallel.hpp"
+
+#include "glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Gecko compressed volume container (.gcvol)
+//
+// The scalar field is split in bricks of 2^brick_size_log2 elements per side,
+// padded to a whole number of bricks by repeating the last element along each
+// axis. Each brick is compressed on its own with compressBrick(), or stored
+// as is if that does not make it smaller. The file starts with a
+// GCVolHeader, the brick payloads follow and the index, one GCVolBrickEntry
+// per brick x fastest, then y, then z, comes last. All values are little
+// endian.
+constexpr std::array<char, 8> GCVOL_MAGIC{'G', 'E', 'C', 'K',
+                                          'O', 'C', 'V', 'L'};
+constexpr std::uint32_t GCVOL_VERSION{1};
+constexpr std::uint32_t GCVOL_MAX_BRICK_SIZE_LOG2{7};
+
+enum class GCVolBrickEncoding : std::uint32_t { Stored = 0, DeltaRLE = 1 };
+
+struct GCVolBrickEntry {
+  // Payload location from the start of the file, in bytes
+  std::uint64_t offset;
+  std::uint32_t size;
+  GCVolBrickEncoding encoding;
+  // Range of the values in the brick
+  float value_min, value_max;
+};
+
+struct GCVolHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t brick_size_log2;
+  std::array<float, 3> bounds_min;
+  std::array<float, 3> bounds_max;
+  std::array<std::uint32_t, 3> num_elements;
+  // Range of the values in the field
+  float value_min, value_max;
+  std::uint32_t reserved;
+  std::uint64_t index_offset;
+};
+
+static_assert(std::is_trivially_copyable_v<GCVolHeader> &&
+                  std::is_trivially_copyable_v<GCVolBrickEntry>,
+              "GCVol structures must be trivially copyable");
+
+// True if the file name has the .gcvol extension
+[[nodiscard]] bool isGCVolFilename(const std::string &filename) noexcept;
+
+class GCVolFile {
+public:
+  // Factory functions
+  [[nodiscard]] static GCVolFile createFromFile(const std::string &filename);
+
+  // Compress the field in parallel over bricks and write it to a new file
+  static void writeToFile(const std::string &filename,
+                          const ScalarField<float> &field,
+                          int brick_size_log2 = 5);
+
+  [[nodiscard]] glm::vec3 boundsMin() const noexcept {
+    return {_header.bounds_min[0], _header.bounds_min[1],
+            _header.bounds_min[2]};
+  }
+
+  [[nodiscard]] glm::vec3 boundsMax() const noexcept {
+    return {_header.bounds_max[0], _header.bounds_max[1],
+            _header.bounds_max[2]};
+  }
+
+  [[nodiscard]] glm::ivec3 numElements() const noexcept {
+    return {static_cast<int>(_header.num_elements[0]),
+            static_cast<int>(_header.num_elements[1]),
+            static_cast<int>(_header.num_elements[2])};
+  }
+
+  [[nodiscard]] std::pair<float, float> valueRange() const noexcept {
+    return {_header.value_min, _header.value_max};
+  }
+
+  [[nodiscard]] int brickSize() const noexcept {
+    return 1 << _header.brick_size_log2;
+  }
+
+  [[nodiscard]] const glm::ivec3 &numBricks() const noexcept {
+    return _num_bricks;
+  }
+
+  [[nodiscard]] const GCVolBrickEntry &
+  brickEntry(const glm::ivec3 &brick) const noexcept {
+    return _index[brickIndex(brick)];
+  }
+
+  // Decode the brickSize()^3 values of a brick, x fastest
+  void readBrick(const glm::ivec3 &brick, float *values) const;
+
+  // Decode the whole field, in parallel over bricks
+  [[nodiscard]] ScalarField<float> readField() const;
+
+  // Decode the elements [origin, origin + size) only, in parallel over the
+  // bricks they touch. The bounds of the result are the positions of its
+  // corner elements in the whole field.
+  [[nodiscard]] ScalarField<float> readRegion(const glm::ivec3 &origin,
+                                              const glm::ivec3 &size) const;
+
+  // Same as above to a buffer of size.x * size.y * size.z values, x fastest
+  void readRegion(const glm::ivec3 &origin, const glm::ivec3 &size,
+                  float *values,
+                  unsigned int num_threads = defaultThreadCount()) const;
+
+private:
+  GCVolFile(std::shared_ptr<MappedFile> file, const GCVolHeader &header,
+            std::vector<GCVolBrickEntry> index) noexcept;
+
+  // Same as readBrick(), scratch is reused across calls
+  void decodeBrick(std::size_t index, float *values,
+                   std::vector<unsigned char> &scratch) const;
+
+  [[nodiscard]] std::size_t brickIndex(const glm::ivec3 &brick) const noexcept {
+    return static_cast<std::size_t>(brick.x) +
+           static_cast<std::size_t>(_num_bricks.x) *
+               (static_cast<std::size_t>(brick.y) +
+                static_cast<std::size_t>(_num_bricks.y) *
+                    static_cast<std::size_t>(brick.z));
+  }
+
+  std::shared_ptr<MappedFile> _file;
+  GCVolHeader _header;
+  glm::ivec3 _num_bricks;
+  std::vector<GCVolBrickEntry> _index;
+};
+
+// Slab reader decoding the bricks of a .gcvol file each slab touches. The
+// format stores no normals, they have to be derived.
+class GCVolSlabReader final : public SlabReader {
+public:
+  [[nodiscard]] static std::unique_ptr<GCVolSlabReader>
+  createFromFile(const std::string &filename);
+
+  [[nodiscard]] bool hasNormals() const noexcept override { return false; }
+
+  [[nodiscard]] std::optional<std::pair<float, float>>
+  valueRange() const noexcept override {
+    return _file.valueRange();
+  }
+
+  std::pair<float, float> readSlab(int z_begin, int z_end, float *scalars,
+                                   glm::vec3 *normals) const override;
+
+private:
+  explicit GCVolSlabReader(GCVolFile file) noexcept;
+
+  GCVolFile _file;
+};
+
+} // namespace Gecko
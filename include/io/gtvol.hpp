@@ -0,0 +1,218 @@
+#pragma once
+
+#include "io/mapped_file.hpp"
+#include "scalar_field/scalar_field.hpp"
+
+#include "glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Gecko time varying volume container (.gtvol)
+//
+// All the steps of a time varying scalar field in one file. Each step is split
+// in bricks of 2^brick_size_log2 elements per side like in a .gcvol file.
+// Keyframes store all their bricks, the other steps only the bricks that
+// changed since the previous step, so a step costs disk space and reads in
+// proportion to what changed.
+//
+// The file starts with a GTVolHeader. For each step the brick payloads follow,
+// then its GTVolBrickEntry list ordered by brick. The step index, one
+// GTVolStepEntry per step, comes last. All values are little endian.
+constexpr std::array<char, 8> GTVOL_MAGIC{'G', 'E', 'C', 'K',
+                                          'O', 'T', 'V', 'L'};
+constexpr std::uint32_t GTVOL_VERSION{1};
+constexpr std::uint32_t GTVOL_MAX_BRICK_SIZE_LOG2{7};
+
+enum class GTVolBrickEncoding : std::uint32_t {
+  // Values as is
+  Stored = 0,
+  // Values compressed with compressBrick()
+  DeltaRLE = 1,
+  // Bit patterns XORed with the brick at the previous step, compressed with
+  // compressBrick(). Elements that did not change are zero, which compresses
+  // to a few bytes. Never used in keyframes.
+  XorRLE = 2
+};
+
+struct GTVolBrickEntry {
+  // Payload location from the start of the file, in bytes
+  std::uint64_t offset;
+  std::uint32_t size;
+  GTVolBrickEncoding encoding;
+  // Brick index, x fastest, then y, then z
+  std::uint32_t brick;
+  std::uint32_t reserved;
+};
+
+struct GTVolStepEntry {
+  // Location of the brick entries of the step from the start of the file
+  std::uint64_t bricks_offset;
+  std::uint32_t num_bricks;
+  // 1 if the step does not depend on the previous one
+  std::uint32_t keyframe;
+  // Range of the values of the step
+  float value_min, value_max;
+};
+
+struct GTVolHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t brick_size_log2;
+  std::array<float, 3> bounds_min;
+  std::array<float, 3> bounds_max;
+  std::array<std::uint32_t, 3> num_elements;
+  std::uint32_t num_steps;
+  // Range of the values over all the steps
+  float value_min, value_max;
+  std::uint32_t reserved;
+  std::uint64_t step_index_offset;
+};
+
+static_assert(std::is_trivially_copyable_v<GTVolHeader> &&
+                  std::is_trivially_copyable_v<GTVolStepEntry> &&
+                  std::is_trivially_copyable_v<GTVolBrickEntry>,
+              "GTVol structures must be trivially copyable");
+
+// True if the file name has the .gtvol extension
+[[nodiscard]] bool isGTVolFilename(const std::string &filename) noexcept;
+
+// Appends the steps of a time varying field to a new .gtvol file one at a
+// time, so that the whole series never has to be in memory. The file is only
+// valid once finish() returns.
+class GTVolWriter {
+public:
+  // Factory functions
+  // Every keyframe_interval-th step, starting from the first one, is a
+  // keyframe. Seeking decodes at most keyframe_interval steps.
+  [[nodiscard]] static GTVolWriter createFile(const std::string &filename,
+                                              int brick_size_log2 = 5,
+                                              int keyframe_interval = 16);
+
+  // Compress the bricks of the step that changed since the previous one, in
+  // parallel, and append them. All the steps must have the size and bounds of
+  // the first one.
+  void appendStep(const ScalarField<float> &field);
+
+  // Write the step index and the final header
+  void finish();
+
+  [[nodiscard]] std::size_t numSteps() const noexcept {
+    return _steps.size();
+  }
+
+private:
+  GTVolWriter(std::ofstream file, std::string filename, int brick_size_log2,
+              int keyframe_interval) noexcept;
+
+  std::ofstream _file;
+  std::string _filename;
+  GTVolHeader _header;
+  int _keyframe_interval;
+  glm::ivec3 _num_bricks;
+  std::uint64_t _offset;
+  // Bricks of the last step appended, one after the other
+  std::vector<float> _previous;
+  std::vector<GTVolStepEntry> _steps;
+};
+
+class GTVolFile {
+public:
+  // Factory functions
+  [[nodiscard]] static GTVolFile createFromFile(const std::string &filename);
+
+  [[nodiscard]] glm::vec3 boundsMin() const noexcept {
+    return {_header.bounds_min[0], _header.bounds_min[1],
+            _header.bounds_min[2]};
+  }
+
+  [[nodiscard]] glm::vec3 boundsMax() const noexcept {
+    return {_header.bounds_max[0], _header.bounds_max[1],
+            _header.bounds_max[2]};
+  }
+
+  [[nodiscard]] glm::ivec3 numElements() const noexcept {
+    return {static_cast<int>(_header.num_elements[0]),
+            static_cast<int>(_header.num_elements[1]),
+            static_cast<int>(_header.num_elements[2])};
+  }
+
+  [[nodiscard]] std::size_t numSteps() const noexcept {
+    return _steps.size();
+  }
+
+  // Range of the values over all the steps
+  [[nodiscard]] std::pair<float, float> valueRange() const noexcept {
+    return {_header.value_min, _header.value_max};
+  }
+
+  [[nodiscard]] std::pair<float, float>
+  stepValueRange(const std::size_t step) const {
+    const GTVolStepEntry &entry{_steps.at(step)};
+    return {entry.value_min, entry.value_max};
+  }
+
+  [[nodiscard]] int brickSize() const noexcept {
+    return 1 << _header.brick_size_log2;
+  }
+
+  [[nodiscard]] const glm::ivec3 &numBricks() const noexcept {
+    return _num_bricks;
+  }
+
+  [[nodiscard]] std::size_t totalBricks() const noexcept {
+    return static_cast<std::size_t>(_num_bricks.x) *
+           static_cast<std::size_t>(_num_bricks.y) *
+           static_cast<std::size_t>(_num_bricks.z);
+  }
+
+  [[nodiscard]] glm::ivec3 brickOrigin(std::size_t brick) const noexcept;
+
+  [[nodiscard]] bool isKeyframe(const std::size_t step) const {
+    return _steps.at(step).keyframe != 0;
+  }
+
+  // Last keyframe not after the step
+  [[nodiscard]] std::size_t previousKeyframe(std::size_t step) const;
+
+  // Bricks stored for the step and the bytes they take in the file
+  [[nodiscard]] std::size_t numStepBricks(const std::size_t step) const {
+    return _steps.at(step).num_bricks;
+  }
+  [[nodiscard]] std::uint64_t stepBytes(std::size_t step) const;
+
+  // Decode the bricks stored for the step into field, which must hold the
+  // previous step unless the step is a keyframe. Bricks are decoded in
+  // parallel. The indices of the bricks whose values differ from the ones
+  // in field are appended to changed_bricks, in increasing order.
+  void applyStep(std::size_t step, ScalarField<float> &field,
+                 std::vector<std::size_t> &changed_bricks) const;
+
+  // Decode a whole step, starting from the keyframe before it
+  [[nodiscard]] ScalarField<float> readStep(std::size_t step) const;
+
+private:
+  GTVolFile(std::shared_ptr<MappedFile> file, const GTVolHeader &header,
+            std::vector<GTVolStepEntry> steps,
+            std::vector<std::size_t> step_first_brick,
+            std::vector<GTVolBrickEntry> bricks) noexcept;
+
+  std::shared_ptr<MappedFile> _file;
+  GTVolHeader _header;
+  glm::ivec3 _num_bricks;
+  std::vector<GTVolStepEntry> _steps;
+  // Brick entries of all the steps, those of step s start at
+  // _step_first_brick[s]
+  std::vector<std::size_t> _step_first_brick;
+  std::vector<GTVolBrickEntry> _bricks;
+};
+
+} // namespace Gecko
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "io/mapped_file.hpp"
+#include "io/slab_reader.hpp"
+#include "scalar_field/scalar_field.hpp"
+
+#include "glm/glm.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace Gecko {
+
+// Gecko native binary volume container (.gvol)
+//
+// The file starts with a fixed size GVolHeader. Each channel payload follows
+// at an offset aligned to GVOL_PAYLOAD_ALIGNMENT bytes so that it can be used
+// in place from a memory mapping. Components are interleaved per element,
+// elements are stored x fastest, then y, then z, all values are little endian.
+// Bricked channels store elements in the order of BrickedLayout instead, so
+// that a brick can be read with a single contiguous read.
+constexpr std::array<char, 8> GVOL_MAGIC{'G', 'E', 'C', 'K',
+                                         'O', 'V', 'O', 'L'};
+constexpr std::uint32_t GVOL_VERSION{2};
+// Version 1 files are still read, all their channels are linear
+constexpr std::uint32_t GVOL_MIN_VERSION{1};
+constexpr std::uint32_t GVOL_MAX_BRICK_SIZE_LOG2{7};
+constexpr std::uint64_t GVOL_PAYLOAD_ALIGNMENT{4096};
+constexpr std::size_t GVOL_MAX_CHANNELS{4};
+
+enum class GVolDataType : std::uint32_t { Float32 = 0 };
+
+enum class GVolChannelType : std::uint32_t { Scalar = 0, Normal = 1 };
+
+struct GVolChannelDescriptor {
+  GVolChannelType type;
+  GVolDataType data_type;
+  std::uint32_t components;
+  // 0 for a linear channel, otherwise the channel is stored in bricks of
+  // 2^brick_size_log2 elements per side padded to a whole number of bricks
+  std::uint32_t brick_size_log2;
+  // Payload location from the start of the file, in bytes
+  std::uint64_t offset;
+  std::uint64_t size;
+  // Range of the values stored in the channel (over all components)
+  float value_min, value_max;
+};
+
+struct GVolHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t num_channels;
+  std::array<float, 3> bounds_min;
+  std::array<float, 3> bounds_max;
+  std::array<std::uint32_t, 3> num_elements;
+  std::uint32_t reserved;
+  std::array<GVolChannelDescriptor, GVOL_MAX_CHANNELS> channels;
+};
+
+static_assert(std::is_trivially_copyable_v<GVolHeader>,
+              "GVolHeader must be trivially copyable");
+static_assert(sizeof(GVolHeader) <= GVOL_PAYLOAD_ALIGNMENT,
+              "GVolHeader does not fit before the first payload");
+
+// True if the file name has the .gvol extension
+[[nodiscard]] bool isGVolFilename(const std::string &filename) noexcept;
+
+class GVolFile {
+public:
+  // Factory functions
+  [[nodiscard]] static GVolFile createFromFile(const std::string &filename);
+
+  // Write field and (optional) per element normals to a new .gvol file. With
+  // brick_size_log2 > 0 the scalar channel is written bricked, padding
+  // elements repeat the last element along each axis.
+  static void writeToFile(const std::string &filename,
+                          const ScalarField<float> &field,
+                          const glm::vec3 *normals, int brick_size_log2 = 0);
+
+  [[nodiscard]] glm::vec3 boundsMin() const noexcept {
+    return {_header.bounds_min[0], _header.bounds_min[1],
+            _header.bounds_min[2]};
+  }
+
+  [[nodiscard]] glm::vec3 boundsMax() const noexcept {
+    return {_header.bounds_max[0], _header.bounds_max[1],
+            _header.bounds_max[2]};
+  }
+
+  [[nodiscard]] glm::ivec3 numElements() const noexcept {
+    return {static_cast<int>(_header.num_elements[0]),
+            static_cast<int>(_header.num_elements[1]),
+            static_cast<int>(_header.num_elements[2])};
+  }
+
+  // Returns nullptr if the channel is not present in the file
+  [[nodiscard]] const GVolChannelDescriptor *
+  findChannel(GVolChannelType type) const noexcept;
+
+  // Field referencing the scalar channel in place, no data is copied. The
+  // channel must be linear, see OutOfCoreScalarField for bricked ones.
+  [[nodiscard]] ScalarField<float> createScalarField() const;
+
+  // Storage referencing the normal channel in place, empty if not present
+  [[nodiscard]] FieldStorage<glm::vec3> createNormalStorage() const;
+
+  // Hint the OS to start reading the whole file in the background
+  void prefetch() const;
+
+  // Same as above for a single channel, does nothing if it is not present
+  void prefetch(GVolChannelType type) const;
+
+  [[nodiscard]] const std::shared_ptr<MappedFile> &file() const noexcept {
+    return _file;
+  }
+
+private:
+  GVolFile(std::shared_ptr<MappedFile> file, const GVolHeader &header) noexcept
+      : _file{std::move(file)}, _header{header} {}
+
+  template <typename T>
+  [[nodiscard]] FieldStorage<T>
+  createChannelStorage(const GVolChannelDescriptor &channel) const;
+
+  std::shared_ptr<MappedFile> _file;
+  GVolHeader _header;
+};
+
+// Slab reader copying slabs out of the mapped channels of a .gvol file
+class GVolSlabReader final : public SlabReader {
+public:
+  [[nodiscard]] static std::unique_ptr<GVolSlabReader>
+  createFromFile(const std::string &filename);
+
+  [[nodiscard]] bool hasNormals() const noexcept override {
+    return _normals.size() != 0;
+  }
+
+  [[nodiscard]] std::optional<std::pair<float, float>>
+  valueRange() const noexcept override {
+    return _value_range;
+  }
+
+  std::pair<float, float> readSlab(int z_begin, int z_end, float *scalars,
+                                   glm::vec3 *normals) const override;
+
+private:
+  GVolSlabReader(ScalarField<float> field, FieldStorage<glm::vec3> normals,
+                 const std::pair<float, float> &value_range) noexcept;
+
+  ScalarField<float> _field;
+  FieldStorage<glm::vec3> _normals;
+  std::pair<float, float> _value_range;
+};
+
+} // namespace Gecko
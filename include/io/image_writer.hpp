@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Gecko {
+
+// Write 8 bit RGBA pixels, with rows from bottom to top as read back from
+// OpenGL, to an image file. The format is selected from the extension: .png
+// (RGB, stored without compression so that writing costs no more than a copy)
+// or .ppm (binary RGB). Alpha is dropped.
+void writeImage(const std::string &filename, int width, int height,
+                const std::uint8_t *pixels);
+
+} // namespace Gecko
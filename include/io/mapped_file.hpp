@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Gecko {
+
+// View of a whole file mapped in memory. Pages are served directly from the
+// page cache, so no copy is made until (and unless) they are written through a
+// copy-on-write mapping.
+class MappedFile {
+public:
+  enum class Access {
+    // Pages are mapped read-only, writing to them is undefined behaviour
+    ReadOnly,
+    // Pages are private to the process, writes never reach the file
+    CopyOnWrite
+  };
+
+  // Hint on how the mapped range is going to be accessed
+  enum class Advice { Normal, Sequential, Random, WillNeed };
+
+  ~MappedFile() noexcept;
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  // Not copyable
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Factory functions
+  [[nodiscard]] static MappedFile
+  createFromFile(const std::string &filename,
+                 Access access = Access::ReadOnly);
+
+  // Create (or truncate) a file of the given size and map it shared, writes go
+  // to the page cache and end up in the file. The new content is zero.
+  [[nodiscard]] static MappedFile createNewFile(const std::string &filename,
+                                                std::size_t size);
+
+  [[nodiscard]] std::byte *data() noexcept { return _data; }
+  [[nodiscard]] const std::byte *data() const noexcept { return _data; }
+  [[nodiscard]] std::size_t size() const noexcept { return _size; }
+
+  // Pass an access pattern hint for the given byte range to the OS
+  void advise(Advice advice, std::size_t offset, std::size_t length) const;
+  void advise(const Advice advice) const { advise(advice, 0, _size); }
+
+private:
+  MappedFile(std::byte *data, std::size_t size) noexcept;
+
+  void unmap() noexcept;
+
+  std::byte *_data;
+  std::size_t _size;
+};
+
+} // namespace Gecko
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "io/mapped_file.hpp"
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Read only scalar field backed by the bricked scalar channel of a .gvol file,
+// for volumes larger than the available memory. Bricks are copied out of the
+// file on first access and kept in a least recently used cache bounded by a
+// memory budget. When consecutive misses walk along a direction, the next
+// bricks along it are prefetched with an asynchronous read ahead hint.
+//
+// Accessors have the same names as in ScalarField but return values, a brick
+// can be evicted as soon as the access is over. All member functions can be
+// called concurrently. Each thread keeps the brick it accessed last, so runs
+// of accesses to one brick skip the lock of the cache, and that brick stays
+// alive, evicted or not, until the thread moves to another brick of any
+// field: at most one brick per thread above the memory budget.
+class OutOfCoreScalarField {
+public:
+  struct Settings {
+    // Memory for cached bricks, in bytes, at least one brick is kept
+    std::size_t memory_budget{std::size_t{256} << 20u};
+    // Bricks prefetched ahead of a miss along the access direction
+    int prefetch_distance{2};
+  };
+
+  // Hits count the lookups in the cache, the accesses served by the brick
+  // a thread kept are not counted
+  struct Statistics {
+    std::uint64_t hits, misses, prefetches, evictions;
+  };
+
+  // Factory functions
+  // The file must store its scalar channel bricked, see GVolFile::writeToFile
+  [[nodiscard]] static std::unique_ptr<OutOfCoreScalarField>
+  createFromFile(const std::string &filename, const Settings &settings);
+
+  // Not copyable, the cache is shared by all the users of the field
+  OutOfCoreScalarField(const OutOfCoreScalarField &) = delete;
+  OutOfCoreScalarField &operator=(const OutOfCoreScalarField &) = delete;
+
+  OutOfCoreScalarField(OutOfCoreScalarField &&) = delete;
+  OutOfCoreScalarField &operator=(OutOfCoreScalarField &&) = delete;
+
+  [[nodiscard]] const glm::vec3 &min() const noexcept { return _bounds_min; }
+  [[nodiscard]] const glm::vec3 &max() const noexcept { return _bounds_max; }
+
+  [[nodiscard]] const glm::vec3 &getVoxelSize() const noexcept {
+    return _voxel_size;
+  }
+
+  [[nodiscard]] int xSize() const noexcept { return _num_elements.x; }
+  [[nodiscard]] int ySize() const noexcept { return _num_elements.y; }
+  [[nodiscard]] int zSize() const noexcept { return _num_elements.z; }
+
+  [[nodiscard]] std::size_t totalElements() const noexcept {
+    return static_cast<std::size_t>(xSize()) *
+           static_cast<std::size_t>(ySize()) *
+           static_cast<std::size_t>(zSize());
+  }
+
+  [[nodiscard]] float at(int i, int j, int k) const;
+
+  [[nodiscard]] float operator()(int i, int j, int k) const;
+
+  [[nodiscard]] glm::vec3 computeElementPosition(const int i, const int j,
+                                                 const int k) const noexcept {
+    return min() + glm::vec3{static_cast<float>(i), static_cast<float>(j),
+                             static_cast<float>(k)} *
+                       getVoxelSize();
+  }
+
+  // Trilinear interpolation of the field at a world space position, positions
+  // outside of the bounds are clamped to the border elements
+  [[nodiscard]] float sample(const glm::vec3 &position) const;
+
+  // Copy the elements of the box [origin, origin + size) to values, x
+  // fastest, looking up each brick it touches once. Throws std::out_of_range
+  // if the box is not inside the field.
+  void readRegion(const glm::ivec3 &origin, const glm::ivec3 &size,
+                  float *values) const;
+
+  // Range of the values as stored in the file header
+  [[nodiscard]] const std::pair<float, float> &valueRange() const noexcept {
+    return _value_range;
+  }
+
+  [[nodiscard]] int brickSize() const noexcept { return 1 << _brick_size_log2; }
+
+  [[nodiscard]] std::size_t cachedBricks() const;
+  [[nodiscard]] std::size_t maxCachedBricks() const noexcept {
+    return _max_cached_bricks;
+  }
+
+  [[nodiscard]] Statistics statistics() const noexcept;
+  void resetStatistics() noexcept;
+
+private:
+  using Brick = std::vector<float>;
+
+  struct CacheEntry {
+    std::shared_ptr<const Brick> brick;
+    // Position in _lru
+    std::list<std::size_t>::iterator lru_position;
+  };
+
+  OutOfCoreScalarField(std::shared_ptr<MappedFile> file,
+                       std::uint64_t payload_offset,
+                       const glm::vec3 &bounds_min,
+                       const glm::vec3 &bounds_max,
+                       const glm::ivec3 &num_elements, int brick_size_log2,
+                       const std::pair<float, float> &value_range,
+                       const Settings &settings);
+
+  // Brick containing an element, loading it on a miss
+  [[nodiscard]] std::shared_ptr<const Brick>
+  findBrick(const glm::ivec3 &brick_coordinates) const;
+
+  // Same as findBrick() through the brick the calling thread kept, valid
+  // until the next call on the same thread
+  [[nodiscard]] const Brick &
+  findThreadBrick(const glm::ivec3 &brick_coordinates) const;
+
+  [[nodiscard]] glm::ivec3
+  brickCoordinates(const glm::ivec3 &element) const noexcept {
+    return {element.x >> _brick_size_log2, element.y >> _brick_size_log2,
+            element.z >> _brick_size_log2};
+  }
+
+  [[nodiscard]] std::size_t
+  elementOffset(const glm::ivec3 &element) const noexcept {
+    const int mask{brickSize() - 1};
+    return static_cast<std::size_t>(
+        (element.x & mask) | ((element.y & mask) << _brick_size_log2) |
+        ((element.z & mask) << (2 * _brick_size_log2)));
+  }
+
+  [[nodiscard]] std::size_t
+  brickIndex(const glm::ivec3 &brick_coordinates) const noexcept {
+    return static_cast<std::size_t>(brick_coordinates.x) +
+           static_cast<std::size_t>(_num_bricks.x) *
+               (static_cast<std::size_t>(brick_coordinates.y) +
+                static_cast<std::size_t>(_num_bricks.y) *
+                    static_cast<std::size_t>(brick_coordinates.z));
+  }
+
+  // Hint the OS to read the bricks following brick_coordinates along the
+  // direction of the last misses
+  void prefetchAfterMiss(const glm::ivec3 &brick_coordinates) const;
+
+  std::shared_ptr<MappedFile> _file;
+  std::uint64_t _payload_offset;
+  glm::vec3 _bounds_min, _bounds_max;
+  glm::ivec3 _num_elements;
+  glm::vec3 _voxel_size;
+  std::pair<float, float> _value_range;
+  int _brick_size_log2;
+  glm::ivec3 _num_bricks;
+  std::size_t _brick_elements;
+  std::size_t _max_cached_bricks;
+  int _prefetch_distance;
+  // Names the field in the bricks kept by the threads, unlike its address it
+  // is never reused
+  std::uint64_t _id;
+
+  mutable std::mutex _mutex;
+  mutable std::unordered_map<std::size_t, CacheEntry> _cache;
+  // Cached bricks, most recently used first
+  mutable std::list<std::size_t> _lru;
+  // Not next to any brick, the first miss gives no direction
+  mutable glm::ivec3 _last_miss{-2};
+
+  mutable std::atomic<std::uint64_t> _hits{0}, _misses{0}, _prefetches{0},
+      _evictions{0};
+};
+
+} // namespace Gecko
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace Gecko {
+
+// Random access reader returning whole z slabs of a volume, so that a volume
+// can be consumed piece by piece without being resident in memory at once
+class SlabReader {
+public:
+  virtual ~SlabReader() = default;
+
+  // Not copyable or assignable
+  SlabReader(const SlabReader &) = delete;
+  SlabReader &operator=(const SlabReader &) = delete;
+
+  // Factory functions, the format is selected from the file extension
+  [[nodiscard]] static std::unique_ptr<SlabReader>
+  createFromFile(const std::string &filename);
+
+  [[nodiscard]] const glm::vec3 &boundsMin() const noexcept {
+    return _bounds_min;
+  }
+  [[nodiscard]] const glm::vec3 &boundsMax() const noexcept {
+    return _bounds_max;
+  }
+  [[nodiscard]] const glm::ivec3 &numElements() const noexcept {
+    return _num_elements;
+  }
+
+  [[nodiscard]] std::size_t sliceElements() const noexcept {
+    return static_cast<std::size_t>(_num_elements.x) *
+           static_cast<std::size_t>(_num_elements.y);
+  }
+
+  [[nodiscard]] glm::vec3 voxelSize() const noexcept {
+    return (_bounds_max - _bounds_min) /
+           glm::vec3{_num_elements - glm::ivec3{1}};
+  }
+
+  // True if the file stores per element normals that readSlab() can return
+  [[nodiscard]] virtual bool hasNormals() const noexcept = 0;
+
+  // Range of the scalar values over the whole volume if the file stores it,
+  // so that it is known before any slab is read
+  [[nodiscard]] virtual std::optional<std::pair<float, float>>
+  valueRange() const noexcept {
+    return std::nullopt;
+  }
+
+  // Read z slices [z_begin, z_end) in linear order to the given buffers,
+  // normals can be nullptr if they are not needed. Returns the range of the
+  // scalar values read. Can be called concurrently for different slabs.
+  virtual std::pair<float, float> readSlab(int z_begin, int z_end,
+                                           float *scalars,
+                                           glm::vec3 *normals) const = 0;
+
+protected:
+  SlabReader(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+             const glm::ivec3 &num_elements) noexcept
+      : _bounds_min{bounds_min}, _bounds_max{bounds_max}, _num_elements{
+                                                              num_elements} {}
+
+private:
+  glm::vec3 _bounds_min, _bounds_max;
+  glm::ivec3 _num_elements;
+};
+
+} // namespace Gecko
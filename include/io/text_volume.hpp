@@ -0,0 +1,43 @@
+#pragma once
+
+#include "io/mapped_file.hpp"
+#include "io/slab_reader.hpp"
+#include "io/volume_data.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Gecko {
+
+// Load a volume from the legacy text format: bounds min and max (6 floats),
+// number of elements along each axis (3 ints) and then "nx ny nz s" for each
+// element, x fastest. The file is mapped in memory, split in line aligned
+// chunks and each chunk is parsed on its own thread. Normals are skipped, and
+// left empty in the result, if read_normals is false.
+[[nodiscard]] VolumeData loadTextVolume(const std::string &filename,
+                                        bool read_normals = true);
+
+// Slab reader for the legacy text format. The start of every z slice is
+// located up front with a parallel scan of the file, each slab is then parsed
+// independently when requested.
+class TextSlabReader final : public SlabReader {
+public:
+  [[nodiscard]] static std::unique_ptr<TextSlabReader>
+  createFromFile(const std::string &filename);
+
+  [[nodiscard]] bool hasNormals() const noexcept override { return true; }
+
+  std::pair<float, float> readSlab(int z_begin, int z_end, float *scalars,
+                                   glm::vec3 *normals) const override;
+
+private:
+  TextSlabReader(MappedFile file, const glm::vec3 &bounds_min,
+                 const glm::vec3 &bounds_max, const glm::ivec3 &num_elements,
+                 std::vector<const char *> slice_begins) noexcept;
+
+  MappedFile _file;
+  std::vector<const char *> _slice_begins;
+};
+
+} // namespace Gecko
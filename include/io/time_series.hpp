@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Ordered list of the volume files of a time varying volume, one file per
+// timestep in any of the formats SlabReader supports
+class TimeSeries {
+public:
+  // Factory functions
+  // path is either a directory, whose files are the timesteps ordered by name
+  // with numbers compared by value (step_9 before step_10), or a manifest
+  // listing one file per line, relative to the manifest directory. Hidden
+  // files, empty lines and lines starting with # are skipped.
+  [[nodiscard]] static TimeSeries createFromPath(const std::string &path);
+
+  [[nodiscard]] std::size_t numSteps() const noexcept {
+    return _filenames.size();
+  }
+
+  [[nodiscard]] const std::string &stepFilename(const std::size_t step) const {
+    return _filenames.at(step);
+  }
+
+private:
+  explicit TimeSeries(std::vector<std::string> filenames) noexcept
+      : _filenames{std::move(filenames)} {}
+
+  std::vector<std::string> _filenames;
+};
+
+} // namespace Gecko
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "scalar_field/field_storage.hpp"
+#include "scalar_field/scalar_field.hpp"
+
+#include "glm/glm.hpp"
+
+namespace Gecko {
+
+// Volume as loaded from disk, scalar field plus per element normals stored in
+// the same linear order as the field
+struct VolumeData {
+  ScalarField<float> field;
+  FieldStorage<glm::vec3> normals;
+  // Range of the values stored in the field
+  float value_min, value_max;
+};
+
+} // namespace Gecko
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "scalar_field/field_storage.hpp"
+#include "scalar_field/macrocell_grid.hpp"
+#include "scalar_field/scalar_field.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Gecko {
+
+namespace Detail {
+
+// Linear texture lookup with clamp to edge at texture coordinates p of the
+// samples of the raymarcher, T is float or glm::vec3
+template <typename T>
+[[nodiscard]] T sampleTexture(const T *data, const glm::ivec3 &num_elements,
+                              const glm::vec3 &p) noexcept;
+
+#if defined(__AVX2__)
+
+// Rays sampled at once by samplePacket8()
+constexpr std::size_t RAY_PACKET_SIZE{8};
+
+// sampleTexture() of values and normals at the 8 positions (x, y, z), with
+// 32 bit gather offsets. All the arrays are of 8 floats aligned to 32 bytes,
+// the results agree bit for bit with sampleTexture().
+void samplePacket8(const float *values, const glm::vec3 *normals,
+                   const glm::ivec3 &num_elements, const float *x,
+                   const float *y, const float *z, float *value, float *nx,
+                   float *ny, float *nz) noexcept;
+
+#endif
+
+} // namespace Detail
+
+// CPU version of volume_render.frag, for machines without a GPU. Rays go
+// through the centers of the pixels covered by the front faces of the unit
+// cube and are composited exactly as by the shader: the same bounds hit,
+// macrocell skipping on the same sample positions, transfer function, opacity
+// correction and early termination. Values and normals are interpolated like
+// GL_LINEAR textures with GL_CLAMP_TO_EDGE straight from the field, without
+// quantization.
+//
+// The image is split in tiles run as tasks of the global thread pool. Inside a
+// tile, packets of 8 neighbouring rays are marched together and sampled with
+// AVX2 gathers when built with AVX2.
+class CpuRaymarcher {
+public:
+  struct Settings {
+    int macrocell_size{8};
+  };
+
+  // Uniforms of volume_render.frag
+  struct Shading {
+    float step_size{0.01f};
+    float min_value{0.f};
+    float mult{1.f};
+    // Color of the pixels not covered by the volume, the clear color
+    glm::vec3 background{0.1f};
+  };
+
+  // The field and normals must outlive the raymarcher, normals are one per
+  // element as returned by ScalarField::computeNormals()
+  CpuRaymarcher(const ScalarField<float> &field,
+                const FieldStorage<glm::vec3> &normals,
+                const Settings &settings);
+
+  // Render an image of width x height pixels. MVP maps the unit cube of
+  // model space to clip space and eye_model_space is the eye in model space,
+  // as for the shader. Pixels are 8 bit RGBA with rows from bottom to top as
+  // glReadPixels() returns them.
+  void render(const glm::mat4 &MVP, const glm::vec3 &eye_model_space,
+              const Shading &shading, int width, int height,
+              std::uint8_t *pixels) const;
+
+private:
+  const ScalarField<float> &_field;
+  const FieldStorage<glm::vec3> &_normals;
+  MacrocellGrid _macrocells;
+};
+
+} // namespace Gecko
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "field_storage.hpp"
+#include "scalar_field.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Gecko {
+
+// Read only float field kept in memory compressed with a lossy fixed rate
+// transform coder in the style of ZFP. The field is split in blocks of 4^3
+// elements, each block is converted to integers relative to its largest
+// exponent, decorrelated with an orthogonal lifting transform along each axis
+// and its coefficients are coded bit plane by bit plane, most significant
+// first, until the bits of the block are used.
+//
+// Every block takes exactly rate 64 bit words, so a block is found from its
+// coordinates alone and can be decoded on its own. Accessors have the same
+// names as in ScalarField but decode the blocks they touch and return values.
+// All the const member functions can be called concurrently.
+class CompressedScalarField {
+public:
+  constexpr static int BLOCK_SIZE{4};
+  constexpr static std::size_t BLOCK_ELEMENTS{64};
+  // Bits per value, a field takes rate / 32 of the memory of a float one.
+  // The error falls quickly with the rate and stops falling at about 24.
+  constexpr static int MIN_RATE{1};
+  constexpr static int MAX_RATE{32};
+
+  // Factory functions
+  // Compress a linear field in parallel over layers of blocks. Throws
+  // std::runtime_error if the rate is not valid or a value is not finite.
+  [[nodiscard]] static CompressedScalarField
+  compress(const ScalarField<float> &field, int rate);
+
+  // Not copyable, compressed fields are meant to be large
+  CompressedScalarField(const CompressedScalarField &) = delete;
+  CompressedScalarField &operator=(const CompressedScalarField &) = delete;
+
+  CompressedScalarField(CompressedScalarField &&) noexcept = default;
+  CompressedScalarField &operator=(CompressedScalarField &&) noexcept = default;
+
+  [[nodiscard]] const glm::vec3 &min() const noexcept { return _bounds_min; }
+  [[nodiscard]] const glm::vec3 &max() const noexcept { return _bounds_max; }
+
+  [[nodiscard]] const glm::vec3 &getVoxelSize() const noexcept {
+    return _voxel_size;
+  }
+
+  [[nodiscard]] int xSize() const noexcept { return _num_elements.x; }
+  [[nodiscard]] int ySize() const noexcept { return _num_elements.y; }
+  [[nodiscard]] int zSize() const noexcept { return _num_elements.z; }
+
+  [[nodiscard]] std::size_t totalElements() const noexcept {
+    return static_cast<std::size_t>(xSize()) *
+           static_cast<std::size_t>(ySize()) *
+           static_cast<std::size_t>(zSize());
+  }
+
+  [[nodiscard]] int rate() const noexcept { return _rate; }
+
+  [[nodiscard]] const glm::ivec3 &numBlocks() const noexcept {
+    return _num_blocks;
+  }
+
+  // Memory used by the compressed blocks, in bytes
+  [[nodiscard]] std::size_t compressedSize() const noexcept {
+    return _blocks.size() * sizeof(std::uint64_t);
+  }
+
+  [[nodiscard]] float at(int i, int j, int k) const;
+
+  [[nodiscard]] float operator()(int i, int j, int k) const noexcept;
+
+  [[nodiscard]] glm::vec3 computeElementPosition(const int i, const int j,
+                                                 const int k) const noexcept {
+    return min() + glm::vec3{static_cast<float>(i), static_cast<float>(j),
+                             static_cast<float>(k)} *
+                       getVoxelSize();
+  }
+
+  // Trilinear interpolation of the field at a world space position, positions
+  // outside of the bounds are clamped to the border elements. Each block
+  // touched is decoded once.
+  [[nodiscard]] float sample(const glm::vec3 &position) const noexcept;
+
+  // Decode the BLOCK_ELEMENTS values of a block, x fastest. Elements of
+  // blocks on the border past the field size repeat the last element.
+  void decodeBlock(const glm::ivec3 &block, float *values) const noexcept;
+
+  // Decode the elements of the box [origin, origin + size) to values, x
+  // fastest, on the calling thread. Throws std::out_of_range if the box is
+  // not inside the field.
+  void decompressRegion(const glm::ivec3 &origin, const glm::ivec3 &size,
+                        float *values) const;
+
+  // Decode the whole field in parallel over layers of blocks
+  [[nodiscard]] ScalarField<float> decompress() const;
+
+private:
+  CompressedScalarField(const glm::vec3 &bounds_min,
+                        const glm::vec3 &bounds_max,
+                        const glm::ivec3 &num_elements,
+                        const glm::vec3 &voxel_size, int rate);
+
+  [[nodiscard]] std::size_t
+  blockIndex(const glm::ivec3 &block) const noexcept {
+    return static_cast<std::size_t>(block.x) +
+           static_cast<std::size_t>(_num_blocks.x) *
+               (static_cast<std::size_t>(block.y) +
+                static_cast<std::size_t>(_num_blocks.y) *
+                    static_cast<std::size_t>(block.z));
+  }
+
+  [[nodiscard]] const std::uint64_t *
+  blockWords(const glm::ivec3 &block) const noexcept {
+    return _blocks.data() + blockIndex(block) * static_cast<std::size_t>(_rate);
+  }
+
+  glm::vec3 _bounds_min, _bounds_max;
+  glm::ivec3 _num_elements;
+  glm::vec3 _voxel_size;
+  int _rate;
+  glm::ivec3 _num_blocks;
+  FieldStorage<std::uint64_t> _blocks;
+};
+
+} // namespace Gecko
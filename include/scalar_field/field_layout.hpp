@@ -0,0 +1,114 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+namespace Gecko {
+
+// Layouts map the (i, j, k) index of an element to its position in the field
+// storage. The storage is always a sequence of slabs along z, each covering
+// whole xy planes, which is what the parallel passes over a field split on.
+
+// Elements x fastest, then y, then z. Slabs are single z slices.
+class LinearLayout {
+public:
+  explicit LinearLayout(const glm::ivec3 &num_elements) noexcept
+      : _x_size{static_cast<std::size_t>(num_elements.x)},
+        _y_size{static_cast<std::size_t>(num_elements.y)},
+        _z_size{static_cast<std::size_t>(num_elements.z)} {}
+
+  [[nodiscard]] std::size_t storageSize() const noexcept {
+    return numSlabs() * slabElements();
+  }
+
+  [[nodiscard]] std::size_t numSlabs() const noexcept { return _z_size; }
+  [[nodiscard]] std::size_t slabElements() const noexcept {
+    return _x_size * _y_size;
+  }
+
+  [[nodiscard]] std::size_t index(const int i, const int j,
+                                  const int k) const noexcept {
+    return static_cast<std::size_t>(i) +
+           _x_size * (static_cast<std::size_t>(j) +
+                      static_cast<std::size_t>(k) * _y_size);
+  }
+
+private:
+  std::size_t _x_size, _y_size, _z_size;
+};
+
+// Elements grouped in cubic bricks of 2^BRICK_SIZE_LOG2 elements per side,
+// x fastest inside a brick. Bricks are stored x fastest, then y, then z, so
+// slabs are layers of bricks. Neighbours along any axis are at most a brick
+// apart in memory, which keeps stencils and rays walking along z in cache.
+// The field is padded up to a whole number of bricks along each axis.
+template <int BRICK_SIZE_LOG2> class BrickedLayout {
+public:
+  static_assert(BRICK_SIZE_LOG2 > 0 && BRICK_SIZE_LOG2 < 8,
+                "Unsupported brick size");
+
+  constexpr static int BRICK_SIZE{1 << BRICK_SIZE_LOG2};
+  constexpr static std::size_t BRICK_ELEMENTS{
+      static_cast<std::size_t>(BRICK_SIZE) * BRICK_SIZE * BRICK_SIZE};
+
+  explicit BrickedLayout(const glm::ivec3 &num_elements) noexcept
+      : _num_bricks{(num_elements + glm::ivec3{BRICK_SIZE - 1}) /
+                    glm::ivec3{BRICK_SIZE}} {}
+
+  [[nodiscard]] std::size_t storageSize() const noexcept {
+    return numSlabs() * slabElements();
+  }
+
+  [[nodiscard]] std::size_t numSlabs() const noexcept {
+    return static_cast<std::size_t>(_num_bricks.z);
+  }
+  [[nodiscard]] std::size_t slabElements() const noexcept {
+    return static_cast<std::size_t>(_num_bricks.x) *
+           static_cast<std::size_t>(_num_bricks.y) * BRICK_ELEMENTS;
+  }
+
+  [[nodiscard]] const glm::ivec3 &numBricks() const noexcept {
+    return _num_bricks;
+  }
+  [[nodiscard]] std::size_t totalBricks() const noexcept {
+    return numSlabs() * static_cast<std::size_t>(_num_bricks.x) *
+           static_cast<std::size_t>(_num_bricks.y);
+  }
+
+  // Storage index of the first element of a brick
+  [[nodiscard]] static std::size_t
+  brickOffset(const std::size_t brick) noexcept {
+    return brick * BRICK_ELEMENTS;
+  }
+
+  // (i, j, k) index of the first element of a brick
+  [[nodiscard]] glm::ivec3 brickOrigin(const std::size_t brick) const noexcept {
+    const auto bricks_x{static_cast<std::size_t>(_num_bricks.x)};
+    const auto bricks_y{static_cast<std::size_t>(_num_bricks.y)};
+    return glm::ivec3{static_cast<int>(brick % bricks_x),
+                      static_cast<int>(brick / bricks_x % bricks_y),
+                      static_cast<int>(brick / (bricks_x * bricks_y))} *
+           BRICK_SIZE;
+  }
+
+  [[nodiscard]] std::size_t index(const int i, const int j,
+                                  const int k) const noexcept {
+    constexpr int MASK{BRICK_SIZE - 1};
+    const std::size_t brick{
+        static_cast<std::size_t>(i >> BRICK_SIZE_LOG2) +
+        static_cast<std::size_t>(_num_bricks.x) *
+            (static_cast<std::size_t>(j >> BRICK_SIZE_LOG2) +
+             static_cast<std::size_t>(k >> BRICK_SIZE_LOG2) *
+                 static_cast<std::size_t>(_num_bricks.y))};
+    const auto offset{static_cast<std::size_t>(
+        (i & MASK) | ((j & MASK) << BRICK_SIZE_LOG2) |
+        ((k & MASK) << (2 * BRICK_SIZE_LOG2)))};
+    return brick * BRICK_ELEMENTS + offset;
+  }
+
+private:
+  glm::ivec3 _num_bricks;
+};
+
+} // namespace Gecko
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "io/mapped_file.hpp"
+#include "utils/aligned_memory.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace Gecko {
+
+// How memory owned by a FieldStorage is allocated
+enum class StoragePolicy {
+  // Aligned to FIELD_ALIGNMENT bytes
+  Aligned,
+  // Aligned to huge pages and backed by them where the OS supports it, fewer
+  // TLB misses when walking large fields
+  HugePages
+};
+
+// Contiguous block of elements backing a field. The memory is either owned by
+// the storage itself or borrowed from an external owner (e.g. a file mapping)
+// which is kept alive for as long as the storage references it.
+template <typename T> class FieldStorage {
+public:
+  FieldStorage() noexcept = default;
+
+  FieldStorage(FieldStorage &&other) noexcept
+      : _data{std::exchange(other._data, nullptr)},
+        _size{std::exchange(other._size, 0)}, _owner{std::move(other._owner)} {}
+
+  FieldStorage &operator=(FieldStorage &&other) noexcept {
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+    _owner = std::move(other._owner);
+    return *this;
+  }
+
+  // Not copyable, copies must be explicit through allocate()
+  FieldStorage(const FieldStorage &) = delete;
+  FieldStorage &operator=(const FieldStorage &) = delete;
+
+  // Factory functions
+  // Elements are default initialized, i.e. left uninitialized for trivial
+  // types, so that no pass over memory is made before they are written
+  [[nodiscard]] static FieldStorage
+  allocate(const std::size_t size,
+           const StoragePolicy policy = StoragePolicy::Aligned) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "FieldStorage elements must be trivially destructible");
+    std::shared_ptr<void> memory{
+        allocateAligned(size * sizeof(T), std::max(FIELD_ALIGNMENT, alignof(T)),
+                        policy == StoragePolicy::HugePages)};
+    T *const data{static_cast<T *>(memory.get())};
+    std::uninitialized_default_construct_n(data, size);
+    return {data, size, std::move(memory)};
+  }
+
+  [[nodiscard]] static FieldStorage
+  allocate(const std::size_t size, const T &value,
+           const StoragePolicy policy = StoragePolicy::Aligned) {
+    FieldStorage storage{allocate(size, policy)};
+    std::fill_n(storage.data(), size, value);
+    return storage;
+  }
+
+  // Storage backed by a new file, mapped shared so that the elements live in
+  // the page cache instead of anonymous memory. Elements start zeroed.
+  [[nodiscard]] static FieldStorage
+  createFileBacked(const std::string &filename, const std::size_t size) {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "File backed elements must be trivially copyable");
+    auto file{std::make_shared<MappedFile>(
+        MappedFile::createNewFile(filename, size * sizeof(T)))};
+    T *const data{reinterpret_cast<T *>(file->data())};
+    return {data, size, std::move(file)};
+  }
+
+  [[nodiscard]] static FieldStorage
+  wrap(T *data, const std::size_t size,
+       std::shared_ptr<const void> owner) noexcept {
+    return {data, size, std::move(owner)};
+  }
+
+  [[nodiscard]] T *data() noexcept { return _data; }
+  [[nodiscard]] const T *data() const noexcept { return _data; }
+  [[nodiscard]] std::size_t size() const noexcept { return _size; }
+
+  [[nodiscard]] T &operator[](const std::size_t i) noexcept {
+    return _data[i];
+  }
+  [[nodiscard]] const T &operator[](const std::size_t i) const noexcept {
+    return _data[i];
+  }
+
+private:
+  FieldStorage(T *data, const std::size_t size,
+               std::shared_ptr<const void> owner) noexcept
+      : _data{data}, _size{size}, _owner{std::move(owner)} {}
+
+  T *_data{nullptr};
+  std::size_t _size{0};
+  std::shared_ptr<const void> _owner;
+};
+
+} // namespace Gecko
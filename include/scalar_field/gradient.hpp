@@ -0,0 +1,83 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Gecko {
+
+// Compute normals (normalized gradients) for the z slices [z_begin, z_end) of
+// a field with the given size and voxel size. Central differences are used
+// inside the field and one sided differences on its borders, normals are zero
+// where the gradient vanishes.
+// `slices` points to the first element of slice `slices_z_begin` and must
+// cover slices [max(z_begin - 1, 0), min(z_end + 1, z_size)). Normals are
+// written in linear order starting from the first element of slice z_begin.
+template <typename T>
+void computeNormalSlices(const T *slices, const int slices_z_begin,
+                         const glm::ivec3 &num_elements,
+                         const glm::vec3 &voxel_size, const int z_begin,
+                         const int z_end, glm::vec3 *normals) {
+  const auto x_size{static_cast<std::size_t>(num_elements.x)};
+  const auto y_size{static_cast<std::size_t>(num_elements.y)};
+  const std::size_t slice_size{x_size * y_size};
+  const glm::vec3 inv_h{1.f / voxel_size};
+  const glm::vec3 inv_2h{0.5f / voxel_size};
+
+  // Each component is computed in its own contiguous row so that the inner
+  // loops vectorize, rows are interleaved and normalized at the end
+  std::vector<float> gx(x_size), gy(x_size), gz(x_size);
+  for (int k{z_begin}; k != z_end; ++k) {
+    const T *const slice{slices + static_cast<std::size_t>(k - slices_z_begin) *
+                                      slice_size};
+    const T *const slice_zm{k > 0 ? slice - slice_size : slice};
+    const T *const slice_zp{k < num_elements.z - 1 ? slice + slice_size
+                                                   : slice};
+    const float scale_z{k > 0 && k < num_elements.z - 1 ? inv_2h.z : inv_h.z};
+
+    for (std::size_t j{0}; j != y_size; ++j) {
+      const std::size_t row_offset{j * x_size};
+      const T *const row{slice + row_offset};
+      const T *const row_ym{j > 0 ? row - x_size : row};
+      const T *const row_yp{j < y_size - 1 ? row + x_size : row};
+      const float scale_y{j > 0 && j < y_size - 1 ? inv_2h.y : inv_h.y};
+      const T *const row_zm{slice_zm + row_offset};
+      const T *const row_zp{slice_zp + row_offset};
+
+      gx[0] = (static_cast<float>(row[1]) - static_cast<float>(row[0])) *
+              inv_h.x;
+      for (std::size_t i{1}; i < x_size - 1; ++i) {
+        gx[i] =
+            (static_cast<float>(row[i + 1]) - static_cast<float>(row[i - 1])) *
+            inv_2h.x;
+      }
+      gx[x_size - 1] = (static_cast<float>(row[x_size - 1]) -
+                        static_cast<float>(row[x_size - 2])) *
+                       inv_h.x;
+      for (std::size_t i{0}; i != x_size; ++i) {
+        gy[i] =
+            (static_cast<float>(row_yp[i]) - static_cast<float>(row_ym[i])) *
+            scale_y;
+        gz[i] =
+            (static_cast<float>(row_zp[i]) - static_cast<float>(row_zm[i])) *
+            scale_z;
+      }
+
+      glm::vec3 *const normal_row{
+          normals + static_cast<std::size_t>(k - z_begin) * slice_size +
+          row_offset};
+      for (std::size_t i{0}; i != x_size; ++i) {
+        const float length_squared{gx[i] * gx[i] + gy[i] * gy[i] +
+                                   gz[i] * gz[i]};
+        const float inv_length{
+            length_squared > 0.f ? 1.f / std::sqrt(length_squared) : 0.f};
+        normal_row[i] = glm::vec3{gx[i] * inv_length, gy[i] * inv_length,
+                                  gz[i] * inv_length};
+      }
+    }
+  }
+}
+
+} // namespace Gecko
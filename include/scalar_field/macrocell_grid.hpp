@@ -0,0 +1,192 @@
+#pragma once
+
+#include "scalar_field.hpp"
+#include "utils/parallel.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// Coarse grid storing the range of the values of a field in each cell, used
+// to skip regions of the volume that can not contribute to an image.
+// Along each axis cell c covers elements [c * cell_size, (c + 1) * cell_size],
+// the last one being shared with the next cell, so that the range bounds any
+// value linearly interpolated inside the cell. Ranges are stored as
+// (min, max), x fastest. Cells without data have min > max.
+class MacrocellGrid {
+public:
+  MacrocellGrid(const glm::ivec3 &num_elements, const int cell_size)
+      : _num_elements{num_elements}, _cell_size{std::max(1, cell_size)},
+        _num_cells{glm::max((num_elements - glm::ivec3{2}) /
+                                    glm::ivec3{_cell_size} +
+                                glm::ivec3{1},
+                            glm::ivec3{1})},
+        _ranges(static_cast<std::size_t>(_num_cells.x) *
+                    static_cast<std::size_t>(_num_cells.y) *
+                    static_cast<std::size_t>(_num_cells.z),
+                glm::vec2{std::numeric_limits<float>::max(),
+                          std::numeric_limits<float>::lowest()}) {}
+
+  // Factory functions
+  // Reduce the whole field, in parallel over layers of cells along z
+  template <typename T, typename Layout>
+  [[nodiscard]] static MacrocellGrid
+  createFromField(const ScalarField<T, Layout> &field, const int cell_size) {
+    MacrocellGrid grid{glm::ivec3{field.xSize(), field.ySize(), field.zSize()},
+                       cell_size};
+    parallelFor(0, static_cast<std::size_t>(grid._num_cells.z),
+                [&](const std::size_t first, const std::size_t last) -> void {
+                  for (auto cz{static_cast<int>(first)};
+                       cz != static_cast<int>(last); ++cz) {
+                    grid.computeLayer(
+                        cz, 0, field.zSize(),
+                        [&field](const int i, const int j, const int k) {
+                          return field(i, j, k);
+                        },
+                        grid._ranges.data() + grid.layerOffset(cz));
+                  }
+                });
+    return grid;
+  }
+
+  [[nodiscard]] const glm::ivec3 &numCells() const noexcept {
+    return _num_cells;
+  }
+  [[nodiscard]] int cellSize() const noexcept { return _cell_size; }
+  [[nodiscard]] const glm::vec2 *data() const noexcept {
+    return _ranges.data();
+  }
+
+  [[nodiscard]] std::size_t layerCells() const noexcept {
+    return static_cast<std::size_t>(_num_cells.x) *
+           static_cast<std::size_t>(_num_cells.y);
+  }
+
+  // Layers of cells [first, second) covering any of the z slices
+  // [z_begin, z_end)
+  [[nodiscard]] std::pair<int, int> cellLayers(const int z_begin,
+                                               const int z_end) const noexcept {
+    return {std::min(std::max(z_begin - 1, 0) / _cell_size, _num_cells.z - 1),
+            std::min((z_end - 1) / _cell_size + 1, _num_cells.z)};
+  }
+
+  // Box of cells [first, second) covering any of the elements [begin, end)
+  [[nodiscard]] std::pair<glm::ivec3, glm::ivec3>
+  cellRange(const glm::ivec3 &begin, const glm::ivec3 &end) const noexcept {
+    return {glm::min(glm::max(begin - glm::ivec3{1}, glm::ivec3{0}) /
+                         glm::ivec3{_cell_size},
+                     _num_cells - glm::ivec3{1}),
+            glm::min((end - glm::ivec3{1}) / glm::ivec3{_cell_size} +
+                         glm::ivec3{1},
+                     _num_cells)};
+  }
+
+  [[nodiscard]] std::size_t cellIndex(const glm::ivec3 &cell) const noexcept {
+    return static_cast<std::size_t>(cell.x) +
+           static_cast<std::size_t>(_num_cells.x) *
+               static_cast<std::size_t>(cell.y) +
+           layerOffset(cell.z);
+  }
+
+  // Recompute the range of a cell from access(i, j, k) over the whole field,
+  // for fields changing in place. Different cells can be updated
+  // concurrently.
+  template <typename Access>
+  void updateCell(const glm::ivec3 &cell, const Access &access) {
+    _ranges[cellIndex(cell)] = computeCell(
+        cell.x, cell.y, cell.z * _cell_size,
+        std::min((cell.z + 1) * _cell_size, _num_elements.z - 1), access);
+  }
+
+  // Compute the ranges of the cell layers covering z slices [z_begin, z_end)
+  // only from the values of those slices, given in linear order. The result
+  // for cellLayers(z_begin, z_end) is written to ranges and can be merged
+  // into the grid with mergeLayers().
+  void computeSlabRanges(const float *slices, const int z_begin,
+                         const int z_end, glm::vec2 *ranges) const {
+    const auto [layer_begin, layer_end]{cellLayers(z_begin, z_end)};
+    const auto x_size{static_cast<std::size_t>(_num_elements.x)};
+    const auto y_size{static_cast<std::size_t>(_num_elements.y)};
+    const auto access{[&](const int i, const int j, const int k) -> float {
+      return slices[static_cast<std::size_t>(i) +
+                    x_size * (static_cast<std::size_t>(j) +
+                              static_cast<std::size_t>(k - z_begin) * y_size)];
+    }};
+    for (int cz{layer_begin}; cz != layer_end; ++cz) {
+      computeLayer(cz, z_begin, z_end, access,
+                   ranges + static_cast<std::size_t>(cz - layer_begin) *
+                                layerCells());
+    }
+  }
+
+  // Merge ranges of the cell layers [layer_begin, layer_end)
+  void mergeLayers(const int layer_begin, const int layer_end,
+                   const glm::vec2 *ranges) noexcept {
+    glm::vec2 *const layers{_ranges.data() + layerOffset(layer_begin)};
+    const std::size_t count{static_cast<std::size_t>(layer_end - layer_begin) *
+                            layerCells()};
+    for (std::size_t c{0}; c != count; ++c) {
+      layers[c].x = std::min(layers[c].x, ranges[c].x);
+      layers[c].y = std::max(layers[c].y, ranges[c].y);
+    }
+  }
+
+private:
+  [[nodiscard]] std::size_t layerOffset(const int cz) const noexcept {
+    return static_cast<std::size_t>(cz) * layerCells();
+  }
+
+  // Ranges of the cells in layer cz, only accounting for z slices in
+  // [z_begin, z_end)
+  template <typename Access>
+  void computeLayer(const int cz, const int z_begin, const int z_end,
+                    const Access &access, glm::vec2 *ranges) const {
+    const int k_first{std::max(cz * _cell_size, z_begin)};
+    const int k_last{
+        std::min({(cz + 1) * _cell_size, _num_elements.z - 1, z_end - 1})};
+    for (int cy{0}; cy != _num_cells.y; ++cy) {
+      for (int cx{0}; cx != _num_cells.x; ++cx) {
+        ranges[static_cast<std::size_t>(cx) +
+               static_cast<std::size_t>(cy) *
+                   static_cast<std::size_t>(_num_cells.x)] =
+            computeCell(cx, cy, k_first, k_last, access);
+      }
+    }
+  }
+
+  // Range of cell (cx, cy) over z slices [k_first, k_last]
+  template <typename Access>
+  [[nodiscard]] glm::vec2 computeCell(const int cx, const int cy,
+                                      const int k_first, const int k_last,
+                                      const Access &access) const {
+    const int j_first{cy * _cell_size};
+    const int j_last{std::min((cy + 1) * _cell_size, _num_elements.y - 1)};
+    const int i_first{cx * _cell_size};
+    const int i_last{std::min((cx + 1) * _cell_size, _num_elements.x - 1)};
+    glm::vec2 range{std::numeric_limits<float>::max(),
+                    std::numeric_limits<float>::lowest()};
+    for (int k{k_first}; k <= k_last; ++k) {
+      for (int j{j_first}; j <= j_last; ++j) {
+        for (int i{i_first}; i <= i_last; ++i) {
+          const auto value{static_cast<float>(access(i, j, k))};
+          range.x = std::min(range.x, value);
+          range.y = std::max(range.y, value);
+        }
+      }
+    }
+    return range;
+  }
+
+  glm::ivec3 _num_elements;
+  int _cell_size;
+  glm::ivec3 _num_cells;
+  std::vector<glm::vec2> _ranges;
+};
+
+} // namespace Gecko
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "utils/parallel.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace Gecko {
+
+// Texture formats normals can be stored in on the GPU. Octahedral formats
+// store unit vectors as two signed normalized components.
+enum class NormalFormat { Float32, Octahedral16, Octahedral8 };
+
+// Component type used on the CPU for each octahedral format
+template <NormalFormat FORMAT> struct NormalFormatTraits;
+
+template <> struct NormalFormatTraits<NormalFormat::Octahedral16> {
+  using Type = std::int16_t;
+};
+
+template <> struct NormalFormatTraits<NormalFormat::Octahedral8> {
+  using Type = std::int8_t;
+};
+
+// Components of the encodings below which both must be for the zero vector,
+// half a 16 bit level from the corner (-1, -1) so that texture filtering
+// between equal encodings does not move them out
+constexpr float OCTAHEDRAL_ZERO_LIMIT{-1.f + 0.5f / 32767.f};
+
+// Map a direction to the octahedron |x| + |y| + |z| = 1 and unfold the lower
+// half over the corners, giving a point in [-1, 1]^2. Zero vectors map to the
+// corner (-1, -1), out of band: every corner decodes to -z and -z itself
+// maps to (1, 1).
+[[nodiscard]] inline glm::vec2 encodeOctahedral(const glm::vec3 &n) noexcept {
+  const float l1{std::abs(n.x) + std::abs(n.y) + std::abs(n.z)};
+  if (l1 == 0.f) {
+    return glm::vec2{-1.f};
+  }
+  const glm::vec2 p{glm::vec2{n.x, n.y} / l1};
+  if (n.z >= 0.f) {
+    return p;
+  }
+  return glm::vec2{(1.f - std::abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f),
+                   (1.f - std::abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f)};
+}
+
+// Inverse of encodeOctahedral(), same as the decoding in the shaders. The
+// zero vector decodes to zero, as the CPU raymarcher takes vanishing float
+// normals.
+[[nodiscard]] inline glm::vec3 decodeOctahedral(const glm::vec2 &e) noexcept {
+  if (e.x < OCTAHEDRAL_ZERO_LIMIT && e.y < OCTAHEDRAL_ZERO_LIMIT) {
+    return glm::vec3{0.f};
+  }
+  glm::vec3 n{e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y)};
+  const float t{std::max(-n.z, 0.f)};
+  n.x += n.x >= 0.f ? -t : t;
+  n.y += n.y >= 0.f ? -t : t;
+  return glm::normalize(n);
+}
+
+// Encode count normals to interleaved pairs of signed normalized components,
+// rounding to nearest
+template <NormalFormat FORMAT>
+void encodeNormals(const glm::vec3 *normals, const std::size_t count,
+                   typename NormalFormatTraits<FORMAT>::Type *encoded) {
+  using Type = typename NormalFormatTraits<FORMAT>::Type;
+  constexpr Type MAX_LEVEL{std::numeric_limits<Type>::max()};
+  for (std::size_t e{0}; e != count; ++e) {
+    const glm::vec2 p{encodeOctahedral(normals[e]) *
+                      static_cast<float>(MAX_LEVEL)};
+    auto x{static_cast<Type>(std::round(p.x))};
+    auto y{static_cast<Type>(std::round(p.y))};
+    // Directions rounded to the corner of the zero vector are -z, moved to
+    // another corner
+    if (x == -MAX_LEVEL && y == -MAX_LEVEL && normals[e] != glm::vec3{0.f}) {
+      x = y = MAX_LEVEL;
+    }
+    encoded[2 * e] = x;
+    encoded[2 * e + 1] = y;
+  }
+}
+
+// Same as above for a format known at run time, encoded points to elements of
+// the format. Float32 normals are copied.
+inline void encodeNormals(const NormalFormat format, const glm::vec3 *normals,
+                          const std::size_t count, void *encoded) {
+  switch (format) {
+  case NormalFormat::Octahedral16: {
+    encodeNormals<NormalFormat::Octahedral16>(
+        normals, count, static_cast<std::int16_t *>(encoded));
+    break;
+  }
+  case NormalFormat::Octahedral8: {
+    encodeNormals<NormalFormat::Octahedral8>(
+        normals, count, static_cast<std::int8_t *>(encoded));
+    break;
+  }
+  default: {
+    std::copy_n(normals, count, static_cast<glm::vec3 *>(encoded));
+    break;
+  }
+  }
+}
+
+// Encode count normals in parallel over chunks
+template <NormalFormat FORMAT>
+void encodeNormalsParallel(const glm::vec3 *normals, const std::size_t count,
+                           typename NormalFormatTraits<FORMAT>::Type *encoded) {
+  constexpr static std::size_t CHUNK_SIZE{1u << 16u};
+  parallelFor(0, (count + CHUNK_SIZE - 1) / CHUNK_SIZE,
+              [&](const std::size_t first, const std::size_t last) -> void {
+                const std::size_t begin{first * CHUNK_SIZE};
+                const std::size_t end{std::min(last * CHUNK_SIZE, count)};
+                encodeNormals<FORMAT>(normals + begin, end - begin,
+                                      encoded + 2 * begin);
+              });
+}
+
+} // namespace Gecko
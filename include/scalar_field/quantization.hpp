@@ -0,0 +1,253 @@
+#pragma once
+
+#include "scalar_field.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+// IEEE 754 binary16 value, only used for storage, arithmetic goes through
+// float
+class Half {
+public:
+  Half() noexcept = default;
+
+  explicit Half(const float value) noexcept : _bits{fromFloat(value)} {}
+
+  explicit operator float() const noexcept { return toFloat(_bits); }
+
+  // Half of the given binary16 encoding
+  [[nodiscard]] static Half fromBits(const std::uint16_t bits) noexcept {
+    Half half;
+    half._bits = bits;
+    return half;
+  }
+
+  [[nodiscard]] std::uint16_t bits() const noexcept { return _bits; }
+
+private:
+  // Round to nearest even, overflows to infinity, NaNs stay NaNs
+  [[nodiscard]] static std::uint16_t fromFloat(const float value) noexcept {
+    std::uint32_t f;
+    std::memcpy(&f, &value, sizeof(f));
+    const auto sign{static_cast<std::uint16_t>((f >> 16u) & 0x8000u)};
+    const std::uint32_t abs{f & 0x7FFFFFFFu};
+    if (abs >= 0x7F800000u) {
+      // Infinity or NaN
+      return static_cast<std::uint16_t>(sign | 0x7C00u |
+                                        (abs > 0x7F800000u ? 0x200u : 0u));
+    }
+    if (abs >= 0x477FF000u) {
+      // Rounds to a value above the largest half
+      return static_cast<std::uint16_t>(sign | 0x7C00u);
+    }
+    if (abs < 0x38800000u) {
+      // Subnormal half, shift the mantissa with the implicit bit in place
+      const std::uint32_t exponent{abs >> 23u};
+      if (exponent < 102u) {
+        return sign;
+      }
+      const std::uint32_t mantissa{(abs & 0x7FFFFFu) | 0x800000u};
+      const std::uint32_t shift{126u - exponent};
+      const std::uint32_t half_mantissa{mantissa >> shift};
+      const std::uint32_t remainder{mantissa & ((1u << shift) - 1u)};
+      const std::uint32_t halfway{1u << (shift - 1u)};
+      const std::uint32_t round_up{
+          remainder > halfway ||
+          (remainder == halfway && (half_mantissa & 1u) != 0u)};
+      return static_cast<std::uint16_t>(sign | (half_mantissa + round_up));
+    }
+    // Normal half, rebias the exponent and round the mantissa, a carry into
+    // the exponent gives the right result
+    const std::uint32_t rebiased{abs - 0x38000000u};
+    const std::uint32_t round_up{
+        (rebiased & 0x1FFFu) > 0x1000u ||
+        ((rebiased & 0x1FFFu) == 0x1000u && (rebiased & 0x2000u) != 0u)};
+    return static_cast<std::uint16_t>(sign | ((rebiased >> 13u) + round_up));
+  }
+
+  [[nodiscard]] static float toFloat(const std::uint16_t bits) noexcept {
+    const std::uint32_t sign{(static_cast<std::uint32_t>(bits) & 0x8000u)
+                             << 16u};
+    const std::uint32_t exponent{(bits >> 10u) & 0x1Fu};
+    const std::uint32_t mantissa{bits & 0x3FFu};
+    std::uint32_t f;
+    if (exponent == 0x1Fu) {
+      f = sign | 0x7F800000u | (mantissa << 13u);
+    } else if (exponent != 0u) {
+      f = sign | ((exponent + 112u) << 23u) | (mantissa << 13u);
+    } else {
+      // Zero or subnormal, exact in float
+      const float magnitude{std::ldexp(static_cast<float>(mantissa), -24)};
+      return sign != 0u ? -magnitude : magnitude;
+    }
+    float value;
+    std::memcpy(&value, &f, sizeof(value));
+    return value;
+  }
+
+  std::uint16_t _bits{0};
+};
+
+// Texture formats a scalar volume can be stored in on the GPU, normalized
+// integer formats are mapped to [0, 1] when sampled
+enum class VolumeFormat { Float32, Float16, UNorm16, UNorm8 };
+
+// Element type used on the CPU for each quantized format
+template <VolumeFormat FORMAT> struct VolumeFormatTraits;
+
+template <> struct VolumeFormatTraits<VolumeFormat::Float16> {
+  using Type = Half;
+};
+
+template <> struct VolumeFormatTraits<VolumeFormat::UNorm16> {
+  using Type = std::uint16_t;
+};
+
+template <> struct VolumeFormatTraits<VolumeFormat::UNorm8> {
+  using Type = std::uint8_t;
+};
+
+// Field stored with a reduced precision element type. The value of an element
+// is recovered as stored * scale + offset, where stored is normalized to
+// [0, 1] for integer types as the GPU does when sampling.
+template <VolumeFormat FORMAT> struct QuantizedField {
+  using Type = typename VolumeFormatTraits<FORMAT>::Type;
+
+  ScalarField<Type> field;
+  float scale, offset;
+};
+
+// Range of the values in a field, reduced in parallel over z slices
+[[nodiscard]] inline std::pair<float, float>
+computeValueRange(const ScalarField<float> &field) {
+  const std::size_t slice_elements{static_cast<std::size_t>(field.xSize()) *
+                                   static_cast<std::size_t>(field.ySize())};
+  const auto num_slices{static_cast<std::size_t>(field.zSize())};
+  std::vector<std::pair<float, float>> slice_ranges(num_slices);
+  parallelFor(0, num_slices,
+              [&](const std::size_t first, const std::size_t last) -> void {
+                for (std::size_t k{first}; k != last; ++k) {
+                  const auto [slice_min, slice_max]{std::minmax_element(
+                      field.data() + k * slice_elements,
+                      field.data() + (k + 1) * slice_elements)};
+                  slice_ranges[k] = {*slice_min, *slice_max};
+                }
+              });
+  std::pair<float, float> range{std::numeric_limits<float>::max(),
+                                std::numeric_limits<float>::lowest()};
+  for (const auto &[slice_min, slice_max] : slice_ranges) {
+    range.first = std::min(range.first, slice_min);
+    range.second = std::max(range.second, slice_max);
+  }
+  return range;
+}
+
+// True for formats storing values normalized to [0, 1]
+[[nodiscard]] constexpr bool
+isNormalizedFormat(const VolumeFormat format) noexcept {
+  return format == VolumeFormat::UNorm16 || format == VolumeFormat::UNorm8;
+}
+
+// Scale and offset mapping a value range to the stored values of a format,
+// as (scale, offset). Normalized formats use their full range, float formats
+// store values unchanged.
+[[nodiscard]] inline std::pair<float, float>
+computeQuantization(const VolumeFormat format,
+                    const std::pair<float, float> &value_range) noexcept {
+  if (isNormalizedFormat(format)) {
+    return {value_range.second - value_range.first, value_range.first};
+  }
+  return {1.f, 0.f};
+}
+
+// Quantize count values given the (scale, offset) of the format, with
+// rounding to nearest. Values outside the range are clamped.
+template <VolumeFormat FORMAT>
+void quantizeValues(const float *values, const std::size_t count,
+                    const std::pair<float, float> &quantization,
+                    typename VolumeFormatTraits<FORMAT>::Type *stored) {
+  using Type = typename VolumeFormatTraits<FORMAT>::Type;
+  if constexpr (isNormalizedFormat(FORMAT)) {
+    constexpr auto MAX_LEVEL{
+        static_cast<float>(std::numeric_limits<Type>::max())};
+    const auto [scale, offset]{quantization};
+    const float inv_step{scale > 0.f ? MAX_LEVEL / scale : 0.f};
+    for (std::size_t e{0}; e != count; ++e) {
+      const float level{
+          std::clamp((values[e] - offset) * inv_step, 0.f, MAX_LEVEL)};
+      stored[e] = static_cast<Type>(level + 0.5f);
+    }
+  } else {
+    for (std::size_t e{0}; e != count; ++e) {
+      stored[e] = Type{values[e]};
+    }
+  }
+}
+
+// Same as above for a format known at run time, stored points to elements of
+// the format. Float32 values are copied.
+inline void quantizeValues(const VolumeFormat format, const float *values,
+                           const std::size_t count,
+                           const std::pair<float, float> &quantization,
+                           void *stored) {
+  switch (format) {
+  case VolumeFormat::Float16: {
+    quantizeValues<VolumeFormat::Float16>(values, count, quantization,
+                                          static_cast<Half *>(stored));
+    break;
+  }
+  case VolumeFormat::UNorm16: {
+    quantizeValues<VolumeFormat::UNorm16>(
+        values, count, quantization, static_cast<std::uint16_t *>(stored));
+    break;
+  }
+  case VolumeFormat::UNorm8: {
+    quantizeValues<VolumeFormat::UNorm8>(values, count, quantization,
+                                         static_cast<std::uint8_t *>(stored));
+    break;
+  }
+  default: {
+    std::copy_n(values, count, static_cast<float *>(stored));
+    break;
+  }
+  }
+}
+
+// Quantize a field in parallel over z slices, the value range is mapped to
+// the full range of integer formats
+template <VolumeFormat FORMAT>
+[[nodiscard]] QuantizedField<FORMAT>
+quantize(const ScalarField<float> &field,
+         const std::pair<float, float> &value_range) {
+  using Type = typename VolumeFormatTraits<FORMAT>::Type;
+  auto quantized{ScalarField<Type>::createUninitialized(
+      field.min(), field.max(), field.xSize(), field.ySize(), field.zSize())};
+  const std::pair<float, float> quantization{
+      computeQuantization(FORMAT, value_range)};
+  const std::size_t slice_elements{static_cast<std::size_t>(field.xSize()) *
+                                   static_cast<std::size_t>(field.ySize())};
+  parallelFor(0, static_cast<std::size_t>(field.zSize()),
+              [&](const std::size_t first, const std::size_t last) -> void {
+                quantizeValues<FORMAT>(
+                    field.data() + first * slice_elements,
+                    (last - first) * slice_elements, quantization,
+                    quantized.data() + first * slice_elements);
+              });
+  return {std::move(quantized), quantization.first, quantization.second};
+}
+
+template <VolumeFormat FORMAT>
+[[nodiscard]] QuantizedField<FORMAT>
+quantize(const ScalarField<float> &field) {
+  return quantize<FORMAT>(field, computeValueRange(field));
+}
+
+} // namespace Gecko
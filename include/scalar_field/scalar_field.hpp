@@ -1,15 +1,29 @@
 #pragma once
 
+#include "field_layout.hpp"
+#include "field_storage.hpp"
+#include "gradient.hpp"
+#include "trilinear_simd.hpp"
+#include "utils/parallel.hpp"
+
 #include "glm/glm.hpp"
 #include "glm/gtx/transform.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 namespace Gecko {
 
-template <typename T> class ScalarField {
+// Field of elements on a regular grid. Layout selects how elements are ordered
+// in the storage, data() and the storage based factories follow that order.
+template <typename T, typename Layout = LinearLayout> class ScalarField {
 public:
   [[nodiscard]] static ScalarField
   createFromMinMax(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
@@ -20,6 +34,20 @@ public:
                          const glm::vec3 &voxel_size, int x_size, int y_size,
                          int z_size, const T &default_value);
 
+  // Create a field whose elements are left uninitialized, for when all of them
+  // are about to be written anyway
+  [[nodiscard]] static ScalarField
+  createUninitialized(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+                      int x_size, int y_size, int z_size,
+                      StoragePolicy policy = StoragePolicy::Aligned);
+
+  // Create a field on top of existing storage without copying it, the storage
+  // must hold at least Layout::storageSize() elements in layout order
+  [[nodiscard]] static ScalarField
+  createFromStorage(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+                    int x_size, int y_size, int z_size,
+                    FieldStorage<T> storage);
+
   ScalarField(const ScalarField &other);
   ScalarField(ScalarField &&) noexcept = default;
   ScalarField &operator=(ScalarField &&) noexcept = default;
@@ -45,21 +73,21 @@ public:
 
   [[nodiscard]] T &at(const int i, const int j, const int k) {
     checkIndex(i, j, k);
-    return _elements[static_cast<std::size_t>(computeLinearIndex(i, j, k))];
+    return _elements[computeStorageIndex(i, j, k)];
   }
 
   [[nodiscard]] const T &at(const int i, const int j, const int k) const {
     checkIndex(i, j, k);
-    return _elements[static_cast<std::size_t>(computeLinearIndex(i, j, k))];
+    return _elements[computeStorageIndex(i, j, k)];
   }
 
   [[nodiscard]] T &operator()(const int i, const int j, const int k) noexcept {
-    return _elements[static_cast<std::size_t>(computeLinearIndex(i, j, k))];
+    return _elements[computeStorageIndex(i, j, k)];
   }
 
   [[nodiscard]] const T &operator()(const int i, const int j,
                                     const int k) const noexcept {
-    return _elements[static_cast<std::size_t>(computeLinearIndex(i, j, k))];
+    return _elements[computeStorageIndex(i, j, k)];
   }
 
   [[nodiscard]] glm::vec3 computeDiagonal() const noexcept {
@@ -86,8 +114,48 @@ public:
     return computePosition(i, j, k);
   }
 
-  [[nodiscard]] T *data() noexcept { return _elements.get(); }
-  [[nodiscard]] const T *data() const noexcept { return _elements.get(); }
+  [[nodiscard]] T *data() noexcept { return _elements.data(); }
+  [[nodiscard]] const T *data() const noexcept { return _elements.data(); }
+
+  // Trilinear interpolation of the field at a world space position, positions
+  // outside of the bounds are clamped to the border elements and NaN
+  // coordinates to the first element. Integer fields round to the nearest.
+  [[nodiscard]] T sample(const glm::vec3 &position) const noexcept;
+
+  // Sample count positions at once, linear float fields use SIMD gathers when
+  // built with AVX2
+  void sample(const glm::vec3 *positions, std::size_t count,
+              T *values) const noexcept;
+
+  [[nodiscard]] const Layout &layout() const noexcept { return _layout; }
+
+  // Number of elements in the storage, including the layout padding
+  [[nodiscard]] std::size_t storageSize() const noexcept {
+    return _layout.storageSize();
+  }
+
+  // Copy of the field with a different layout, e.g. to a linear one before
+  // uploading it to the GPU
+  template <typename OtherLayout>
+  [[nodiscard]] ScalarField<T, OtherLayout> convertLayout() const;
+
+  // Call func(brick_origin, brick_elements) for each brick of a bricked
+  // field, in storage order. Elements are x fastest inside a brick and the
+  // ones past the field size are padding.
+  template <typename Func> void forEachBrick(Func &&func) const {
+    for (std::size_t b{0}; b != _layout.totalBricks(); ++b) {
+      func(_layout.brickOrigin(b), data() + Layout::brickOffset(b));
+    }
+  }
+  template <typename Func> void forEachBrick(Func &&func) {
+    for (std::size_t b{0}; b != _layout.totalBricks(); ++b) {
+      func(_layout.brickOrigin(b), data() + Layout::brickOffset(b));
+    }
+  }
+
+  // Per element normals from the central difference gradient of the field,
+  // computed in parallel over z slices. Linear layout only.
+  [[nodiscard]] FieldStorage<glm::vec3> computeNormals() const;
 
   // Cube data for OpenGL buffers to draw which reflects the model matrix
   // returned
@@ -110,9 +178,23 @@ public:
                                                              6, 4, 5, 6, 5, 7};
 
 private:
+  template <typename, typename> friend class ScalarField;
+
   ScalarField(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
               int x_size, int y_size, int z_size, const T &default_value);
 
+  ScalarField(const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+              int x_size, int y_size, int z_size, FieldStorage<T> storage);
+
+  // Call func(slab_first, slab_last) in parallel over ranges of layout slabs.
+  // All the parallel passes over the field share this split and run each
+  // range on the same pinned worker, the last one on the calling thread, so
+  // each thread works on the pages it touched first, which the OS places on
+  // the thread's NUMA node.
+  template <typename Func> void parallelForSlabs(Func &&func) const {
+    parallelForPinned(0, _layout.numSlabs(), std::forward<Func>(func));
+  }
+
   void checkIndex(const int i, const int j, const int k) const {
     if (i >= xSize() || i < 0 || j >= ySize() || j < 0 || k >= zSize() ||
         k < 0) {
@@ -132,9 +214,10 @@ private:
     }
   }
 
-  [[nodiscard]] int computeLinearIndex(const int i, const int j,
-                                       const int k) const noexcept {
-    return i + xSize() * (j + k * ySize());
+  // Computed in 64 bits, fields above 2^31 elements are common
+  [[nodiscard]] std::size_t computeStorageIndex(const int i, const int j,
+                                                const int k) const noexcept {
+    return _layout.index(i, j, k);
   }
 
   [[nodiscard]] glm::vec3 computePosition(const int i, const int j,
@@ -147,11 +230,12 @@ private:
   glm::vec3 _bounds_min, _bounds_max;
   glm::ivec3 _num_elements;
   glm::vec3 _voxel_size;
-  std::unique_ptr<T[]> _elements;
+  Layout _layout;
+  FieldStorage<T> _elements;
 };
 
-template <typename T>
-ScalarField<T> ScalarField<T>::createFromMinMax(
+template <typename T, typename Layout>
+ScalarField<T, Layout> ScalarField<T, Layout>::createFromMinMax(
     const glm::vec3 &bounds_min, const glm::vec3 &bounds_max, const int x_size,
     const int y_size, const int z_size, const T &default_value) {
   checkSize(x_size, y_size, z_size);
@@ -159,8 +243,8 @@ ScalarField<T> ScalarField<T>::createFromMinMax(
   return {bounds_min, bounds_max, x_size, y_size, z_size, default_value};
 }
 
-template <typename T>
-ScalarField<T> ScalarField<T>::createFromMinVoxelSize(
+template <typename T, typename Layout>
+ScalarField<T, Layout> ScalarField<T, Layout>::createFromMinVoxelSize(
     const glm::vec3 &bounds_min, const glm::vec3 &voxel_size, const int x_size,
     const int y_size, const int z_size, const T &default_value) {
   checkSize(x_size, y_size, z_size);
@@ -177,11 +261,58 @@ ScalarField<T> ScalarField<T>::createFromMinVoxelSize(
           default_value};
 }
 
-template <typename T>
-ScalarField<T>::ScalarField(const glm::vec3 &bounds_min,
-                            const glm::vec3 &bounds_max, const int x_size,
-                            const int y_size, const int z_size,
-                            const T &default_value)
+template <typename T, typename Layout>
+ScalarField<T, Layout> ScalarField<T, Layout>::createUninitialized(
+    const glm::vec3 &bounds_min, const glm::vec3 &bounds_max, const int x_size,
+    const int y_size, const int z_size, const StoragePolicy policy) {
+  checkSize(x_size, y_size, z_size);
+  checkBounds(bounds_min, bounds_max);
+  return {bounds_min,
+          bounds_max,
+          x_size,
+          y_size,
+          z_size,
+          FieldStorage<T>::allocate(
+              Layout{glm::ivec3{x_size, y_size, z_size}}.storageSize(),
+              policy)};
+}
+
+template <typename T, typename Layout>
+ScalarField<T, Layout> ScalarField<T, Layout>::createFromStorage(
+    const glm::vec3 &bounds_min, const glm::vec3 &bounds_max, const int x_size,
+    const int y_size, const int z_size, FieldStorage<T> storage) {
+  checkSize(x_size, y_size, z_size);
+  checkBounds(bounds_min, bounds_max);
+  if (storage.size() <
+      Layout{glm::ivec3{x_size, y_size, z_size}}.storageSize()) {
+    throw std::runtime_error{"Storage too small for Scalar field size"};
+  }
+  return {bounds_min, bounds_max, x_size, y_size, z_size, std::move(storage)};
+}
+
+template <typename T, typename Layout>
+ScalarField<T, Layout>::ScalarField(const glm::vec3 &bounds_min,
+                                    const glm::vec3 &bounds_max,
+                                    const int x_size, const int y_size,
+                                    const int z_size, const T &default_value)
+    : ScalarField{bounds_min, bounds_max, x_size, y_size, z_size,
+                  FieldStorage<T>::allocate(
+                      Layout{glm::ivec3{x_size, y_size, z_size}}
+                          .storageSize())} {
+  // First touch happens here, fill in parallel so pages are spread
+  const std::size_t slab_elements{_layout.slabElements()};
+  parallelForSlabs([&](const std::size_t first,
+                       const std::size_t last) -> void {
+    std::fill(data() + first * slab_elements, data() + last * slab_elements,
+              default_value);
+  });
+}
+
+template <typename T, typename Layout>
+ScalarField<T, Layout>::ScalarField(const glm::vec3 &bounds_min,
+                                    const glm::vec3 &bounds_max,
+                                    const int x_size, const int y_size,
+                                    const int z_size, FieldStorage<T> storage)
     : _bounds_min{bounds_min}, _bounds_max{bounds_max}, _num_elements{x_size,
                                                                       y_size,
                                                                       z_size},
@@ -189,20 +320,113 @@ ScalarField<T>::ScalarField(const glm::vec3 &bounds_min,
                   glm::vec3{static_cast<float>(_num_elements.x - 1),
                             static_cast<float>(_num_elements.y - 1),
                             static_cast<float>(_num_elements.z - 1)}},
-      _elements{new T[totalElements()]} {
-  for (std::size_t i{0}; i != totalElements(); ++i) {
-    _elements[i] = default_value;
+      _layout{_num_elements}, _elements{std::move(storage)} {}
+
+template <typename T, typename Layout>
+ScalarField<T, Layout>::ScalarField(const ScalarField &other)
+    : _bounds_min{other._bounds_min}, _bounds_max{other._bounds_max},
+      _num_elements{other._num_elements}, _voxel_size{other._voxel_size},
+      _layout{other._layout}, _elements{FieldStorage<T>::allocate(
+                                  other.storageSize())} {
+  const std::size_t slab_elements{_layout.slabElements()};
+  parallelForSlabs([&](const std::size_t first,
+                       const std::size_t last) -> void {
+    std::copy(other.data() + first * slab_elements,
+              other.data() + last * slab_elements,
+              data() + first * slab_elements);
+  });
+}
+
+template <typename T, typename Layout>
+template <typename OtherLayout>
+ScalarField<T, OtherLayout> ScalarField<T, Layout>::convertLayout() const {
+  auto converted{ScalarField<T, OtherLayout>::createUninitialized(
+      min(), max(), xSize(), ySize(), zSize())};
+  // Padding of the new layout is left uninitialized, it is never read
+  parallelFor(0, static_cast<std::size_t>(zSize()),
+              [&](const std::size_t first, const std::size_t last) -> void {
+                for (auto k{static_cast<int>(first)};
+                     k != static_cast<int>(last); ++k) {
+                  for (int j{0}; j != ySize(); ++j) {
+                    for (int i{0}; i != xSize(); ++i) {
+                      converted(i, j, k) = (*this)(i, j, k);
+                    }
+                  }
+                }
+              });
+  return converted;
+}
+
+template <typename T, typename Layout>
+T ScalarField<T, Layout>::sample(const glm::vec3 &position) const noexcept {
+  // Continuous index clamped to the field, like GL_CLAMP_TO_EDGE. The
+  // comparison is false for NaN, which ends up at 0 as in the AVX2 path
+  // instead of being converted to int
+  const glm::vec3 upper{_num_elements - glm::ivec3{1}};
+  glm::vec3 u{(position - min()) / getVoxelSize()};
+  for (int c{0}; c != 3; ++c) {
+    u[c] = u[c] > 0.f ? std::min(u[c], upper[c]) : 0.f;
+  }
+  const glm::ivec3 base{
+      glm::min(glm::ivec3{glm::floor(u)}, _num_elements - glm::ivec3{2})};
+  const glm::vec3 t{u - glm::vec3{base}};
+  const auto value{[&](const int di, const int dj, const int dk) -> float {
+    return static_cast<float>((*this)(base.x + di, base.y + dj, base.z + dk));
+  }};
+  const auto lerp{[](const float a, const float b, const float w) -> float {
+    return a + w * (b - a);
+  }};
+
+  const float c00{lerp(value(0, 0, 0), value(1, 0, 0), t.x)};
+  const float c10{lerp(value(0, 1, 0), value(1, 1, 0), t.x)};
+  const float c01{lerp(value(0, 0, 1), value(1, 0, 1), t.x)};
+  const float c11{lerp(value(0, 1, 1), value(1, 1, 1), t.x)};
+  const float result{
+      lerp(lerp(c00, c10, t.y), lerp(c01, c11, t.y), t.z)};
+  if constexpr (std::is_integral_v<T>) {
+    // Nearest value, truncating would bias integer fields downwards
+    return static_cast<T>(std::round(result));
+  } else {
+    return static_cast<T>(result);
   }
 }
 
-template <typename T>
-ScalarField<T>::ScalarField(const ScalarField &other)
-    : _bounds_min{other._bounds_min}, _bounds_max{other._bounds_max},
-      _num_elements{other._num_elements},
-      _voxel_size{other._voxel_size}, _elements{new T[totalElements()]} {
-  for (std::size_t i{0}; i != totalElements(); ++i) {
-    _elements[i] = other._elements[i];
+template <typename T, typename Layout>
+void ScalarField<T, Layout>::sample(const glm::vec3 *positions,
+                                    const std::size_t count,
+                                    T *values) const noexcept {
+  std::size_t p{0};
+#if defined(__AVX2__)
+  if constexpr (std::is_same_v<T, float> &&
+                std::is_same_v<Layout, LinearLayout>) {
+    if (storageSize() <=
+        static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max())) {
+      const glm::vec3 inv_voxel_size{1.f / getVoxelSize()};
+      for (; p + TRILINEAR_SIMD_WIDTH <= count; p += TRILINEAR_SIMD_WIDTH) {
+        sampleTrilinear8(data(), _num_elements, min(), inv_voxel_size,
+                         positions + p, values + p);
+      }
+    }
   }
+#endif
+  for (; p != count; ++p) {
+    values[p] = sample(positions[p]);
+  }
+}
+
+template <typename T, typename Layout>
+FieldStorage<glm::vec3> ScalarField<T, Layout>::computeNormals() const {
+  static_assert(std::is_same_v<Layout, LinearLayout>,
+                "Normals can only be computed on linear fields");
+  auto normals{FieldStorage<glm::vec3>::allocate(totalElements())};
+  const std::size_t slab_elements{_layout.slabElements()};
+  parallelForSlabs([&](const std::size_t first,
+                       const std::size_t last) -> void {
+    computeNormalSlices(data(), 0, _num_elements, _voxel_size,
+                        static_cast<int>(first), static_cast<int>(last),
+                        normals.data() + first * slab_elements);
+  });
+  return normals;
 }
 
-} // namespace Gecko
\ No newline at end of file
+} // namespace Gecko
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Gecko {
+
+#if defined(__AVX2__)
+
+// Number of positions sampled at once by sampleTrilinear8()
+constexpr std::size_t TRILINEAR_SIMD_WIDTH{8};
+
+namespace Detail {
+
+// Clamped continuous index along one axis, split in integer base index and
+// interpolation weight
+inline void trilinearAxis(const __m256 position, const float bounds_min,
+                          const float inv_voxel_size, const int size,
+                          __m256i &base, __m256 &t) noexcept {
+  __m256 u{_mm256_mul_ps(_mm256_sub_ps(position, _mm256_set1_ps(bounds_min)),
+                         _mm256_set1_ps(inv_voxel_size))};
+  // Same as GL_CLAMP_TO_EDGE, NaNs end up at 0
+  u = _mm256_min_ps(_mm256_max_ps(u, _mm256_setzero_ps()),
+                    _mm256_set1_ps(static_cast<float>(size - 1)));
+  const __m256 u_base{_mm256_min_ps(
+      _mm256_floor_ps(u), _mm256_set1_ps(static_cast<float>(size - 2)))};
+  t = _mm256_sub_ps(u, u_base);
+  base = _mm256_cvttps_epi32(u_base);
+}
+
+[[nodiscard]] inline __m256 lerp(const __m256 a, const __m256 b,
+                                 const __m256 t) noexcept {
+#if defined(__FMA__)
+  return _mm256_fmadd_ps(t, _mm256_sub_ps(b, a), a);
+#else
+  return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+#endif
+}
+
+} // namespace Detail
+
+// Trilinear interpolation of 8 positions in a linear float field with AVX2
+// gathers. The storage must have less than 2^31 elements so that the gather
+// offsets fit in 32 bit.
+inline void sampleTrilinear8(const float *data, const glm::ivec3 &num_elements,
+                             const glm::vec3 &bounds_min,
+                             const glm::vec3 &inv_voxel_size,
+                             const glm::vec3 *positions,
+                             float *values) noexcept {
+  // Positions are interleaved, transpose them to one register per axis
+  alignas(32) float xs[TRILINEAR_SIMD_WIDTH];
+  alignas(32) float ys[TRILINEAR_SIMD_WIDTH];
+  alignas(32) float zs[TRILINEAR_SIMD_WIDTH];
+  for (std::size_t l{0}; l != TRILINEAR_SIMD_WIDTH; ++l) {
+    xs[l] = positions[l].x;
+    ys[l] = positions[l].y;
+    zs[l] = positions[l].z;
+  }
+
+  __m256i i, j, k;
+  __m256 tx, ty, tz;
+  Detail::trilinearAxis(_mm256_load_ps(xs), bounds_min.x, inv_voxel_size.x,
+                        num_elements.x, i, tx);
+  Detail::trilinearAxis(_mm256_load_ps(ys), bounds_min.y, inv_voxel_size.y,
+                        num_elements.y, j, ty);
+  Detail::trilinearAxis(_mm256_load_ps(zs), bounds_min.z, inv_voxel_size.z,
+                        num_elements.z, k, tz);
+
+  const int x_stride{1};
+  const int y_stride{num_elements.x};
+  const int z_stride{num_elements.x * num_elements.y};
+  const __m256i index{_mm256_add_epi32(
+      i, _mm256_add_epi32(_mm256_mullo_epi32(j, _mm256_set1_epi32(y_stride)),
+                          _mm256_mullo_epi32(k, _mm256_set1_epi32(z_stride))))};
+  const auto gather{[data, index](const int offset) -> __m256 {
+    return _mm256_i32gather_ps(
+        data, _mm256_add_epi32(index, _mm256_set1_epi32(offset)), 4);
+  }};
+
+  const __m256 c00{Detail::lerp(gather(0), gather(x_stride), tx)};
+  const __m256 c10{
+      Detail::lerp(gather(y_stride), gather(y_stride + x_stride), tx)};
+  const __m256 c01{
+      Detail::lerp(gather(z_stride), gather(z_stride + x_stride), tx)};
+  const __m256 c11{Detail::lerp(gather(z_stride + y_stride),
+                                gather(z_stride + y_stride + x_stride), tx)};
+  _mm256_storeu_ps(values, Detail::lerp(Detail::lerp(c00, c10, ty),
+                                        Detail::lerp(c01, c11, ty), tz));
+}
+
+#endif
+
+} // namespace Gecko
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace Gecko {
+
+// Alignment of field allocations, a cache line and wide enough for any SIMD
+// load or store
+constexpr std::size_t FIELD_ALIGNMENT{64};
+
+// Size of the transparent huge pages requested by allocateAligned()
+constexpr std::size_t HUGE_PAGE_SIZE{2u << 20u};
+
+// Allocate size bytes of uninitialized memory aligned to the given power of
+// two. With huge_pages the block is aligned to and rounded up to
+// HUGE_PAGE_SIZE and the OS is asked to back it with transparent huge pages,
+// where supported. Throws std::bad_alloc on failure.
+[[nodiscard]] std::shared_ptr<void>
+allocateAligned(std::size_t size, std::size_t alignment, bool huge_pages);
+
+} // namespace Gecko
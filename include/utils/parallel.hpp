@@ -0,0 +1,190 @@
+#pragma once
+
+#include "utils/thread_pool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+
+namespace Gecko {
+
+// Number of threads used by default by the parallel algorithms
+[[nodiscard]] inline unsigned int defaultThreadCount() noexcept {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+namespace Detail {
+
+template <typename Func>
+void splitRange(TaskGroup &group, const std::size_t begin, std::size_t end,
+                const std::size_t grain, Func &func) {
+  // Hand out the upper halves, they are stolen before the smaller splits
+  while (end - begin > grain) {
+    const std::size_t middle{begin + (end - begin) / 2};
+    group.run([&group, middle, end, grain, &func]() -> void {
+      splitRange(group, middle, end, grain, func);
+    });
+    end = middle;
+  }
+  func(begin, end);
+}
+
+template <typename Func>
+void splitBox(TaskGroup &group, const glm::ivec3 &first, glm::ivec3 last,
+              const glm::ivec3 &grain, Func &func) {
+  while (true) {
+    // Split the axis with the most grains, on a multiple of the grain
+    const glm::ivec3 grains{(last - first + grain - 1) / grain};
+    const int axis{grains.x >= grains.y && grains.x >= grains.z ? 0
+                   : grains.y >= grains.z                       ? 1
+                                                                : 2};
+    if (grains[axis] <= 1) {
+      break;
+    }
+    glm::ivec3 middle{first};
+    middle[axis] += grains[axis] / 2 * grain[axis];
+    group.run([&group, middle, last, &grain, &func]() -> void {
+      splitBox(group, middle, last, grain, func);
+    });
+    last[axis] = middle[axis];
+  }
+  func(first, last);
+}
+
+} // namespace Detail
+
+// Split [begin, end) in contiguous ranges, num_threads of them, and call
+// func(range_begin, range_end) on each of them as tasks of the pool. The first
+// exception thrown by any of the calls is rethrown once all of them are done.
+template <typename Func>
+void parallelFor(const std::size_t begin, const std::size_t end, Func &&func,
+                 const unsigned int num_threads = defaultThreadCount(),
+                 ThreadPool &pool = ThreadPool::global()) {
+  if (end <= begin) {
+    return;
+  }
+  const std::size_t count{end - begin};
+  const std::size_t num_ranges{
+      std::min(count, static_cast<std::size_t>(std::max(1u, num_threads)))};
+  if (num_ranges == 1) {
+    func(begin, end);
+    return;
+  }
+
+  TaskGroup group{pool};
+  const auto run_range{[&](const std::size_t r) -> void {
+    func(begin + r * count / num_ranges, begin + (r + 1) * count / num_ranges);
+  }};
+  // Queued on the deque of worker r - 1 when called from outside of the
+  // pool, but any idle worker may steal them, see parallelForPinned() for
+  // ranges that stay on the same worker from call to call
+  for (std::size_t r{1}; r != num_ranges; ++r) {
+    group.run([&run_range, r]() -> void { run_range(r); }, r - 1);
+  }
+  // The calling thread takes care of the first range
+  std::exception_ptr exception;
+  try {
+    run_range(0);
+  } catch (...) {
+    exception = std::current_exception();
+  }
+  try {
+    group.wait();
+  } catch (...) {
+    if (!exception) {
+      exception = std::current_exception();
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+// Split [begin, end) in a contiguous range per worker of the pool plus one
+// and call func(range_begin, range_end) for range w on worker w, without
+// stealing, and for the last range on the calling thread, which would
+// otherwise only wait. The split only depends on the range and the pool, so
+// passes over the same data from the same thread have each part of it
+// handled by the same thread, on the same NUMA node as the memory it touched
+// first. Called from a worker, that worker runs the last range as well as its
+// own. Exceptions as for parallelFor().
+template <typename Func>
+void parallelForPinned(const std::size_t begin, const std::size_t end,
+                       Func &&func, ThreadPool &pool = ThreadPool::global()) {
+  if (end <= begin) {
+    return;
+  }
+  const std::size_t count{end - begin};
+  const std::size_t num_ranges{
+      std::min(count, static_cast<std::size_t>(pool.numWorkers()) + 1)};
+  if (num_ranges == 1) {
+    func(begin, end);
+    return;
+  }
+
+  TaskGroup group{pool};
+  const auto run_range{[&](const std::size_t r) -> void {
+    func(begin + r * count / num_ranges, begin + (r + 1) * count / num_ranges);
+  }};
+  for (std::size_t r{0}; r != num_ranges - 1; ++r) {
+    group.runOnWorker(r, [&run_range, r]() -> void { run_range(r); });
+  }
+  std::exception_ptr exception;
+  try {
+    run_range(num_ranges - 1);
+  } catch (...) {
+    exception = std::current_exception();
+  }
+  try {
+    group.wait();
+  } catch (...) {
+    if (!exception) {
+      exception = std::current_exception();
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+// Split [begin, end) in halves down to ranges of at most grain elements and
+// call func(range_begin, range_end) on each of them. The ranges are stolen by
+// the idle workers, so the load balances when their cost varies, at the price
+// of a task per range. Exceptions as for parallelFor().
+template <typename Func>
+void parallelForGrain(const std::size_t begin, const std::size_t end,
+                      const std::size_t grain, Func &&func,
+                      ThreadPool &pool = ThreadPool::global()) {
+  if (end <= begin) {
+    return;
+  }
+  TaskGroup group{pool};
+  group.run([&]() -> void {
+    Detail::splitRange(group, begin, end, std::max<std::size_t>(1, grain),
+                       func);
+  });
+  group.wait();
+}
+
+// As parallelForGrain() over the box [begin, end), calling func(first, last)
+// on boxes of at most grain elements along each axis, aligned to the grain
+// from begin
+template <typename Func>
+void parallelFor3D(const glm::ivec3 &begin, const glm::ivec3 &end,
+                   const glm::ivec3 &grain, Func &&func,
+                   ThreadPool &pool = ThreadPool::global()) {
+  if (glm::any(glm::lessThanEqual(end, begin))) {
+    return;
+  }
+  const glm::ivec3 box_grain{glm::max(grain, glm::ivec3{1})};
+  TaskGroup group{pool};
+  group.run([&]() -> void {
+    Detail::splitBox(group, begin, end, box_grain, func);
+  });
+  group.wait();
+}
+
+} // namespace Gecko
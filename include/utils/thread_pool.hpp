@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Gecko {
+
+class TaskGroup;
+
+// CPUs the process may run on, grouped by NUMA node. A single group when the
+// topology is unknown.
+[[nodiscard]] std::vector<std::vector<unsigned int>> cpusPerNode();
+
+// Work stealing pool shared by the CPU side stages. Each worker has its own
+// deque of tasks: it pushes and pops at the back, so nested tasks run depth
+// first on the thread that spawned them, and idle workers steal from the
+// front of the other deques, where the oldest and largest tasks are. Threads
+// waiting for a TaskGroup run queued tasks meanwhile, so tasks can wait for
+// other tasks and the waiting thread takes part in the work.
+//
+// On machines with several NUMA nodes, workers are pinned to the CPUs of a
+// node, consecutive workers on the same node, so that memory a worker touches
+// first stays local to it. Tasks can also be pinned to a worker, see
+// TaskGroup::runOnWorker().
+class ThreadPool {
+public:
+  // With 0 workers all the tasks run on the waiting threads
+  explicit ThreadPool(unsigned int num_workers);
+
+  // All the task groups must be done
+  ~ThreadPool();
+
+  // Not copyable or assignable
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Pool with defaultThreadCount() - 1 workers, the thread waiting for the
+  // tasks being the last one
+  [[nodiscard]] static ThreadPool &global();
+
+  [[nodiscard]] unsigned int numWorkers() const noexcept {
+    return static_cast<unsigned int>(_threads.size());
+  }
+
+private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> function;
+    TaskGroup *group;
+  };
+
+  struct Deque {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    // Tasks only the worker of the deque runs, never stolen
+    std::deque<Task> pinned_tasks;
+    std::atomic<std::size_t> num_pinned_tasks{0};
+  };
+
+  // Queue on the deque of the calling worker, threads outside of the pool
+  // queue on the deque of worker hint % numWorkers()
+  void submit(Task task, std::size_t hint);
+
+  // Queue for the given worker only
+  void submitPinned(Task task, std::size_t worker);
+
+  // Run a queued task, the pinned tasks of the calling worker first, then
+  // from its deque, false if there was none
+  bool runOne();
+
+  void workerLoop(std::size_t index);
+
+  std::vector<std::unique_ptr<Deque>> _deques;
+  std::atomic<std::size_t> _queued_tasks{0};
+  std::mutex _sleep_mutex;
+  std::condition_variable _sleep_condition;
+  bool _stop{false};
+  std::vector<std::thread> _threads;
+};
+
+// Tasks waited for together. The first exception thrown by a task is rethrown
+// by wait().
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool &pool = ThreadPool::global()) noexcept
+      : _pool{pool} {}
+
+  // Waits for the tasks still running, without rethrowing their exceptions
+  ~TaskGroup();
+
+  // Not copyable or assignable
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  // Queue a task. From outside of the pool, the hint picks the deque of the
+  // worker it is queued on, but idle workers steal from any deque, so it does
+  // not decide which worker runs it. Use runOnWorker() for that.
+  void run(std::function<void()> function, std::size_t hint = 0);
+
+  // Queue a task only the given worker runs, worker < numWorkers()
+  void runOnWorker(std::size_t worker, std::function<void()> function);
+
+  // Queue continuation as a task of the group once all the tasks run so far
+  // are done, or now if there are none. It is skipped if any of them threw.
+  void then(std::function<void()> continuation);
+
+  // Run queued tasks until the tasks of the group and their continuations
+  // are done
+  void wait();
+
+private:
+  friend class ThreadPool;
+
+  // Account for a task of the group that completed, possibly with an
+  // exception
+  void finishTask(std::exception_ptr exception);
+
+  void waitTasks();
+
+  ThreadPool &_pool;
+  std::mutex _mutex;
+  std::condition_variable _done_condition;
+  std::size_t _pending{0};
+  std::exception_ptr _exception;
+  std::function<void()> _continuation;
+};
+
+} // namespace Gecko
@@ -0,0 +1,16 @@
+#version 330 core
+
+out vec4 fragment_color;
+
+in vec2 uv;
+
+uniform sampler2D image;
+// Part of the image drawn, from its lower left corner
+uniform vec2 uv_scale;
+// Largest coordinates read, keeps the filtering from blending in texels
+// past the part drawn
+uniform vec2 uv_max;
+
+void main() {
+    fragment_color = texture(image, min(uv * uv_scale, uv_max));
+}
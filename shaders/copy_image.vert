@@ -0,0 +1,9 @@
+#version 330 core
+
+out vec2 uv;
+
+// Triangle covering the viewport, drawn without vertex attributes
+void main() {
+    uv = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.f;
+    gl_Position = vec4(uv * 2.f - 1.f, 0.f, 1.f);
+}
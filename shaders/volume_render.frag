@@ -6,9 +6,38 @@ in vec3 p_model_space;
 
 uniform vec3 eye_model_space;
 uniform float step_size;
+// Fraction of a step the samples are moved along the rays, varied between
+// the frames averaged by progressive refinement
+uniform float sample_offset;
 
 uniform sampler3D volume_texture;
 uniform sampler3D volume_normal_texture;
+// Texture values map to field values as value * value_scale + value_offset,
+// quantized volumes store normalized values
+uniform float value_scale;
+uniform float value_offset;
+// Normals stored as two octahedral components instead of three floats
+uniform bool octahedral_normals;
+
+// Value range of coarse cells of the volume, see MacrocellGrid
+uniform sampler3D macrocell_texture;
+uniform vec3 volume_size;
+uniform float macrocell_size;
+
+// Volume paged in bricks of macrocell_size elements, see VolumeBrickCache.
+// volume_texture and volume_normal_texture are then atlases of bricks with
+// one element of apron, the page table has one (slot, state) texel per brick.
+uniform bool paged_volume;
+uniform usampler3D page_table;
+uniform vec3 atlas_size;
+// Feedback pass, writes the brick each ray needs instead of a color
+uniform bool feedback_pass;
+uniform int frame_index;
+
+const uint BRICK_MISSING = 0u;
+const uint BRICK_RESIDENT = 1u;
+const uint BRICK_CONSTANT = 2u;
+const uint FEEDBACK_RESIDENT_BIT = 0x80000000u;
 
 uniform float min_value;
 uniform float mult;
@@ -30,6 +59,58 @@ in vec3 bounds_min, in vec3 bounds_max) {
 
     return vec2(maxElement(slabs_min_intersection), minElement(slabs_max_intersection));
 }
+// Cell covering the texture coordinates interpolating elements
+// [c * macrocell_size, (c + 1) * macrocell_size]
+ivec3 computeMacrocell(in vec3 point, in ivec3 num_cells) {
+    vec3 element = point * volume_size - 0.5f;
+    return clamp(ivec3(floor(element / macrocell_size)), ivec3(0), num_cells - 1);
+}
+
+// The transfer function below maps 0 to fully transparent and black, a cell
+// containing only zeros under the threshold has no effect on the image
+bool isEmptyMacrocell(in vec2 range) {
+    return range.x == 0.f && range.y == 0.f && min_value > 0.f;
+}
+
+// Unfold the octahedron |x| + |y| + |z| = 1 from [-1, 1]^2, see
+// encodeOctahedral(). Zero normals are stored at the corner (-1, -1) and
+// decode to zero, as with float normals.
+const float OCTAHEDRAL_ZERO_LIMIT = -1.f + 0.5f / 32767.f;
+
+vec3 decodeOctahedral(in vec2 e) {
+    if (all(lessThan(e, vec2(OCTAHEDRAL_ZERO_LIMIT)))) {
+        return vec3(0.f);
+    }
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.f);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.f)));
+    return normalize(n);
+}
+
+vec3 fetchNormal(in vec3 point) {
+    if (octahedral_normals) {
+        return decodeOctahedral(texture(volume_normal_texture, point).rg);
+    }
+    return normalize(texture(volume_normal_texture, point).xyz);
+}
+
+// Texture coordinates in the atlas of a point inside a resident brick
+vec3 computeAtlasPoint(in vec3 point, in ivec3 brick, in uvec3 slot) {
+    vec3 element = clamp(point * volume_size - 0.5f, vec3(0.f), volume_size - 1.f);
+    vec3 local = element - vec3(brick) * macrocell_size;
+    return (vec3(slot) * (macrocell_size + 1.f) + local + 0.5f) / atlas_size;
+}
+
+uint hash(in uint value) {
+    value = value * 747796405u + 2891336453u;
+    value = ((value >> ((value >> 28u) + 4u)) ^ value) * 277803737u;
+    return (value >> 22u) ^ value;
+}
+
+vec4 packFeedback(in uint value) {
+    return vec4((uvec4(value) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu) / 255.f;
+}
+
 /*
 vec3 computeGradient(in vec3 position) {
     float grad_eps = step_size;
@@ -49,18 +130,75 @@ vec3 computeGradient(in vec3 position) {
 
 void main() {
     vec3 dir = normalize(p_model_space - eye_model_space);
-    vec2 t = computeBoundsHit(eye_model_space, vec3(1.f) / dir, vec3(0.f), vec3(1.f));
+    vec3 inv_dir = vec3(1.f) / dir;
+    vec2 t = computeBoundsHit(eye_model_space, inv_dir, vec3(0.f), vec3(1.f));
+    ivec3 num_macrocells = textureSize(macrocell_texture, 0);
 
     float alpha = 0.f;
     vec3 c = vec3(0.f);
 
-    float current_t = t.x;
+    float current_t = t.x + sample_offset * step_size;
     vec3 current_point = eye_model_space + current_t * dir;
     vec3 step = step_size * dir;
 
+    // Brick to report in the feedback pass, 0 for none. Of the resident
+    // bricks along the ray one is picked uniformly by reservoir sampling.
+    uint feedback = 0u;
+    uint resident_samples = 0u;
+    uint random_state = hash(uint(gl_FragCoord.x) + hash(uint(gl_FragCoord.y) + hash(uint(frame_index))));
+
     while (current_t <= t.y && alpha < 0.99f) {
-        float score_value = texture(volume_texture, current_point).r;
-        vec3 normal = normalize(texture(volume_normal_texture, current_point).xyz);
+        ivec3 cell = computeMacrocell(current_point, num_macrocells);
+        if (isEmptyMacrocell(texelFetch(macrocell_texture, cell, 0).rg)) {
+            // Jump to the first sample past the cell, keeping the samples on
+            // the same positions as without skipping
+            vec3 cell_min = (vec3(cell) * macrocell_size + 0.5f) / volume_size;
+            vec3 cell_max = (vec3(cell + 1) * macrocell_size + 0.5f) / volume_size;
+            cell_min = mix(cell_min, vec3(0.f), equal(cell, ivec3(0)));
+            cell_max = mix(cell_max, vec3(1.f), equal(cell, num_macrocells - 1));
+            float cell_exit_t = computeBoundsHit(eye_model_space, inv_dir, cell_min, cell_max).y;
+            current_t += max(1.f, ceil((cell_exit_t - current_t) / step_size)) * step_size;
+            current_point = eye_model_space + current_t * dir;
+            continue;
+        }
+
+        vec3 sample_point = current_point;
+        uint brick_state = BRICK_RESIDENT;
+        uvec4 page = uvec4(0u);
+        if (paged_volume) {
+            page = texelFetch(page_table, cell, 0);
+            brick_state = page.w;
+            uint brick_id = uint(cell.x + num_macrocells.x * (cell.y + num_macrocells.y * cell.z)) + 1u;
+            if (brick_state == BRICK_MISSING) {
+                if (feedback_pass) {
+                    feedback = brick_id;
+                    break;
+                }
+                // Not loaded yet, leave a hole instead of stalling
+                current_t += step_size;
+                current_point += step;
+                continue;
+            }
+            if (brick_state == BRICK_RESIDENT) {
+                ++resident_samples;
+                random_state = hash(random_state);
+                if (random_state % resident_samples == 0u) {
+                    feedback = FEEDBACK_RESIDENT_BIT | brick_id;
+                }
+                sample_point = computeAtlasPoint(current_point, cell, page.xyz);
+            }
+        }
+
+        float score_value;
+        vec3 normal;
+        if (brick_state == BRICK_CONSTANT) {
+            // Constant bricks store their value in the page table
+            score_value = uintBitsToFloat(page.x);
+            normal = vec3(0.f);
+        } else {
+            score_value = texture(volume_texture, sample_point).r * value_scale + value_offset;
+            normal = fetchNormal(sample_point);
+        }
 
         // Map volume value to tf interval
         vec4 tf_value = vec4(0.f);
@@ -84,5 +222,5 @@ void main() {
         current_point += step;
     }
 
-    fragment_color = vec4(c, 1.f);
+    fragment_color = feedback_pass ? packFeedback(feedback) : vec4(c, 1.f);
 }
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "camera/camera_path.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace {
+
+constexpr float PI{3.1415927410125732421875f};
+constexpr float TWO_PI{2.f * PI};
+
+const glm::vec3 UP{0.f, 1.f, 0.f};
+
+// Interpolate angles in radians along the shorter way around the circle
+[[nodiscard]] float mixAngle(const float a, const float b,
+                             const float t) noexcept {
+  float delta{std::fmod(b - a, TWO_PI)};
+  if (delta > PI) {
+    delta -= TWO_PI;
+  } else if (delta < -PI) {
+    delta += TWO_PI;
+  }
+  const float angle{a + t * delta};
+  return angle < 0.f ? angle + TWO_PI : angle;
+}
+
+} // namespace
+
+CameraPath CameraPath::createFromFile(const std::string &filename) {
+  std::ifstream file{filename};
+  if (!file.is_open()) {
+    throw std::runtime_error{
+        fmt::format("Could not open camera path {}", filename)};
+  }
+  std::vector<Keyframe> keyframes;
+  std::string line;
+  for (std::size_t line_number{1}; std::getline(file, line); ++line_number) {
+    const auto first{line.find_first_not_of(" \t\r")};
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    std::istringstream tokens{line};
+    std::size_t frame;
+    std::string type;
+    glm::vec3 a, b;
+    if (!(tokens >> frame >> type >> a.x >> a.y >> a.z >> b.x >> b.y >>
+          b.z) ||
+        (type != "orbit" && type != "look")) {
+      throw std::runtime_error{fmt::format(
+          "Malformed keyframe at {}:{}", filename, line_number)};
+    }
+    if (!keyframes.empty() && frame <= keyframes.back().frame) {
+      throw std::runtime_error{fmt::format(
+          "Keyframe at {}:{} is not after the previous one", filename,
+          line_number)};
+    }
+    Keyframe keyframe{frame, type == "orbit", OrbitCamera{}, a, b};
+    if (keyframe.orbit) {
+      keyframe.camera = OrbitCamera{a, glm::radians(b.x), glm::radians(b.y),
+                                    b.z};
+      keyframe.eye = keyframe.camera.getEyeAndViewMatrix().first;
+      keyframe.at = a;
+    }
+    keyframes.push_back(keyframe);
+  }
+  if (keyframes.empty()) {
+    throw std::runtime_error{
+        fmt::format("No keyframes found in camera path {}", filename)};
+  }
+  return CameraPath{std::move(keyframes)};
+}
+
+std::pair<glm::vec3, glm::mat4>
+CameraPath::getEyeAndViewMatrix(const std::size_t frame) const noexcept {
+  // First keyframe after the frame
+  const auto next{std::upper_bound(
+      _keyframes.begin(), _keyframes.end(), frame,
+      [](const std::size_t f, const Keyframe &keyframe) -> bool {
+        return f < keyframe.frame;
+      })};
+  if (next == _keyframes.begin() || next == _keyframes.end()) {
+    const Keyframe &keyframe{next == _keyframes.end() ? _keyframes.back()
+                                                      : _keyframes.front()};
+    return {keyframe.eye, glm::lookAt(keyframe.eye, keyframe.at, UP)};
+  }
+  const Keyframe &k0{*(next - 1)};
+  const Keyframe &k1{*next};
+  const float t{static_cast<float>(frame - k0.frame) /
+                static_cast<float>(k1.frame - k0.frame)};
+  if (k0.orbit && k1.orbit) {
+    return OrbitCamera{glm::mix(k0.camera.at(), k1.camera.at(), t),
+                       mixAngle(k0.camera.phi(), k1.camera.phi(), t),
+                       glm::mix(k0.camera.theta(), k1.camera.theta(), t),
+                       glm::mix(k0.camera.radius(), k1.camera.radius(), t)}
+        .getEyeAndViewMatrix();
+  }
+  const glm::vec3 eye{glm::mix(k0.eye, k1.eye, t)};
+  return {eye, glm::lookAt(eye, glm::mix(k0.at, k1.at, t), UP)};
+}
+
+} // namespace Gecko
@@ -17,4 +17,8 @@ OrbitCamera::OrbitCamera(const glm::vec3 &from, const glm::vec3 &at) noexcept
       }()},
       _radius{glm::length(from - at)} {}
 
+OrbitCamera::OrbitCamera(const glm::vec3 &at, const float phi,
+                         const float theta, const float radius) noexcept
+    : _at{at}, _phi{phi}, _theta{theta}, _radius{radius} {}
+
 } // namespace Gecko
\ No newline at end of file
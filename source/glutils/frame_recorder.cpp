@@ -0,0 +1,216 @@
+#include "glutils/frame_recorder.hpp"
+#include "io/image_writer.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Gecko {
+
+FrameRecorder::FrameRecorder(const int width, const int height,
+                             const Settings &settings)
+    : _width{width}, _height{height},
+      _slots(std::max<std::size_t>(1, settings.readback_buffers)) {
+  const std::size_t frame_bytes{static_cast<std::size_t>(width) *
+                                static_cast<std::size_t>(height) * 4};
+  for (Slot &slot : _slots) {
+    glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(frame_bytes),
+                 nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  const unsigned int num_writers{settings.writer_threads != 0
+                                     ? settings.writer_threads
+                                     : defaultThreadCount()};
+  _writers.reserve(num_writers);
+  for (unsigned int w{0}; w != num_writers; ++w) {
+    _writers.emplace_back(&FrameRecorder::writerLoop, this);
+  }
+}
+
+FrameRecorder::~FrameRecorder() {
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _stop = true;
+  }
+  _pending_condition.notify_all();
+  for (std::thread &writer : _writers) {
+    writer.join();
+  }
+  // Nothing reads from the buffers anymore, release them
+  for (Slot &slot : _slots) {
+    if (slot.pixels != nullptr) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    if (slot.fence != nullptr) {
+      glDeleteSync(slot.fence);
+    }
+    glDeleteBuffers(1, &slot.buffer);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameRecorder::record(const GLuint framebuffer, std::string filename) {
+  update();
+  // Free the oldest frame if all the buffers are in use
+  bool stalled{false};
+  while (_order.size() == _slots.size()) {
+    stalled = true;
+    Slot &oldest{_slots[_order.front()]};
+    if (oldest.state == SlotState::Reading) {
+      dispatchSlot(oldest, true);
+    } else {
+      std::unique_lock<std::mutex> lock{_mutex};
+      _written_condition.wait(lock, [this]() -> bool {
+        return !_written_slots.empty() || _writer_exception;
+      });
+    }
+    recycleSlots();
+  }
+  _stalls += stalled ? 1 : 0;
+
+  const auto slot_index{static_cast<std::size_t>(
+      std::find_if(_slots.begin(), _slots.end(),
+                   [](const Slot &slot) -> bool {
+                     return slot.state == SlotState::Idle;
+                   }) -
+      _slots.begin())};
+  Slot &slot{_slots[slot_index]};
+  // Into the pixel buffer the read back does not wait for rendering
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.filename = std::move(filename);
+  slot.state = SlotState::Reading;
+  _order.push_back(slot_index);
+  ++_recorded_frames;
+}
+
+void FrameRecorder::update() {
+  // Read backs complete in order, stop at the first one still in progress
+  for (const std::size_t slot_index : _order) {
+    Slot &slot{_slots[slot_index]};
+    if (slot.state == SlotState::Reading) {
+      dispatchSlot(slot, false);
+      if (slot.state == SlotState::Reading) {
+        break;
+      }
+    }
+  }
+  recycleSlots();
+}
+
+void FrameRecorder::finish() {
+  while (!_order.empty()) {
+    Slot &oldest{_slots[_order.front()]};
+    if (oldest.state == SlotState::Reading) {
+      dispatchSlot(oldest, true);
+    } else {
+      std::unique_lock<std::mutex> lock{_mutex};
+      _written_condition.wait(lock, [this]() -> bool {
+        return !_written_slots.empty() || _writer_exception;
+      });
+    }
+    recycleSlots();
+  }
+}
+
+void FrameRecorder::dispatchSlot(Slot &slot, const bool wait) {
+  // Flushing makes sure the fence is eventually signaled
+  constexpr static GLuint64 WAIT_TIMEOUT{100000000};
+  GLenum status;
+  do {
+    status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              wait ? WAIT_TIMEOUT : 0);
+  } while (wait && status == GL_TIMEOUT_EXPIRED);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    return;
+  }
+  if (status == GL_WAIT_FAILED) {
+    throw std::runtime_error{"Could not wait for the read back of a frame"};
+  }
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  slot.pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                 static_cast<GLsizeiptr>(_width) * _height * 4,
+                                 GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (slot.pixels == nullptr) {
+    throw std::runtime_error{"Could not map pixel pack buffer"};
+  }
+  slot.state = SlotState::Writing;
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _pending_slots.push_back(static_cast<std::size_t>(&slot - _slots.data()));
+  }
+  _pending_condition.notify_one();
+}
+
+void FrameRecorder::recycleSlots() {
+  std::deque<std::size_t> written_slots;
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    written_slots.swap(_written_slots);
+  }
+  for (const std::size_t slot_index : written_slots) {
+    Slot &slot{_slots[slot_index]};
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    slot.pixels = nullptr;
+    slot.state = SlotState::Idle;
+    _order.erase(std::find(_order.begin(), _order.end(), slot_index));
+    ++_written_frames;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  rethrowWriterException();
+}
+
+void FrameRecorder::rethrowWriterException() {
+  const std::lock_guard<std::mutex> lock{_mutex};
+  if (_writer_exception) {
+    std::rethrow_exception(_writer_exception);
+  }
+}
+
+void FrameRecorder::writerLoop() {
+  while (true) {
+    std::size_t slot_index;
+    {
+      std::unique_lock<std::mutex> lock{_mutex};
+      _pending_condition.wait(
+          lock, [this]() -> bool { return _stop || !_pending_slots.empty(); });
+      if (_stop) {
+        return;
+      }
+      slot_index = _pending_slots.front();
+      _pending_slots.pop_front();
+    }
+
+    const Slot &slot{_slots[slot_index]};
+    try {
+      writeImage(slot.filename, _width, _height,
+                 static_cast<const std::uint8_t *>(slot.pixels));
+    } catch (...) {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      _writer_exception = std::current_exception();
+      _written_condition.notify_all();
+      return;
+    }
+
+    {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      _written_slots.push_back(slot_index);
+    }
+    _written_condition.notify_one();
+  }
+}
+
+} // namespace Gecko
@@ -0,0 +1,50 @@
+#include "glutils/gpu_timer.hpp"
+
+#include <algorithm>
+
+namespace Gecko {
+
+GpuTimer::GpuTimer(const std::size_t num_queries)
+    : _queries(std::max<std::size_t>(1, num_queries)) {
+  glGenQueries(static_cast<GLsizei>(_queries.size()), _queries.data());
+}
+
+GpuTimer::~GpuTimer() {
+  glDeleteQueries(static_cast<GLsizei>(_queries.size()), _queries.data());
+}
+
+bool GpuTimer::begin() {
+  if (_count == _queries.size()) {
+    return false;
+  }
+  glBeginQuery(GL_TIME_ELAPSED, _queries[(_first + _count) % _queries.size()]);
+  _measuring = true;
+  return true;
+}
+
+void GpuTimer::end() {
+  if (!_measuring) {
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+  _measuring = false;
+  ++_count;
+}
+
+std::optional<double> GpuTimer::poll() {
+  if (_count == 0) {
+    return std::nullopt;
+  }
+  GLint available{GL_FALSE};
+  glGetQueryObjectiv(_queries[_first], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available == GL_FALSE) {
+    return std::nullopt;
+  }
+  GLuint64 nanoseconds{0};
+  glGetQueryObjectui64v(_queries[_first], GL_QUERY_RESULT, &nanoseconds);
+  _first = (_first + 1) % _queries.size();
+  --_count;
+  return static_cast<double>(nanoseconds) * 1e-6;
+}
+
+} // namespace Gecko
@@ -0,0 +1,161 @@
+#include "glutils/headless_context.hpp"
+
+#include "glad/glad.h"
+
+// Keep X11 out of the EGL headers
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "fmt/format.h"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace Gecko {
+
+namespace {
+
+// True if the space separated extension list contains the extension
+[[nodiscard]] bool hasExtension(const char *extensions,
+                                const char *extension) noexcept {
+  if (extensions == nullptr) {
+    return false;
+  }
+  const std::size_t length{std::strlen(extension)};
+  for (const char *found{std::strstr(extensions, extension)};
+       found != nullptr; found = std::strstr(found + length, extension)) {
+    if ((found == extensions || found[-1] == ' ') &&
+        (found[length] == ' ' || found[length] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Function>
+[[nodiscard]] Function loadFunction(const char *name) noexcept {
+  return reinterpret_cast<Function>(eglGetProcAddress(name));
+}
+
+[[nodiscard]] EGLDisplay openDisplay() {
+  const char *const client_extensions{
+      eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS)};
+  const auto get_platform_display{
+      hasExtension(client_extensions, "EGL_EXT_platform_base")
+          ? loadFunction<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                "eglGetPlatformDisplayEXT")
+          : nullptr};
+  if (get_platform_display != nullptr &&
+      hasExtension(client_extensions, "EGL_EXT_platform_device")) {
+    const auto query_devices{
+        loadFunction<PFNEGLQUERYDEVICESEXTPROC>("eglQueryDevicesEXT")};
+    std::array<EGLDeviceEXT, 1> devices;
+    EGLint num_devices{0};
+    if (query_devices != nullptr &&
+        query_devices(static_cast<EGLint>(devices.size()), devices.data(),
+                      &num_devices) == EGL_TRUE &&
+        num_devices > 0) {
+      const EGLDisplay display{get_platform_display(EGL_PLATFORM_DEVICE_EXT,
+                                                    devices[0], nullptr)};
+      if (display != EGL_NO_DISPLAY) {
+        return display;
+      }
+    }
+  }
+  if (get_platform_display != nullptr &&
+      hasExtension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+    const EGLDisplay display{get_platform_display(
+        EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)};
+    if (display != EGL_NO_DISPLAY) {
+      return display;
+    }
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+} // namespace
+
+HeadlessContext HeadlessContext::create() {
+  const EGLDisplay display{openDisplay()};
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY ||
+      eglInitialize(display, &major, &minor) != EGL_TRUE) {
+    throw std::runtime_error{"Could not initialize an EGL display"};
+  }
+  // From here on the display is terminated with the context
+  HeadlessContext context{display, EGL_NO_CONTEXT};
+  if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS),
+                    "EGL_KHR_surfaceless_context")) {
+    throw std::runtime_error{
+        "The EGL display does not support contexts without a surface"};
+  }
+  if (eglBindAPI(EGL_OPENGL_API) != EGL_TRUE) {
+    throw std::runtime_error{"The EGL display does not support OpenGL"};
+  }
+
+  // No surface is created, the default of window surfaces would exclude all
+  // the configurations of surfaceless displays
+  constexpr static std::array<EGLint, 5> CONFIG_ATTRIBUTES{
+      EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs{0};
+  if (eglChooseConfig(display, CONFIG_ATTRIBUTES.data(), &config, 1,
+                      &num_configs) != EGL_TRUE ||
+      num_configs == 0) {
+    throw std::runtime_error{"No EGL configuration supports OpenGL"};
+  }
+  constexpr static std::array<EGLint, 7> CONTEXT_ATTRIBUTES{
+      EGL_CONTEXT_MAJOR_VERSION,
+      4,
+      EGL_CONTEXT_MINOR_VERSION,
+      3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE};
+  context._context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                                      CONTEXT_ATTRIBUTES.data());
+  if (context._context == EGL_NO_CONTEXT) {
+    throw std::runtime_error{fmt::format(
+        "Could not create an OpenGL 4.3 context on EGL {}.{}", major, minor)};
+  }
+  if (eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                     context._context) != EGL_TRUE) {
+    throw std::runtime_error{"Could not make the EGL context current"};
+  }
+  if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+    throw std::runtime_error{"Failed to initialize GLAD"};
+  }
+  return context;
+}
+
+HeadlessContext::~HeadlessContext() { destroy(); }
+
+HeadlessContext::HeadlessContext(HeadlessContext &&other) noexcept
+    : _display{std::exchange(other._display, EGL_NO_DISPLAY)},
+      _context{std::exchange(other._context, EGL_NO_CONTEXT)} {}
+
+HeadlessContext &HeadlessContext::operator=(HeadlessContext &&other) noexcept {
+  if (this != &other) {
+    destroy();
+    _display = std::exchange(other._display, EGL_NO_DISPLAY);
+    _context = std::exchange(other._context, EGL_NO_CONTEXT);
+  }
+  return *this;
+}
+
+void HeadlessContext::destroy() noexcept {
+  if (_display == EGL_NO_DISPLAY) {
+    return;
+  }
+  if (_context != EGL_NO_CONTEXT) {
+    eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(_display, _context);
+  }
+  eglTerminate(_display);
+  _display = EGL_NO_DISPLAY;
+}
+
+} // namespace Gecko
@@ -0,0 +1,63 @@
+#include "glutils/offscreen_framebuffer.hpp"
+
+#include "fmt/format.h"
+
+#include <stdexcept>
+
+namespace Gecko {
+
+OffscreenFramebuffer::OffscreenFramebuffer(const int width, const int height,
+                                           const GLenum color_format)
+    : _width{width}, _height{height} {
+  glGenTextures(1, &_color_texture);
+  glBindTexture(GL_TEXTURE_2D, _color_texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(color_format), width,
+               height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenRenderbuffers(1, &_depth_renderbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, _depth_renderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &_framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         _color_texture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, _depth_renderbuffer);
+  const GLenum status{glCheckFramebufferStatus(GL_FRAMEBUFFER)};
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteTextures(1, &_color_texture);
+    glDeleteRenderbuffers(1, &_depth_renderbuffer);
+    throw std::runtime_error{fmt::format(
+        "Offscreen framebuffer of {}x{} is not complete", width, height)};
+  }
+}
+
+OffscreenFramebuffer::~OffscreenFramebuffer() {
+  glDeleteFramebuffers(1, &_framebuffer);
+  glDeleteTextures(1, &_color_texture);
+  glDeleteRenderbuffers(1, &_depth_renderbuffer);
+}
+
+void OffscreenFramebuffer::bind() const noexcept {
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+  glViewport(0, 0, _width, _height);
+}
+
+void OffscreenFramebuffer::readPixels(std::vector<std::uint8_t> &pixels) const {
+  pixels.resize(static_cast<std::size_t>(_width) *
+                static_cast<std::size_t>(_height) * 4);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE,
+               pixels.data());
+}
+
+} // namespace Gecko
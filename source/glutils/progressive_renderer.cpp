@@ -0,0 +1,188 @@
+#include "glutils/progressive_renderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Gecko {
+
+namespace {
+
+// Radical inverse of index in the given base, the Halton sequence in [0, 1)
+[[nodiscard]] float radicalInverse(unsigned int index,
+                                   const unsigned int base) noexcept {
+  const float inv_base{1.f / static_cast<float>(base)};
+  float scale{inv_base};
+  float value{0.f};
+  while (index != 0) {
+    value += static_cast<float>(index % base) * scale;
+    index /= base;
+    scale *= inv_base;
+  }
+  return value;
+}
+
+// Offset in [-0.5, 0.5) that is 0 for the first sample
+[[nodiscard]] float centeredOffset(const float value) noexcept {
+  return value < 0.5f ? value : value - 1.f;
+}
+
+} // namespace
+
+ProgressiveRenderer::ProgressiveRenderer(const GLSLProgram &copy_program,
+                                         const Settings &settings)
+    : _copy_program{copy_program}, _settings{settings},
+      _interaction_scale{settings.interaction_scale},
+      _interaction_step_multiplier{settings.interaction_step_multiplier} {
+  glGenVertexArrays(1, &_vao);
+}
+
+ProgressiveRenderer::~ProgressiveRenderer() { glDeleteVertexArrays(1, &_vao); }
+
+std::optional<ProgressiveRenderer::Frame>
+ProgressiveRenderer::beginFrame(const int width, const int height,
+                                const bool interacting) {
+  if (width != _width || height != _height) {
+    _width = width;
+    _height = height;
+    _sample = std::make_unique<OffscreenFramebuffer>(width, height);
+    // Averaging many 8 bit frames would band
+    _accumulation =
+        std::make_unique<OffscreenFramebuffer>(width, height, GL_RGBA16F);
+    // Full size, the scale changes without reallocating
+    _coarse = std::make_unique<OffscreenFramebuffer>(width, height);
+    _samples = 0;
+  }
+  adaptInteraction();
+
+  _interacting = interacting;
+  Frame frame;
+  float quality{1.f};
+  if (interacting) {
+    _samples = 0;
+    _coarse_size = glm::max(
+        glm::ivec2{glm::vec2{glm::ivec2{width, height}} * _interaction_scale},
+        glm::ivec2{1});
+    frame.framebuffer = _coarse->id();
+    frame.width = _coarse_size.x;
+    frame.height = _coarse_size.y;
+    frame.step_multiplier = _interaction_step_multiplier;
+    quality = _interaction_scale * _interaction_scale /
+              _interaction_step_multiplier;
+  } else {
+    if (converged()) {
+      return std::nullopt;
+    }
+    // Halton points, the first sample is the frame drawn without refinement
+    const auto index{static_cast<unsigned int>(_samples)};
+    frame.framebuffer = _sample->id();
+    frame.width = width;
+    frame.height = height;
+    frame.pixel_offset = glm::vec2{centeredOffset(radicalInverse(index, 2)),
+                                   centeredOffset(radicalInverse(index, 3))};
+    frame.sample_offset = radicalInverse(index, 5);
+  }
+  if (_timer.begin()) {
+    _measured_qualities.push_back(quality);
+  }
+  return frame;
+}
+
+void ProgressiveRenderer::endFrame() {
+  _timer.end();
+  if (_interacting) {
+    return;
+  }
+  // Running average, the new frame weighs 1 / samples
+  _accumulation->bind();
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+  glBlendColor(0.f, 0.f, 0.f, 1.f / static_cast<float>(_samples + 1));
+  drawImage(_sample->colorTexture(), glm::vec2{1.f}, glm::vec2{1.f});
+  glDisable(GL_BLEND);
+  ++_samples;
+}
+
+void ProgressiveRenderer::present(const GLuint framebuffer, const int width,
+                                  const int height) const {
+  if (_accumulation == nullptr) {
+    return;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, width, height);
+  if (_interacting) {
+    // The coarse image only covers the lower left corner of its texture, the
+    // last row and column are read at their centers to not blend in the
+    // stale texels past them
+    const glm::vec2 full_size{glm::ivec2{_width, _height}};
+    drawImage(_coarse->colorTexture(), glm::vec2{_coarse_size} / full_size,
+              (glm::vec2{_coarse_size} - 0.5f) / full_size);
+  } else {
+    drawImage(_accumulation->colorTexture(), glm::vec2{1.f}, glm::vec2{1.f});
+  }
+}
+
+void ProgressiveRenderer::adaptInteraction() {
+  // Weight of a new measure in the cost of a unit of quality
+  constexpr static double COST_SMOOTHING{0.25};
+  // Scale steps, the resolution does not change for every measure
+  constexpr static float SCALE_STEPS{20.f};
+
+  while (const std::optional<double> frame_time{_timer.poll()}) {
+    const double cost{*frame_time /
+                      static_cast<double>(_measured_qualities.front())};
+    _measured_qualities.pop_front();
+    if (_quality_cost == 0.) {
+      _quality_cost = cost;
+    } else {
+      _quality_cost += COST_SMOOTHING * (cost - _quality_cost);
+    }
+    _last_frame_time = *frame_time;
+  }
+  if (_settings.frame_budget <= 0. || _quality_cost <= 0.) {
+    return;
+  }
+
+  const float min_scale{std::clamp(_settings.min_scale, 0.f, 1.f)};
+  const float min_quality{min_scale * min_scale /
+                          std::max(1.f, _settings.max_step_multiplier)};
+  const float quality{std::clamp(
+      static_cast<float>(_settings.frame_budget / _quality_cost), min_quality,
+      1.f)};
+  if (quality >= min_scale * min_scale) {
+    // Rounded down to keep within the budget
+    _interaction_scale = std::max(
+        min_scale, std::floor(std::sqrt(quality) * SCALE_STEPS) / SCALE_STEPS);
+    _interaction_step_multiplier = 1.f;
+  } else {
+    _interaction_scale = min_scale;
+    _interaction_step_multiplier = min_scale * min_scale / quality;
+  }
+}
+
+void ProgressiveRenderer::drawImage(const GLuint texture,
+                                    const glm::vec2 &uv_scale,
+                                    const glm::vec2 &uv_max) const {
+  // The volume program stays current between frames
+  GLint previous_program;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+  const GLboolean depth_test{glIsEnabled(GL_DEPTH_TEST)};
+  glDisable(GL_DEPTH_TEST);
+
+  _copy_program.use();
+  _copy_program.setInt("image", 0);
+  _copy_program.setVec2("uv_scale", uv_scale);
+  _copy_program.setVec2("uv_max", uv_max);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glBindVertexArray(_vao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (depth_test == GL_TRUE) {
+    glEnable(GL_DEPTH_TEST);
+  }
+  glUseProgram(static_cast<GLuint>(previous_program));
+}
+
+} // namespace Gecko
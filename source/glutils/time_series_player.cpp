@@ -0,0 +1,446 @@
+#include "glutils/time_series_player.hpp"
+#include "io/slab_reader.hpp"
+#include "scalar_field/gradient.hpp"
+#include "utils/parallel.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace {
+
+[[nodiscard]] void *mapUnpackBuffer(const GLuint buffer,
+                                    const std::size_t size) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  // The previous upload from the buffer may still be in flight, invalidating
+  // lets the driver hand out fresh memory instead of waiting for it
+  void *const ptr{glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                   static_cast<GLsizeiptr>(size),
+                                   GL_MAP_WRITE_BIT |
+                                       GL_MAP_INVALIDATE_BUFFER_BIT)};
+  if (ptr == nullptr) {
+    throw std::runtime_error{"Could not map pixel unpack buffer"};
+  }
+  return ptr;
+}
+
+void unmapUnpackBuffer(const GLuint buffer) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+    throw std::runtime_error{"Pixel unpack buffer content was lost"};
+  }
+}
+
+} // namespace
+
+TimeSeriesPlayer::TimeSeriesPlayer(TimeSeries series, const Settings &settings)
+    : _series{std::move(series)}, _settings{settings},
+      _volume_texture_format{
+          Utils::volumeTextureFormat(settings.volume_format)},
+      _normal_texture_format{
+          Utils::normalTextureFormat(settings.normal_format)},
+      _slots(std::max<std::size_t>(1, settings.prefetch_steps)) {
+  setStepsPerSecond(_settings.steps_per_second);
+  _settings.prefetch_steps = _slots.size();
+  {
+    const std::unique_ptr<SlabReader> reader{
+        SlabReader::createFromFile(_series.stepFilename(0))};
+    _bounds_min = reader->boundsMin();
+    _bounds_max = reader->boundsMax();
+    _num_elements = reader->numElements();
+  }
+  _macrocells.emplace(_num_elements, _settings.macrocell_size);
+
+  for (TextureSet *const set : {&_front, &_back}) {
+    set->volume_texture = Utils::createVolumeTexture(
+        _volume_texture_format.internal_format, _num_elements);
+    set->normal_texture = Utils::createVolumeTexture(
+        _normal_texture_format.internal_format, _num_elements);
+    set->macrocell_texture = Utils::createVolumeTexture(
+        GL_RG32F, _macrocells->numCells(), GL_NEAREST);
+  }
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  const auto total_elements{static_cast<std::size_t>(_num_elements.x) *
+                            static_cast<std::size_t>(_num_elements.y) *
+                            static_cast<std::size_t>(_num_elements.z)};
+  for (Slot &slot : _slots) {
+    glGenBuffers(1, &slot.scalar_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.scalar_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER,
+                 static_cast<GLsizeiptr>(total_elements *
+                                         _volume_texture_format.element_size),
+                 nullptr, GL_STREAM_DRAW);
+    glGenBuffers(1, &slot.normal_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.normal_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER,
+                 static_cast<GLsizeiptr>(total_elements *
+                                         _normal_texture_format.element_size),
+                 nullptr, GL_STREAM_DRAW);
+  }
+  scheduleReads();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  _worker = std::thread{&TimeSeriesPlayer::workerLoop, this};
+}
+
+TimeSeriesPlayer::~TimeSeriesPlayer() {
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _stop = true;
+  }
+  _pending_condition.notify_all();
+  _worker.join();
+  // Nothing writes to the buffers anymore, release them
+  for (Slot &slot : _slots) {
+    if (slot.scalars != nullptr) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.scalar_buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.normal_buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glDeleteBuffers(1, &slot.scalar_buffer);
+    glDeleteBuffers(1, &slot.normal_buffer);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (_back_fence != nullptr) {
+    glDeleteSync(_back_fence);
+  }
+  for (const TextureSet *const set : {&_front, &_back}) {
+    glDeleteTextures(1, &set->volume_texture);
+    glDeleteTextures(1, &set->normal_texture);
+    glDeleteTextures(1, &set->macrocell_texture);
+  }
+}
+
+void TimeSeriesPlayer::setPlaying(const bool playing,
+                                  const double time) noexcept {
+  if (playing && !_playing) {
+    _next_step_time = time + stepInterval();
+    _late = false;
+  }
+  _playing = playing;
+}
+
+void TimeSeriesPlayer::setStepsPerSecond(
+    const double steps_per_second) noexcept {
+  constexpr static double MIN_STEPS_PER_SECOND{0.01};
+  _settings.steps_per_second =
+      std::max(MIN_STEPS_PER_SECOND, steps_per_second);
+}
+
+void TimeSeriesPlayer::seek(const std::size_t step) {
+  _next_step = step % numSteps();
+  _show_next = true;
+  _late = false;
+  if (_back.step != static_cast<std::int64_t>(_next_step)) {
+    _back.step = -1;
+  }
+  // Queued reads are scheduled again in the new order, the one in progress
+  // completes and its slot is reused if its step is not wanted
+  const std::lock_guard<std::mutex> lock{_mutex};
+  for (const std::size_t slot_index : _pending_slots) {
+    _slots[slot_index].state = SlotState::Idle;
+  }
+  _pending_slots.clear();
+}
+
+void TimeSeriesPlayer::update(const double time) {
+  std::deque<std::size_t> completed_slots;
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    if (_worker_exception) {
+      std::rethrow_exception(_worker_exception);
+    }
+    completed_slots.swap(_completed_slots);
+  }
+  for (const std::size_t slot_index : completed_slots) {
+    Slot &slot{_slots[slot_index]};
+    slot.state = SlotState::Read;
+    ++_read_steps;
+    _total_read_time += slot.read_time;
+  }
+
+  // Upload the next step as soon as it is read, the back set is free until
+  // then
+  if (_back.step != static_cast<std::int64_t>(_next_step)) {
+    const auto slot{std::find_if(
+        _slots.begin(), _slots.end(), [this](const Slot &s) -> bool {
+          return s.state == SlotState::Read && s.step == _next_step;
+        })};
+    if (slot != _slots.end()) {
+      uploadSlot(*slot);
+    }
+  }
+  scheduleReads();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (!_show_next && (!_playing || time < _next_step_time)) {
+    return;
+  }
+  if (!backReady()) {
+    if (!_show_next && !_late) {
+      _late = true;
+      ++_late_steps;
+    }
+    return;
+  }
+  // Keep the cadence unless the step was late or the render loop fell behind
+  // by more than a step
+  const bool rebase{_show_next || _late ||
+                    time >= _next_step_time + stepInterval()};
+  _next_step_time = rebase ? time + stepInterval()
+                           : _next_step_time + stepInterval();
+  std::swap(_front, _back);
+  _back.step = -1;
+  _next_step = (static_cast<std::size_t>(_front.step) + 1) % numSteps();
+  _show_next = false;
+  _late = false;
+  ++_shown_steps;
+}
+
+TimeSeriesPlayer::Statistics TimeSeriesPlayer::statistics() const noexcept {
+  const auto buffered_steps{static_cast<std::size_t>(
+      std::count_if(_slots.begin(), _slots.end(),
+                    [](const Slot &slot) -> bool {
+                      return slot.state == SlotState::Read;
+                    }) +
+      (_back.step != -1 ? 1 : 0))};
+  return {_shown_steps, _late_steps,
+          _read_steps != 0 ? _total_read_time / static_cast<double>(_read_steps)
+                           : 0.,
+          buffered_steps};
+}
+
+std::vector<std::size_t> TimeSeriesPlayer::wantedSteps() const {
+  // The steps in the texture sets are not read again
+  std::vector<std::size_t> steps;
+  for (std::size_t s{0};
+       s != std::min(_settings.prefetch_steps, numSteps()) + 1; ++s) {
+    const std::size_t step{(_next_step + s) % numSteps()};
+    if (static_cast<std::int64_t>(step) != _front.step &&
+        static_cast<std::int64_t>(step) != _back.step &&
+        std::find(steps.begin(), steps.end(), step) == steps.end()) {
+      steps.push_back(step);
+    }
+  }
+  if (steps.size() > _settings.prefetch_steps) {
+    steps.resize(_settings.prefetch_steps);
+  }
+  return steps;
+}
+
+void TimeSeriesPlayer::scheduleReads() {
+  const std::vector<std::size_t> wanted{wantedSteps()};
+  const auto is_wanted{[&](const std::size_t step) -> bool {
+    return std::find(wanted.begin(), wanted.end(), step) != wanted.end();
+  }};
+  // Read steps not wanted anymore, e.g. after a seek, free their slot
+  for (Slot &slot : _slots) {
+    if (slot.state == SlotState::Read && !is_wanted(slot.step)) {
+      slot.state = SlotState::Idle;
+    }
+  }
+
+  std::vector<std::size_t> scheduled;
+  for (const std::size_t step : wanted) {
+    const bool present{std::any_of(
+        _slots.begin(), _slots.end(), [step](const Slot &slot) -> bool {
+          return slot.state != SlotState::Idle && slot.step == step;
+        })};
+    if (present) {
+      continue;
+    }
+    const auto idle{std::find_if(
+        _slots.begin(), _slots.end(), [](const Slot &slot) -> bool {
+          return slot.state == SlotState::Idle;
+        })};
+    if (idle == _slots.end()) {
+      break;
+    }
+    const auto total_elements{static_cast<std::size_t>(_num_elements.x) *
+                              static_cast<std::size_t>(_num_elements.y) *
+                              static_cast<std::size_t>(_num_elements.z)};
+    // Slots freed without being uploaded are still mapped
+    if (idle->scalars == nullptr) {
+      idle->scalars =
+          mapUnpackBuffer(idle->scalar_buffer,
+                          total_elements * _volume_texture_format.element_size);
+      idle->normals =
+          mapUnpackBuffer(idle->normal_buffer,
+                          total_elements * _normal_texture_format.element_size);
+    }
+    idle->step = step;
+    idle->state = SlotState::Reading;
+    scheduled.push_back(static_cast<std::size_t>(idle - _slots.begin()));
+  }
+  if (scheduled.empty()) {
+    return;
+  }
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _pending_slots.insert(_pending_slots.end(), scheduled.begin(),
+                          scheduled.end());
+  }
+  _pending_condition.notify_one();
+}
+
+void TimeSeriesPlayer::uploadSlot(Slot &slot) {
+  if (_back_fence != nullptr) {
+    glDeleteSync(_back_fence);
+    _back_fence = nullptr;
+  }
+  // Sourced from the pixel buffers, the copies to the textures can proceed
+  // asynchronously
+  unmapUnpackBuffer(slot.scalar_buffer);
+  slot.scalars = nullptr;
+  glBindTexture(GL_TEXTURE_3D, _back.volume_texture);
+  Utils::uploadVolumeTexture(_volume_texture_format.format,
+                             _volume_texture_format.type, _num_elements,
+                             _volume_texture_format.element_size, nullptr);
+  unmapUnpackBuffer(slot.normal_buffer);
+  slot.normals = nullptr;
+  glBindTexture(GL_TEXTURE_3D, _back.normal_texture);
+  Utils::uploadVolumeTexture(_normal_texture_format.format,
+                             _normal_texture_format.type, _num_elements,
+                             _normal_texture_format.element_size, nullptr);
+
+  // Ranges come from client memory, not from a pixel buffer
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  const glm::ivec3 &num_cells{_macrocells->numCells()};
+  glBindTexture(GL_TEXTURE_3D, _back.macrocell_texture);
+  glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, num_cells.x, num_cells.y,
+                  num_cells.z, GL_RG, GL_FLOAT, slot.macrocell_ranges.data());
+  glBindTexture(GL_TEXTURE_3D, 0);
+  _back_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  _back.step = static_cast<std::int64_t>(slot.step);
+  _back.quantization = slot.quantization;
+  slot.state = SlotState::Idle;
+}
+
+bool TimeSeriesPlayer::backReady() {
+  if (_back.step != static_cast<std::int64_t>(_next_step) ||
+      _back_fence == nullptr) {
+    return false;
+  }
+  // Flushing makes sure the fence is eventually signaled without a swap
+  const GLenum status{
+      glClientWaitSync(_back_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0)};
+  if (status == GL_TIMEOUT_EXPIRED) {
+    return false;
+  }
+  if (status == GL_WAIT_FAILED) {
+    throw std::runtime_error{"Could not wait for the upload of a timestep"};
+  }
+  glDeleteSync(_back_fence);
+  _back_fence = nullptr;
+  return true;
+}
+
+void TimeSeriesPlayer::readSlot(Slot &slot,
+                                std::vector<float> &scalars_scratch,
+                                std::vector<glm::vec3> &normals_scratch) const {
+  const auto start{std::chrono::steady_clock::now()};
+  const std::string &filename{_series.stepFilename(slot.step)};
+  const std::unique_ptr<SlabReader> reader{
+      SlabReader::createFromFile(filename)};
+  if (reader->numElements() != _num_elements) {
+    throw std::runtime_error{fmt::format(
+        "Timestep {} has {}x{}x{} elements instead of {}x{}x{}", filename,
+        reader->numElements().x, reader->numElements().y,
+        reader->numElements().z, _num_elements.x, _num_elements.y,
+        _num_elements.z)};
+  }
+
+  // Scalars go through the scratch buffer, the macrocell ranges and the
+  // quantization need them and the mapped buffers are write only
+  const std::size_t slice_elements{reader->sliceElements()};
+  const auto num_slices{static_cast<std::size_t>(_num_elements.z)};
+  const std::size_t total_elements{num_slices * slice_elements};
+  scalars_scratch.resize(total_elements);
+  const bool derive_normals{_settings.derive_normals || !reader->hasNormals()};
+  const bool encode_normals{_settings.normal_format != NormalFormat::Float32};
+  glm::vec3 *normals{static_cast<glm::vec3 *>(slot.normals)};
+  if (encode_normals) {
+    normals_scratch.resize(total_elements);
+    normals = normals_scratch.data();
+  }
+  const std::pair<float, float> value_range{
+      reader->readSlab(0, _num_elements.z, scalars_scratch.data(),
+                       derive_normals ? nullptr : normals)};
+  slot.quantization =
+      computeQuantization(_settings.volume_format, value_range);
+
+  // Steps are prepared one at a time, the work on each is split over slices
+  parallelFor(0, num_slices,
+              [&](const std::size_t first, const std::size_t last) -> void {
+                const std::size_t offset{first * slice_elements};
+                const std::size_t count{(last - first) * slice_elements};
+                quantizeValues(_settings.volume_format,
+                               scalars_scratch.data() + offset, count,
+                               slot.quantization,
+                               static_cast<unsigned char *>(slot.scalars) +
+                                   offset *
+                                       _volume_texture_format.element_size);
+                if (derive_normals) {
+                  computeNormalSlices(scalars_scratch.data(), 0,
+                                      _num_elements, reader->voxelSize(),
+                                      static_cast<int>(first),
+                                      static_cast<int>(last),
+                                      normals + offset);
+                }
+                if (encode_normals) {
+                  encodeNormals(_settings.normal_format, normals + offset,
+                                count,
+                                static_cast<unsigned char *>(slot.normals) +
+                                    offset *
+                                        _normal_texture_format.element_size);
+                }
+              });
+
+  slot.macrocell_ranges.resize(_macrocells->layerCells() *
+                               static_cast<std::size_t>(
+                                   _macrocells->numCells().z));
+  _macrocells->computeSlabRanges(scalars_scratch.data(), 0, _num_elements.z,
+                                 slot.macrocell_ranges.data());
+  slot.read_time = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+}
+
+void TimeSeriesPlayer::workerLoop() {
+  std::vector<float> scalars_scratch;
+  std::vector<glm::vec3> normals_scratch;
+  while (true) {
+    std::size_t slot_index;
+    {
+      std::unique_lock<std::mutex> lock{_mutex};
+      _pending_condition.wait(
+          lock, [this]() -> bool { return _stop || !_pending_slots.empty(); });
+      if (_stop) {
+        return;
+      }
+      slot_index = _pending_slots.front();
+      _pending_slots.pop_front();
+    }
+
+    try {
+      readSlot(_slots[slot_index], scalars_scratch, normals_scratch);
+    } catch (...) {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      _worker_exception = std::current_exception();
+      return;
+    }
+
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _completed_slots.push_back(slot_index);
+  }
+}
+
+} // namespace Gecko
@@ -0,0 +1,242 @@
+#include "glutils/time_varying_volume.hpp"
+#include "scalar_field/gradient.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace Gecko {
+
+namespace {
+
+[[nodiscard]] std::size_t boxElements(const glm::ivec3 &size) noexcept {
+  return static_cast<std::size_t>(size.x) * static_cast<std::size_t>(size.y) *
+         static_cast<std::size_t>(size.z);
+}
+
+// Copy the box [origin, origin + size) of a grid of source_size elements to
+// destination, x fastest
+template <typename T>
+void copyBox(const T *source, const glm::ivec3 &source_size,
+             const glm::ivec3 &origin, const glm::ivec3 &size,
+             T *destination) {
+  for (int k{0}; k != size.z; ++k) {
+    for (int j{0}; j != size.y; ++j) {
+      const T *const row{
+          source + static_cast<std::size_t>(origin.x) +
+          static_cast<std::size_t>(source_size.x) *
+              (static_cast<std::size_t>(origin.y + j) +
+               static_cast<std::size_t>(source_size.y) *
+                   static_cast<std::size_t>(origin.z + k))};
+      std::copy_n(row, size.x,
+                  destination + static_cast<std::size_t>(size.x) *
+                                    (static_cast<std::size_t>(j) +
+                                     static_cast<std::size_t>(size.y) *
+                                         static_cast<std::size_t>(k)));
+    }
+  }
+}
+
+} // namespace
+
+TimeVaryingVolume::TimeVaryingVolume(GTVolFile file,
+                                     const GLuint macrocell_texture,
+                                     const Settings &settings)
+    : _file{std::move(file)}, _macrocell_texture{macrocell_texture},
+      _settings{settings},
+      _volume_format{Utils::volumeTextureFormat(settings.volume_format)},
+      _normal_format{Utils::normalTextureFormat(settings.normal_format)},
+      _quantization{
+          computeQuantization(settings.volume_format, _file.valueRange())},
+      _field{ScalarField<float>::createUninitialized(
+          _file.boundsMin(), _file.boundsMax(), _file.numElements().x,
+          _file.numElements().y, _file.numElements().z)},
+      _macrocells{_file.numElements(), settings.macrocell_size} {
+  _volume_texture = Utils::createVolumeTexture(_volume_format.internal_format,
+                                               _file.numElements());
+  _normal_texture = Utils::createVolumeTexture(_normal_format.internal_format,
+                                               _file.numElements());
+  std::vector<std::size_t> bricks;
+  _file.applyStep(0, _field, bricks);
+  _statistics.read_bricks = _file.numStepBricks(0);
+  _statistics.read_bytes = _file.stepBytes(0);
+  // The textures are undefined, all the bricks are uploaded and not only the
+  // ones that differ from the uninitialized field
+  bricks.resize(_file.totalBricks());
+  std::iota(bricks.begin(), bricks.end(), std::size_t{0});
+  uploadBricks(bricks);
+}
+
+TimeVaryingVolume::~TimeVaryingVolume() {
+  glDeleteTextures(1, &_volume_texture);
+  glDeleteTextures(1, &_normal_texture);
+}
+
+void TimeVaryingVolume::setStep(const std::size_t step) {
+  const std::size_t keyframe{_file.previousKeyframe(step)};
+  _statistics = {};
+  if (step == _step) {
+    return;
+  }
+  std::vector<std::size_t> changed_bricks;
+  for (std::size_t s{step > _step && keyframe <= _step ? _step + 1 : keyframe};
+       s <= step; ++s) {
+    _file.applyStep(s, _field, changed_bricks);
+    _statistics.read_bricks += _file.numStepBricks(s);
+    _statistics.read_bytes += _file.stepBytes(s);
+  }
+  // Bricks changed by several steps are uploaded once
+  std::sort(changed_bricks.begin(), changed_bricks.end());
+  changed_bricks.erase(
+      std::unique(changed_bricks.begin(), changed_bricks.end()),
+      changed_bricks.end());
+  uploadBricks(changed_bricks);
+  _step = step;
+}
+
+void TimeVaryingVolume::uploadBricks(const std::vector<std::size_t> &bricks) {
+  const glm::ivec3 num_elements{_file.numElements()};
+  const int brick_size{_file.brickSize()};
+  // Normals are central differences: the normals of the brick grown by one
+  // element change with it, and are computed from the brick grown by two
+  const std::size_t brick_elements{boxElements(glm::ivec3{brick_size})};
+  const std::size_t normal_elements{boxElements(glm::ivec3{brick_size + 2})};
+  const std::size_t scalar_bytes{brick_elements * _volume_format.element_size};
+  const std::size_t normal_bytes{normal_elements *
+                                 _normal_format.element_size};
+
+  // Prepare batches of bricks in parallel and upload them in order, which
+  // bounds the memory used for staging
+  constexpr static std::size_t BATCH_BYTES{std::size_t{64} << 20u};
+  const std::size_t batch_size{std::max<std::size_t>(
+      BATCH_BYTES / (scalar_bytes + normal_bytes), defaultThreadCount())};
+  std::vector<unsigned char> scalars(std::min(batch_size, bricks.size()) *
+                                     scalar_bytes);
+  std::vector<unsigned char> normals(std::min(batch_size, bricks.size()) *
+                                     normal_bytes);
+  for (std::size_t batch_begin{0}; batch_begin < bricks.size();
+       batch_begin += batch_size) {
+    const std::size_t batch_end{
+        std::min(bricks.size(), batch_begin + batch_size)};
+    parallelFor(
+        batch_begin, batch_end,
+        [&](const std::size_t first, const std::size_t last) -> void {
+          std::vector<float> values(brick_elements);
+          std::vector<float> region;
+          std::vector<glm::vec3> region_normals, box_normals;
+          for (std::size_t b{first}; b != last; ++b) {
+            const glm::ivec3 origin{_file.brickOrigin(bricks[b])};
+            const glm::ivec3 end{
+                glm::min(origin + glm::ivec3{brick_size}, num_elements)};
+            copyBox(_field.data(), num_elements, origin, end - origin,
+                    values.data());
+            quantizeValues(_settings.volume_format, values.data(),
+                           boxElements(end - origin), _quantization,
+                           scalars.data() + (b - batch_begin) * scalar_bytes);
+
+            const glm::ivec3 normal_origin{
+                glm::max(origin - glm::ivec3{1}, glm::ivec3{0})};
+            const glm::ivec3 normal_end{
+                glm::min(end + glm::ivec3{1}, num_elements)};
+            const glm::ivec3 region_origin{
+                glm::max(origin - glm::ivec3{2}, glm::ivec3{0})};
+            const glm::ivec3 region_size{
+                glm::min(end + glm::ivec3{2}, num_elements) - region_origin};
+            region.resize(boxElements(region_size));
+            region_normals.resize(region.size());
+            copyBox(_field.data(), num_elements, region_origin, region_size,
+                    region.data());
+            // Region borders inside the field get one sided differences,
+            // they are outside of the box of normals kept
+            computeNormalSlices(region.data(), 0, region_size,
+                                _field.getVoxelSize(), 0, region_size.z,
+                                region_normals.data());
+            box_normals.resize(boxElements(normal_end - normal_origin));
+            copyBox(region_normals.data(), region_size,
+                    normal_origin - region_origin, normal_end - normal_origin,
+                    box_normals.data());
+            encodeNormals(_settings.normal_format, box_normals.data(),
+                          box_normals.size(),
+                          normals.data() + (b - batch_begin) * normal_bytes);
+          }
+        });
+
+    for (std::size_t b{batch_begin}; b != batch_end; ++b) {
+      const glm::ivec3 origin{_file.brickOrigin(bricks[b])};
+      const glm::ivec3 size{
+          glm::min(origin + glm::ivec3{brick_size}, num_elements) - origin};
+      glBindTexture(GL_TEXTURE_3D, _volume_texture);
+      glTexSubImage3D(GL_TEXTURE_3D, 0, origin.x, origin.y, origin.z, size.x,
+                      size.y, size.z, _volume_format.format,
+                      _volume_format.type,
+                      scalars.data() + (b - batch_begin) * scalar_bytes);
+      const glm::ivec3 normal_origin{
+          glm::max(origin - glm::ivec3{1}, glm::ivec3{0})};
+      const glm::ivec3 normal_size{
+          glm::min(origin + size + glm::ivec3{1}, num_elements) -
+          normal_origin};
+      glBindTexture(GL_TEXTURE_3D, _normal_texture);
+      glTexSubImage3D(GL_TEXTURE_3D, 0, normal_origin.x, normal_origin.y,
+                      normal_origin.z, normal_size.x, normal_size.y,
+                      normal_size.z, _normal_format.format,
+                      _normal_format.type,
+                      normals.data() + (b - batch_begin) * normal_bytes);
+      _statistics.uploaded_bytes +=
+          boxElements(size) * _volume_format.element_size +
+          boxElements(normal_size) * _normal_format.element_size;
+    }
+  }
+  _statistics.uploaded_bricks = bricks.size();
+
+  if (_macrocell_texture == 0 || bricks.empty()) {
+    return;
+  }
+  // Cells are shared by neighbouring bricks, collect each one once
+  const glm::ivec3 &num_cells{_macrocells.numCells()};
+  std::vector<unsigned char> dirty(boxElements(num_cells));
+  std::vector<glm::ivec3> cells;
+  for (const std::size_t brick : bricks) {
+    const glm::ivec3 origin{_file.brickOrigin(brick)};
+    const auto [first_cell, last_cell]{_macrocells.cellRange(
+        origin, glm::min(origin + glm::ivec3{brick_size}, num_elements))};
+    for (int cz{first_cell.z}; cz != last_cell.z; ++cz) {
+      for (int cy{first_cell.y}; cy != last_cell.y; ++cy) {
+        for (int cx{first_cell.x}; cx != last_cell.x; ++cx) {
+          const glm::ivec3 cell{cx, cy, cz};
+          unsigned char &cell_dirty{dirty[_macrocells.cellIndex(cell)]};
+          if (cell_dirty == 0) {
+            cell_dirty = 1;
+            cells.push_back(cell);
+          }
+        }
+      }
+    }
+  }
+  parallelFor(0, cells.size(),
+              [&](const std::size_t first, const std::size_t last) -> void {
+                for (std::size_t c{first}; c != last; ++c) {
+                  _macrocells.updateCell(
+                      cells[c],
+                      [this](const int i, const int j, const int k) -> float {
+                        return _field(i, j, k);
+                      });
+                }
+              });
+  // One upload per brick of the cells it covers
+  glBindTexture(GL_TEXTURE_3D, _macrocell_texture);
+  std::vector<glm::vec2> ranges;
+  for (const std::size_t brick : bricks) {
+    const glm::ivec3 origin{_file.brickOrigin(brick)};
+    const auto [first_cell, last_cell]{_macrocells.cellRange(
+        origin, glm::min(origin + glm::ivec3{brick_size}, num_elements))};
+    ranges.resize(boxElements(last_cell - first_cell));
+    copyBox(_macrocells.data(), num_cells, first_cell, last_cell - first_cell,
+            ranges.data());
+    glTexSubImage3D(GL_TEXTURE_3D, 0, first_cell.x, first_cell.y,
+                    first_cell.z, last_cell.x - first_cell.x,
+                    last_cell.y - first_cell.y, last_cell.z - first_cell.z,
+                    GL_RG, GL_FLOAT, ranges.data());
+  }
+}
+
+} // namespace Gecko
@@ -1,6 +1,7 @@
 #include "glutils/utils.hpp"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
 #include <string>
 
 namespace Gecko::Utils {
@@ -98,4 +99,74 @@ void APIENTRY GLDebugCallback(const GLenum source, const GLenum type,
                id, message);
 }
 
+VolumeTextureFormat volumeTextureFormat(const VolumeFormat format) noexcept {
+  switch (format) {
+  case VolumeFormat::Float16: {
+    return {GL_R16F, GL_RED, GL_HALF_FLOAT, sizeof(Half)};
+  }
+  case VolumeFormat::UNorm16: {
+    return {GL_R16, GL_RED, GL_UNSIGNED_SHORT, sizeof(std::uint16_t)};
+  }
+  case VolumeFormat::UNorm8: {
+    return {GL_R8, GL_RED, GL_UNSIGNED_BYTE, sizeof(std::uint8_t)};
+  }
+  default: {
+    return {GL_R32F, GL_RED, GL_FLOAT, sizeof(float)};
+  }
+  }
+}
+
+VolumeTextureFormat normalTextureFormat(const NormalFormat format) noexcept {
+  switch (format) {
+  case NormalFormat::Octahedral16: {
+    return {GL_RG16_SNORM, GL_RG, GL_SHORT, 2 * sizeof(std::int16_t)};
+  }
+  case NormalFormat::Octahedral8: {
+    return {GL_RG8_SNORM, GL_RG, GL_BYTE, 2 * sizeof(std::int8_t)};
+  }
+  default: {
+    return {GL_RGB32F, GL_RGB, GL_FLOAT, sizeof(glm::vec3)};
+  }
+  }
+}
+
+GLuint createVolumeTexture(const GLenum internal_format,
+                           const glm::ivec3 &size, const GLenum filter) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_3D, texture);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER,
+                  static_cast<GLint>(filter));
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER,
+                  static_cast<GLint>(filter));
+  if (GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage) {
+    glTexStorage3D(GL_TEXTURE_3D, 1, internal_format, size.x, size.y, size.z);
+  } else {
+    // Format and type are irrelevant without data, they only need to be valid
+    glTexImage3D(GL_TEXTURE_3D, 0, static_cast<GLint>(internal_format), size.x,
+                 size.y, size.z, 0, GL_RED, GL_FLOAT, nullptr);
+  }
+  return texture;
+}
+
+void uploadVolumeTexture(const GLenum format, const GLenum type,
+                         const glm::ivec3 &size, const std::size_t element_size,
+                         const void *data) {
+  constexpr static std::size_t MAX_UPLOAD_SIZE{256u << 20u};
+  const std::size_t slice_size{static_cast<std::size_t>(size.x) *
+                               static_cast<std::size_t>(size.y) *
+                               element_size};
+  const int slab_depth{static_cast<int>(std::clamp<std::size_t>(
+      MAX_UPLOAD_SIZE / slice_size, 1, static_cast<std::size_t>(size.z)))};
+  const auto bytes{static_cast<const unsigned char *>(data)};
+  for (int z{0}; z < size.z; z += slab_depth) {
+    const int depth{std::min(slab_depth, size.z - z)};
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, z, size.x, size.y, depth, format,
+                    type, bytes + static_cast<std::size_t>(z) * slice_size);
+  }
+}
+
 } // namespace Gecko::Utils
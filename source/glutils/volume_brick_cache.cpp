@@ -0,0 +1,467 @@
+#include "glutils/volume_brick_cache.hpp"
+#include "scalar_field/gradient.hpp"
+#include "utils/parallel.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace Gecko {
+
+namespace {
+
+// Feedback values, 0 means nothing to report. The brick index is stored + 1.
+constexpr std::uint32_t FEEDBACK_RESIDENT_BIT{0x80000000u};
+constexpr std::uint32_t FEEDBACK_INDEX_MASK{0x7FFFFFFFu};
+
+[[nodiscard]] std::uint32_t floatBits(const float value) noexcept {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+} // namespace
+
+VolumeBrickCache::VolumeBrickCache(const ScalarField<float> &field,
+                                   const FieldStorage<glm::vec3> &normals,
+                                   const GLuint macrocell_texture,
+                                   const Settings &settings)
+    : VolumeBrickCache{&field,
+                       nullptr,
+                       nullptr,
+                       normals.size() != 0 ? &normals : nullptr,
+                       glm::ivec3{field.xSize(), field.ySize(), field.zSize()},
+                       field.getVoxelSize(),
+                       macrocell_texture,
+                       settings} {}
+
+VolumeBrickCache::VolumeBrickCache(const CompressedScalarField &field,
+                                   const GLuint macrocell_texture,
+                                   const Settings &settings)
+    : VolumeBrickCache{nullptr,
+                       &field,
+                       nullptr,
+                       nullptr,
+                       glm::ivec3{field.xSize(), field.ySize(), field.zSize()},
+                       field.getVoxelSize(),
+                       macrocell_texture,
+                       settings} {}
+
+VolumeBrickCache::VolumeBrickCache(const OutOfCoreScalarField &field,
+                                   const GLuint macrocell_texture,
+                                   const Settings &settings)
+    : VolumeBrickCache{nullptr,
+                       nullptr,
+                       &field,
+                       nullptr,
+                       glm::ivec3{field.xSize(), field.ySize(), field.zSize()},
+                       field.getVoxelSize(),
+                       macrocell_texture,
+                       settings} {}
+
+VolumeBrickCache::VolumeBrickCache(
+    const ScalarField<float> *field,
+    const CompressedScalarField *compressed_field,
+    const OutOfCoreScalarField *out_of_core_field,
+    const FieldStorage<glm::vec3> *normals, const glm::ivec3 &num_elements,
+    const glm::vec3 &voxel_size, const GLuint macrocell_texture,
+    const Settings &settings)
+    : _field{field}, _compressed_field{compressed_field},
+      _out_of_core_field{out_of_core_field}, _normals{normals},
+      _num_elements{num_elements}, _voxel_size{voxel_size},
+      _macrocell_texture{macrocell_texture}, _settings{settings},
+      _scalar_format{Utils::volumeTextureFormat(settings.volume_format)},
+      _normal_format{Utils::normalTextureFormat(settings.normal_format)} {
+  _settings.brick_size = std::max(1, _settings.brick_size);
+  _settings.feedback_downscale = std::max(1, _settings.feedback_downscale);
+  const int brick_size{_settings.brick_size};
+  // Same as the cells of a MacrocellGrid with cell size brick_size
+  _num_bricks = glm::max((num_elements - glm::ivec3{2}) /
+                                 glm::ivec3{brick_size} +
+                             glm::ivec3{1},
+                         glm::ivec3{1});
+  const std::size_t total_bricks{static_cast<std::size_t>(_num_bricks.x) *
+                                 static_cast<std::size_t>(_num_bricks.y) *
+                                 static_cast<std::size_t>(_num_bricks.z)};
+  if (total_bricks > FEEDBACK_INDEX_MASK) {
+    throw std::runtime_error{"Too many bricks for the brick cache"};
+  }
+
+  // Slots for the budget, laid out in an atlas as close to a cube as the
+  // maximum texture size allows
+  const auto padded_size{static_cast<std::size_t>(brick_size + 1)};
+  const std::size_t slot_bytes{
+      padded_size * padded_size * padded_size *
+      (_scalar_format.element_size + _normal_format.element_size)};
+  GLint max_texture_size;
+  glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_texture_size);
+  const std::size_t max_axis_slots{std::max<std::size_t>(
+      1, static_cast<std::size_t>(max_texture_size) / padded_size)};
+  const std::size_t requested_slots{std::clamp<std::size_t>(
+      _settings.memory_budget / slot_bytes, 1, total_bricks)};
+  const auto slots_x{std::min(
+      max_axis_slots,
+      static_cast<std::size_t>(
+          std::ceil(std::cbrt(static_cast<double>(requested_slots)))))};
+  const auto slots_y{std::min(
+      max_axis_slots, static_cast<std::size_t>(std::ceil(std::sqrt(
+                          static_cast<double>(requested_slots) /
+                          static_cast<double>(slots_x)))))};
+  const std::size_t slots_z{
+      std::min(max_axis_slots, (requested_slots + slots_x * slots_y - 1) /
+                                   (slots_x * slots_y))};
+  _atlas_slots = glm::ivec3{static_cast<int>(slots_x),
+                            static_cast<int>(slots_y),
+                            static_cast<int>(slots_z)};
+  _slots.resize(std::min(requested_slots, slots_x * slots_y * slots_z));
+  _free_slots.reserve(_slots.size());
+  for (std::size_t s{_slots.size()}; s != 0; --s) {
+    _free_slots.push_back(s - 1);
+  }
+  spdlog::info("Brick cache with {} slots of {}^3 elements for {} bricks",
+               _slots.size(), padded_size, total_bricks);
+
+  _scalar_atlas =
+      Utils::createVolumeTexture(_scalar_format.internal_format, atlasSize());
+  _normal_atlas =
+      Utils::createVolumeTexture(_normal_format.internal_format, atlasSize());
+  // All bricks start missing
+  _page_entries.resize(total_bricks, glm::uvec4{0u});
+  _page_table =
+      Utils::createVolumeTexture(GL_RGBA32UI, _num_bricks, GL_NEAREST);
+  glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, _num_bricks.x, _num_bricks.y,
+                  _num_bricks.z, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
+                  _page_entries.data());
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  glGenFramebuffers(1, &_feedback_framebuffer);
+  glGenRenderbuffers(1, &_feedback_renderbuffer);
+  glGenBuffers(static_cast<GLsizei>(_feedback_buffers.size()),
+               _feedback_buffers.data());
+}
+
+VolumeBrickCache::~VolumeBrickCache() {
+  glDeleteBuffers(static_cast<GLsizei>(_feedback_buffers.size()),
+                  _feedback_buffers.data());
+  glDeleteRenderbuffers(1, &_feedback_renderbuffer);
+  glDeleteFramebuffers(1, &_feedback_framebuffer);
+  glDeleteTextures(1, &_page_table);
+  glDeleteTextures(1, &_normal_atlas);
+  glDeleteTextures(1, &_scalar_atlas);
+}
+
+void VolumeBrickCache::beginFeedback(const int viewport_width,
+                                     const int viewport_height) {
+  const glm::ivec2 size{
+      glm::max(glm::ivec2{viewport_width, viewport_height} /
+                   _settings.feedback_downscale,
+               glm::ivec2{1})};
+  glBindFramebuffer(GL_FRAMEBUFFER, _feedback_framebuffer);
+  if (size != _feedback_size) {
+    _feedback_size = size;
+    glBindRenderbuffer(GL_RENDERBUFFER, _feedback_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, _feedback_renderbuffer);
+  }
+  glViewport(0, 0, size.x, size.y);
+  glClearColor(0.f, 0.f, 0.f, 0.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void VolumeBrickCache::endFeedback() {
+  const GLuint buffer{_feedback_buffers[_feedback_index]};
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+  if (_feedback_buffer_sizes[_feedback_index] != _feedback_size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER,
+                 static_cast<GLsizeiptr>(_feedback_size.x) * _feedback_size.y *
+                     static_cast<GLsizeiptr>(sizeof(std::uint32_t)),
+                 nullptr, GL_STREAM_READ);
+    _feedback_buffer_sizes[_feedback_index] = _feedback_size;
+  }
+  // Asynchronous, the data is only waited for when mapped by update()
+  glReadPixels(0, 0, _feedback_size.x, _feedback_size.y, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  _feedback_index = (_feedback_index + 1) % _feedback_buffers.size();
+}
+
+bool VolumeBrickCache::update() {
+  ++_frame;
+
+  // Latest feedback read back, rendered the frame before
+  const std::size_t read_index{(_feedback_index + _feedback_buffers.size() -
+                                1) %
+                               _feedback_buffers.size()};
+  const glm::ivec2 read_size{_feedback_buffer_sizes[read_index]};
+  if (read_size.x == 0) {
+    return false;
+  }
+  std::unordered_map<std::size_t, std::size_t> requests;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, _feedback_buffers[read_index]);
+  const auto *const feedback{static_cast<const std::uint32_t *>(
+      glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY))};
+  if (feedback != nullptr) {
+    const std::size_t count{static_cast<std::size_t>(read_size.x) *
+                            static_cast<std::size_t>(read_size.y)};
+    for (std::size_t p{0}; p != count; ++p) {
+      const std::uint32_t value{feedback[p]};
+      if (value == 0u) {
+        continue;
+      }
+      const std::size_t brick{(value & FEEDBACK_INDEX_MASK) - 1u};
+      const glm::uvec4 &entry{_page_entries[brick]};
+      if (entry.w == static_cast<std::uint32_t>(BrickState::Resident)) {
+        touchSlot(entry.x + static_cast<std::size_t>(_atlas_slots.x) *
+                                (entry.y + static_cast<std::size_t>(
+                                               _atlas_slots.y) *
+                                               entry.z));
+      } else if (entry.w == static_cast<std::uint32_t>(BrickState::Missing)) {
+        // Resident reports of bricks evicted since are stale, ignore them
+        if ((value & FEEDBACK_RESIDENT_BIT) == 0u) {
+          ++requests[brick];
+        }
+      }
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (requests.empty()) {
+    return false;
+  }
+
+  // Bricks hit by the most rays first
+  std::vector<std::pair<std::size_t, std::size_t>> sorted_requests(
+      requests.begin(), requests.end());
+  const std::size_t num_loads{
+      std::min(sorted_requests.size(), _settings.max_loads_per_update)};
+  std::partial_sort(
+      sorted_requests.begin(),
+      sorted_requests.begin() + static_cast<std::ptrdiff_t>(num_loads),
+      sorted_requests.end(),
+      [](const std::pair<std::size_t, std::size_t> &a,
+         const std::pair<std::size_t, std::size_t> &b) -> bool {
+        return a.second > b.second;
+      });
+
+  std::vector<BrickData> loaded(num_loads);
+  for (std::size_t l{0}; l != num_loads; ++l) {
+    loaded[l].brick = sorted_requests[l].first;
+  }
+  parallelFor(0, num_loads,
+              [&](const std::size_t first, const std::size_t last) -> void {
+                BrickScratch scratch;
+                for (std::size_t l{first}; l != last; ++l) {
+                  loadBrick(loaded[l], scratch);
+                }
+              });
+  for (const BrickData &data : loaded) {
+    storeBrick(data);
+  }
+  glBindTexture(GL_TEXTURE_3D, 0);
+  return true;
+}
+
+glm::ivec3
+VolumeBrickCache::brickCoordinates(const std::size_t brick) const noexcept {
+  const auto bricks_x{static_cast<std::size_t>(_num_bricks.x)};
+  const auto bricks_y{static_cast<std::size_t>(_num_bricks.y)};
+  return glm::ivec3{static_cast<int>(brick % bricks_x),
+                    static_cast<int>(brick / bricks_x % bricks_y),
+                    static_cast<int>(brick / (bricks_x * bricks_y))};
+}
+
+void VolumeBrickCache::readRegion(const glm::ivec3 &origin,
+                                  const glm::ivec3 &size,
+                                  float *values) const {
+  if (_compressed_field != nullptr) {
+    _compressed_field->decompressRegion(origin, size, values);
+    return;
+  }
+  if (_out_of_core_field != nullptr) {
+    _out_of_core_field->readRegion(origin, size, values);
+    return;
+  }
+  for (int k{0}; k != size.z; ++k) {
+    for (int j{0}; j != size.y; ++j) {
+      std::copy_n(&(*_field)(origin.x, origin.y + j, origin.z + k), size.x,
+                  values + static_cast<std::size_t>(size.x) *
+                               (static_cast<std::size_t>(j) +
+                                static_cast<std::size_t>(size.y) *
+                                    static_cast<std::size_t>(k)));
+    }
+  }
+}
+
+void VolumeBrickCache::loadBrick(BrickData &data,
+                                 BrickScratch &scratch) const {
+  const int padded_size{_settings.brick_size + 1};
+  const auto padded_elements{static_cast<std::size_t>(padded_size) *
+                             static_cast<std::size_t>(padded_size) *
+                             static_cast<std::size_t>(padded_size)};
+  const glm::ivec3 origin{brickCoordinates(data.brick) *
+                          _settings.brick_size};
+  const glm::ivec3 last{_num_elements - glm::ivec3{1}};
+
+  // Copy the brick elements out of a source with the given origin and size,
+  // elements past the end of the field repeat the last one as with clamp to
+  // edge filtering
+  const auto extract{[&](const auto *source, const glm::ivec3 &source_origin,
+                         const glm::ivec3 &source_size, auto *brick) -> void {
+    const int row_count{std::min(padded_size, _num_elements.x - origin.x)};
+    for (int k{0}; k != padded_size; ++k) {
+      const int z{std::min(origin.z + k, last.z) - source_origin.z};
+      for (int j{0}; j != padded_size; ++j) {
+        const int y{std::min(origin.y + j, last.y) - source_origin.y};
+        const auto *const row{
+            source + static_cast<std::size_t>(origin.x - source_origin.x) +
+            static_cast<std::size_t>(source_size.x) *
+                (static_cast<std::size_t>(y) +
+                 static_cast<std::size_t>(source_size.y) *
+                     static_cast<std::size_t>(z))};
+        auto *const brick_row{
+            brick + static_cast<std::size_t>(padded_size) *
+                        (static_cast<std::size_t>(j) +
+                         static_cast<std::size_t>(padded_size) *
+                             static_cast<std::size_t>(k))};
+        std::copy_n(row, row_count, brick_row);
+        std::fill(brick_row + row_count, brick_row + padded_size,
+                  brick_row[row_count - 1]);
+      }
+    }
+  }};
+
+  // Central differences need the elements around the brick when normals are
+  // derived, normals on the border of the region are wrong but never used
+  // unless the region border is the field border
+  const int apron{_normals == nullptr ? 1 : 0};
+  const glm::ivec3 region_min{glm::max(origin - glm::ivec3{apron}, 0)};
+  const glm::ivec3 region_max{
+      glm::min(origin + glm::ivec3{_settings.brick_size + apron}, last)};
+  const glm::ivec3 region_size{region_max - region_min + glm::ivec3{1}};
+  const std::size_t region_elements{static_cast<std::size_t>(region_size.x) *
+                                    static_cast<std::size_t>(region_size.y) *
+                                    static_cast<std::size_t>(region_size.z)};
+  scratch.region.resize(region_elements);
+  readRegion(region_min, region_size, scratch.region.data());
+
+  scratch.scalars.resize(padded_elements);
+  extract(scratch.region.data(), region_min, region_size,
+          scratch.scalars.data());
+  scratch.normals.resize(padded_elements);
+  if (_normals != nullptr) {
+    extract(_normals->data(), glm::ivec3{0}, _num_elements,
+            scratch.normals.data());
+  } else {
+    scratch.region_normals.resize(region_elements);
+    computeNormalSlices(scratch.region.data(), 0, region_size, _voxel_size, 0,
+                        region_size.z, scratch.region_normals.data());
+    extract(scratch.region_normals.data(), region_min, region_size,
+            scratch.normals.data());
+  }
+
+  const auto [range_min, range_max]{
+      std::minmax_element(scratch.scalars.begin(), scratch.scalars.end())};
+  data.range = glm::vec2{*range_min, *range_max};
+  data.constant = data.range.x == data.range.y &&
+                  std::all_of(scratch.normals.begin(), scratch.normals.end(),
+                              [](const glm::vec3 &n) -> bool {
+                                return n == glm::vec3{0.f};
+                              });
+  if (data.constant) {
+    return;
+  }
+  data.scalars.resize(padded_elements * _scalar_format.element_size);
+  quantizeValues(_settings.volume_format, scratch.scalars.data(),
+                 padded_elements, _settings.quantization, data.scalars.data());
+  data.normals.resize(padded_elements * _normal_format.element_size);
+  encodeNormals(_settings.normal_format, scratch.normals.data(),
+                padded_elements, data.normals.data());
+}
+
+bool VolumeBrickCache::acquireSlot(std::size_t &slot_index) {
+  if (!_free_slots.empty()) {
+    slot_index = _free_slots.back();
+    _free_slots.pop_back();
+  } else {
+    slot_index = _lru.back();
+    Slot &slot{_slots[slot_index]};
+    if (slot.last_used == _frame) {
+      return false;
+    }
+    _lru.pop_back();
+    setPageEntry(static_cast<std::size_t>(slot.brick), glm::uvec4{0u});
+  }
+  _lru.push_front(slot_index);
+  _slots[slot_index].lru_position = _lru.begin();
+  _slots[slot_index].last_used = _frame;
+  return true;
+}
+
+void VolumeBrickCache::touchSlot(const std::size_t slot_index) noexcept {
+  Slot &slot{_slots[slot_index]};
+  slot.last_used = _frame;
+  _lru.splice(_lru.begin(), _lru, slot.lru_position);
+}
+
+void VolumeBrickCache::storeBrick(const BrickData &data) {
+  if (data.constant) {
+    setPageEntry(data.brick,
+                 glm::uvec4{floatBits(data.range.x), 0u, 0u,
+                            static_cast<std::uint32_t>(BrickState::Constant)});
+  } else {
+    std::size_t slot_index;
+    if (!acquireSlot(slot_index)) {
+      // Every slot is in view, the brick is requested again next frame
+      return;
+    }
+    _slots[slot_index].brick = static_cast<std::int64_t>(data.brick);
+    const glm::ivec3 slot{
+        static_cast<int>(slot_index % static_cast<std::size_t>(_atlas_slots.x)),
+        static_cast<int>(slot_index / static_cast<std::size_t>(_atlas_slots.x) %
+                         static_cast<std::size_t>(_atlas_slots.y)),
+        static_cast<int>(slot_index /
+                         (static_cast<std::size_t>(_atlas_slots.x) *
+                          static_cast<std::size_t>(_atlas_slots.y)))};
+    const int padded_size{_settings.brick_size + 1};
+    const glm::ivec3 offset{slot * padded_size};
+    glBindTexture(GL_TEXTURE_3D, _scalar_atlas);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, offset.x, offset.y, offset.z,
+                    padded_size, padded_size, padded_size,
+                    _scalar_format.format, _scalar_format.type,
+                    data.scalars.data());
+    glBindTexture(GL_TEXTURE_3D, _normal_atlas);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, offset.x, offset.y, offset.z,
+                    padded_size, padded_size, padded_size,
+                    _normal_format.format, _normal_format.type,
+                    data.normals.data());
+    setPageEntry(data.brick,
+                 glm::uvec4{glm::uvec3{slot},
+                            static_cast<std::uint32_t>(BrickState::Resident)});
+  }
+
+  // Ranges stay valid after eviction, empty bricks keep being skipped
+  if (_macrocell_texture != 0) {
+    const glm::ivec3 cell{brickCoordinates(data.brick)};
+    glBindTexture(GL_TEXTURE_3D, _macrocell_texture);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, cell.x, cell.y, cell.z, 1, 1, 1, GL_RG,
+                    GL_FLOAT, &data.range);
+  }
+}
+
+void VolumeBrickCache::setPageEntry(const std::size_t brick,
+                                    const glm::uvec4 &entry) {
+  _page_entries[brick] = entry;
+  const glm::ivec3 coordinates{brickCoordinates(brick)};
+  glBindTexture(GL_TEXTURE_3D, _page_table);
+  glTexSubImage3D(GL_TEXTURE_3D, 0, coordinates.x, coordinates.y,
+                  coordinates.z, 1, 1, 1, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
+                  &entry);
+}
+
+} // namespace Gecko
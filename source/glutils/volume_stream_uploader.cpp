@@ -0,0 +1,296 @@
+#include "glutils/volume_stream_uploader.hpp"
+#include "scalar_field/gradient.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace {
+
+[[nodiscard]] void *mapUnpackBuffer(const GLuint buffer,
+                                    const std::size_t size) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  // Invalidating lets the driver hand out fresh memory instead of waiting for
+  // a previous upload from the same buffer to complete
+  void *const ptr{glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                   static_cast<GLsizeiptr>(size),
+                                   GL_MAP_WRITE_BIT |
+                                       GL_MAP_INVALIDATE_BUFFER_BIT)};
+  if (ptr == nullptr) {
+    throw std::runtime_error{"Could not map pixel unpack buffer"};
+  }
+  return ptr;
+}
+
+void unmapUnpackBuffer(const GLuint buffer) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+    throw std::runtime_error{"Pixel unpack buffer content was lost"};
+  }
+}
+
+} // namespace
+
+VolumeStreamUploader::VolumeStreamUploader(
+    std::shared_ptr<const SlabReader> reader, const Settings &settings)
+    : _reader{std::move(reader)}, _settings{settings},
+      _volume_texture_format{
+          Utils::volumeTextureFormat(settings.volume_format)},
+      _normal_texture_format{
+          Utils::normalTextureFormat(settings.normal_format)},
+      _value_range{std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::lowest()},
+      _slots(std::max<std::size_t>(1, settings.num_buffers)) {
+  _settings.derive_normals =
+      _settings.derive_normals && _settings.normal_texture != 0;
+  _settings.slab_depth = std::max(1, _settings.slab_depth);
+  if (_settings.macrocell_texture != 0) {
+    // Cells start without data, which is never skipped
+    _macrocells.emplace(_reader->numElements(), _settings.macrocell_size);
+    uploadMacrocellLayers(0, _macrocells->numCells().z);
+  }
+
+  const std::size_t slab_elements{
+      static_cast<std::size_t>(_settings.slab_depth) *
+      _reader->sliceElements()};
+  for (Slot &slot : _slots) {
+    glGenBuffers(1, &slot.scalar_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.scalar_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER,
+                 static_cast<GLsizeiptr>(slab_elements *
+                                         _volume_texture_format.element_size),
+                 nullptr, GL_STREAM_DRAW);
+    if (_settings.normal_texture != 0) {
+      glGenBuffers(1, &slot.normal_buffer);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.normal_buffer);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER,
+                   static_cast<GLsizeiptr>(slab_elements *
+                                           _normal_texture_format.element_size),
+                   nullptr, GL_STREAM_DRAW);
+    }
+  }
+  for (std::size_t s{0}; s != _slots.size(); ++s) {
+    schedule(s);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  const std::size_t num_workers{
+      std::min<std::size_t>(_slots.size(), defaultThreadCount())};
+  for (std::size_t w{0}; w != num_workers; ++w) {
+    _workers.emplace_back(&VolumeStreamUploader::workerLoop, this);
+  }
+}
+
+VolumeStreamUploader::~VolumeStreamUploader() {
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _stop = true;
+  }
+  _pending_condition.notify_all();
+  for (std::thread &worker : _workers) {
+    worker.join();
+  }
+  // Nothing writes to the buffers anymore, release them
+  for (Slot &slot : _slots) {
+    if (slot.scalars != nullptr) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.scalar_buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    if (slot.normals != nullptr) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.normal_buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glDeleteBuffers(1, &slot.scalar_buffer);
+    if (slot.normal_buffer != 0) {
+      glDeleteBuffers(1, &slot.normal_buffer);
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+bool VolumeStreamUploader::update() {
+  std::deque<std::size_t> completed_slots;
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    if (_worker_exception) {
+      std::rethrow_exception(_worker_exception);
+    }
+    completed_slots.swap(_completed_slots);
+  }
+
+  const glm::ivec3 &num_elements{_reader->numElements()};
+  for (const std::size_t slot_index : completed_slots) {
+    Slot &slot{_slots[slot_index]};
+    const int depth{slot.z_end - slot.z_begin};
+
+    unmapUnpackBuffer(slot.scalar_buffer);
+    slot.scalars = nullptr;
+    glBindTexture(GL_TEXTURE_3D, _settings.volume_texture);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, slot.z_begin, num_elements.x,
+                    num_elements.y, depth, _volume_texture_format.format,
+                    _volume_texture_format.type, nullptr);
+    if (slot.normals != nullptr) {
+      unmapUnpackBuffer(slot.normal_buffer);
+      slot.normals = nullptr;
+      glBindTexture(GL_TEXTURE_3D, _settings.normal_texture);
+      glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, slot.z_begin, num_elements.x,
+                      num_elements.y, depth, _normal_texture_format.format,
+                      _normal_texture_format.type, nullptr);
+    }
+
+    if (_macrocells) {
+      const auto [layer_begin, layer_end]{slot.macrocell_layers};
+      _macrocells->mergeLayers(layer_begin, layer_end,
+                               slot.macrocell_ranges.data());
+      uploadMacrocellLayers(layer_begin, layer_end);
+    }
+
+    _uploaded_slices += depth;
+    _value_range.first = std::min(_value_range.first, slot.value_range.first);
+    _value_range.second =
+        std::max(_value_range.second, slot.value_range.second);
+    // Reuse the buffers for the next slab
+    schedule(slot_index);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  return finished();
+}
+
+void VolumeStreamUploader::schedule(const std::size_t slot_index) {
+  if (_next_slice == _reader->numElements().z) {
+    return;
+  }
+  Slot &slot{_slots[slot_index]};
+  slot.z_begin = _next_slice;
+  slot.z_end = std::min(_next_slice + _settings.slab_depth,
+                        _reader->numElements().z);
+  _next_slice = slot.z_end;
+
+  const std::size_t slab_elements{
+      static_cast<std::size_t>(slot.z_end - slot.z_begin) *
+      _reader->sliceElements()};
+  slot.scalars = mapUnpackBuffer(
+      slot.scalar_buffer, slab_elements * _volume_texture_format.element_size);
+  if (slot.normal_buffer != 0) {
+    slot.normals =
+        mapUnpackBuffer(slot.normal_buffer,
+                        slab_elements * _normal_texture_format.element_size);
+  }
+
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _pending_slots.push_back(slot_index);
+  }
+  _pending_condition.notify_one();
+}
+
+std::pair<float, float>
+VolumeStreamUploader::readSlot(Slot &slot, std::vector<float> &scalars_scratch,
+                               std::vector<glm::vec3> &normals_scratch) const {
+  const std::size_t slice_elements{_reader->sliceElements()};
+  const std::size_t slab_elements{
+      static_cast<std::size_t>(slot.z_end - slot.z_begin) * slice_elements};
+  // Normals are read or computed in place unless they need encoding
+  const bool encode_normals{slot.normals != nullptr &&
+                            _settings.normal_format != NormalFormat::Float32};
+  glm::vec3 *normals{static_cast<glm::vec3 *>(slot.normals)};
+  if (encode_normals) {
+    normals_scratch.resize(slab_elements);
+    normals = normals_scratch.data();
+  }
+
+  std::pair<float, float> value_range;
+  if (_settings.volume_format == VolumeFormat::Float32 &&
+      !_settings.derive_normals && !_macrocells) {
+    value_range =
+        _reader->readSlab(slot.z_begin, slot.z_end,
+                          static_cast<float *>(slot.scalars), normals);
+  } else {
+    // Central differences along z need the slices next to the slab
+    const int halo{_settings.derive_normals ? 1 : 0};
+    const int z_first{std::max(slot.z_begin - halo, 0)};
+    const int z_last{std::min(slot.z_end + halo, _reader->numElements().z)};
+    scalars_scratch.resize(static_cast<std::size_t>(z_last - z_first) *
+                           slice_elements);
+    value_range =
+        _reader->readSlab(z_first, z_last, scalars_scratch.data(),
+                          _settings.derive_normals ? nullptr : normals);
+    const float *const slab_scalars{
+        scalars_scratch.data() +
+        static_cast<std::size_t>(slot.z_begin - z_first) * slice_elements};
+    quantizeValues(_settings.volume_format, slab_scalars, slab_elements,
+                   _settings.quantization, slot.scalars);
+
+    if (_settings.derive_normals) {
+      computeNormalSlices(scalars_scratch.data(), z_first,
+                          _reader->numElements(), _reader->voxelSize(),
+                          slot.z_begin, slot.z_end, normals);
+    }
+    if (_macrocells) {
+      slot.macrocell_layers =
+          _macrocells->cellLayers(slot.z_begin, slot.z_end);
+      slot.macrocell_ranges.resize(
+          static_cast<std::size_t>(slot.macrocell_layers.second -
+                                   slot.macrocell_layers.first) *
+          _macrocells->layerCells());
+      _macrocells->computeSlabRanges(slab_scalars, slot.z_begin, slot.z_end,
+                                     slot.macrocell_ranges.data());
+    }
+  }
+
+  if (encode_normals) {
+    encodeNormals(_settings.normal_format, normals, slab_elements,
+                  slot.normals);
+  }
+  return value_range;
+}
+
+void VolumeStreamUploader::uploadMacrocellLayers(const int layer_begin,
+                                                 const int layer_end) const {
+  const glm::ivec3 &num_cells{_macrocells->numCells()};
+  // Ranges come from client memory, not from a pixel buffer
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_3D, _settings.macrocell_texture);
+  glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, layer_begin, num_cells.x,
+                  num_cells.y, layer_end - layer_begin, GL_RG, GL_FLOAT,
+                  _macrocells->data() +
+                      static_cast<std::size_t>(layer_begin) *
+                          _macrocells->layerCells());
+}
+
+void VolumeStreamUploader::workerLoop() {
+  std::vector<float> scalars_scratch;
+  std::vector<glm::vec3> normals_scratch;
+  while (true) {
+    std::size_t slot_index;
+    {
+      std::unique_lock<std::mutex> lock{_mutex};
+      _pending_condition.wait(
+          lock, [this]() -> bool { return _stop || !_pending_slots.empty(); });
+      if (_stop) {
+        return;
+      }
+      slot_index = _pending_slots.front();
+      _pending_slots.pop_front();
+    }
+
+    Slot &slot{_slots[slot_index]};
+    try {
+      slot.value_range = readSlot(slot, scalars_scratch, normals_scratch);
+    } catch (...) {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      _worker_exception = std::current_exception();
+      return;
+    }
+
+    const std::lock_guard<std::mutex> lock{_mutex};
+    _completed_slots.push_back(slot_index);
+  }
+}
+
+} // namespace Gecko
@@ -0,0 +1,145 @@
+#include "io/brick_codec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace {
+
+constexpr std::size_t MAX_LITERAL{128};
+constexpr std::size_t MIN_RUN{3};
+constexpr std::size_t MAX_RUN{MIN_RUN + 127};
+
+// Append the run length encoding of bytes to encoded
+void encodeRuns(const unsigned char *bytes, const std::size_t size,
+                std::vector<unsigned char> &encoded) {
+  std::size_t literal_begin{0};
+  const auto flush_literals{[&](const std::size_t end) -> void {
+    while (literal_begin != end) {
+      const std::size_t length{std::min(MAX_LITERAL, end - literal_begin)};
+      encoded.push_back(static_cast<unsigned char>(length - 1));
+      encoded.insert(encoded.end(), bytes + literal_begin,
+                     bytes + literal_begin + length);
+      literal_begin += length;
+    }
+  }};
+  std::size_t b{0};
+  while (b != size) {
+    const std::size_t run_end{static_cast<std::size_t>(
+        std::find_if(bytes + b, bytes + std::min(size, b + MAX_RUN),
+                     [value{bytes[b]}](const unsigned char other) -> bool {
+                       return other != value;
+                     }) -
+        bytes)};
+    if (run_end - b >= MIN_RUN) {
+      flush_literals(b);
+      encoded.push_back(
+          static_cast<unsigned char>(run_end - b - MIN_RUN + 128));
+      encoded.push_back(bytes[b]);
+      b = run_end;
+      literal_begin = b;
+    } else {
+      ++b;
+    }
+  }
+  flush_literals(size);
+}
+
+void decodeRuns(const unsigned char *encoded, const std::size_t size,
+                unsigned char *bytes, const std::size_t expected_size) {
+  std::size_t e{0}, b{0};
+  while (e != size) {
+    const unsigned char control{encoded[e++]};
+    if (control < 128) {
+      const std::size_t length{std::size_t{control} + 1};
+      if (e + length > size || b + length > expected_size) {
+        throw std::runtime_error{"Corrupt literal run in compressed brick"};
+      }
+      std::memcpy(bytes + b, encoded + e, length);
+      e += length;
+      b += length;
+    } else {
+      const std::size_t length{std::size_t{control} - 128 + MIN_RUN};
+      if (e == size || b + length > expected_size) {
+        throw std::runtime_error{"Corrupt repeated run in compressed brick"};
+      }
+      std::memset(bytes + b, encoded[e++], length);
+      b += length;
+    }
+  }
+  if (b != expected_size) {
+    throw std::runtime_error{"Compressed brick has the wrong size"};
+  }
+}
+
+} // namespace
+
+std::size_t compressBrick(const float *values, const std::size_t count,
+                          std::vector<unsigned char> &encoded) {
+  // Delta of the bit patterns, shuffled in byte planes
+  std::vector<unsigned char> planes(count * sizeof(std::uint32_t));
+  std::uint32_t previous{0};
+  for (std::size_t v{0}; v != count; ++v) {
+    std::uint32_t bits;
+    std::memcpy(&bits, values + v, sizeof(bits));
+    const std::uint32_t delta{bits - previous};
+    previous = bits;
+    for (std::size_t p{0}; p != sizeof(std::uint32_t); ++p) {
+      planes[p * count + v] = static_cast<unsigned char>(delta >> (8u * p));
+    }
+  }
+  const std::size_t initial_size{encoded.size()};
+  encodeRuns(planes.data(), planes.size(), encoded);
+  return encoded.size() - initial_size;
+}
+
+void decompressBrick(const unsigned char *encoded, const std::size_t size,
+                     float *values, const std::size_t count,
+                     std::vector<unsigned char> &scratch) {
+  scratch.resize(count * sizeof(std::uint32_t));
+  decodeRuns(encoded, size, scratch.data(), scratch.size());
+  // Gather the planes a chunk at a time, plane by plane so the loops vectorize
+  constexpr static std::size_t CHUNK_SIZE{1024};
+  std::array<std::uint32_t, CHUNK_SIZE> deltas;
+  std::uint32_t previous{0};
+  for (std::size_t chunk{0}; chunk < count; chunk += CHUNK_SIZE) {
+    const std::size_t chunk_count{std::min(CHUNK_SIZE, count - chunk)};
+    std::fill_n(deltas.begin(), chunk_count, 0u);
+    for (std::size_t p{0}; p != sizeof(std::uint32_t); ++p) {
+      const unsigned char *const plane{scratch.data() + p * count + chunk};
+      for (std::size_t v{0}; v != chunk_count; ++v) {
+        deltas[v] |= static_cast<std::uint32_t>(plane[v]) << (8u * p);
+      }
+    }
+    for (std::size_t v{0}; v != chunk_count; ++v) {
+      previous += deltas[v];
+      std::memcpy(values + chunk + v, &previous, sizeof(previous));
+    }
+  }
+}
+
+void extractBrick(const ScalarField<float> &field, const glm::ivec3 &origin,
+                  const int brick_size, float *brick) {
+  const glm::ivec3 last{field.xSize() - 1, field.ySize() - 1,
+                        field.zSize() - 1};
+  const int row_count{std::min(brick_size, field.xSize() - origin.x)};
+  for (int k{0}; k != brick_size; ++k) {
+    const int z{std::min(origin.z + k, last.z)};
+    for (int j{0}; j != brick_size; ++j) {
+      const int y{std::min(origin.y + j, last.y)};
+      float *const brick_row{brick + static_cast<std::size_t>(brick_size) *
+                                         (static_cast<std::size_t>(j) +
+                                          static_cast<std::size_t>(brick_size) *
+                                              static_cast<std::size_t>(k))};
+      std::copy_n(&field(origin.x, y, z), row_count, brick_row);
+      std::fill(brick_row + row_count, brick_row + brick_size,
+                brick_row[row_count - 1]);
+    }
+  }
+}
+
+} // namespace Gecko
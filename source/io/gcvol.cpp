@@ -0,0 +1,325 @@
+#include "io/gcvol.hpp"
+#include "io/brick_codec.hpp"
+#include "utils/parallel.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+
+namespace Gecko {
+
+bool isGCVolFilename(const std::string &filename) noexcept {
+  constexpr static std::string_view EXTENSION{".gcvol"};
+  return filename.size() >= EXTENSION.size() &&
+         filename.compare(filename.size() - EXTENSION.size(),
+                          EXTENSION.size(), EXTENSION) == 0;
+}
+
+GCVolFile GCVolFile::createFromFile(const std::string &filename) {
+  auto file{std::make_shared<MappedFile>(MappedFile::createFromFile(filename))};
+  if (file->size() < sizeof(GCVolHeader)) {
+    throw std::runtime_error{
+        fmt::format("File {} is too small to be a .gcvol file", filename)};
+  }
+  GCVolHeader header;
+  std::memcpy(&header, file->data(), sizeof(GCVolHeader));
+
+  if (header.magic != GCVOL_MAGIC) {
+    throw std::runtime_error{
+        fmt::format("File {} is not a .gcvol file", filename)};
+  }
+  if (header.version != GCVOL_VERSION) {
+    throw std::runtime_error{fmt::format(
+        "Unsupported .gcvol version {} in file {}", header.version, filename)};
+  }
+  if (header.brick_size_log2 == 0 ||
+      header.brick_size_log2 > GCVOL_MAX_BRICK_SIZE_LOG2 ||
+      std::any_of(header.num_elements.begin(), header.num_elements.end(),
+                  [](const std::uint32_t n) -> bool {
+                    return n < 2 ||
+                           n > std::numeric_limits<std::int32_t>::max();
+                  })) {
+    throw std::runtime_error{
+        fmt::format("Invalid field size in file {}", filename)};
+  }
+
+  const std::uint64_t brick_size{std::uint64_t{1} << header.brick_size_log2};
+  const std::uint64_t brick_bytes{brick_size * brick_size * brick_size *
+                                  sizeof(float)};
+  std::uint64_t total_bricks{1};
+  for (const std::uint32_t n : header.num_elements) {
+    total_bricks *= (n + brick_size - 1) / brick_size;
+  }
+  if (header.index_offset > file->size() ||
+      (file->size() - header.index_offset) / sizeof(GCVolBrickEntry) <
+          total_bricks) {
+    throw std::runtime_error{
+        fmt::format("Truncated brick index in file {}", filename)};
+  }
+  std::vector<GCVolBrickEntry> index(total_bricks);
+  std::memcpy(index.data(), file->data() + header.index_offset,
+              index.size() * sizeof(GCVolBrickEntry));
+  for (const GCVolBrickEntry &entry : index) {
+    const bool valid_encoding{
+        (entry.encoding == GCVolBrickEncoding::Stored &&
+         entry.size == brick_bytes) ||
+        entry.encoding == GCVolBrickEncoding::DeltaRLE};
+    if (!valid_encoding || entry.offset > header.index_offset ||
+        entry.size > header.index_offset - entry.offset) {
+      throw std::runtime_error{
+          fmt::format("Invalid brick in file {}", filename)};
+    }
+  }
+
+  // Bricks are decoded in any order, depending on the region read
+  file->advise(MappedFile::Advice::Random);
+  return {std::move(file), header, std::move(index)};
+}
+
+GCVolFile::GCVolFile(std::shared_ptr<MappedFile> file,
+                     const GCVolHeader &header,
+                     std::vector<GCVolBrickEntry> index) noexcept
+    : _file{std::move(file)}, _header{header},
+      _num_bricks{(numElements() + glm::ivec3{brickSize() - 1}) /
+                  glm::ivec3{brickSize()}},
+      _index{std::move(index)} {}
+
+void GCVolFile::writeToFile(const std::string &filename,
+                            const ScalarField<float> &field,
+                            const int brick_size_log2) {
+  if (brick_size_log2 <= 0 ||
+      brick_size_log2 > static_cast<int>(GCVOL_MAX_BRICK_SIZE_LOG2)) {
+    throw std::runtime_error{"Invalid brick size for .gcvol file"};
+  }
+  GCVolHeader header{};
+  header.magic = GCVOL_MAGIC;
+  header.version = GCVOL_VERSION;
+  header.brick_size_log2 = static_cast<std::uint32_t>(brick_size_log2);
+  header.bounds_min = {field.min().x, field.min().y, field.min().z};
+  header.bounds_max = {field.max().x, field.max().y, field.max().z};
+  header.num_elements = {static_cast<std::uint32_t>(field.xSize()),
+                         static_cast<std::uint32_t>(field.ySize()),
+                         static_cast<std::uint32_t>(field.zSize())};
+  header.value_min = std::numeric_limits<float>::max();
+  header.value_max = std::numeric_limits<float>::lowest();
+
+  std::ofstream output_file{filename, std::ios::binary | std::ios::trunc};
+  if (!output_file.is_open()) {
+    throw std::runtime_error{
+        fmt::format("Could not open file {} for writing", filename)};
+  }
+  // The header is written again at the end, once the index offset is known
+  output_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  const int brick_size{1 << brick_size_log2};
+  const glm::ivec3 num_bricks{
+      (glm::ivec3{field.xSize(), field.ySize(), field.zSize()} +
+       glm::ivec3{brick_size - 1}) /
+      glm::ivec3{brick_size}};
+  const std::size_t bricks_x{static_cast<std::size_t>(num_bricks.x)};
+  const std::size_t bricks_y{static_cast<std::size_t>(num_bricks.y)};
+  const std::size_t total_bricks{bricks_x * bricks_y *
+                                 static_cast<std::size_t>(num_bricks.z)};
+  const std::size_t brick_elements{static_cast<std::size_t>(brick_size) *
+                                   static_cast<std::size_t>(brick_size) *
+                                   static_cast<std::size_t>(brick_size)};
+  const std::size_t brick_bytes{brick_elements * sizeof(float)};
+
+  // Compress batches of bricks in parallel and append them in order, which
+  // bounds the memory used for the encoded bricks
+  constexpr static std::size_t BATCH_BYTES{std::size_t{64} << 20u};
+  const std::size_t batch_size{std::max<std::size_t>(
+      BATCH_BYTES / brick_bytes, defaultThreadCount())};
+  std::vector<GCVolBrickEntry> index(total_bricks);
+  std::vector<std::vector<unsigned char>> encoded(batch_size);
+  std::uint64_t offset{sizeof(GCVolHeader)};
+  for (std::size_t batch_begin{0}; batch_begin < total_bricks;
+       batch_begin += batch_size) {
+    const std::size_t batch_end{
+        std::min(total_bricks, batch_begin + batch_size)};
+    parallelFor(
+        batch_begin, batch_end,
+        [&](const std::size_t first, const std::size_t last) -> void {
+          std::vector<float> brick(brick_elements);
+          for (std::size_t b{first}; b != last; ++b) {
+            const glm::ivec3 origin{
+                glm::ivec3{static_cast<int>(b % bricks_x),
+                           static_cast<int>(b / bricks_x % bricks_y),
+                           static_cast<int>(b / (bricks_x * bricks_y))} *
+                brick_size};
+            extractBrick(field, origin, brick_size, brick.data());
+            GCVolBrickEntry &entry{index[b]};
+            const auto [brick_min, brick_max]{
+                std::minmax_element(brick.begin(), brick.end())};
+            entry.value_min = *brick_min;
+            entry.value_max = *brick_max;
+            std::vector<unsigned char> &brick_encoded{encoded[b - batch_begin]};
+            brick_encoded.clear();
+            entry.encoding = GCVolBrickEncoding::DeltaRLE;
+            if (compressBrick(brick.data(), brick.size(), brick_encoded) >=
+                brick_bytes) {
+              // Incompressible, store it as is
+              brick_encoded.resize(brick_bytes);
+              std::memcpy(brick_encoded.data(), brick.data(), brick_bytes);
+              entry.encoding = GCVolBrickEncoding::Stored;
+            }
+            entry.size = static_cast<std::uint32_t>(brick_encoded.size());
+          }
+        });
+    for (std::size_t b{batch_begin}; b != batch_end; ++b) {
+      GCVolBrickEntry &entry{index[b]};
+      entry.offset = offset;
+      offset += entry.size;
+      header.value_min = std::min(header.value_min, entry.value_min);
+      header.value_max = std::max(header.value_max, entry.value_max);
+      output_file.write(
+          reinterpret_cast<const char *>(encoded[b - batch_begin].data()),
+          static_cast<std::streamsize>(entry.size));
+    }
+  }
+
+  header.index_offset = offset;
+  output_file.write(reinterpret_cast<const char *>(index.data()),
+                    static_cast<std::streamsize>(index.size() *
+                                                 sizeof(GCVolBrickEntry)));
+  output_file.seekp(0);
+  output_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (!output_file) {
+    throw std::runtime_error{
+        fmt::format("Error while writing .gcvol file {}", filename)};
+  }
+}
+
+void GCVolFile::readBrick(const glm::ivec3 &brick, float *values) const {
+  std::vector<unsigned char> scratch;
+  decodeBrick(brickIndex(brick), values, scratch);
+}
+
+void GCVolFile::decodeBrick(const std::size_t index, float *values,
+                            std::vector<unsigned char> &scratch) const {
+  const GCVolBrickEntry &entry{_index[index]};
+  const auto *const payload{
+      reinterpret_cast<const unsigned char *>(_file->data() + entry.offset)};
+  const std::size_t brick_elements{static_cast<std::size_t>(brickSize()) *
+                                   static_cast<std::size_t>(brickSize()) *
+                                   static_cast<std::size_t>(brickSize())};
+  if (entry.encoding == GCVolBrickEncoding::Stored) {
+    std::memcpy(values, payload, brick_elements * sizeof(float));
+  } else {
+    decompressBrick(payload, entry.size, values, brick_elements, scratch);
+  }
+}
+
+ScalarField<float> GCVolFile::readField() const {
+  return readRegion(glm::ivec3{0}, numElements());
+}
+
+ScalarField<float> GCVolFile::readRegion(const glm::ivec3 &origin,
+                                         const glm::ivec3 &size) const {
+  const glm::ivec3 num_elements{numElements()};
+  if (glm::any(glm::lessThan(size, glm::ivec3{2}))) {
+    throw std::out_of_range{"Invalid region of .gcvol file"};
+  }
+  // Keep the exact bounds when reading the whole field
+  const glm::vec3 voxel_size{(boundsMax() - boundsMin()) /
+                             glm::vec3{num_elements - glm::ivec3{1}}};
+  const bool whole_field{origin == glm::ivec3{0} && size == num_elements};
+  auto region{ScalarField<float>::createUninitialized(
+      whole_field ? boundsMin() : boundsMin() + glm::vec3{origin} * voxel_size,
+      whole_field ? boundsMax()
+                  : boundsMin() +
+                        glm::vec3{origin + size - glm::ivec3{1}} * voxel_size,
+      size.x, size.y, size.z,
+      whole_field ? StoragePolicy::HugePages : StoragePolicy::Aligned)};
+  readRegion(origin, size, region.data());
+  return region;
+}
+
+void GCVolFile::readRegion(const glm::ivec3 &origin, const glm::ivec3 &size,
+                           float *values,
+                           const unsigned int num_threads) const {
+  if (glm::any(glm::lessThan(origin, glm::ivec3{0})) ||
+      glm::any(glm::lessThan(size, glm::ivec3{1})) ||
+      glm::any(glm::greaterThan(origin + size, numElements()))) {
+    throw std::out_of_range{"Invalid region of .gcvol file"};
+  }
+  const int brick_size_log2{static_cast<int>(_header.brick_size_log2)};
+  const int brick_size{brickSize()};
+  const glm::ivec3 first_brick{origin / brick_size};
+  const glm::ivec3 brick_range{(origin + size - glm::ivec3{1}) / brick_size -
+                               first_brick + glm::ivec3{1}};
+  const std::size_t range_x{static_cast<std::size_t>(brick_range.x)};
+  const std::size_t range_y{static_cast<std::size_t>(brick_range.y)};
+  const std::size_t brick_elements{std::size_t{1}
+                                   << (3 * brick_size_log2)};
+  parallelFor(
+      0, range_x * range_y * static_cast<std::size_t>(brick_range.z),
+      [&](const std::size_t first, const std::size_t last) -> void {
+        std::vector<float> brick_values(brick_elements);
+        std::vector<unsigned char> scratch;
+        for (std::size_t b{first}; b != last; ++b) {
+          const glm::ivec3 brick{
+              first_brick +
+              glm::ivec3{static_cast<int>(b % range_x),
+                         static_cast<int>(b / range_x % range_y),
+                         static_cast<int>(b / (range_x * range_y))}};
+          decodeBrick(brickIndex(brick), brick_values.data(), scratch);
+          // Part of the brick inside the region, in brick coordinates
+          const glm::ivec3 brick_origin{brick * brick_size};
+          const glm::ivec3 begin{glm::max(origin - brick_origin, 0)};
+          const glm::ivec3 end{
+              glm::min(origin + size - brick_origin, glm::ivec3{brick_size})};
+          const glm::ivec3 target{brick_origin - origin};
+          for (int k{begin.z}; k != end.z; ++k) {
+            for (int j{begin.y}; j != end.y; ++j) {
+              const float *const row{
+                  brick_values.data() +
+                  static_cast<std::size_t>((j << brick_size_log2) +
+                                           (k << (2 * brick_size_log2)))};
+              std::copy(row + begin.x, row + end.x,
+                        values + static_cast<std::size_t>(target.x + begin.x) +
+                            static_cast<std::size_t>(size.x) *
+                                (static_cast<std::size_t>(target.y + j) +
+                                 static_cast<std::size_t>(size.y) *
+                                     static_cast<std::size_t>(target.z + k)));
+            }
+          }
+        }
+      },
+      num_threads);
+}
+
+std::unique_ptr<GCVolSlabReader>
+GCVolSlabReader::createFromFile(const std::string &filename) {
+  return std::unique_ptr<GCVolSlabReader>{
+      new GCVolSlabReader{GCVolFile::createFromFile(filename)}};
+}
+
+GCVolSlabReader::GCVolSlabReader(GCVolFile file) noexcept
+    : SlabReader{file.boundsMin(), file.boundsMax(), file.numElements()},
+      _file{std::move(file)} {}
+
+std::pair<float, float> GCVolSlabReader::readSlab(const int z_begin,
+                                                  const int z_end,
+                                                  float *scalars,
+                                                  glm::vec3 *normals) const {
+  if (normals != nullptr) {
+    throw std::runtime_error{".gcvol files do not store normals"};
+  }
+  // Slabs are already read concurrently, decode on the calling thread only
+  const glm::ivec3 num_elements{numElements()};
+  _file.readRegion(glm::ivec3{0, 0, z_begin},
+                   glm::ivec3{num_elements.x, num_elements.y, z_end - z_begin},
+                   scalars, 1);
+  const auto [slab_min, slab_max]{std::minmax_element(
+      scalars, scalars + static_cast<std::size_t>(z_end - z_begin) *
+                             sliceElements())};
+  return {*slab_min, *slab_max};
+}
+
+} // namespace Gecko
@@ -0,0 +1,436 @@
+#include "io/gtvol.hpp"
+#include "io/brick_codec.hpp"
+#include "utils/parallel.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+
+namespace Gecko {
+
+namespace {
+
+// XOR the bit patterns of count values of a and b
+void xorValues(const float *a, const float *b, const std::size_t count,
+               float *result) noexcept {
+  for (std::size_t v{0}; v != count; ++v) {
+    std::uint32_t a_bits, b_bits;
+    std::memcpy(&a_bits, a + v, sizeof(a_bits));
+    std::memcpy(&b_bits, b + v, sizeof(b_bits));
+    const std::uint32_t bits{a_bits ^ b_bits};
+    std::memcpy(result + v, &bits, sizeof(bits));
+  }
+}
+
+// Copy the part of the brick inside the field back to it, returns true if any
+// bit of the field changed
+bool insertBrick(const float *brick, const glm::ivec3 &origin,
+                 const int brick_size, ScalarField<float> &field) noexcept {
+  const glm::ivec3 count{
+      glm::min(glm::ivec3{brick_size},
+               glm::ivec3{field.xSize(), field.ySize(), field.zSize()} -
+                   origin)};
+  const std::size_t row_bytes{static_cast<std::size_t>(count.x) *
+                              sizeof(float)};
+  bool changed{false};
+  for (int k{0}; k != count.z; ++k) {
+    for (int j{0}; j != count.y; ++j) {
+      const float *const brick_row{
+          brick + static_cast<std::size_t>(brick_size) *
+                      (static_cast<std::size_t>(j) +
+                       static_cast<std::size_t>(brick_size) *
+                           static_cast<std::size_t>(k))};
+      float *const field_row{&field(origin.x, origin.y + j, origin.z + k)};
+      if (std::memcmp(field_row, brick_row, row_bytes) != 0) {
+        std::memcpy(field_row, brick_row, row_bytes);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+} // namespace
+
+bool isGTVolFilename(const std::string &filename) noexcept {
+  constexpr static std::string_view EXTENSION{".gtvol"};
+  return filename.size() >= EXTENSION.size() &&
+         filename.compare(filename.size() - EXTENSION.size(),
+                          EXTENSION.size(), EXTENSION) == 0;
+}
+
+GTVolWriter GTVolWriter::createFile(const std::string &filename,
+                                    const int brick_size_log2,
+                                    const int keyframe_interval) {
+  if (brick_size_log2 <= 0 ||
+      brick_size_log2 > static_cast<int>(GTVOL_MAX_BRICK_SIZE_LOG2)) {
+    throw std::runtime_error{"Invalid brick size for .gtvol file"};
+  }
+  if (keyframe_interval <= 0) {
+    throw std::runtime_error{"Invalid keyframe interval for .gtvol file"};
+  }
+  std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+  if (!file.is_open()) {
+    throw std::runtime_error{
+        fmt::format("Could not open file {} for writing", filename)};
+  }
+  return {std::move(file), filename, brick_size_log2, keyframe_interval};
+}
+
+GTVolWriter::GTVolWriter(std::ofstream file, std::string filename,
+                         const int brick_size_log2,
+                         const int keyframe_interval) noexcept
+    : _file{std::move(file)}, _filename{std::move(filename)}, _header{},
+      _keyframe_interval{keyframe_interval}, _num_bricks{0},
+      _offset{sizeof(GTVolHeader)} {
+  _header.magic = GTVOL_MAGIC;
+  _header.version = GTVOL_VERSION;
+  _header.brick_size_log2 = static_cast<std::uint32_t>(brick_size_log2);
+  _header.value_min = std::numeric_limits<float>::max();
+  _header.value_max = std::numeric_limits<float>::lowest();
+}
+
+void GTVolWriter::appendStep(const ScalarField<float> &field) {
+  const glm::ivec3 num_elements{field.xSize(), field.ySize(), field.zSize()};
+  const int brick_size{1 << _header.brick_size_log2};
+  const std::size_t brick_elements{std::size_t{1}
+                                   << (3 * _header.brick_size_log2)};
+  const std::size_t brick_bytes{brick_elements * sizeof(float)};
+  if (_steps.empty()) {
+    _header.bounds_min = {field.min().x, field.min().y, field.min().z};
+    _header.bounds_max = {field.max().x, field.max().y, field.max().z};
+    _header.num_elements = {static_cast<std::uint32_t>(num_elements.x),
+                            static_cast<std::uint32_t>(num_elements.y),
+                            static_cast<std::uint32_t>(num_elements.z)};
+    _num_bricks = (num_elements + glm::ivec3{brick_size - 1}) /
+                  glm::ivec3{brick_size};
+    _previous.resize(static_cast<std::size_t>(_num_bricks.x) *
+                     static_cast<std::size_t>(_num_bricks.y) *
+                     static_cast<std::size_t>(_num_bricks.z) *
+                     brick_elements);
+    // The header is written again by finish()
+    _file.write(reinterpret_cast<const char *>(&_header), sizeof(_header));
+  } else if (num_elements !=
+             glm::ivec3{static_cast<int>(_header.num_elements[0]),
+                        static_cast<int>(_header.num_elements[1]),
+                        static_cast<int>(_header.num_elements[2])}) {
+    throw std::runtime_error{
+        fmt::format("Step {} of {} does not have the size of the first one",
+                    _steps.size(), _filename)};
+  }
+
+  const bool keyframe{_steps.size() %
+                          static_cast<std::size_t>(_keyframe_interval) ==
+                      0};
+  const std::size_t bricks_x{static_cast<std::size_t>(_num_bricks.x)};
+  const std::size_t bricks_y{static_cast<std::size_t>(_num_bricks.y)};
+  const std::size_t total_bricks{_previous.size() / brick_elements};
+
+  // Same batching as GCVolFile::writeToFile(), bounding the memory used for
+  // the encoded bricks
+  constexpr static std::size_t BATCH_BYTES{std::size_t{64} << 20u};
+  const std::size_t batch_size{std::max<std::size_t>(
+      BATCH_BYTES / brick_bytes, defaultThreadCount())};
+  std::vector<GTVolBrickEntry> step_bricks;
+  std::vector<GTVolBrickEntry> batch_bricks(batch_size);
+  std::vector<std::vector<unsigned char>> encoded(batch_size);
+  for (std::size_t batch_begin{0}; batch_begin < total_bricks;
+       batch_begin += batch_size) {
+    const std::size_t batch_end{
+        std::min(total_bricks, batch_begin + batch_size)};
+    parallelFor(
+        batch_begin, batch_end,
+        [&](const std::size_t first, const std::size_t last) -> void {
+          std::vector<float> brick(brick_elements), residual(brick_elements);
+          for (std::size_t b{first}; b != last; ++b) {
+            const glm::ivec3 origin{
+                glm::ivec3{static_cast<int>(b % bricks_x),
+                           static_cast<int>(b / bricks_x % bricks_y),
+                           static_cast<int>(b / (bricks_x * bricks_y))} *
+                brick_size};
+            extractBrick(field, origin, brick_size, brick.data());
+            float *const previous{_previous.data() + b * brick_elements};
+            std::vector<unsigned char> &brick_encoded{encoded[b - batch_begin]};
+            brick_encoded.clear();
+            GTVolBrickEntry &entry{batch_bricks[b - batch_begin]};
+            entry.brick = static_cast<std::uint32_t>(b);
+            entry.size = 0;
+            entry.reserved = 0;
+            if (!keyframe &&
+                std::memcmp(brick.data(), previous, brick_bytes) == 0) {
+              // Unchanged, not stored
+              continue;
+            }
+            if (keyframe) {
+              entry.encoding = GTVolBrickEncoding::DeltaRLE;
+              compressBrick(brick.data(), brick_elements, brick_encoded);
+            } else {
+              entry.encoding = GTVolBrickEncoding::XorRLE;
+              xorValues(brick.data(), previous, brick_elements,
+                        residual.data());
+              compressBrick(residual.data(), brick_elements, brick_encoded);
+            }
+            if (brick_encoded.size() >= brick_bytes) {
+              // Incompressible, store it as is
+              brick_encoded.resize(brick_bytes);
+              std::memcpy(brick_encoded.data(), brick.data(), brick_bytes);
+              entry.encoding = GTVolBrickEncoding::Stored;
+            }
+            entry.size = static_cast<std::uint32_t>(brick_encoded.size());
+            std::copy(brick.begin(), brick.end(), previous);
+          }
+        });
+    for (std::size_t b{batch_begin}; b != batch_end; ++b) {
+      GTVolBrickEntry &entry{batch_bricks[b - batch_begin]};
+      if (entry.size == 0) {
+        continue;
+      }
+      entry.offset = _offset;
+      _offset += entry.size;
+      _file.write(
+          reinterpret_cast<const char *>(encoded[b - batch_begin].data()),
+          static_cast<std::streamsize>(entry.size));
+      step_bricks.push_back(entry);
+    }
+  }
+
+  GTVolStepEntry step{};
+  step.bricks_offset = _offset;
+  step.num_bricks = static_cast<std::uint32_t>(step_bricks.size());
+  step.keyframe = keyframe ? 1 : 0;
+  const auto [step_min, step_max]{std::minmax_element(
+      field.data(), field.data() + field.totalElements())};
+  step.value_min = *step_min;
+  step.value_max = *step_max;
+  _header.value_min = std::min(_header.value_min, step.value_min);
+  _header.value_max = std::max(_header.value_max, step.value_max);
+  _file.write(reinterpret_cast<const char *>(step_bricks.data()),
+              static_cast<std::streamsize>(step_bricks.size() *
+                                           sizeof(GTVolBrickEntry)));
+  _offset += step_bricks.size() * sizeof(GTVolBrickEntry);
+  _steps.push_back(step);
+  if (!_file) {
+    throw std::runtime_error{
+        fmt::format("Error while writing .gtvol file {}", _filename)};
+  }
+}
+
+void GTVolWriter::finish() {
+  if (_steps.empty()) {
+    throw std::runtime_error{
+        fmt::format("No steps written to .gtvol file {}", _filename)};
+  }
+  _header.num_steps = static_cast<std::uint32_t>(_steps.size());
+  _header.step_index_offset = _offset;
+  _file.write(reinterpret_cast<const char *>(_steps.data()),
+              static_cast<std::streamsize>(_steps.size() *
+                                           sizeof(GTVolStepEntry)));
+  _file.seekp(0);
+  _file.write(reinterpret_cast<const char *>(&_header), sizeof(_header));
+  _file.close();
+  if (!_file) {
+    throw std::runtime_error{
+        fmt::format("Error while writing .gtvol file {}", _filename)};
+  }
+}
+
+GTVolFile GTVolFile::createFromFile(const std::string &filename) {
+  auto file{std::make_shared<MappedFile>(MappedFile::createFromFile(filename))};
+  if (file->size() < sizeof(GTVolHeader)) {
+    throw std::runtime_error{
+        fmt::format("File {} is too small to be a .gtvol file", filename)};
+  }
+  GTVolHeader header;
+  std::memcpy(&header, file->data(), sizeof(GTVolHeader));
+
+  if (header.magic != GTVOL_MAGIC) {
+    throw std::runtime_error{
+        fmt::format("File {} is not a .gtvol file", filename)};
+  }
+  if (header.version != GTVOL_VERSION) {
+    throw std::runtime_error{fmt::format(
+        "Unsupported .gtvol version {} in file {}", header.version, filename)};
+  }
+  if (header.brick_size_log2 == 0 ||
+      header.brick_size_log2 > GTVOL_MAX_BRICK_SIZE_LOG2 ||
+      std::any_of(header.num_elements.begin(), header.num_elements.end(),
+                  [](const std::uint32_t n) -> bool {
+                    return n < 2 ||
+                           n > std::numeric_limits<std::int32_t>::max();
+                  })) {
+    throw std::runtime_error{
+        fmt::format("Invalid field size in file {}", filename)};
+  }
+
+  const std::uint64_t brick_size{std::uint64_t{1} << header.brick_size_log2};
+  const std::uint64_t brick_bytes{brick_size * brick_size * brick_size *
+                                  sizeof(float)};
+  std::uint64_t total_bricks{1};
+  for (const std::uint32_t n : header.num_elements) {
+    total_bricks *= (n + brick_size - 1) / brick_size;
+  }
+  if (header.num_steps == 0 || header.step_index_offset > file->size() ||
+      (file->size() - header.step_index_offset) / sizeof(GTVolStepEntry) <
+          header.num_steps) {
+    throw std::runtime_error{
+        fmt::format("Truncated step index in file {}", filename)};
+  }
+  std::vector<GTVolStepEntry> steps(header.num_steps);
+  std::memcpy(steps.data(), file->data() + header.step_index_offset,
+              steps.size() * sizeof(GTVolStepEntry));
+
+  std::vector<std::size_t> step_first_brick;
+  step_first_brick.reserve(steps.size());
+  std::vector<GTVolBrickEntry> bricks;
+  for (std::size_t s{0}; s != steps.size(); ++s) {
+    const GTVolStepEntry &step{steps[s]};
+    // Keyframes store all their bricks and the first step is one
+    if ((s == 0 && step.keyframe == 0) || step.num_bricks > total_bricks ||
+        (step.keyframe != 0 && step.num_bricks != total_bricks) ||
+        step.bricks_offset > header.step_index_offset ||
+        (header.step_index_offset - step.bricks_offset) /
+                sizeof(GTVolBrickEntry) <
+            step.num_bricks) {
+      throw std::runtime_error{
+          fmt::format("Invalid step {} in file {}", s, filename)};
+    }
+    step_first_brick.push_back(bricks.size());
+    bricks.resize(bricks.size() + step.num_bricks);
+    GTVolBrickEntry *const step_bricks{bricks.data() + step_first_brick[s]};
+    std::memcpy(step_bricks, file->data() + step.bricks_offset,
+                step.num_bricks * sizeof(GTVolBrickEntry));
+    for (std::size_t b{0}; b != step.num_bricks; ++b) {
+      const GTVolBrickEntry &entry{step_bricks[b]};
+      const bool valid_encoding{
+          (entry.encoding == GTVolBrickEncoding::Stored &&
+           entry.size == brick_bytes) ||
+          entry.encoding == GTVolBrickEncoding::DeltaRLE ||
+          (entry.encoding == GTVolBrickEncoding::XorRLE &&
+           step.keyframe == 0)};
+      // Ordered bricks can not repeat
+      if (!valid_encoding || entry.brick >= total_bricks ||
+          (b != 0 && entry.brick <= step_bricks[b - 1].brick) ||
+          entry.offset > step.bricks_offset ||
+          entry.size > step.bricks_offset - entry.offset) {
+        throw std::runtime_error{
+            fmt::format("Invalid brick in step {} of file {}", s, filename)};
+      }
+    }
+  }
+
+  // Steps are mostly read one after the other
+  file->advise(MappedFile::Advice::Sequential);
+  return {std::move(file), header, std::move(steps),
+          std::move(step_first_brick), std::move(bricks)};
+}
+
+GTVolFile::GTVolFile(std::shared_ptr<MappedFile> file,
+                     const GTVolHeader &header,
+                     std::vector<GTVolStepEntry> steps,
+                     std::vector<std::size_t> step_first_brick,
+                     std::vector<GTVolBrickEntry> bricks) noexcept
+    : _file{std::move(file)}, _header{header},
+      _num_bricks{(numElements() + glm::ivec3{brickSize() - 1}) /
+                  glm::ivec3{brickSize()}},
+      _steps{std::move(steps)}, _step_first_brick{std::move(step_first_brick)},
+      _bricks{std::move(bricks)} {}
+
+glm::ivec3 GTVolFile::brickOrigin(const std::size_t brick) const noexcept {
+  const std::size_t bricks_x{static_cast<std::size_t>(_num_bricks.x)};
+  const std::size_t bricks_y{static_cast<std::size_t>(_num_bricks.y)};
+  return glm::ivec3{static_cast<int>(brick % bricks_x),
+                    static_cast<int>(brick / bricks_x % bricks_y),
+                    static_cast<int>(brick / (bricks_x * bricks_y))} *
+         brickSize();
+}
+
+std::size_t GTVolFile::previousKeyframe(std::size_t step) const {
+  if (step >= numSteps()) {
+    throw std::out_of_range{"Invalid step of .gtvol file"};
+  }
+  while (_steps[step].keyframe == 0) {
+    --step;
+  }
+  return step;
+}
+
+std::uint64_t GTVolFile::stepBytes(const std::size_t step) const {
+  const std::size_t first{_step_first_brick.at(step)};
+  std::uint64_t bytes{0};
+  for (std::size_t b{first}; b != first + _steps[step].num_bricks; ++b) {
+    bytes += _bricks[b].size;
+  }
+  return bytes;
+}
+
+void GTVolFile::applyStep(const std::size_t step, ScalarField<float> &field,
+                          std::vector<std::size_t> &changed_bricks) const {
+  if (step >= numSteps()) {
+    throw std::out_of_range{"Invalid step of .gtvol file"};
+  }
+  if (glm::ivec3{field.xSize(), field.ySize(), field.zSize()} !=
+      numElements()) {
+    throw std::runtime_error{
+        "Field does not have the size of the .gtvol file"};
+  }
+  const int brick_size{brickSize()};
+  const std::size_t brick_elements{std::size_t{1}
+                                   << (3 * _header.brick_size_log2)};
+  const GTVolBrickEntry *const step_bricks{_bricks.data() +
+                                          _step_first_brick[step]};
+  const std::size_t num_bricks{_steps[step].num_bricks};
+  std::vector<unsigned char> changed(num_bricks);
+  // Bricks do not overlap, each one is read and written by a single thread
+  parallelFor(
+      0, num_bricks,
+      [&](const std::size_t first, const std::size_t last) -> void {
+        std::vector<float> brick(brick_elements), residual(brick_elements);
+        std::vector<unsigned char> scratch;
+        for (std::size_t b{first}; b != last; ++b) {
+          const GTVolBrickEntry &entry{step_bricks[b]};
+          const glm::ivec3 origin{brickOrigin(entry.brick)};
+          const auto *const payload{reinterpret_cast<const unsigned char *>(
+              _file->data() + entry.offset)};
+          switch (entry.encoding) {
+          case GTVolBrickEncoding::Stored:
+            std::memcpy(brick.data(), payload, brick_elements * sizeof(float));
+            break;
+          case GTVolBrickEncoding::DeltaRLE:
+            decompressBrick(payload, entry.size, brick.data(), brick_elements,
+                            scratch);
+            break;
+          case GTVolBrickEncoding::XorRLE:
+            decompressBrick(payload, entry.size, residual.data(),
+                            brick_elements, scratch);
+            extractBrick(field, origin, brick_size, brick.data());
+            xorValues(residual.data(), brick.data(), brick_elements,
+                      brick.data());
+            break;
+          }
+          changed[b] = insertBrick(brick.data(), origin, brick_size, field);
+        }
+      });
+  for (std::size_t b{0}; b != num_bricks; ++b) {
+    if (changed[b] != 0) {
+      changed_bricks.push_back(step_bricks[b].brick);
+    }
+  }
+}
+
+ScalarField<float> GTVolFile::readStep(const std::size_t step) const {
+  const glm::ivec3 num_elements{numElements()};
+  auto field{ScalarField<float>::createUninitialized(
+      boundsMin(), boundsMax(), num_elements.x, num_elements.y,
+      num_elements.z)};
+  std::vector<std::size_t> changed_bricks;
+  for (std::size_t s{previousKeyframe(step)}; s <= step; ++s) {
+    applyStep(s, field, changed_bricks);
+  }
+  return field;
+}
+
+} // namespace Gecko
@@ -0,0 +1,351 @@
+#include "io/gvol.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace Gecko {
+
+namespace {
+
+[[nodiscard]] std::size_t dataTypeSize(const GVolDataType data_type) {
+  switch (data_type) {
+  case GVolDataType::Float32: {
+    return sizeof(float);
+  }
+  default: {
+    throw std::runtime_error{"Unknown data type in .gvol channel"};
+  }
+  }
+}
+
+[[nodiscard]] std::uint64_t alignPayloadOffset(const std::uint64_t offset) {
+  return (offset + GVOL_PAYLOAD_ALIGNMENT - 1) / GVOL_PAYLOAD_ALIGNMENT *
+         GVOL_PAYLOAD_ALIGNMENT;
+}
+
+// Bytes stored for a channel, including the padding of bricked channels.
+// std::nullopt if the size does not fit in 64 bits.
+[[nodiscard]] std::optional<std::uint64_t>
+channelStorageBytes(const GVolHeader &header,
+                    const GVolChannelDescriptor &channel) {
+  const std::uint64_t brick_size{std::uint64_t{1}
+                                 << channel.brick_size_log2};
+  std::uint64_t bytes{dataTypeSize(channel.data_type)};
+  const auto multiply{[&bytes](const std::uint64_t factor) -> bool {
+    if (factor != 0 && bytes > std::numeric_limits<std::uint64_t>::max() /
+                                   factor) {
+      return false;
+    }
+    bytes *= factor;
+    return true;
+  }};
+  if (!multiply(channel.components)) {
+    return std::nullopt;
+  }
+  for (const std::uint32_t axis_elements : header.num_elements) {
+    if (!multiply((axis_elements + brick_size - 1) / brick_size *
+                  brick_size)) {
+      return std::nullopt;
+    }
+  }
+  return bytes;
+}
+
+[[nodiscard]] std::pair<float, float> computeRange(const float *values,
+                                                   const std::size_t count) {
+  float value_min{std::numeric_limits<float>::max()};
+  float value_max{std::numeric_limits<float>::lowest()};
+  for (std::size_t i{0}; i != count; ++i) {
+    value_min = std::min(value_min, values[i]);
+    value_max = std::max(value_max, values[i]);
+  }
+  return {value_min, value_max};
+}
+
+// Write the field brick by brick in the order of BrickedLayout
+void writeBricks(std::ofstream &output_file, const ScalarField<float> &field,
+                 const int brick_size_log2) {
+  const int brick_size{1 << brick_size_log2};
+  const glm::ivec3 num_elements{field.xSize(), field.ySize(), field.zSize()};
+  const glm::ivec3 num_bricks{(num_elements + glm::ivec3{brick_size - 1}) /
+                              glm::ivec3{brick_size}};
+  const glm::ivec3 last{num_elements - glm::ivec3{1}};
+  std::vector<float> brick(static_cast<std::size_t>(brick_size) *
+                           static_cast<std::size_t>(brick_size) *
+                           static_cast<std::size_t>(brick_size));
+  for (int bz{0}; bz != num_bricks.z; ++bz) {
+    for (int by{0}; by != num_bricks.y; ++by) {
+      for (int bx{0}; bx != num_bricks.x; ++bx) {
+        const glm::ivec3 origin{glm::ivec3{bx, by, bz} * brick_size};
+        auto element{brick.begin()};
+        for (int k{0}; k != brick_size; ++k) {
+          const int z{std::min(origin.z + k, last.z)};
+          for (int j{0}; j != brick_size; ++j) {
+            const int y{std::min(origin.y + j, last.y)};
+            for (int i{0}; i != brick_size; ++i) {
+              *element++ = field(std::min(origin.x + i, last.x), y, z);
+            }
+          }
+        }
+        output_file.write(reinterpret_cast<const char *>(brick.data()),
+                          static_cast<std::streamsize>(brick.size() *
+                                                       sizeof(float)));
+      }
+    }
+  }
+}
+
+} // namespace
+
+bool isGVolFilename(const std::string &filename) noexcept {
+  constexpr static std::string_view EXTENSION{".gvol"};
+  return filename.size() >= EXTENSION.size() &&
+         filename.compare(filename.size() - EXTENSION.size(),
+                          EXTENSION.size(), EXTENSION) == 0;
+}
+
+GVolFile GVolFile::createFromFile(const std::string &filename) {
+  // Map privately so that fields built on top of the file stay writable
+  auto file{std::make_shared<MappedFile>(MappedFile::createFromFile(
+      filename, MappedFile::Access::CopyOnWrite))};
+  if (file->size() < sizeof(GVolHeader)) {
+    throw std::runtime_error{
+        fmt::format("File {} is too small to be a .gvol file", filename)};
+  }
+  GVolHeader header;
+  std::memcpy(&header, file->data(), sizeof(GVolHeader));
+
+  if (header.magic != GVOL_MAGIC) {
+    throw std::runtime_error{
+        fmt::format("File {} is not a .gvol file", filename)};
+  }
+  if (header.version < GVOL_MIN_VERSION || header.version > GVOL_VERSION) {
+    throw std::runtime_error{fmt::format(
+        "Unsupported .gvol version {} in file {}", header.version, filename)};
+  }
+  if (header.num_channels > GVOL_MAX_CHANNELS) {
+    throw std::runtime_error{
+        fmt::format("Invalid number of channels in file {}", filename)};
+  }
+  // Fields are indexed with int and samplers need two elements per axis
+  if (std::any_of(header.num_elements.begin(), header.num_elements.end(),
+                  [](const std::uint32_t n) -> bool {
+                    return n < 2 ||
+                           n > std::numeric_limits<std::int32_t>::max();
+                  })) {
+    throw std::runtime_error{
+        fmt::format("Invalid field size in file {}", filename)};
+  }
+  for (std::uint32_t c{0}; c != header.num_channels; ++c) {
+    const GVolChannelDescriptor &channel{header.channels[c]};
+    if (channel.brick_size_log2 > GVOL_MAX_BRICK_SIZE_LOG2) {
+      throw std::runtime_error{fmt::format(
+          "Invalid brick size for channel {} in file {}", c, filename)};
+    }
+    if (channel.components == 0) {
+      throw std::runtime_error{fmt::format(
+          "Channel {} without components in file {}", c, filename)};
+    }
+    const std::optional<std::uint64_t> expected_size{
+        channelStorageBytes(header, channel)};
+    // Written so that corrupt offsets and sizes can not wrap around
+    if (!expected_size || channel.size != *expected_size ||
+        channel.offset % GVOL_PAYLOAD_ALIGNMENT != 0 ||
+        channel.size > file->size() ||
+        channel.offset > file->size() - channel.size) {
+      throw std::runtime_error{fmt::format(
+          "Invalid payload for channel {} in file {}", c, filename)};
+    }
+  }
+
+  return {std::move(file), header};
+}
+
+void GVolFile::writeToFile(const std::string &filename,
+                           const ScalarField<float> &field,
+                           const glm::vec3 *normals,
+                           const int brick_size_log2) {
+  static_assert(sizeof(glm::vec3) == 3 * sizeof(float),
+                "Normals can not be written as packed floats");
+  if (brick_size_log2 < 0 ||
+      brick_size_log2 > static_cast<int>(GVOL_MAX_BRICK_SIZE_LOG2)) {
+    throw std::runtime_error{"Invalid brick size for .gvol file"};
+  }
+  GVolHeader header{};
+  header.magic = GVOL_MAGIC;
+  header.version = GVOL_VERSION;
+  header.bounds_min = {field.min().x, field.min().y, field.min().z};
+  header.bounds_max = {field.max().x, field.max().y, field.max().z};
+  header.num_elements = {static_cast<std::uint32_t>(field.xSize()),
+                         static_cast<std::uint32_t>(field.ySize()),
+                         static_cast<std::uint32_t>(field.zSize())};
+
+  const std::size_t total_elements{field.totalElements()};
+  std::array<const void *, GVOL_MAX_CHANNELS> payloads{};
+  std::uint64_t offset{alignPayloadOffset(sizeof(GVolHeader))};
+  const auto add_channel{[&](const GVolChannelType type,
+                             const std::uint32_t components,
+                             const float *values) -> void {
+    GVolChannelDescriptor &channel{header.channels[header.num_channels]};
+    channel.type = type;
+    channel.data_type = GVolDataType::Float32;
+    channel.components = components;
+    channel.offset = offset;
+    // Sizes of a field in memory do not overflow
+    channel.size = *channelStorageBytes(header, channel);
+    std::tie(channel.value_min, channel.value_max) =
+        computeRange(values, total_elements * components);
+    payloads[header.num_channels++] = values;
+    offset = alignPayloadOffset(offset + channel.size);
+  }};
+  header.channels[0].brick_size_log2 =
+      static_cast<std::uint32_t>(brick_size_log2);
+  add_channel(GVolChannelType::Scalar, 1, field.data());
+  if (normals != nullptr) {
+    add_channel(GVolChannelType::Normal, 3, &normals->x);
+  }
+
+  std::ofstream output_file{filename, std::ios::binary | std::ios::trunc};
+  if (!output_file.is_open()) {
+    throw std::runtime_error{
+        fmt::format("Could not open file {} for writing", filename)};
+  }
+  output_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (std::uint32_t c{0}; c != header.num_channels; ++c) {
+    const GVolChannelDescriptor &channel{header.channels[c]};
+    // Pad up to the aligned payload start
+    output_file.seekp(static_cast<std::streamoff>(channel.offset));
+    if (channel.brick_size_log2 == 0) {
+      output_file.write(static_cast<const char *>(payloads[c]),
+                        static_cast<std::streamsize>(channel.size));
+    } else {
+      writeBricks(output_file, field, brick_size_log2);
+    }
+  }
+  // Make sure the file covers the padding after the last payload as well
+  const GVolChannelDescriptor &last{header.channels[header.num_channels - 1]};
+  if (alignPayloadOffset(last.offset + last.size) != last.offset + last.size) {
+    output_file.seekp(static_cast<std::streamoff>(
+        alignPayloadOffset(last.offset + last.size) - 1));
+    output_file.put('\0');
+  }
+  if (!output_file) {
+    throw std::runtime_error{
+        fmt::format("Error while writing .gvol file {}", filename)};
+  }
+}
+
+const GVolChannelDescriptor *
+GVolFile::findChannel(const GVolChannelType type) const noexcept {
+  const auto channels_end{_header.channels.begin() + _header.num_channels};
+  const auto channel{
+      std::find_if(_header.channels.begin(), channels_end,
+                   [type](const GVolChannelDescriptor &c) -> bool {
+                     return c.type == type;
+                   })};
+  return channel == channels_end ? nullptr : &*channel;
+}
+
+template <typename T>
+FieldStorage<T>
+GVolFile::createChannelStorage(const GVolChannelDescriptor &channel) const {
+  if (channel.data_type != GVolDataType::Float32 ||
+      channel.components * sizeof(float) != sizeof(T)) {
+    throw std::runtime_error{"Unexpected layout for .gvol channel"};
+  }
+  if (channel.brick_size_log2 != 0) {
+    throw std::runtime_error{
+        "Bricked .gvol channels can only be read out of core"};
+  }
+  // Payloads are page aligned, reinterpreting them in place is safe
+  return FieldStorage<T>::wrap(
+      reinterpret_cast<T *>(_file->data() + channel.offset),
+      channel.size / sizeof(T), _file);
+}
+
+ScalarField<float> GVolFile::createScalarField() const {
+  const GVolChannelDescriptor *const channel{
+      findChannel(GVolChannelType::Scalar)};
+  if (channel == nullptr) {
+    throw std::runtime_error{"No scalar channel in .gvol file"};
+  }
+  const glm::ivec3 num_elements{numElements()};
+  return ScalarField<float>::createFromStorage(
+      boundsMin(), boundsMax(), num_elements.x, num_elements.y, num_elements.z,
+      createChannelStorage<float>(*channel));
+}
+
+FieldStorage<glm::vec3> GVolFile::createNormalStorage() const {
+  const GVolChannelDescriptor *const channel{
+      findChannel(GVolChannelType::Normal)};
+  if (channel == nullptr) {
+    return {};
+  }
+  return createChannelStorage<glm::vec3>(*channel);
+}
+
+void GVolFile::prefetch() const {
+  _file->advise(MappedFile::Advice::Sequential);
+  _file->advise(MappedFile::Advice::WillNeed);
+}
+
+void GVolFile::prefetch(const GVolChannelType type) const {
+  const GVolChannelDescriptor *const channel{findChannel(type)};
+  if (channel == nullptr) {
+    return;
+  }
+  _file->advise(MappedFile::Advice::Sequential, channel->offset,
+                channel->size);
+  _file->advise(MappedFile::Advice::WillNeed, channel->offset, channel->size);
+}
+
+std::unique_ptr<GVolSlabReader>
+GVolSlabReader::createFromFile(const std::string &filename) {
+  const GVolFile file{GVolFile::createFromFile(filename)};
+  ScalarField<float> field{file.createScalarField()};
+  // The channel is there, or creating the field would have thrown
+  const GVolChannelDescriptor &scalars{
+      *file.findChannel(GVolChannelType::Scalar)};
+  return std::unique_ptr<GVolSlabReader>{new GVolSlabReader{
+      std::move(field), file.createNormalStorage(),
+      {scalars.value_min, scalars.value_max}}};
+}
+
+GVolSlabReader::GVolSlabReader(
+    ScalarField<float> field, FieldStorage<glm::vec3> normals,
+    const std::pair<float, float> &value_range) noexcept
+    : SlabReader{field.min(), field.max(),
+                 glm::ivec3{field.xSize(), field.ySize(), field.zSize()}},
+      _field{std::move(field)}, _normals{std::move(normals)},
+      _value_range{value_range} {}
+
+std::pair<float, float> GVolSlabReader::readSlab(const int z_begin,
+                                                 const int z_end,
+                                                 float *scalars,
+                                                 glm::vec3 *normals) const {
+  const std::size_t offset{static_cast<std::size_t>(z_begin) *
+                           sliceElements()};
+  const std::size_t count{static_cast<std::size_t>(z_end - z_begin) *
+                          sliceElements()};
+  const float *const source{_field.data() + offset};
+  std::copy_n(source, count, scalars);
+  if (normals != nullptr) {
+    if (_normals.size() == 0) {
+      throw std::runtime_error{"No normal channel in .gvol file"};
+    }
+    std::copy_n(_normals.data() + offset, count, normals);
+  }
+  return computeRange(source, count);
+}
+
+} // namespace Gecko
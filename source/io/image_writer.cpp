@@ -0,0 +1,170 @@
+#include "io/image_writer.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace Gecko {
+
+namespace {
+
+[[nodiscard]] bool hasExtension(const std::string &filename,
+                                const std::string_view extension) noexcept {
+  return filename.size() >= extension.size() &&
+         filename.compare(filename.size() - extension.size(),
+                          extension.size(), extension) == 0;
+}
+
+// Rows of RGB pixels from top to bottom, each one preceded by a zero byte if
+// filter_byte is true
+[[nodiscard]] std::vector<std::uint8_t>
+flipToRGB(const int width, const int height, const std::uint8_t *pixels,
+          const bool filter_byte) {
+  const auto row_size{static_cast<std::size_t>(width) * 3 +
+                      (filter_byte ? 1 : 0)};
+  std::vector<std::uint8_t> rows(row_size * static_cast<std::size_t>(height));
+  for (int y{0}; y != height; ++y) {
+    const std::uint8_t *const source{
+        pixels + static_cast<std::size_t>(height - 1 - y) *
+                     static_cast<std::size_t>(width) * 4};
+    std::uint8_t *destination{rows.data() +
+                              static_cast<std::size_t>(y) * row_size};
+    if (filter_byte) {
+      // No filter
+      *destination++ = 0;
+    }
+    for (int x{0}; x != width; ++x) {
+      std::copy_n(source + 4 * x, 3, destination + 3 * x);
+    }
+  }
+  return rows;
+}
+
+class Crc32 {
+public:
+  Crc32() noexcept {
+    for (std::uint32_t n{0}; n != _table.size(); ++n) {
+      std::uint32_t c{n};
+      for (int k{0}; k != 8; ++k) {
+        c = (c & 1u) != 0 ? 0xEDB88320u ^ (c >> 1u) : c >> 1u;
+      }
+      _table[n] = c;
+    }
+  }
+
+  [[nodiscard]] std::uint32_t update(std::uint32_t crc,
+                                     const std::uint8_t *data,
+                                     const std::size_t size) const noexcept {
+    crc = ~crc;
+    for (std::size_t i{0}; i != size; ++i) {
+      crc = _table[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8u);
+    }
+    return ~crc;
+  }
+
+private:
+  std::array<std::uint32_t, 256> _table;
+};
+
+void appendBigEndian(std::vector<std::uint8_t> &bytes,
+                     const std::uint32_t value) {
+  for (int shift{24}; shift >= 0; shift -= 8) {
+    bytes.push_back(static_cast<std::uint8_t>(value >> shift));
+  }
+}
+
+void writeChunk(std::ofstream &file, const Crc32 &crc32,
+                const std::array<char, 4> &type,
+                const std::vector<std::uint8_t> &data) {
+  std::vector<std::uint8_t> chunk;
+  chunk.reserve(data.size() + 12);
+  appendBigEndian(chunk, static_cast<std::uint32_t>(data.size()));
+  chunk.insert(chunk.end(), type.begin(), type.end());
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  // The CRC covers the type and the data
+  appendBigEndian(chunk, crc32.update(0, chunk.data() + 4, chunk.size() - 4));
+  file.write(reinterpret_cast<const char *>(chunk.data()),
+             static_cast<std::streamsize>(chunk.size()));
+}
+
+void writePNG(std::ofstream &file, const int width, const int height,
+              const std::uint8_t *pixels) {
+  constexpr static std::array<std::uint8_t, 8> SIGNATURE{
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  file.write(reinterpret_cast<const char *>(SIGNATURE.data()),
+             SIGNATURE.size());
+  const Crc32 crc32;
+
+  std::vector<std::uint8_t> header;
+  appendBigEndian(header, static_cast<std::uint32_t>(width));
+  appendBigEndian(header, static_cast<std::uint32_t>(height));
+  // 8 bit RGB, deflate, adaptive filtering, no interlace
+  header.insert(header.end(), {8, 2, 0, 0, 0});
+  writeChunk(file, crc32, {'I', 'H', 'D', 'R'}, header);
+
+  // zlib stream of stored deflate blocks
+  const std::vector<std::uint8_t> rows{flipToRGB(width, height, pixels, true)};
+  constexpr static std::size_t MAX_BLOCK_SIZE{65535};
+  std::vector<std::uint8_t> stream{0x78, 0x01};
+  stream.reserve(rows.size() + rows.size() / MAX_BLOCK_SIZE * 5 + 16);
+  std::uint32_t adler_a{1}, adler_b{0};
+  for (std::size_t begin{0}; begin < rows.size(); begin += MAX_BLOCK_SIZE) {
+    const std::size_t size{std::min(MAX_BLOCK_SIZE, rows.size() - begin)};
+    const bool last{begin + size == rows.size()};
+    stream.push_back(last ? 1 : 0);
+    const auto length{static_cast<std::uint16_t>(size)};
+    const auto complement{static_cast<std::uint16_t>(~length)};
+    stream.insert(stream.end(),
+                  {static_cast<std::uint8_t>(length & 0xFFu),
+                   static_cast<std::uint8_t>(length >> 8u),
+                   static_cast<std::uint8_t>(complement & 0xFFu),
+                   static_cast<std::uint8_t>(complement >> 8u)});
+    stream.insert(stream.end(),
+                  rows.begin() + static_cast<std::ptrdiff_t>(begin),
+                  rows.begin() + static_cast<std::ptrdiff_t>(begin + size));
+    for (std::size_t i{begin}; i != begin + size; ++i) {
+      adler_a = (adler_a + rows[i]) % 65521u;
+      adler_b = (adler_b + adler_a) % 65521u;
+    }
+  }
+  appendBigEndian(stream, (adler_b << 16u) | adler_a);
+  writeChunk(file, crc32, {'I', 'D', 'A', 'T'}, stream);
+  writeChunk(file, crc32, {'I', 'E', 'N', 'D'}, {});
+}
+
+} // namespace
+
+void writeImage(const std::string &filename, const int width,
+                const int height, const std::uint8_t *pixels) {
+  const bool png{hasExtension(filename, ".png")};
+  if (!png && !hasExtension(filename, ".ppm")) {
+    throw std::runtime_error{
+        fmt::format("Unsupported image format for file {}", filename)};
+  }
+  std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+  if (!file.is_open()) {
+    throw std::runtime_error{
+        fmt::format("Could not open file {} for writing", filename)};
+  }
+  if (png) {
+    writePNG(file, width, height, pixels);
+  } else {
+    const std::string header{fmt::format("P6\n{} {}\n255\n", width, height)};
+    file.write(header.data(), static_cast<std::streamsize>(header.size()));
+    const std::vector<std::uint8_t> rows{
+        flipToRGB(width, height, pixels, false)};
+    file.write(reinterpret_cast<const char *>(rows.data()),
+               static_cast<std::streamsize>(rows.size()));
+  }
+  if (!file) {
+    throw std::runtime_error{
+        fmt::format("Error while writing image {}", filename)};
+  }
+}
+
+} // namespace Gecko
@@ -0,0 +1,230 @@
+#include "io/mapped_file.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Gecko {
+
+MappedFile::MappedFile(std::byte *data, const std::size_t size) noexcept
+    : _data{data}, _size{size} {}
+
+MappedFile::~MappedFile() noexcept { unmap(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : _data{std::exchange(other._data, nullptr)}, _size{std::exchange(
+                                                      other._size, 0)} {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+  }
+  return *this;
+}
+
+#if defined(_WIN32)
+
+MappedFile MappedFile::createFromFile(const std::string &filename,
+                                      const Access access) {
+  const HANDLE file{CreateFileA(filename.c_str(), GENERIC_READ,
+                                FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr)};
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error{
+        fmt::format("Could not open file {} for mapping", filename)};
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    CloseHandle(file);
+    throw std::runtime_error{
+        fmt::format("Could not query size of file {}", filename)};
+  }
+  const auto size{static_cast<std::size_t>(file_size.QuadPart)};
+  if (size == 0) {
+    CloseHandle(file);
+    return {nullptr, 0};
+  }
+  const HANDLE mapping{CreateFileMappingA(
+      file, nullptr,
+      access == Access::CopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0,
+      nullptr)};
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    throw std::runtime_error{
+        fmt::format("Could not create mapping for file {}", filename)};
+  }
+  void *const view{MapViewOfFile(
+      mapping, access == Access::CopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ,
+      0, 0, 0)};
+  CloseHandle(mapping);
+  if (view == nullptr) {
+    throw std::runtime_error{fmt::format("Could not map file {}", filename)};
+  }
+  return {static_cast<std::byte *>(view), size};
+}
+
+MappedFile MappedFile::createNewFile(const std::string &filename,
+                                     const std::size_t size) {
+  const HANDLE file{CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+                                0, nullptr, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, nullptr)};
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error{
+        fmt::format("Could not create file {} for mapping", filename)};
+  }
+  if (size == 0) {
+    CloseHandle(file);
+    return {nullptr, 0};
+  }
+  // Creating the mapping extends the file to the requested size
+  const auto size64{static_cast<std::uint64_t>(size)};
+  const HANDLE mapping{CreateFileMappingA(
+      file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32u),
+      static_cast<DWORD>(size64 & 0xFFFFFFFFu), nullptr)};
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    throw std::runtime_error{
+        fmt::format("Could not create mapping for file {}", filename)};
+  }
+  void *const view{MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0)};
+  CloseHandle(mapping);
+  if (view == nullptr) {
+    throw std::runtime_error{fmt::format("Could not map file {}", filename)};
+  }
+  return {static_cast<std::byte *>(view), size};
+}
+
+void MappedFile::advise(const Advice advice, const std::size_t offset,
+                        const std::size_t length) const {
+  if (advice != Advice::WillNeed || _data == nullptr || offset >= _size) {
+    return;
+  }
+  WIN32_MEMORY_RANGE_ENTRY range{_data + offset,
+                                 std::min(length, _size - offset)};
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MappedFile::unmap() noexcept {
+  if (_data != nullptr) {
+    UnmapViewOfFile(_data);
+    _data = nullptr;
+    _size = 0;
+  }
+}
+
+#else
+
+MappedFile MappedFile::createFromFile(const std::string &filename,
+                                      const Access access) {
+  const int fd{::open(filename.c_str(), O_RDONLY)};
+  if (fd == -1) {
+    throw std::runtime_error{
+        fmt::format("Could not open file {} for mapping", filename)};
+  }
+  struct stat file_stat {};
+  if (::fstat(fd, &file_stat) == -1) {
+    ::close(fd);
+    throw std::runtime_error{
+        fmt::format("Could not query size of file {}", filename)};
+  }
+  const auto size{static_cast<std::size_t>(file_stat.st_size)};
+  if (size == 0) {
+    ::close(fd);
+    return {nullptr, 0};
+  }
+  void *const view{
+      ::mmap(nullptr, size,
+             access == Access::CopyOnWrite ? PROT_READ | PROT_WRITE
+                                           : PROT_READ,
+             MAP_PRIVATE, fd, 0)};
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    throw std::runtime_error{fmt::format("Could not map file {}", filename)};
+  }
+  return {static_cast<std::byte *>(view), size};
+}
+
+MappedFile MappedFile::createNewFile(const std::string &filename,
+                                     const std::size_t size) {
+  const int fd{::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)};
+  if (fd == -1) {
+    throw std::runtime_error{
+        fmt::format("Could not create file {} for mapping", filename)};
+  }
+  if (size == 0) {
+    ::close(fd);
+    return {nullptr, 0};
+  }
+  if (::ftruncate(fd, static_cast<off_t>(size)) == -1) {
+    ::close(fd);
+    throw std::runtime_error{
+        fmt::format("Could not resize file {} to {} bytes", filename, size)};
+  }
+  void *const view{
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    throw std::runtime_error{fmt::format("Could not map file {}", filename)};
+  }
+  return {static_cast<std::byte *>(view), size};
+}
+
+void MappedFile::advise(const Advice advice, const std::size_t offset,
+                        const std::size_t length) const {
+  if (_data == nullptr || offset >= _size) {
+    return;
+  }
+  // madvise requires a page aligned start address
+  const auto page_size{static_cast<std::size_t>(::sysconf(_SC_PAGESIZE))};
+  const std::size_t aligned_offset{offset - offset % page_size};
+  const std::size_t aligned_length{std::min(length, _size - offset) +
+                                   (offset - aligned_offset)};
+  const int posix_advice{[advice]() -> int {
+    switch (advice) {
+    case Advice::Sequential: {
+      return MADV_SEQUENTIAL;
+    }
+    case Advice::Random: {
+      return MADV_RANDOM;
+    }
+    case Advice::WillNeed: {
+      return MADV_WILLNEED;
+    }
+    default: {
+      return MADV_NORMAL;
+    }
+    }
+  }()};
+  // Advice is only a hint, failing to apply it is not an error
+  static_cast<void>(
+      ::madvise(_data + aligned_offset, aligned_length, posix_advice));
+}
+
+void MappedFile::unmap() noexcept {
+  if (_data != nullptr) {
+    ::munmap(_data, _size);
+    _data = nullptr;
+    _size = 0;
+  }
+}
+
+#endif
+
+} // namespace Gecko
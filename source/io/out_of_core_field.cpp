@@ -0,0 +1,288 @@
+#include "io/out_of_core_field.hpp"
+#include "io/gvol.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace {
+
+// Brick the thread accessed last, shared by all the fields
+struct ThreadBrick {
+  std::uint64_t field_id{0};
+  std::size_t index{0};
+  std::shared_ptr<const std::vector<float>> brick;
+};
+
+thread_local ThreadBrick thread_brick;
+
+// 0 is the id of no field
+std::atomic<std::uint64_t> next_field_id{1};
+
+} // namespace
+
+std::unique_ptr<OutOfCoreScalarField>
+OutOfCoreScalarField::createFromFile(const std::string &filename,
+                                     const Settings &settings) {
+  const GVolFile file{GVolFile::createFromFile(filename)};
+  const GVolChannelDescriptor *const channel{
+      file.findChannel(GVolChannelType::Scalar)};
+  if (channel == nullptr) {
+    throw std::runtime_error{
+        fmt::format("No scalar channel in .gvol file {}", filename)};
+  }
+  if (channel->brick_size_log2 == 0) {
+    throw std::runtime_error{fmt::format(
+        "The scalar channel of {} is not bricked, rewrite it with a brick size",
+        filename)};
+  }
+  if (channel->data_type != GVolDataType::Float32 ||
+      channel->components != 1) {
+    throw std::runtime_error{"Unexpected layout for .gvol channel"};
+  }
+  const glm::ivec3 num_elements{file.numElements()};
+  if (glm::any(glm::lessThan(num_elements, glm::ivec3{2})) ||
+      glm::any(glm::lessThanEqual(file.boundsMax(), file.boundsMin()))) {
+    throw std::runtime_error{
+        fmt::format("Invalid field in .gvol file {}", filename)};
+  }
+  // Bricks are read once and then served from the cache
+  file.file()->advise(MappedFile::Advice::Random, channel->offset,
+                      channel->size);
+  return std::unique_ptr<OutOfCoreScalarField>{new OutOfCoreScalarField{
+      file.file(), channel->offset, file.boundsMin(), file.boundsMax(),
+      num_elements, static_cast<int>(channel->brick_size_log2),
+      std::pair{channel->value_min, channel->value_max}, settings}};
+}
+
+OutOfCoreScalarField::OutOfCoreScalarField(
+    std::shared_ptr<MappedFile> file, const std::uint64_t payload_offset,
+    const glm::vec3 &bounds_min, const glm::vec3 &bounds_max,
+    const glm::ivec3 &num_elements, const int brick_size_log2,
+    const std::pair<float, float> &value_range, const Settings &settings)
+    : _file{std::move(file)}, _payload_offset{payload_offset},
+      _bounds_min{bounds_min}, _bounds_max{bounds_max},
+      _num_elements{num_elements},
+      _voxel_size{(bounds_max - bounds_min) /
+                  glm::vec3{num_elements - glm::ivec3{1}}},
+      _value_range{value_range}, _brick_size_log2{brick_size_log2},
+      _num_bricks{(num_elements + glm::ivec3{brickSize() - 1}) /
+                  glm::ivec3{brickSize()}},
+      _brick_elements{std::size_t{1}
+                      << (3 * static_cast<unsigned>(brick_size_log2))},
+      _max_cached_bricks{std::max<std::size_t>(
+          1, settings.memory_budget / (_brick_elements * sizeof(float)))},
+      _prefetch_distance{std::max(0, settings.prefetch_distance)},
+      _id{next_field_id.fetch_add(1, std::memory_order_relaxed)} {}
+
+float OutOfCoreScalarField::at(const int i, const int j, const int k) const {
+  if (i >= xSize() || i < 0 || j >= ySize() || j < 0 || k >= zSize() ||
+      k < 0) {
+    throw std::out_of_range{"Invalid element index in OutOfCoreScalarField"};
+  }
+  return (*this)(i, j, k);
+}
+
+float OutOfCoreScalarField::operator()(const int i, const int j,
+                                       const int k) const {
+  const glm::ivec3 element{i, j, k};
+  return findThreadBrick(brickCoordinates(element))[elementOffset(element)];
+}
+
+float OutOfCoreScalarField::sample(const glm::vec3 &position) const {
+  // Same as ScalarField::sample(), NaN coordinates end up at 0
+  const glm::vec3 upper{_num_elements - glm::ivec3{1}};
+  glm::vec3 u{(position - min()) / getVoxelSize()};
+  for (int c{0}; c != 3; ++c) {
+    u[c] = u[c] > 0.f ? std::min(u[c], upper[c]) : 0.f;
+  }
+  const glm::ivec3 base{
+      glm::min(glm::ivec3{glm::floor(u)}, _num_elements - glm::ivec3{2})};
+  const glm::vec3 t{u - glm::vec3{base}};
+
+  // Corners of the cell, x fastest
+  std::array<float, 8> corners;
+  const glm::ivec3 first_brick{brickCoordinates(base)};
+  if (brickCoordinates(base + glm::ivec3{1}) == first_brick) {
+    // Most cells are inside a brick, one lookup for the 8 corners
+    const Brick &brick{findThreadBrick(first_brick)};
+    const std::size_t origin{elementOffset(base)};
+    const std::size_t dy{std::size_t{1} << _brick_size_log2};
+    const std::size_t dz{dy << _brick_size_log2};
+    for (std::size_t c{0}; c != 8; ++c) {
+      corners[c] = brick[origin + (c & 1u) + ((c >> 1u) & 1u) * dy +
+                         (c >> 2u) * dz];
+    }
+  } else {
+    // The others span up to 8 bricks, each looked up once
+    std::array<std::shared_ptr<const Brick>, 8> bricks;
+    for (int c{0}; c != 8; ++c) {
+      const glm::ivec3 element{base + glm::ivec3{c & 1, (c >> 1) & 1, c >> 2}};
+      const glm::ivec3 brick_coordinates{brickCoordinates(element)};
+      const glm::ivec3 d{brick_coordinates - first_brick};
+      std::shared_ptr<const Brick> &brick{
+          bricks[static_cast<std::size_t>(d.x + 2 * d.y + 4 * d.z)]};
+      if (brick == nullptr) {
+        brick = findBrick(brick_coordinates);
+      }
+      corners[static_cast<std::size_t>(c)] = (*brick)[elementOffset(element)];
+    }
+  }
+
+  const auto lerp{[](const float a, const float b, const float w) -> float {
+    return a + w * (b - a);
+  }};
+  const float c00{lerp(corners[0], corners[1], t.x)};
+  const float c10{lerp(corners[2], corners[3], t.x)};
+  const float c01{lerp(corners[4], corners[5], t.x)};
+  const float c11{lerp(corners[6], corners[7], t.x)};
+  return lerp(lerp(c00, c10, t.y), lerp(c01, c11, t.y), t.z);
+}
+
+void OutOfCoreScalarField::readRegion(const glm::ivec3 &origin,
+                                      const glm::ivec3 &size,
+                                      float *values) const {
+  if (glm::any(glm::lessThan(origin, glm::ivec3{0})) ||
+      glm::any(glm::lessThanEqual(size, glm::ivec3{0})) ||
+      glm::any(glm::greaterThan(origin + size, _num_elements))) {
+    throw std::out_of_range{"Invalid region of OutOfCoreScalarField"};
+  }
+  const glm::ivec3 end{origin + size};
+  const glm::ivec3 first_brick{origin / brickSize()};
+  const glm::ivec3 last_brick{(end - glm::ivec3{1}) / brickSize()};
+  for (int bk{first_brick.z}; bk <= last_brick.z; ++bk) {
+    for (int bj{first_brick.y}; bj <= last_brick.y; ++bj) {
+      for (int bi{first_brick.x}; bi <= last_brick.x; ++bi) {
+        const glm::ivec3 brick_coordinates{bi, bj, bk};
+        const std::shared_ptr<const Brick> brick{findBrick(brick_coordinates)};
+        // Part of the region inside the brick, rows along x are contiguous
+        const glm::ivec3 brick_origin{brick_coordinates * brickSize()};
+        const glm::ivec3 first{glm::max(origin, brick_origin)};
+        const glm::ivec3 last{
+            glm::min(end, brick_origin + glm::ivec3{brickSize()})};
+        for (int k{first.z}; k != last.z; ++k) {
+          for (int j{first.y}; j != last.y; ++j) {
+            const auto brick_row{static_cast<std::size_t>(
+                (first.x - brick_origin.x) |
+                ((j - brick_origin.y) << _brick_size_log2) |
+                ((k - brick_origin.z) << (2 * _brick_size_log2)))};
+            std::copy_n(
+                brick->data() + brick_row, last.x - first.x,
+                values + static_cast<std::size_t>(first.x - origin.x) +
+                    static_cast<std::size_t>(size.x) *
+                        (static_cast<std::size_t>(j - origin.y) +
+                         static_cast<std::size_t>(size.y) *
+                             static_cast<std::size_t>(k - origin.z)));
+          }
+        }
+      }
+    }
+  }
+}
+
+std::size_t OutOfCoreScalarField::cachedBricks() const {
+  const std::lock_guard<std::mutex> lock{_mutex};
+  return _cache.size();
+}
+
+OutOfCoreScalarField::Statistics
+OutOfCoreScalarField::statistics() const noexcept {
+  return {_hits.load(std::memory_order_relaxed),
+          _misses.load(std::memory_order_relaxed),
+          _prefetches.load(std::memory_order_relaxed),
+          _evictions.load(std::memory_order_relaxed)};
+}
+
+void OutOfCoreScalarField::resetStatistics() noexcept {
+  _hits.store(0, std::memory_order_relaxed);
+  _misses.store(0, std::memory_order_relaxed);
+  _prefetches.store(0, std::memory_order_relaxed);
+  _evictions.store(0, std::memory_order_relaxed);
+}
+
+std::shared_ptr<const OutOfCoreScalarField::Brick>
+OutOfCoreScalarField::findBrick(const glm::ivec3 &brick_coordinates) const {
+  const std::size_t index{brickIndex(brick_coordinates)};
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    const auto entry{_cache.find(index)};
+    if (entry != _cache.end()) {
+      _lru.splice(_lru.begin(), _lru, entry->second.lru_position);
+      _hits.fetch_add(1, std::memory_order_relaxed);
+      return entry->second.brick;
+    }
+  }
+
+  // Read outside of the lock so that hits on other threads are not blocked
+  // by the I/O, two threads missing the same brick both read it
+  _misses.fetch_add(1, std::memory_order_relaxed);
+  prefetchAfterMiss(brick_coordinates);
+  auto brick{std::make_shared<Brick>(_brick_elements)};
+  std::memcpy(brick->data(),
+              _file->data() + _payload_offset +
+                  index * _brick_elements * sizeof(float),
+              _brick_elements * sizeof(float));
+
+  const std::lock_guard<std::mutex> lock{_mutex};
+  const auto [entry, inserted]{_cache.try_emplace(index)};
+  if (!inserted) {
+    _lru.splice(_lru.begin(), _lru, entry->second.lru_position);
+    return entry->second.brick;
+  }
+  _lru.push_front(index);
+  entry->second = CacheEntry{std::move(brick), _lru.begin()};
+  if (_cache.size() > _max_cached_bricks) {
+    // Readers still holding the evicted brick keep it alive until done
+    _cache.erase(_lru.back());
+    _lru.pop_back();
+    _evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+  return entry->second.brick;
+}
+
+const OutOfCoreScalarField::Brick &OutOfCoreScalarField::findThreadBrick(
+    const glm::ivec3 &brick_coordinates) const {
+  const std::size_t index{brickIndex(brick_coordinates)};
+  if (thread_brick.field_id != _id || thread_brick.index != index ||
+      thread_brick.brick == nullptr) {
+    thread_brick.brick = findBrick(brick_coordinates);
+    thread_brick.field_id = _id;
+    thread_brick.index = index;
+  }
+  return *thread_brick.brick;
+}
+
+void OutOfCoreScalarField::prefetchAfterMiss(
+    const glm::ivec3 &brick_coordinates) const {
+  glm::ivec3 direction;
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    direction = brick_coordinates - _last_miss;
+    _last_miss = brick_coordinates;
+  }
+  // Only misses on neighbouring bricks give a direction
+  if (direction == glm::ivec3{0} ||
+      glm::any(glm::greaterThan(glm::abs(direction), glm::ivec3{1}))) {
+    return;
+  }
+  glm::ivec3 next{brick_coordinates};
+  for (int p{0}; p != _prefetch_distance; ++p) {
+    next += direction;
+    if (glm::any(glm::lessThan(next, glm::ivec3{0})) ||
+        glm::any(glm::greaterThanEqual(next, _num_bricks))) {
+      return;
+    }
+    _file->advise(MappedFile::Advice::WillNeed,
+                  _payload_offset +
+                      brickIndex(next) * _brick_elements * sizeof(float),
+                  _brick_elements * sizeof(float));
+    _prefetches.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+} // namespace Gecko
@@ -0,0 +1,19 @@
+#include "io/slab_reader.hpp"
+#include "io/gcvol.hpp"
+#include "io/gvol.hpp"
+#include "io/text_volume.hpp"
+
+namespace Gecko {
+
+std::unique_ptr<SlabReader>
+SlabReader::createFromFile(const std::string &filename) {
+  if (isGVolFilename(filename)) {
+    return GVolSlabReader::createFromFile(filename);
+  }
+  if (isGCVolFilename(filename)) {
+    return GCVolSlabReader::createFromFile(filename);
+  }
+  return TextSlabReader::createFromFile(filename);
+}
+
+} // namespace Gecko
@@ -0,0 +1,313 @@
+#include "io/text_volume.hpp"
+#include "io/mapped_file.hpp"
+#include "utils/parallel.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Gecko {
+
+namespace {
+
+// Chunks smaller than this are not worth a thread
+constexpr std::size_t MIN_CHUNK_SIZE{1u << 20u};
+// More chunks than threads to even out differences in chunk parse time
+constexpr std::size_t CHUNKS_PER_THREAD{4};
+// nx ny nz s
+constexpr std::size_t VALUES_PER_ELEMENT{4};
+
+[[nodiscard]] constexpr bool isSpace(const char c) noexcept {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+         c == '\f';
+}
+
+// Parse a single value in [first, last), returns a pointer past the parsed
+// characters or nullptr on failure
+template <typename T>
+[[nodiscard]] const char *parseValue(const char *first, const char *last,
+                                     T &value) noexcept {
+  if (first != last && *first == '+') {
+    ++first;
+  }
+#if defined(_LIBCPP_VERSION)
+  // libc++ lacks floating point from_chars, fall back to strtof on a copy
+  if constexpr (std::is_floating_point_v<T>) {
+    std::array<char, 64> buffer{};
+    const auto length{std::min(
+        static_cast<std::size_t>(std::find_if(first, last, isSpace) - first),
+        buffer.size() - 1)};
+    std::copy_n(first, length, buffer.begin());
+    char *parse_end{nullptr};
+    value = static_cast<T>(std::strtod(buffer.data(), &parse_end));
+    return parse_end == buffer.data() ? nullptr
+                                      : first + (parse_end - buffer.data());
+  } else
+#endif
+  {
+    const auto [ptr, ec]{std::from_chars(first, last, value)};
+    return ec == std::errc{} ? ptr : nullptr;
+  }
+}
+
+// Sequential whitespace separated token reader over a range of characters
+class TokenReader {
+public:
+  TokenReader(const char *begin, const char *end,
+              const char *file_begin) noexcept
+      : _current{begin}, _end{end}, _file_begin{file_begin} {}
+
+  // Skip whitespace, returns false if the end of the range was reached
+  [[nodiscard]] bool skipSpace() noexcept {
+    _current = std::find_if_not(_current, _end, isSpace);
+    return _current != _end;
+  }
+
+  template <typename T> [[nodiscard]] T next() {
+    if (!skipSpace()) {
+      throw std::runtime_error{"Unexpected end of volume file"};
+    }
+    T value{};
+    const char *const parse_end{parseValue(_current, _end, value)};
+    if (parse_end == nullptr || (parse_end != _end && !isSpace(*parse_end))) {
+      throw std::runtime_error{fmt::format("Invalid value at byte {}",
+                                           _current - _file_begin)};
+    }
+    _current = parse_end;
+    return value;
+  }
+
+  [[nodiscard]] const char *position() const noexcept { return _current; }
+
+private:
+  const char *_current;
+  const char *const _end;
+  const char *const _file_begin;
+};
+
+[[nodiscard]] std::size_t countTokens(const char *first,
+                                      const char *const last) noexcept {
+  std::size_t count{0};
+  bool in_token{false};
+  for (; first != last; ++first) {
+    const bool space{isSpace(*first)};
+    count += static_cast<std::size_t>(!space && !in_token);
+    in_token = !space;
+  }
+  return count;
+}
+
+// Returns a pointer to the start of the token following the first n ones
+[[nodiscard]] const char *skipTokens(const char *first, const char *const last,
+                                     std::size_t n) noexcept {
+  first = std::find_if_not(first, last, isSpace);
+  for (; n != 0 && first != last; --n) {
+    first = std::find_if_not(std::find_if(first, last, isSpace), last, isSpace);
+  }
+  return first;
+}
+
+// Parse all values in [begin, end), the first one having the given index in
+// the value sequence of the buffers. Returns the range of the scalar values.
+std::pair<float, float> parseValues(const char *begin, const char *end,
+                                    const char *file_begin,
+                                    std::size_t value_index, float *scalars,
+                                    glm::vec3 *normals) {
+  TokenReader reader{begin, end, file_begin};
+  float value_min{std::numeric_limits<float>::max()};
+  float value_max{std::numeric_limits<float>::lowest()};
+  while (reader.skipSpace()) {
+    const float value{reader.next<float>()};
+    const std::size_t element{value_index / VALUES_PER_ELEMENT};
+    const std::size_t component{value_index % VALUES_PER_ELEMENT};
+    if (component == VALUES_PER_ELEMENT - 1) {
+      scalars[element] = value;
+      value_min = std::min(value_min, value);
+      value_max = std::max(value_max, value);
+    } else if (normals != nullptr) {
+      normals[element][static_cast<glm::length_t>(component)] = value;
+    }
+    ++value_index;
+  }
+  return {value_min, value_max};
+}
+
+// Header of the file and split of the body in chunks, with the index of the
+// first value of each chunk
+struct TextLayout {
+  glm::vec3 bounds_min, bounds_max;
+  glm::ivec3 num_points;
+  std::vector<const char *> chunk_begins;
+  std::vector<std::size_t> chunk_first_value;
+
+  [[nodiscard]] std::size_t numChunks() const noexcept {
+    return chunk_begins.size() - 1;
+  }
+};
+
+[[nodiscard]] TextLayout scanTextVolume(const MappedFile &file,
+                                        const std::string &filename) {
+  const auto file_begin{reinterpret_cast<const char *>(file.data())};
+  const char *const file_end{file_begin + file.size()};
+  TextLayout layout;
+
+  // Header is tiny, read it sequentially
+  TokenReader header_reader{file_begin, file_end, file_begin};
+  layout.bounds_min.x = header_reader.next<float>();
+  layout.bounds_min.y = header_reader.next<float>();
+  layout.bounds_min.z = header_reader.next<float>();
+  layout.bounds_max.x = header_reader.next<float>();
+  layout.bounds_max.y = header_reader.next<float>();
+  layout.bounds_max.z = header_reader.next<float>();
+  layout.num_points.x = header_reader.next<int>();
+  layout.num_points.y = header_reader.next<int>();
+  layout.num_points.z = header_reader.next<int>();
+  if (glm::any(glm::lessThan(layout.num_points, glm::ivec3{2}))) {
+    throw std::runtime_error{
+        fmt::format("Invalid volume size in file {}", filename)};
+  }
+
+  // Split body in chunks starting right after a new line
+  const char *const body_begin{header_reader.position()};
+  const auto body_size{static_cast<std::size_t>(file_end - body_begin)};
+  const std::size_t num_chunks{std::clamp<std::size_t>(
+      body_size / MIN_CHUNK_SIZE, 1,
+      CHUNKS_PER_THREAD * defaultThreadCount())};
+  layout.chunk_begins.resize(num_chunks + 1, file_end);
+  layout.chunk_begins.front() = body_begin;
+  for (std::size_t c{1}; c != num_chunks; ++c) {
+    const char *const split{std::max(body_begin + c * body_size / num_chunks,
+                                     layout.chunk_begins[c - 1])};
+    const char *const line_end{std::find(split, file_end, '\n')};
+    layout.chunk_begins[c] = line_end == file_end ? file_end : line_end + 1;
+  }
+
+  // Count the values in each chunk to know where it starts
+  layout.chunk_first_value.resize(num_chunks + 1, 0);
+  parallelFor(0, num_chunks,
+              [&](const std::size_t first, const std::size_t last) -> void {
+                for (std::size_t c{first}; c != last; ++c) {
+                  layout.chunk_first_value[c + 1] = countTokens(
+                      layout.chunk_begins[c], layout.chunk_begins[c + 1]);
+                }
+              });
+  for (std::size_t c{0}; c != num_chunks; ++c) {
+    layout.chunk_first_value[c + 1] += layout.chunk_first_value[c];
+  }
+  const std::size_t expected_values{
+      VALUES_PER_ELEMENT * static_cast<std::size_t>(layout.num_points.x) *
+      static_cast<std::size_t>(layout.num_points.y) *
+      static_cast<std::size_t>(layout.num_points.z)};
+  if (layout.chunk_first_value.back() != expected_values) {
+    throw std::runtime_error{
+        fmt::format("Volume file {} contains {} values, expected {}",
+                    filename, layout.chunk_first_value.back(),
+                    expected_values)};
+  }
+
+  return layout;
+}
+
+} // namespace
+
+VolumeData loadTextVolume(const std::string &filename,
+                          const bool read_normals) {
+  const MappedFile file{MappedFile::createFromFile(filename)};
+  file.advise(MappedFile::Advice::Sequential);
+  const TextLayout layout{scanTextVolume(file, filename)};
+  const auto file_begin{reinterpret_cast<const char *>(file.data())};
+
+  // Every element is written by the parser, skip initialization. Volumes are
+  // large, huge pages save TLB misses in every later pass over them.
+  ScalarField<float> field{ScalarField<float>::createUninitialized(
+      layout.bounds_min, layout.bounds_max, layout.num_points.x,
+      layout.num_points.y, layout.num_points.z, StoragePolicy::HugePages)};
+  auto normals{read_normals ? FieldStorage<glm::vec3>::allocate(
+                                  field.totalElements(),
+                                  StoragePolicy::HugePages)
+                            : FieldStorage<glm::vec3>{}};
+
+  // Parse each chunk and write values in place
+  const std::size_t num_chunks{layout.numChunks()};
+  std::vector<std::pair<float, float>> chunk_ranges(num_chunks);
+  parallelFor(0, num_chunks,
+              [&](const std::size_t first, const std::size_t last) -> void {
+                for (std::size_t c{first}; c != last; ++c) {
+                  chunk_ranges[c] = parseValues(
+                      layout.chunk_begins[c], layout.chunk_begins[c + 1],
+                      file_begin, layout.chunk_first_value[c], field.data(),
+                      normals.data());
+                }
+              });
+
+  float value_min{std::numeric_limits<float>::max()};
+  float value_max{std::numeric_limits<float>::lowest()};
+  for (const auto &[chunk_min, chunk_max] : chunk_ranges) {
+    value_min = std::min(value_min, chunk_min);
+    value_max = std::max(value_max, chunk_max);
+  }
+  return {std::move(field), std::move(normals), value_min, value_max};
+}
+
+std::unique_ptr<TextSlabReader>
+TextSlabReader::createFromFile(const std::string &filename) {
+  MappedFile file{MappedFile::createFromFile(filename)};
+  const TextLayout layout{scanTextVolume(file, filename)};
+
+  // Locate the start of each z slice, every chunk takes care of the slices
+  // starting inside it
+  const auto file_begin{reinterpret_cast<const char *>(file.data())};
+  const std::size_t slice_values{
+      VALUES_PER_ELEMENT * static_cast<std::size_t>(layout.num_points.x) *
+      static_cast<std::size_t>(layout.num_points.y)};
+  std::vector<const char *> slice_begins(
+      static_cast<std::size_t>(layout.num_points.z) + 1,
+      file_begin + file.size());
+  parallelFor(
+      0, layout.numChunks(),
+      [&](const std::size_t first, const std::size_t last) -> void {
+        for (std::size_t c{first}; c != last; ++c) {
+          const char *position{layout.chunk_begins[c]};
+          std::size_t value{layout.chunk_first_value[c]};
+          std::size_t slice{(value + slice_values - 1) / slice_values};
+          while (slice * slice_values < layout.chunk_first_value[c + 1]) {
+            position = skipTokens(position, layout.chunk_begins[c + 1],
+                                  slice * slice_values - value);
+            value = slice * slice_values;
+            slice_begins[slice++] = position;
+          }
+        }
+      });
+
+  return std::unique_ptr<TextSlabReader>{
+      new TextSlabReader{std::move(file), layout.bounds_min, layout.bounds_max,
+                         layout.num_points, std::move(slice_begins)}};
+}
+
+TextSlabReader::TextSlabReader(MappedFile file, const glm::vec3 &bounds_min,
+                               const glm::vec3 &bounds_max,
+                               const glm::ivec3 &num_elements,
+                               std::vector<const char *> slice_begins) noexcept
+    : SlabReader{bounds_min, bounds_max, num_elements}, _file{std::move(file)},
+      _slice_begins{std::move(slice_begins)} {}
+
+std::pair<float, float> TextSlabReader::readSlab(const int z_begin,
+                                                 const int z_end,
+                                                 float *scalars,
+                                                 glm::vec3 *normals) const {
+  return parseValues(_slice_begins[static_cast<std::size_t>(z_begin)],
+                     _slice_begins[static_cast<std::size_t>(z_end)],
+                     reinterpret_cast<const char *>(_file.data()), 0, scalars,
+                     normals);
+}
+
+} // namespace Gecko
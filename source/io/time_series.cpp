@@ -0,0 +1,111 @@
+#include "io/time_series.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace {
+
+[[nodiscard]] bool isDigit(const char c) noexcept {
+  return std::isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+// Order names character by character, except for runs of digits which are
+// ordered by their value
+[[nodiscard]] bool naturalLess(const std::string &a, const std::string &b) {
+  std::size_t i{0}, j{0};
+  while (i != a.size() && j != b.size()) {
+    if (isDigit(a[i]) && isDigit(b[j])) {
+      // Leading zeros do not change the value
+      while (i + 1 < a.size() && a[i] == '0' && isDigit(a[i + 1])) {
+        ++i;
+      }
+      while (j + 1 < b.size() && b[j] == '0' && isDigit(b[j + 1])) {
+        ++j;
+      }
+      const std::size_t a_end{static_cast<std::size_t>(
+          std::find_if_not(a.begin() + static_cast<std::ptrdiff_t>(i),
+                           a.end(), isDigit) -
+          a.begin())};
+      const std::size_t b_end{static_cast<std::size_t>(
+          std::find_if_not(b.begin() + static_cast<std::ptrdiff_t>(j),
+                           b.end(), isDigit) -
+          b.begin())};
+      // With no leading zeros, longer runs are larger numbers
+      if (a_end - i != b_end - j) {
+        return a_end - i < b_end - j;
+      }
+      const int order{a.compare(i, a_end - i, b, j, b_end - j)};
+      if (order != 0) {
+        return order < 0;
+      }
+      i = a_end;
+      j = b_end;
+    } else {
+      if (a[i] != b[j]) {
+        return a[i] < b[j];
+      }
+      ++i;
+      ++j;
+    }
+  }
+  return a.size() - i < b.size() - j;
+}
+
+[[nodiscard]] std::vector<std::string>
+listDirectory(const std::filesystem::path &directory) {
+  std::vector<std::string> filenames;
+  for (const std::filesystem::directory_entry &entry :
+       std::filesystem::directory_iterator{directory}) {
+    if (entry.is_regular_file() &&
+        entry.path().filename().string().front() != '.') {
+      filenames.push_back(entry.path().string());
+    }
+  }
+  std::sort(filenames.begin(), filenames.end(), naturalLess);
+  return filenames;
+}
+
+[[nodiscard]] std::vector<std::string>
+readManifest(const std::filesystem::path &manifest) {
+  std::ifstream file{manifest};
+  if (!file.is_open()) {
+    throw std::runtime_error{
+        fmt::format("Could not open manifest {}", manifest.string())};
+  }
+  const std::filesystem::path directory{manifest.parent_path()};
+  std::vector<std::string> filenames;
+  std::string line;
+  while (std::getline(file, line)) {
+    // Trim spaces and the carriage return of files written on Windows
+    const auto first{line.find_first_not_of(" \t\r")};
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    const auto last{line.find_last_not_of(" \t\r")};
+    const std::filesystem::path step{line.substr(first, last - first + 1)};
+    filenames.push_back(
+        (step.is_absolute() ? step : directory / step).string());
+  }
+  return filenames;
+}
+
+} // namespace
+
+TimeSeries TimeSeries::createFromPath(const std::string &path) {
+  std::vector<std::string> filenames{std::filesystem::is_directory(path)
+                                         ? listDirectory(path)
+                                         : readManifest(path)};
+  if (filenames.empty()) {
+    throw std::runtime_error{fmt::format("No timesteps found in {}", path)};
+  }
+  return TimeSeries{std::move(filenames)};
+}
+
+} // namespace Gecko
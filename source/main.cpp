@@ -11,27 +11,110 @@
 // clang-format on
 
 #include "glutils/utils.hpp"
+#include "glutils/frame_recorder.hpp"
+#include "glutils/gpu_timer.hpp"
+#include "glutils/offscreen_framebuffer.hpp"
 #include "glutils/program.hpp"
+#include "glutils/progressive_renderer.hpp"
+#include "glutils/time_series_player.hpp"
+#include "glutils/time_varying_volume.hpp"
+#include "glutils/volume_brick_cache.hpp"
+#include "glutils/volume_stream_uploader.hpp"
+#include "camera/camera_path.hpp"
 #include "camera/orbit_camera.hpp"
+#include "io/gcvol.hpp"
+#include "io/gtvol.hpp"
+#include "io/gvol.hpp"
+#include "io/image_writer.hpp"
+#include "io/out_of_core_field.hpp"
+#include "io/slab_reader.hpp"
+#include "io/text_volume.hpp"
+#include "io/time_series.hpp"
+#include "io/volume_data.hpp"
+#include "render/cpu_raymarcher.hpp"
+#include "scalar_field/compressed_field.hpp"
+#include "scalar_field/macrocell_grid.hpp"
+#include "scalar_field/normal_encoding.hpp"
+#include "scalar_field/quantization.hpp"
 #include "scalar_field/scalar_field.hpp"
+#include "utils/parallel.hpp"
+#if defined(GECKO_EGL)
+#include "glutils/headless_context.hpp"
+#endif
 
+#include "fmt/format.h"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
 #include <array>
-#include <fstream>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 static void glfwErrorCallback(const int error, const char *description) {
   spdlog::error("GLFW error {}: {}", error, description);
 }
 
+// Seconds on a monotonic clock, also without a window
+[[nodiscard]] static double currentTime() noexcept {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Model matrix mapping the unit cube to the field bounds
+[[nodiscard]] static glm::mat4 computeModelMatrix(const glm::vec3 &bounds_min,
+                                                  const glm::vec3 &bounds_max) {
+  return glm::rotate(glm::radians(-90.f), glm::vec3{1.f, 0.f, 0.f}) *
+         glm::rotate(glm::radians(-90.f), glm::vec3{0.f, 0.f, 1.f}) *
+         glm::translate(bounds_min) * glm::scale(bounds_max - bounds_min);
+}
+
+[[nodiscard]] static float computeStepSize(const glm::vec3 &bounds_min,
+                                           const glm::vec3 &bounds_max,
+                                           const glm::ivec3 &num_elements) {
+  const glm::vec3 voxel_size{(bounds_max - bounds_min) /
+                             glm::vec3{num_elements - glm::ivec3{1}}};
+  return std::min(voxel_size.x, std::min(voxel_size.y, voxel_size.z)) / 4.f;
+}
+
+// Image filename of a frame of a camera path: image.png becomes
+// image_0000.png
+[[nodiscard]] static std::string frameFilename(const std::string &filename,
+                                               const std::size_t frame) {
+  const std::size_t extension{filename.rfind('.')};
+  const std::size_t separator{filename.find_last_of("/\\")};
+  const std::size_t stem_end{
+      extension != std::string::npos &&
+              (separator == std::string::npos || extension > separator)
+          ? extension
+          : filename.size()};
+  return fmt::format("{}_{:04}{}", filename.substr(0, stem_end), frame,
+                     filename.substr(stem_end));
+}
+
 static Gecko::OrbitCamera camera{glm::vec3{0.f, 0.f, 10.f},
                                  glm::zero<glm::vec3>()};
 static glm::vec2 previous_mouse_position;
 static uint8_t down_flags{0u};
+// Last change of the view or of the transfer function, frames are drawn
+// coarse around it
+static double last_interaction_time{0.};
+// Frames still to draw after the last input event, the overlay reacts to
+// some of them a frame late
+constexpr static int INPUT_FRAMES{2};
+static int input_frames{INPUT_FRAMES};
 
 static void glfwKeyCallback(GLFWwindow *window, const int key,
                             [[maybe_unused]] const int scancode,
                             const int action, [[maybe_unused]] const int mods) {
+  input_frames = INPUT_FRAMES;
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, GLFW_TRUE);
   }
@@ -54,7 +137,8 @@ static void glfwKeyCallback(GLFWwindow *window, const int key,
   }
 }
 
-static void createOverlay(float* min_value, float* mult) {
+static void createOverlay(float* min_value, float* mult,
+                          const Gecko::ProgressiveRenderer &refiner) {
   constexpr static float DISTANCE{10.0f};
   const ImVec2 window_pos{DISTANCE, DISTANCE};
   const ImVec2 window_pos_pivot{0.0f, 0.0f};
@@ -69,6 +153,12 @@ static void createOverlay(float* min_value, float* mult) {
   ImGui::Text("Performance: %.3f ms/frame (%.1f FPS)",
               static_cast<double>(1000.0f / ImGui::GetIO().Framerate),
               static_cast<double>(ImGui::GetIO().Framerate));
+  ImGui::Text("GPU: %.2f ms/frame", refiner.lastFrameTime());
+  ImGui::Text("Interaction: %d%% resolution, step x%.2f",
+              static_cast<int>(refiner.interactionScale() * 100.f),
+              static_cast<double>(refiner.interactionStepMultiplier()));
+  ImGui::Text("Refinement: %d samples%s", refiner.samples(),
+              refiner.converged() ? ", converged" : "");
   ImGui::End();
 
   ImGui::Begin("Score tf tuner");
@@ -77,9 +167,54 @@ static void createOverlay(float* min_value, float* mult) {
   ImGui::End();
 }
 
+static void createPlaybackOverlay(Gecko::TimeSeriesPlayer &player,
+                                  const double time) {
+  ImGui::Begin("Playback");
+  bool playing{player.playing()};
+  if (ImGui::Checkbox("Play", &playing)) {
+    player.setPlaying(playing, time);
+  }
+  int step{static_cast<int>(std::max<std::int64_t>(player.currentStep(), 0))};
+  if (ImGui::SliderInt("Step", &step, 0,
+                       static_cast<int>(player.numSteps()) - 1)) {
+    player.seek(static_cast<std::size_t>(step));
+  }
+  auto steps_per_second{static_cast<float>(player.stepsPerSecond())};
+  if (ImGui::SliderFloat("Steps per second", &steps_per_second, 1.f, 60.f)) {
+    player.setStepsPerSecond(static_cast<double>(steps_per_second));
+  }
+  const Gecko::TimeSeriesPlayer::Statistics statistics{player.statistics()};
+  ImGui::Text("Shown: %llu, late (dropped frames): %llu",
+              static_cast<unsigned long long>(statistics.shown_steps),
+              static_cast<unsigned long long>(statistics.late_steps));
+  ImGui::Text("Read time: %.1f ms/step, buffered steps: %zu",
+              1000.0 * statistics.average_read_time,
+              statistics.buffered_steps);
+  ImGui::End();
+}
+
+static void createStepOverlay(Gecko::TimeVaryingVolume &volume,
+                              bool *playing) {
+  ImGui::Begin("Playback");
+  ImGui::Checkbox("Play", playing);
+  int step{static_cast<int>(volume.currentStep())};
+  if (ImGui::SliderInt("Step", &step, 0,
+                       static_cast<int>(volume.numSteps()) - 1)) {
+    volume.setStep(static_cast<std::size_t>(step));
+  }
+  const Gecko::TimeVaryingVolume::Statistics &statistics{
+      volume.statistics()};
+  ImGui::Text("Read: %zu bricks, %.1f KB", statistics.read_bricks,
+              static_cast<double>(statistics.read_bytes) / 1024.0);
+  ImGui::Text("Uploaded: %zu bricks, %.1f KB", statistics.uploaded_bricks,
+              static_cast<double>(statistics.uploaded_bytes) / 1024.0);
+  ImGui::End();
+}
+
 static void glfwMouseButtonCallback(GLFWwindow *window, const int button,
                                     const int action,
                                     [[maybe_unused]] const int mods) {
+  input_frames = INPUT_FRAMES;
   if (button == GLFW_MOUSE_BUTTON_LEFT) {
     if (action == GLFW_PRESS) {
       down_flags |= 0x1u;
@@ -96,6 +231,7 @@ static void glfwMouseButtonCallback(GLFWwindow *window, const int button,
 static void glfwMouseCallback([[maybe_unused]] GLFWwindow *window,
                               const double xpos, const double ypos) {
   constexpr static float CAMERA_SENSITIVITY{0.01f};
+  input_frames = INPUT_FRAMES;
   const bool ctrl_down{static_cast<bool>(down_flags & 0x2u)};
   const bool shift_down{static_cast<bool>(down_flags & 0x4u)};
 
@@ -114,6 +250,7 @@ static void glfwMouseCallback([[maybe_unused]] GLFWwindow *window,
         camera.moveRight(-CAMERA_SENSITIVITY * x_offset);
         camera.moveUp(CAMERA_SENSITIVITY * y_offset);
       }
+      last_interaction_time = currentTime();
     }
   }
 }
@@ -122,7 +259,20 @@ static void glfwScrollCallback([[maybe_unused]] GLFWwindow *window,
                                [[maybe_unused]] const double xoffset,
                                const double yoffset) {
   constexpr static float SCROLL_SENSITIVITY{0.1f};
+  input_frames = INPUT_FRAMES;
   camera.changeRadius(SCROLL_SENSITIVITY * static_cast<float>(-yoffset));
+  last_interaction_time = currentTime();
+}
+
+// The window was resized or its content damaged
+static void glfwRedrawCallback([[maybe_unused]] GLFWwindow *window) {
+  input_frames = INPUT_FRAMES;
+}
+
+static void glfwFramebufferSizeCallback(GLFWwindow *window,
+                                        [[maybe_unused]] const int width,
+                                        [[maybe_unused]] const int height) {
+  glfwRedrawCallback(window);
 }
 
 template <typename T>
@@ -131,72 +281,582 @@ template <typename T>
   return a * std::exp(-t * t / (2.f * c * c));
 }
 
-int main([[maybe_unused]] int argc, const char *argv[]) {
+// True for .gvol files storing their scalar channel bricked, which are read
+// out of core
+[[nodiscard]] static bool isBrickedGVolFile(const std::string &filename) {
+  if (!Gecko::isGVolFilename(filename)) {
+    return false;
+  }
+  const Gecko::GVolFile gvol_file{Gecko::GVolFile::createFromFile(filename)};
+  const Gecko::GVolChannelDescriptor *const scalar_channel{
+      gvol_file.findChannel(Gecko::GVolChannelType::Scalar)};
+  return scalar_channel != nullptr && scalar_channel->brick_size_log2 != 0;
+}
+
+[[nodiscard]] static Gecko::VolumeData loadVolume(const std::string &filename,
+                                                  const bool read_normals) {
+  if (Gecko::isGVolFilename(filename)) {
+    // Binary volumes are used in place from the file mapping, only the
+    // channels needed are read
+    const Gecko::GVolFile gvol_file{Gecko::GVolFile::createFromFile(filename)};
+    gvol_file.prefetch(Gecko::GVolChannelType::Scalar);
+    if (read_normals) {
+      gvol_file.prefetch(Gecko::GVolChannelType::Normal);
+    }
+    const Gecko::GVolChannelDescriptor *const scalar_channel{
+        gvol_file.findChannel(Gecko::GVolChannelType::Scalar)};
+    return {gvol_file.createScalarField(),
+            read_normals ? gvol_file.createNormalStorage()
+                         : Gecko::FieldStorage<glm::vec3>{},
+            scalar_channel->value_min, scalar_channel->value_max};
+  }
+  if (Gecko::isGCVolFilename(filename)) {
+    // Decoded in parallel over bricks, normals are always derived
+    const Gecko::GCVolFile gcvol_file{
+        Gecko::GCVolFile::createFromFile(filename)};
+    const auto [value_min, value_max]{gcvol_file.valueRange()};
+    return {gcvol_file.readField(), Gecko::FieldStorage<glm::vec3>{},
+            value_min, value_max};
+  }
+  return Gecko::loadTextVolume(filename, read_normals);
+}
+
+// Convert the steps of a time series to a single .gtvol file, only the bricks
+// changing from one step to the next are stored
+static void writeTimeVaryingVolume(const Gecko::TimeSeries &series,
+                                   const std::string &filename,
+                                   const int brick_size_log2) {
+  Gecko::GTVolWriter writer{
+      Gecko::GTVolWriter::createFile(filename, brick_size_log2)};
+  for (std::size_t s{0}; s != series.numSteps(); ++s) {
+    writer.appendStep(loadVolume(series.stepFilename(s), false).field);
+  }
+  writer.finish();
+}
+
+// Smallest power of two cell size keeping the macrocell grid small enough to
+// be cheap to build and upload
+[[nodiscard]] static int computeMacrocellSize(const glm::ivec3 &num_elements) {
+  constexpr static int MIN_CELL_SIZE{8};
+  constexpr static int MAX_CELLS{128};
+  const int max_elements{
+      std::max(num_elements.x, std::max(num_elements.y, num_elements.z))};
+  int cell_size{MIN_CELL_SIZE};
+  while ((max_elements - 2) / cell_size + 1 > MAX_CELLS) {
+    cell_size *= 2;
+  }
+  return cell_size;
+}
+
+// Quantize the field to the format and upload it to the texture bound to the
+// active unit, returns the (scale, offset) mapping texture values back to
+// field values
+template <Gecko::VolumeFormat FORMAT>
+[[nodiscard]] static std::pair<float, float>
+uploadQuantizedField(const Gecko::VolumeData &volume) {
+  const auto quantized{Gecko::quantize<FORMAT>(
+      volume.field, {volume.value_min, volume.value_max})};
+  const Gecko::Utils::VolumeTextureFormat texture_format{
+      Gecko::Utils::volumeTextureFormat(FORMAT)};
+  Gecko::Utils::uploadVolumeTexture(
+      texture_format.format, texture_format.type,
+      glm::ivec3{quantized.field.xSize(), quantized.field.ySize(),
+                 quantized.field.zSize()},
+      texture_format.element_size, quantized.field.data());
+  return {quantized.scale, quantized.offset};
+}
+
+[[nodiscard]] static std::pair<float, float>
+uploadScalarField(const Gecko::VolumeData &volume,
+                  const Gecko::VolumeFormat format) {
+  switch (format) {
+  case Gecko::VolumeFormat::Float16: {
+    return uploadQuantizedField<Gecko::VolumeFormat::Float16>(volume);
+  }
+  case Gecko::VolumeFormat::UNorm16: {
+    return uploadQuantizedField<Gecko::VolumeFormat::UNorm16>(volume);
+  }
+  case Gecko::VolumeFormat::UNorm8: {
+    return uploadQuantizedField<Gecko::VolumeFormat::UNorm8>(volume);
+  }
+  default: {
+    const Gecko::ScalarField<float> &field{volume.field};
+    Gecko::Utils::uploadVolumeTexture(
+        GL_RED, GL_FLOAT,
+        glm::ivec3{field.xSize(), field.ySize(), field.zSize()},
+        sizeof(float), field.data());
+    return {1.f, 0.f};
+  }
+  }
+}
+
+// Encode the normals to the format and upload them to the texture bound to the
+// active unit
+template <Gecko::NormalFormat FORMAT>
+static void uploadEncodedNormals(const Gecko::FieldStorage<glm::vec3> &normals,
+                                 const glm::ivec3 &num_elements) {
+  using Type = typename Gecko::NormalFormatTraits<FORMAT>::Type;
+  std::vector<Type> encoded(2 * normals.size());
+  Gecko::encodeNormalsParallel<FORMAT>(normals.data(), normals.size(),
+                                       encoded.data());
+  const Gecko::Utils::VolumeTextureFormat texture_format{
+      Gecko::Utils::normalTextureFormat(FORMAT)};
+  Gecko::Utils::uploadVolumeTexture(texture_format.format, texture_format.type,
+                                    num_elements, texture_format.element_size,
+                                    encoded.data());
+}
+
+static void uploadNormals(const Gecko::FieldStorage<glm::vec3> &normals,
+                          const glm::ivec3 &num_elements,
+                          const Gecko::NormalFormat format) {
+  switch (format) {
+  case Gecko::NormalFormat::Octahedral16: {
+    uploadEncodedNormals<Gecko::NormalFormat::Octahedral16>(normals,
+                                                            num_elements);
+    break;
+  }
+  case Gecko::NormalFormat::Octahedral8: {
+    uploadEncodedNormals<Gecko::NormalFormat::Octahedral8>(normals,
+                                                           num_elements);
+    break;
+  }
+  default: {
+    Gecko::Utils::uploadVolumeTexture(GL_RGB, GL_FLOAT, num_elements,
+                                      sizeof(glm::vec3), normals.data());
+    break;
+  }
+  }
+}
+
+[[nodiscard]] static std::unique_ptr<Gecko::VolumeStreamUploader>
+createStreamUploader(std::shared_ptr<const Gecko::SlabReader> reader,
+                     Gecko::VolumeStreamUploader::Settings settings) {
+  // Aim for slabs of a few MB, big enough to amortize the upload calls
+  constexpr static std::size_t SLAB_SIZE{16u << 20u};
+  const std::size_t slice_size{reader->sliceElements() * sizeof(float)};
+  settings.slab_depth = static_cast<int>(std::clamp<std::size_t>(
+      SLAB_SIZE / slice_size, 1,
+      static_cast<std::size_t>(reader->numElements().z)));
+  // Two buffers per worker, one being filled while the other is uploaded
+  settings.num_buffers = 2 * std::size_t{Gecko::defaultThreadCount()};
+  return std::make_unique<Gecko::VolumeStreamUploader>(std::move(reader),
+                                                       settings);
+}
+
+[[nodiscard]] static std::optional<Gecko::VolumeFormat>
+parseVolumeFormat(const std::string &name) noexcept {
+  if (name == "f32") {
+    return Gecko::VolumeFormat::Float32;
+  }
+  if (name == "f16") {
+    return Gecko::VolumeFormat::Float16;
+  }
+  if (name == "u16") {
+    return Gecko::VolumeFormat::UNorm16;
+  }
+  if (name == "u8") {
+    return Gecko::VolumeFormat::UNorm8;
+  }
+  return std::nullopt;
+}
+
+[[nodiscard]] static std::optional<Gecko::NormalFormat>
+parseNormalFormat(const std::string &name) noexcept {
+  if (name == "f32") {
+    return Gecko::NormalFormat::Float32;
+  }
+  if (name == "oct16") {
+    return Gecko::NormalFormat::Octahedral16;
+  }
+  if (name == "oct8") {
+    return Gecko::NormalFormat::Octahedral8;
+  }
+  return std::nullopt;
+}
+
+// Number of type T spanning the whole string and accepted by the predicate
+template <typename T, typename Predicate>
+[[nodiscard]] static std::optional<T> parseNumber(const std::string &value,
+                                                  Predicate &&accept) {
+  T number;
+  const char *const end{value.data() + value.size()};
+  const auto [last, error]{std::from_chars(value.data(), end, number)};
+  if (error != std::errc{} || last != end || !accept(number)) {
+    return std::nullopt;
+  }
+  return number;
+}
+
+[[nodiscard]] static bool isPositive(const std::size_t value) noexcept {
+  return value != 0;
+}
+
+// Image size as <width>x<height>
+[[nodiscard]] static std::optional<glm::ivec2>
+parseImageSize(const std::string &value) noexcept {
+  glm::ivec2 size;
+  const char *const end{value.data() + value.size()};
+  const auto [width_end, width_error]{
+      std::from_chars(value.data(), end, size.x)};
+  if (width_error != std::errc{} || width_end == end || *width_end != 'x') {
+    return std::nullopt;
+  }
+  const auto [height_end, height_error]{
+      std::from_chars(width_end + 1, end, size.y)};
+  if (height_error != std::errc{} || height_end != end || size.x <= 0 ||
+      size.y <= 0) {
+    return std::nullopt;
+  }
+  return size;
+}
+
+struct Options {
+  std::string volume_filename;
+  std::string gvol_output_filename;
+  std::string gcvol_output_filename;
+  // Only with time_series, the steps are converted to a single file
+  std::string gtvol_output_filename;
+  // Write the scalar channel in bricks of 2^gvol_brick_size_log2 elements
+  int gvol_brick_size_log2{0};
+  bool stream{false};
+  // The volume is a directory or manifest of timesteps played in a loop
+  bool time_series{false};
+  double steps_per_second{10.};
+  std::size_t prefetch_steps{3};
+  bool derive_normals{false};
+  // GPU memory for the bricks of a paged volume in MB, 0 to upload the whole
+  // volume
+  std::size_t brick_cache_megabytes{0};
+  // Bits per value of the volume kept compressed in memory for the brick
+  // cache, 0 to keep it as floats
+  int compress_rate{0};
+  Gecko::VolumeFormat volume_format{Gecko::VolumeFormat::Float32};
+  Gecko::NormalFormat normal_format{Gecko::NormalFormat::Float32};
+  // Render a single frame offscreen to this image instead of opening a window
+  std::string headless_image_filename;
+  glm::ivec2 image_size{800, 600};
+  // Render every frame of a camera path, numbered after the headless image
+  std::string camera_path_filename;
+  // Render headless images with the CPU raymarcher, without OpenGL
+  bool cpu_render{false};
+  // Draw the headless image this many more times and report its GPU time, 0
+  // to draw it once
+  std::size_t timed_frames{0};
+  // GPU milliseconds the frames drawn while interacting should take, 0 for
+  // a fixed resolution scale
+  double frame_budget{16.};
+};
+
+[[nodiscard]] static std::optional<Options> parseOptions(const int argc,
+                                                         const char *argv[]) {
+  Options options;
+  for (int a{1}; a < argc; ++a) {
+    const std::string argument{argv[a]};
+    if (argument == "--write-gvol" && a + 1 < argc) {
+      options.gvol_output_filename = argv[++a];
+    } else if (argument == "--write-gcvol" && a + 1 < argc) {
+      options.gcvol_output_filename = argv[++a];
+    } else if (argument == "--write-gtvol" && a + 1 < argc) {
+      options.gtvol_output_filename = argv[++a];
+    } else if (argument == "--gvol-brick-size" && a + 1 < argc) {
+      // Powers of two supported by .gvol files
+      const std::optional<int> brick_size{parseNumber<int>(
+          argv[++a], [](const int size) -> bool {
+            return size >= 2 &&
+                   size <= 1 << Gecko::GVOL_MAX_BRICK_SIZE_LOG2 &&
+                   (size & (size - 1)) == 0;
+          })};
+      if (!brick_size) {
+        return std::nullopt;
+      }
+      options.gvol_brick_size_log2 = 1;
+      while (1 << options.gvol_brick_size_log2 != *brick_size) {
+        ++options.gvol_brick_size_log2;
+      }
+    } else if (argument == "--stream") {
+      options.stream = true;
+    } else if (argument == "--headless" && a + 1 < argc) {
+      options.headless_image_filename = argv[++a];
+    } else if (argument == "--size" && a + 1 < argc) {
+      const std::optional<glm::ivec2> size{parseImageSize(argv[++a])};
+      if (!size) {
+        return std::nullopt;
+      }
+      options.image_size = *size;
+    } else if (argument == "--frame-budget" && a + 1 < argc) {
+      // Milliseconds, 0 to disable
+      const std::optional<double> frame_budget{parseNumber<double>(
+          argv[++a], [](const double budget) -> bool { return budget >= 0.; })};
+      if (!frame_budget) {
+        return std::nullopt;
+      }
+      options.frame_budget = *frame_budget;
+    } else if (argument == "--cpu") {
+      options.cpu_render = true;
+    } else if (argument == "--time-frames" && a + 1 < argc) {
+      const std::optional<std::size_t> frames{
+          parseNumber<std::size_t>(argv[++a], isPositive)};
+      if (!frames) {
+        return std::nullopt;
+      }
+      options.timed_frames = *frames;
+    } else if (argument == "--camera-path" && a + 1 < argc) {
+      options.camera_path_filename = argv[++a];
+    } else if (argument == "--time-series") {
+      options.time_series = true;
+    } else if (argument == "--fps" && a + 1 < argc) {
+      const std::optional<double> steps_per_second{parseNumber<double>(
+          argv[++a], [](const double rate) -> bool { return rate > 0.; })};
+      if (!steps_per_second) {
+        return std::nullopt;
+      }
+      options.steps_per_second = *steps_per_second;
+    } else if (argument == "--prefetch" && a + 1 < argc) {
+      const std::optional<std::size_t> steps{
+          parseNumber<std::size_t>(argv[++a], isPositive)};
+      if (!steps) {
+        return std::nullopt;
+      }
+      options.prefetch_steps = *steps;
+    } else if (argument == "--derive-normals") {
+      options.derive_normals = true;
+    } else if (argument == "--format" && a + 1 < argc) {
+      const std::optional<Gecko::VolumeFormat> format{
+          parseVolumeFormat(argv[++a])};
+      if (!format) {
+        return std::nullopt;
+      }
+      options.volume_format = *format;
+    } else if (argument == "--normal-format" && a + 1 < argc) {
+      const std::optional<Gecko::NormalFormat> format{
+          parseNormalFormat(argv[++a])};
+      if (!format) {
+        return std::nullopt;
+      }
+      options.normal_format = *format;
+    } else if (argument == "--brick-cache" && a + 1 < argc) {
+      const std::optional<std::size_t> megabytes{
+          parseNumber<std::size_t>(argv[++a], isPositive)};
+      if (!megabytes) {
+        return std::nullopt;
+      }
+      options.brick_cache_megabytes = *megabytes;
+    } else if (argument == "--compress-rate" && a + 1 < argc) {
+      // Bits per value
+      const std::optional<int> rate{
+          parseNumber<int>(argv[++a], [](const int bits) -> bool {
+            return bits >= Gecko::CompressedScalarField::MIN_RATE &&
+                   bits <= Gecko::CompressedScalarField::MAX_RATE;
+          })};
+      if (!rate) {
+        return std::nullopt;
+      }
+      options.compress_rate = *rate;
+    } else if (options.volume_filename.empty() && argument.front() != '-') {
+      options.volume_filename = argument;
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (options.volume_filename.empty() ||
+      (options.stream && !options.gvol_output_filename.empty()) ||
+      (options.stream && !options.gcvol_output_filename.empty()) ||
+      (options.stream && options.brick_cache_megabytes != 0) ||
+      (options.compress_rate != 0 && options.brick_cache_megabytes == 0) ||
+      (options.time_series &&
+       (options.stream || options.brick_cache_megabytes != 0 ||
+        !options.gvol_output_filename.empty() ||
+        !options.gcvol_output_filename.empty())) ||
+      (!options.gtvol_output_filename.empty() && !options.time_series) ||
+      (!options.camera_path_filename.empty() &&
+       options.headless_image_filename.empty()) ||
+      // Frame times are measured on a single OpenGL headless image
+      (options.timed_frames != 0 &&
+       (options.headless_image_filename.empty() ||
+        !options.camera_path_filename.empty() || options.cpu_render)) ||
+      // The CPU raymarcher needs the whole volume in memory
+      (options.cpu_render &&
+       (options.headless_image_filename.empty() || options.stream ||
+        options.time_series || options.brick_cache_megabytes != 0 ||
+        Gecko::isGTVolFilename(options.volume_filename))) ||
+      // Time varying volumes are played as they are
+      (Gecko::isGTVolFilename(options.volume_filename) &&
+       (options.stream || options.time_series ||
+        options.brick_cache_megabytes != 0 ||
+        !options.gvol_output_filename.empty() ||
+        !options.gcvol_output_filename.empty()))) {
+    return std::nullopt;
+  }
+  return options;
+}
+
+// Headless rendering with the CPU raymarcher, same view and shading as the
+// OpenGL path with the default overlay settings
+static void renderOnCpu(const Options &options) {
+  Gecko::VolumeData volume{
+      loadVolume(options.volume_filename, !options.derive_normals)};
+  const Gecko::ScalarField<float> &field{volume.field};
+  if (volume.normals.size() != field.totalElements()) {
+    spdlog::info("Deriving normals from the field gradient");
+    volume.normals = field.computeNormals();
+  }
+  const glm::ivec3 num_elements{field.xSize(), field.ySize(), field.zSize()};
+  Gecko::CpuRaymarcher::Settings settings;
+  settings.macrocell_size = computeMacrocellSize(num_elements);
+  const Gecko::CpuRaymarcher raymarcher{field, volume.normals, settings};
+
+  const glm::mat4 M{computeModelMatrix(field.min(), field.max())};
+  const glm::mat4 MI{glm::inverse(M)};
+  const glm::mat4 P{glm::perspectiveFov(
+      glm::radians(60.f), static_cast<float>(options.image_size.x),
+      static_cast<float>(options.image_size.y), 0.1f, 400.f)};
+  Gecko::CpuRaymarcher::Shading shading;
+  shading.step_size =
+      computeStepSize(field.min(), field.max(), num_elements);
+
+  std::vector<std::uint8_t> pixels(static_cast<std::size_t>(
+                                       options.image_size.x) *
+                                   static_cast<std::size_t>(
+                                       options.image_size.y) *
+                                   4);
+  const auto render_frame{[&](const std::pair<glm::vec3, glm::mat4> &view,
+                              const std::string &filename) -> void {
+    const auto &[eye, V]{view};
+    raymarcher.render(P * V * M, glm::vec3{MI * glm::vec4{eye, 1.f}},
+                      shading, options.image_size.x, options.image_size.y,
+                      pixels.data());
+    Gecko::writeImage(filename, options.image_size.x, options.image_size.y,
+                      pixels.data());
+  }};
+  const double start_time{currentTime()};
+  if (options.camera_path_filename.empty()) {
+    render_frame(camera.getEyeAndViewMatrix(), options.headless_image_filename);
+    spdlog::info("Wrote {}x{} image {} in {:.2f} s", options.image_size.x,
+                 options.image_size.y, options.headless_image_filename,
+                 currentTime() - start_time);
+    return;
+  }
+  const Gecko::CameraPath camera_path{
+      Gecko::CameraPath::createFromFile(options.camera_path_filename)};
+  for (std::size_t frame{0}; frame != camera_path.numFrames(); ++frame) {
+    render_frame(camera_path.getEyeAndViewMatrix(frame),
+                 frameFilename(options.headless_image_filename, frame));
+  }
+  const double elapsed{currentTime() - start_time};
+  spdlog::info("Wrote {} frames of {}x{} in {:.2f} s ({:.1f} frames/s)",
+               camera_path.numFrames(), options.image_size.x,
+               options.image_size.y, elapsed,
+               static_cast<double>(camera_path.numFrames()) / elapsed);
+}
+
+int main(int argc, const char *argv[]) {
   try {
-    glfwSetErrorCallback(glfwErrorCallback);
-    if (!glfwInit()) {
-      spdlog::error("Could not initialize GLFW");
+    const std::optional<Options> parsed_options{parseOptions(argc, argv)};
+    if (!parsed_options) {
+      spdlog::error("Usage: {} <volume> [--stream] "
+                    "[--time-series [--fps <steps/s>] [--prefetch <steps>] "
+                    "[--write-gtvol <output.gtvol>]] "
+                    "[--derive-normals] "
+                    "[--format f32|f16|u16|u8] "
+                    "[--normal-format f32|oct16|oct8] "
+                    "[--brick-cache <MB>] [--compress-rate <bits>] "
+                    "[--write-gvol <output.gvol>] "
+                    "[--write-gcvol <output.gcvol>] [--gvol-brick-size <n>] "
+                    "[--frame-budget <ms>] "
+                    "[--headless <image.png|ppm> [--size <w>x<h>] "
+                    "[--camera-path <path.txt> | --time-frames <n>] "
+                    "[--cpu]]",
+                    argv[0]);
       return 1;
     }
+    const Options &options{*parsed_options};
+    if (options.cpu_render) {
+      renderOnCpu(options);
+      return 0;
+    }
+
+    // Either a window with an overlay or an offscreen context
+    const bool headless{!options.headless_image_filename.empty()};
+#if defined(GECKO_EGL)
+    std::optional<Gecko::HeadlessContext> headless_context;
+#endif
+    GLFWwindow *window{nullptr};
+    if (headless) {
+#if defined(GECKO_EGL)
+      headless_context.emplace(Gecko::HeadlessContext::create());
+#else
+      throw std::runtime_error{
+          "Headless rendering needs EGL, configure with -DGECKO_EGL=ON"};
+#endif
+    } else {
+      glfwSetErrorCallback(glfwErrorCallback);
+      if (!glfwInit()) {
+        spdlog::error("Could not initialize GLFW");
+        return 1;
+      }
 
 #if defined(__APPLE__)
-    // GL 4.1
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+      // GL 4.1
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
 #else
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    if (GL_ARB_debug_output) {
-      glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
-    }
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+      glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+      if (GL_ARB_debug_output) {
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+      }
 #endif
-    glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-
-    // Create GLFW window
-    constexpr static int INITIAL_WIDTH{800};
-    constexpr static int INITIAL_HEIGHT{600};
-    GLFWwindow *window{glfwCreateWindow(INITIAL_WIDTH, INITIAL_HEIGHT, "Gecko",
-                                        nullptr, nullptr)};
-    if (window == nullptr) {
-      spdlog::error("Could not create GLFW window");
-      glfwTerminate();
-      return 1;
-    }
-    glfwMakeContextCurrent(window);
-    // Enable vsync
-    glfwSwapInterval(1);
-
-    constexpr static int MINIMUM_WIDTH{200};
-    constexpr static int MINIMUM_HEIGHT{200};
-    glfwSetWindowSizeLimits(window, MINIMUM_WIDTH, MINIMUM_HEIGHT,
-                            GLFW_DONT_CARE, GLFW_DONT_CARE);
-    glfwSetKeyCallback(window, glfwKeyCallback);
-    glfwSetScrollCallback(window, glfwScrollCallback);
-    glfwSetCursorPosCallback(window, glfwMouseCallback);
-    glfwSetMouseButtonCallback(window, glfwMouseButtonCallback);
-
-    // Initialize GLAD
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
-      spdlog::error("Failed to initialize GLAD");
-      glfwDestroyWindow(window);
-      glfwTerminate();
-      return 1;
-    }
+      glfwWindowHint(GLFW_SAMPLES, 4);
+      glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+      glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+      // Create GLFW window
+      constexpr static int INITIAL_WIDTH{800};
+      constexpr static int INITIAL_HEIGHT{600};
+      window = glfwCreateWindow(INITIAL_WIDTH, INITIAL_HEIGHT, "Gecko",
+                                nullptr, nullptr);
+      if (window == nullptr) {
+        spdlog::error("Could not create GLFW window");
+        glfwTerminate();
+        return 1;
+      }
+      glfwMakeContextCurrent(window);
+      // Enable vsync
+      glfwSwapInterval(1);
+
+      constexpr static int MINIMUM_WIDTH{200};
+      constexpr static int MINIMUM_HEIGHT{200};
+      glfwSetWindowSizeLimits(window, MINIMUM_WIDTH, MINIMUM_HEIGHT,
+                              GLFW_DONT_CARE, GLFW_DONT_CARE);
+      glfwSetKeyCallback(window, glfwKeyCallback);
+      glfwSetScrollCallback(window, glfwScrollCallback);
+      glfwSetCursorPosCallback(window, glfwMouseCallback);
+      glfwSetMouseButtonCallback(window, glfwMouseButtonCallback);
+      glfwSetFramebufferSizeCallback(window, glfwFramebufferSizeCallback);
+      glfwSetWindowRefreshCallback(window, glfwRedrawCallback);
+
+      // Initialize GLAD
+      if (!gladLoadGLLoader(
+              reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
+        spdlog::error("Failed to initialize GLAD");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 1;
+      }
 
-    // Setup Dear ImGui context
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO &io{ImGui::GetIO()};
-    static_cast<void>(io);
+      // Setup Dear ImGui context
+      IMGUI_CHECKVERSION();
+      ImGui::CreateContext();
+      ImGuiIO &io{ImGui::GetIO()};
+      static_cast<void>(io);
 
-    // Setup dark style
-    ImGui::StyleColorsDark();
+      // Setup dark style
+      ImGui::StyleColorsDark();
 
-    // Setup Platform / Renderer bindings
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330 core");
+      // Setup Platform / Renderer bindings
+      ImGui_ImplGlfw_InitForOpenGL(window, true);
+      ImGui_ImplOpenGL3_Init("#version 330 core");
+    }
 
     // Enable depth test
     glEnable(GL_DEPTH_TEST);
@@ -226,75 +886,260 @@ int main([[maybe_unused]] int argc, const char *argv[]) {
         Gecko::GLSLShader::createFromFile("../shaders/volume_render.vert"),
         Gecko::GLSLShader::createFromFile("../shaders/volume_render.frag")};
 
-    // Load file
-    std::ifstream input_file{argv[1]};
-    glm::vec3 bounds_min, bounds_max;
-    input_file >> bounds_min.x >> bounds_min.y >> bounds_min.z;
-    input_file >> bounds_max.x >> bounds_max.y >> bounds_max.z;
-    glm::ivec3 num_points;
-    input_file >> num_points.x >> num_points.y >> num_points.z;
-
-    // Create example field
+    // Allocate textures for the volume and fill them, either from a volume
+    // fully loaded up front or slab by slab while rendering
     using ScalarField = Gecko::ScalarField<float>;
-    ScalarField field{ScalarField::createFromMinMax(
-        bounds_min, bounds_max, num_points.x, num_points.y, num_points.z, 0.f)};
-
-    std::unique_ptr<glm::vec3[]> normal_data{
-        new glm::vec3[num_points.x * num_points.y * num_points.z]};
-
-    float field_max{std::numeric_limits<float>::lowest()};
-    float field_min{std::numeric_limits<float>::max()};
-    std::size_t index{0};
-    for (int k{0}; k != field.zSize(); ++k) {
-      for (int j{0}; j != field.ySize(); ++j) {
-        for (int i{0}; i != field.xSize(); ++i) {
-          float nx, ny, nz, s;
-          input_file >> nx >> ny >> nz >> s;
-          field_max = std::max(field_max, s);
-          field_min = std::min(field_min, s);
-          field(i, j, k) = s;
-          normal_data[index].x = nx;
-          normal_data[index].y = ny;
-          normal_data[index].z = nz;
-          ++index;
-        }
+    glm::vec3 bounds_min, bounds_max;
+    glm::ivec3 num_elements;
+    std::optional<Gecko::VolumeData> volume;
+    // Replaces the volume field once compressed
+    std::optional<Gecko::CompressedScalarField> compressed_field;
+    // Bricked .gvol file paged without loading it
+    std::unique_ptr<Gecko::OutOfCoreScalarField> out_of_core_field;
+    std::unique_ptr<Gecko::SlabReader> slab_reader;
+    std::optional<Gecko::TimeSeries> time_series;
+    std::optional<Gecko::GTVolFile> gtvol_file;
+    // Bricks decoded from a compressed field derive their normals
+    bool derive_normals{options.derive_normals || options.compress_rate != 0};
+    const bool paged{options.brick_cache_megabytes != 0};
+    if (options.time_series) {
+      time_series.emplace(
+          Gecko::TimeSeries::createFromPath(options.volume_filename));
+      spdlog::info("Playing {} timesteps", time_series->numSteps());
+      if (!options.gtvol_output_filename.empty()) {
+        constexpr static int DEFAULT_BRICK_SIZE_LOG2{5};
+        spdlog::info("Writing time varying volume to {}",
+                     options.gtvol_output_filename);
+        writeTimeVaryingVolume(*time_series, options.gtvol_output_filename,
+                               options.gvol_brick_size_log2 != 0
+                                   ? options.gvol_brick_size_log2
+                                   : DEFAULT_BRICK_SIZE_LOG2);
       }
+      // Only the header of the first step, the player reads the steps
+      const std::unique_ptr<Gecko::SlabReader> first_step{
+          Gecko::SlabReader::createFromFile(time_series->stepFilename(0))};
+      bounds_min = first_step->boundsMin();
+      bounds_max = first_step->boundsMax();
+      num_elements = first_step->numElements();
+    } else if (Gecko::isGTVolFilename(options.volume_filename)) {
+      gtvol_file.emplace(
+          Gecko::GTVolFile::createFromFile(options.volume_filename));
+      spdlog::info("Playing {} timesteps", gtvol_file->numSteps());
+      bounds_min = gtvol_file->boundsMin();
+      bounds_max = gtvol_file->boundsMax();
+      num_elements = gtvol_file->numElements();
+    } else if (options.stream) {
+      slab_reader = Gecko::SlabReader::createFromFile(options.volume_filename);
+      bounds_min = slab_reader->boundsMin();
+      bounds_max = slab_reader->boundsMax();
+      num_elements = slab_reader->numElements();
+      derive_normals = derive_normals || !slab_reader->hasNormals();
+    } else if (paged && isBrickedGVolFile(options.volume_filename)) {
+      if (!options.gvol_output_filename.empty() ||
+          !options.gcvol_output_filename.empty() ||
+          options.compress_rate != 0) {
+        throw std::runtime_error{
+            "Bricked .gvol files are only read out of core, they can not be "
+            "converted or compressed"};
+      }
+      // The brick cache reads the bricks it loads from the file
+      out_of_core_field = Gecko::OutOfCoreScalarField::createFromFile(
+          options.volume_filename, Gecko::OutOfCoreScalarField::Settings{});
+      spdlog::info("Reading bricks of {}^3 elements out of core",
+                   out_of_core_field->brickSize());
+      derive_normals = true;
+      bounds_min = out_of_core_field->min();
+      bounds_max = out_of_core_field->max();
+      num_elements =
+          glm::ivec3{out_of_core_field->xSize(), out_of_core_field->ySize(),
+                     out_of_core_field->zSize()};
+    } else {
+      volume.emplace(loadVolume(options.volume_filename, !derive_normals));
+      const ScalarField &field{volume->field};
+      spdlog::info("Field min: {}, max: {}", volume->value_min,
+                   volume->value_max);
+      if (!options.gvol_output_filename.empty()) {
+        // Derived normals are not worth storing, they are cheaper to compute
+        // than to read back
+        spdlog::info("Writing volume to {}", options.gvol_output_filename);
+        Gecko::GVolFile::writeToFile(
+            options.gvol_output_filename, field,
+            derive_normals ? nullptr : volume->normals.data(),
+            options.gvol_brick_size_log2);
+      }
+      if (!options.gcvol_output_filename.empty()) {
+        constexpr static int DEFAULT_BRICK_SIZE_LOG2{5};
+        spdlog::info("Writing compressed volume to {}",
+                     options.gcvol_output_filename);
+        Gecko::GCVolFile::writeToFile(options.gcvol_output_filename, field,
+                                      options.gvol_brick_size_log2 != 0
+                                          ? options.gvol_brick_size_log2
+                                          : DEFAULT_BRICK_SIZE_LOG2);
+      }
+      if (volume->normals.size() != field.totalElements()) {
+        spdlog::info("Deriving normals from the field gradient");
+        // The brick cache derives the normals of each brick it loads
+        volume->normals = paged ? Gecko::FieldStorage<glm::vec3>{}
+                                : field.computeNormals();
+      }
+      bounds_min = field.min();
+      bounds_max = field.max();
+      num_elements = glm::ivec3{field.xSize(), field.ySize(), field.zSize()};
     }
-    spdlog::info("Field max: {}, min: {}", field_min, field_max);
 
-    // Copy data to OpenGL texture
-    GLuint volume_texture;
-    glGenTextures(1, &volume_texture);
+    // Rows of 8 and 16 bit volumes are not 4 byte aligned in general
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLuint volume_texture{0}, normal_texture{0};
+    // The player and the time varying volume own their textures
+    if (!paged && !time_series && !gtvol_file) {
+      glActiveTexture(GL_TEXTURE0);
+      volume_texture = Gecko::Utils::createVolumeTexture(
+          Gecko::Utils::volumeTextureFormat(options.volume_format)
+              .internal_format,
+          num_elements);
+      glActiveTexture(GL_TEXTURE1);
+      normal_texture = Gecko::Utils::createVolumeTexture(
+          Gecko::Utils::normalTextureFormat(options.normal_format)
+              .internal_format,
+          num_elements);
+    }
+    // Value ranges of coarse cells for empty space skipping, a paged volume
+    // uses the cells as bricks
+    constexpr static int MIN_BRICK_SIZE{32};
+    const int macrocell_size{
+        paged ? std::max(MIN_BRICK_SIZE, computeMacrocellSize(num_elements))
+              : computeMacrocellSize(num_elements)};
+    const glm::ivec3 num_macrocells{
+        Gecko::MacrocellGrid{num_elements, macrocell_size}.numCells()};
+    glActiveTexture(GL_TEXTURE2);
+    const GLuint macrocell_texture{
+        time_series ? 0
+                    : Gecko::Utils::createVolumeTexture(
+                          GL_RG32F, num_macrocells, GL_NEAREST)};
+    // Maps values sampled from the volume texture back to field values
+    std::pair<float, float> quantization;
+    std::unique_ptr<Gecko::VolumeStreamUploader> stream_uploader;
+    std::unique_ptr<Gecko::VolumeBrickCache> brick_cache;
+    std::unique_ptr<Gecko::TimeSeriesPlayer> player;
+    std::unique_ptr<Gecko::TimeVaryingVolume> time_varying_volume;
+    if (gtvol_file) {
+      Gecko::TimeVaryingVolume::Settings settings;
+      settings.volume_format = options.volume_format;
+      settings.normal_format = options.normal_format;
+      settings.macrocell_size = macrocell_size;
+      time_varying_volume = std::make_unique<Gecko::TimeVaryingVolume>(
+          std::move(*gtvol_file), macrocell_texture, settings);
+      volume_texture = time_varying_volume->volumeTexture();
+      normal_texture = time_varying_volume->normalTexture();
+      quantization = time_varying_volume->quantization();
+    } else if (time_series) {
+      Gecko::TimeSeriesPlayer::Settings settings;
+      settings.volume_format = options.volume_format;
+      settings.normal_format = options.normal_format;
+      settings.derive_normals = derive_normals;
+      settings.macrocell_size = macrocell_size;
+      settings.steps_per_second = options.steps_per_second;
+      settings.prefetch_steps = options.prefetch_steps;
+      player = std::make_unique<Gecko::TimeSeriesPlayer>(
+          std::move(*time_series), settings);
+      // Each step has its own quantization, set every frame
+      quantization = {1.f, 0.f};
+    } else if (slab_reader != nullptr) {
+      // Normalized formats need the range before the first slab is read
+      const std::optional<std::pair<float, float>> value_range{
+          slab_reader->valueRange()};
+      if (Gecko::isNormalizedFormat(options.volume_format) && !value_range) {
+        throw std::runtime_error{
+            "Streaming to a normalized format needs a volume storing its "
+            "value range, convert it with --write-gvol first"};
+      }
+      quantization = Gecko::computeQuantization(
+          options.volume_format, value_range.value_or(std::pair{0.f, 1.f}));
+      Gecko::VolumeStreamUploader::Settings settings;
+      settings.volume_texture = volume_texture;
+      settings.volume_format = options.volume_format;
+      settings.quantization = quantization;
+      settings.normal_texture = normal_texture;
+      settings.normal_format = options.normal_format;
+      settings.derive_normals = derive_normals;
+      settings.macrocell_texture = macrocell_texture;
+      settings.macrocell_size = macrocell_size;
+      stream_uploader = createStreamUploader(std::move(slab_reader), settings);
+    } else if (paged) {
+      // Cell ranges are unknown until their brick is loaded
+      const Gecko::MacrocellGrid macrocells{num_elements, macrocell_size};
+      glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, num_macrocells.x,
+                      num_macrocells.y, num_macrocells.z, GL_RG, GL_FLOAT,
+                      macrocells.data());
+      quantization = Gecko::computeQuantization(
+          options.volume_format,
+          out_of_core_field != nullptr
+              ? out_of_core_field->valueRange()
+              : std::pair{volume->value_min, volume->value_max});
+      Gecko::VolumeBrickCache::Settings settings;
+      settings.brick_size = macrocell_size;
+      settings.memory_budget = options.brick_cache_megabytes << 20u;
+      settings.volume_format = options.volume_format;
+      settings.quantization = quantization;
+      settings.normal_format = options.normal_format;
+      if (out_of_core_field != nullptr) {
+        brick_cache = std::make_unique<Gecko::VolumeBrickCache>(
+            *out_of_core_field, macrocell_texture, settings);
+      } else if (options.compress_rate != 0) {
+        compressed_field.emplace(Gecko::CompressedScalarField::compress(
+            volume->field, options.compress_rate));
+        spdlog::info("Compressed volume to {} MB at {} bits per value",
+                     compressed_field->compressedSize() >> 20u,
+                     options.compress_rate);
+        brick_cache = std::make_unique<Gecko::VolumeBrickCache>(
+            *compressed_field, macrocell_texture, settings);
+        // Bricks are decoded from the compressed field from now on
+        volume.reset();
+      } else {
+        brick_cache = std::make_unique<Gecko::VolumeBrickCache>(
+            volume->field, volume->normals, macrocell_texture, settings);
+      }
+      volume_texture = brick_cache->scalarAtlas();
+      normal_texture = brick_cache->normalAtlas();
+    } else {
+      const Gecko::MacrocellGrid macrocells{
+          Gecko::MacrocellGrid::createFromField(volume->field, macrocell_size)};
+      glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, num_macrocells.x,
+                      num_macrocells.y, num_macrocells.z, GL_RG, GL_FLOAT,
+                      macrocells.data());
+      glActiveTexture(GL_TEXTURE0);
+      quantization = uploadScalarField(*volume, options.volume_format);
+      glActiveTexture(GL_TEXTURE1);
+      uploadNormals(volume->normals, num_elements, options.normal_format);
+    }
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, 0);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, volume_texture);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, field.xSize(), field.ySize(),
-                 field.zSize(), 0, GL_RED, GL_FLOAT,
-                 reinterpret_cast<void *>(field.data()));
     glBindTexture(GL_TEXTURE_3D, 0);
 
     volume_render_program.use();
     volume_render_program.setInt("volume_texture", 0);
-
-    GLuint normal_texture;
-    glGenTextures(1, &normal_texture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_3D, normal_texture);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB32F, field.xSize(), field.ySize(),
-                 field.zSize(), 0, GL_RGB, GL_FLOAT,
-                 reinterpret_cast<void *>(normal_data.get()));
-    glBindTexture(GL_TEXTURE_3D, 0);
-
     volume_render_program.setInt("volume_normal_texture", 1);
+    volume_render_program.setInt("macrocell_texture", 2);
+    volume_render_program.setVec3("volume_size", glm::vec3{num_elements});
+    volume_render_program.setFloat("macrocell_size",
+                                   static_cast<float>(macrocell_size));
+    volume_render_program.setFloat("value_scale", quantization.first);
+    volume_render_program.setFloat("value_offset", quantization.second);
+    volume_render_program.setInt(
+        "octahedral_normals",
+        options.normal_format != Gecko::NormalFormat::Float32 ? 1 : 0);
+    // Always set, samplers of different types can not share unit 0
+    volume_render_program.setInt("page_table", 3);
+    volume_render_program.setInt("paged_volume",
+                                 brick_cache != nullptr ? 1 : 0);
+    volume_render_program.setInt("feedback_pass", 0);
+    if (brick_cache != nullptr) {
+      volume_render_program.setVec3("atlas_size",
+                                    glm::vec3{brick_cache->atlasSize()});
+    }
 
     //    volume_render_program.setVec2("volume_min_max",
     //                                  glm::vec2{field_min, field_max});
@@ -356,82 +1201,396 @@ int main([[maybe_unused]] int argc, const char *argv[]) {
     float min_value{0.f};
     float mult{1.f};
 
-    // From the field, compute the model matrix
-    const glm::mat4 M{
-        glm::rotate(glm::radians(-90.f), glm::vec3{1.f, 0.f, 0.f}) *
-        glm::rotate(glm::radians(-90.f), glm::vec3{0.f, 0.f, 1.f}) *
-        field.computeModelMatrix()};
+    // From the field bounds, compute the model matrix
+    const glm::mat4 M{computeModelMatrix(bounds_min, bounds_max)};
     const glm::mat4 MI{glm::inverse(M)};
-    volume_render_program.setFloat(
-        "step_size",
-        std::min(field.getVoxelSize().x,
-                 std::min(field.getVoxelSize().y, field.getVoxelSize().z)) /
-            static_cast<float>(4.f));
+    const float step_size{
+        computeStepSize(bounds_min, bounds_max, num_elements)};
+
+    // Playback of a time varying volume, a headless frame shows the first step
+    bool playing_steps{!headless};
+    double next_step_time{currentTime()};
+
+    // Per frame work before drawing: bricks, timesteps and streaming. Returns
+    // true if the volume changed.
+    const auto update_volume{[&]() -> bool {
+      bool changed{false};
+      // Load the bricks requested by the last feedback pass
+      if (brick_cache != nullptr) {
+        changed = brick_cache->update();
+      }
 
-    // Main render loop
-    while (!glfwWindowShouldClose(window)) {
-      glfwPollEvents();
+      // Swap to the next timestep when it is due
+      if (player != nullptr) {
+        const std::int64_t step{player->currentStep()};
+        player->update(currentTime());
+        changed = changed || player->currentStep() != step;
+        volume_render_program.setFloat("value_scale",
+                                       player->quantization().first);
+        volume_render_program.setFloat("value_offset",
+                                       player->quantization().second);
+      }
+
+      // Steps of a time varying volume are applied on this thread, only the
+      // bricks that changed are uploaded
+      if (time_varying_volume != nullptr && playing_steps &&
+          currentTime() >= next_step_time) {
+        time_varying_volume->setStep((time_varying_volume->currentStep() + 1) %
+                                     time_varying_volume->numSteps());
+        changed = true;
+        // Do not try to catch up after slow steps
+        next_step_time =
+            std::max(next_step_time + 1. / options.steps_per_second,
+                     currentTime());
+      }
+
+      // Keep streaming the volume until it is fully uploaded
+      if (stream_uploader != nullptr) {
+        changed = true;
+        if (stream_uploader->update()) {
+          spdlog::info("Field min: {}, max: {}",
+                       stream_uploader->valueRange().first,
+                       stream_uploader->valueRange().second);
+          stream_uploader.reset();
+        }
+      }
+      return changed;
+    }};
 
+    // Draw the volume to the framebuffer of the frame from the given eye and
+    // view matrix
+    int frame_index{0};
+    const auto draw_volume{[&](const Gecko::ProgressiveRenderer::Frame &frame,
+                               const std::pair<glm::vec3, glm::mat4> &view)
+                               -> void {
+      const int width{frame.width};
+      const int height{frame.height};
+      const GLuint framebuffer{frame.framebuffer};
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
       // Clear buffers
       glClearColor(clear_color.r, clear_color.g, clear_color.b, clear_color.a);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-      // Get view matrix
-      const auto [eye, V]{camera.getEyeAndViewMatrix()};
+      const auto &[eye, V]{view};
       volume_render_program.setVec3("eye_model_space",
                                     glm::vec3{MI * glm::vec4{eye, 1.f}});
-      // Update perspective matrix
-      int framebuffer_width, framebuffer_height;
-      glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
-      glViewport(0, 0, framebuffer_width, framebuffer_height);
-      const glm::mat4 P{glm::perspectiveFov(
-          glm::radians(60.f), static_cast<float>(framebuffer_width),
-          static_cast<float>(framebuffer_height), 0.1f, 400.f)};
-      volume_render_program.setMat4("MVP", P * V * M);
-
-      // Start the Dear ImGui frame
-      ImGui_ImplOpenGL3_NewFrame();
-      ImGui_ImplGlfw_NewFrame();
-      ImGui::NewFrame();
-
-      createOverlay(&min_value, &mult);
+      // Update perspective matrix, moving the pixel centers by the offset of
+      // the frame
+      glViewport(0, 0, width, height);
+      const glm::mat4 P{glm::perspectiveFov(glm::radians(60.f),
+                                            static_cast<float>(width),
+                                            static_cast<float>(height), 0.1f,
+                                            400.f)};
+      const glm::vec2 pixel_offset{2.f * frame.pixel_offset /
+                                   glm::vec2{glm::ivec2{width, height}}};
+      volume_render_program.setMat4(
+          "MVP",
+          glm::translate(glm::vec3{pixel_offset.x, pixel_offset.y, 0.f}) * P *
+              V * M);
+      volume_render_program.setFloat("step_size",
+                                     step_size * frame.step_multiplier);
+      volume_render_program.setFloat("sample_offset", frame.sample_offset);
       volume_render_program.setFloat("min_value", min_value);
       volume_render_program.setFloat("mult", mult);
 
       glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_3D, volume_texture);
+      glBindTexture(GL_TEXTURE_3D, player != nullptr ? player->volumeTexture()
+                                                     : volume_texture);
       glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_3D, normal_texture);
+      glBindTexture(GL_TEXTURE_3D, player != nullptr ? player->normalTexture()
+                                                     : normal_texture);
+      glActiveTexture(GL_TEXTURE2);
+      glBindTexture(GL_TEXTURE_3D, player != nullptr
+                                       ? player->macrocellTexture()
+                                       : macrocell_texture);
       //      glActiveTexture(GL_TEXTURE1);
       //      glBindTexture(GL_TEXTURE_1D, tf_texture);
 
       glBindVertexArray(vao);
-      glDrawElements(GL_TRIANGLES,
-                     static_cast<GLsizei>(ScalarField::cube_indices.size()),
-                     GL_UNSIGNED_INT, nullptr);
+      if (brick_cache != nullptr) {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, brick_cache->pageTable());
+        // Low resolution pass reporting the bricks the rays need
+        brick_cache->beginFeedback(width, height);
+        volume_render_program.setInt("feedback_pass", 1);
+        volume_render_program.setInt("frame_index", frame_index++);
+        glDrawElements(GL_TRIANGLES,
+                       static_cast<GLsizei>(ScalarField::cube_indices.size()),
+                       GL_UNSIGNED_INT, nullptr);
+        brick_cache->endFeedback();
+        volume_render_program.setInt("feedback_pass", 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+      }
+      // Nothing to show until the first timestep is uploaded
+      if (player == nullptr || player->currentStep() >= 0) {
+        glDrawElements(GL_TRIANGLES,
+                       static_cast<GLsizei>(ScalarField::cube_indices.size()),
+                       GL_UNSIGNED_INT, nullptr);
+      }
 
       //      glBindTexture(GL_TEXTURE_1D, 0);
       glBindTexture(GL_TEXTURE_3D, 0);
       glBindVertexArray(0);
+    }};
+
+    if (headless) {
+      const Gecko::OffscreenFramebuffer framebuffer{options.image_size.x,
+                                                    options.image_size.y};
+      framebuffer.bind();
+      // Full quality frames, without refinement
+      Gecko::ProgressiveRenderer::Frame frame_target;
+      frame_target.framebuffer = framebuffer.id();
+      frame_target.width = framebuffer.width();
+      frame_target.height = framebuffer.height();
+      const std::optional<Gecko::CameraPath> camera_path{
+          options.camera_path_filename.empty()
+              ? std::nullopt
+              : std::optional<Gecko::CameraPath>{
+                    Gecko::CameraPath::createFromFile(
+                        options.camera_path_filename)}};
+      const auto frame_view{
+          [&](const std::size_t frame) -> std::pair<glm::vec3, glm::mat4> {
+            return camera_path ? camera_path->getEyeAndViewMatrix(frame)
+                               : camera.getEyeAndViewMatrix();
+          }};
+
+      // Render the first frame until the volume is complete: streaming
+      // finished, the first timestep uploaded and the brick cache stable for
+      // a few frames, the feedback of a frame is only processed by the next
+      // one
+      constexpr static int MAX_WARMUP_FRAMES{256};
+      constexpr static int STABLE_FRAMES{4};
+      std::size_t resident_bricks{0};
+      int stable_frames{0};
+      for (int frame{0}; frame != MAX_WARMUP_FRAMES; ++frame) {
+        update_volume();
+        draw_volume(frame_target, frame_view(0));
+        if (brick_cache != nullptr) {
+          stable_frames = brick_cache->residentBricks() == resident_bricks
+                              ? stable_frames + 1
+                              : 0;
+          resident_bricks = brick_cache->residentBricks();
+        }
+        if (stream_uploader == nullptr &&
+            (player == nullptr || player->currentStep() >= 0) &&
+            (brick_cache == nullptr || stable_frames >= STABLE_FRAMES)) {
+          break;
+        }
+      }
+      if (stream_uploader != nullptr ||
+          (player != nullptr && player->currentStep() < 0)) {
+        spdlog::warn("Volume not fully loaded after {} frames",
+                     MAX_WARMUP_FRAMES);
+      }
 
-      // Render
-      ImGui::Render();
-      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      if (camera_path) {
+        // Frames are read back and written in the background
+        Gecko::FrameRecorder recorder{framebuffer.width(),
+                                      framebuffer.height(), {}};
+        const double start_time{currentTime()};
+        for (std::size_t frame{0}; frame != camera_path->numFrames();
+             ++frame) {
+          if (frame != 0) {
+            update_volume();
+            draw_volume(frame_target, frame_view(frame));
+          }
+          // With a brick cache, draw the frame again until its feedback asks
+          // for no missing brick, so recorded frames have no holes
+          if (brick_cache != nullptr) {
+            int redraws{0};
+            while (redraws != MAX_WARMUP_FRAMES && brick_cache->update()) {
+              draw_volume(frame_target, frame_view(frame));
+              ++redraws;
+            }
+            if (redraws == MAX_WARMUP_FRAMES) {
+              spdlog::warn("Frame {} still missing bricks after {} redraws",
+                           frame, MAX_WARMUP_FRAMES);
+            }
+          }
+          recorder.record(
+              framebuffer.id(),
+              frameFilename(options.headless_image_filename, frame));
+        }
+        recorder.finish();
+        const double elapsed{currentTime() - start_time};
+        spdlog::info("Wrote {} frames of {}x{} in {:.2f} s ({:.1f} frames/s, "
+                     "{} waits for readback or writing)",
+                     camera_path->numFrames(), framebuffer.width(),
+                     framebuffer.height(), elapsed,
+                     static_cast<double>(camera_path->numFrames()) / elapsed,
+                     recorder.statistics().stalls);
+      } else {
+        if (options.timed_frames != 0) {
+          // The settled frame drawn again and timed one by one, on the GPU
+          // with timer queries and on the CPU until glFinish() returns, as
+          // software renderers do not time the queries faithfully
+          Gecko::GpuTimer timer{options.timed_frames};
+          std::vector<double> wall_times;
+          for (std::size_t frame{0}; frame != options.timed_frames; ++frame) {
+            const double start_time{currentTime()};
+            timer.begin();
+            draw_volume(frame_target, frame_view(0));
+            timer.end();
+            glFinish();
+            wall_times.push_back(1e3 * (currentTime() - start_time));
+          }
+          std::vector<double> gpu_times;
+          while (const std::optional<double> time{timer.poll()}) {
+            gpu_times.push_back(*time);
+          }
+          const auto log_times{[&](const char *name,
+                                   std::vector<double> &times) -> void {
+            if (times.empty()) {
+              return;
+            }
+            std::sort(times.begin(), times.end());
+            spdlog::info("{} time of {} frames of {}x{}: median {:.3f} ms, "
+                         "min {:.3f} ms, max {:.3f} ms",
+                         name, times.size(), framebuffer.width(),
+                         framebuffer.height(), times[times.size() / 2],
+                         times.front(), times.back());
+          }};
+          log_times("GPU", gpu_times);
+          log_times("Wall", wall_times);
+        }
+        std::vector<std::uint8_t> pixels;
+        framebuffer.readPixels(pixels);
+        Gecko::writeImage(options.headless_image_filename,
+                          framebuffer.width(), framebuffer.height(),
+                          pixels.data());
+        spdlog::info("Wrote {}x{} image {}", framebuffer.width(),
+                     framebuffer.height(), options.headless_image_filename);
+      }
+    } else {
+      // Frames are drawn coarse while interacting and refined at rest
+      constexpr static double INTERACTION_HOLD{0.2};
+      const Gecko::GLSLProgram copy_program{
+          Gecko::GLSLShader::createFromFile("../shaders/copy_image.vert"),
+          Gecko::GLSLShader::createFromFile("../shaders/copy_image.frag")};
+      Gecko::ProgressiveRenderer::Settings refiner_settings;
+      refiner_settings.frame_budget = options.frame_budget;
+      Gecko::ProgressiveRenderer refiner{copy_program, refiner_settings};
+      float previous_min_value{min_value};
+      float previous_mult{mult};
+      std::pair<glm::vec3, glm::mat4> previous_view{
+          camera.getEyeAndViewMatrix()};
 
-      glfwSwapBuffers(window);
+      // Longest sleep without input, for the data loaded in the background
+      constexpr static double IDLE_TIMEOUT{0.25};
+      // Polling period while the volume changes on its own
+      constexpr static double DATA_POLL_INTERVAL{1. / 120.};
+      const auto idle_timeout{[&]() -> double {
+        if (time_varying_volume != nullptr && playing_steps) {
+          return std::max(0., next_step_time - currentTime());
+        }
+        if (stream_uploader != nullptr ||
+            (player != nullptr &&
+             (player->playing() || player->currentStep() < 0))) {
+          return DATA_POLL_INTERVAL;
+        }
+        return IDLE_TIMEOUT;
+      }};
+
+      // Main render loop. A frame is drawn only after input, changes of the
+      // view, the transfer function, the window or the volume, and while the
+      // image is refined, otherwise the loop sleeps until the next event.
+      bool drew_frame{true};
+      while (!glfwWindowShouldClose(window)) {
+        if (drew_frame) {
+          glfwPollEvents();
+        } else {
+          glfwWaitEventsTimeout(idle_timeout());
+        }
+        bool image_changed{update_volume()};
+        const std::pair<glm::vec3, glm::mat4> view{
+            camera.getEyeAndViewMatrix()};
+        if (view != previous_view) {
+          previous_view = view;
+          image_changed = true;
+        }
+
+        int framebuffer_width, framebuffer_height;
+        glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+        // Nothing to draw while minimized
+        drew_frame = framebuffer_width > 0 && framebuffer_height > 0 &&
+                     (input_frames > 0 || image_changed ||
+                      currentTime() - last_interaction_time <
+                          INTERACTION_HOLD ||
+                      !refiner.converged());
+        if (!drew_frame) {
+          continue;
+        }
+        input_frames = std::max(0, input_frames - 1);
+
+        // Start the Dear ImGui frame
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+
+        createOverlay(&min_value, &mult, refiner);
+        if (player != nullptr) {
+          createPlaybackOverlay(*player, currentTime());
+        }
+        if (time_varying_volume != nullptr) {
+          createStepOverlay(*time_varying_volume, &playing_steps);
+        }
+
+        // Moving the transfer function sliders counts as interacting
+        if (min_value != previous_min_value || mult != previous_mult) {
+          previous_min_value = min_value;
+          previous_mult = mult;
+          last_interaction_time = currentTime();
+          image_changed = true;
+        }
+        if (image_changed) {
+          refiner.reset();
+        }
+
+        // Input events do not come every frame, the view is considered
+        // moving for a moment after the last one
+        const bool interacting{currentTime() - last_interaction_time <
+                               INTERACTION_HOLD};
+        if (const std::optional<Gecko::ProgressiveRenderer::Frame> frame{
+                refiner.beginFrame(framebuffer_width, framebuffer_height,
+                                   interacting)}) {
+          draw_volume(*frame, view);
+          refiner.endFrame();
+        }
+        refiner.present(0, framebuffer_width, framebuffer_height);
+
+        // Render
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+        glfwSwapBuffers(window);
+      }
     }
 
-    glDeleteTextures(1, &volume_texture);
+    stream_uploader.reset();
+    player.reset();
+    if (brick_cache != nullptr) {
+      // The atlases belong to the cache
+      brick_cache.reset();
+    } else if (time_varying_volume != nullptr) {
+      time_varying_volume.reset();
+    } else {
+      glDeleteTextures(1, &volume_texture);
+      glDeleteTextures(1, &normal_texture);
+    }
+    glDeleteTextures(1, &macrocell_texture);
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
 
-    // Cleanup
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    // Cleanup, the headless context is destroyed with its scope
+    if (!headless) {
+      ImGui_ImplOpenGL3_Shutdown();
+      ImGui_ImplGlfw_Shutdown();
+      ImGui::DestroyContext();
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
 
   } catch (const std::exception &ex) {
     spdlog::error(ex.what());
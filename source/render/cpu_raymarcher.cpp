@@ -0,0 +1,383 @@
+#include "render/cpu_raymarcher.hpp"
+#include "scalar_field/trilinear_simd.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace Detail {
+
+namespace {
+
+// Same rounding as Detail::lerp() of the AVX2 path, whatever the contraction
+// of floating point expressions of the compiler
+[[nodiscard]] float lerp(const float a, const float b, const float t) noexcept {
+#if defined(__FMA__)
+  return std::fma(t, b - a, a);
+#else
+  return a + t * (b - a);
+#endif
+}
+
+[[nodiscard]] glm::vec3 lerp(const glm::vec3 &a, const glm::vec3 &b,
+                             const float t) noexcept {
+  return {lerp(a.x, b.x, t), lerp(a.y, b.y, t), lerp(a.z, b.z, t)};
+}
+
+} // namespace
+
+template <typename T>
+T sampleTexture(const T *data, const glm::ivec3 &num_elements,
+                const glm::vec3 &p) noexcept {
+  // Texture coordinates to elements as (p - 0.5 / n) * n, as the AVX2 path
+  const glm::vec3 size{num_elements};
+  const glm::vec3 u{glm::clamp((p - 0.5f / size) * size, glm::vec3{0.f},
+                               size - 1.f)};
+  const glm::ivec3 base{
+      glm::min(glm::ivec3{glm::floor(u)}, num_elements - glm::ivec3{2})};
+  const glm::vec3 w{u - glm::vec3{base}};
+  const auto x_size{static_cast<std::size_t>(num_elements.x)};
+  const std::size_t slice_size{x_size *
+                               static_cast<std::size_t>(num_elements.y)};
+  const T *const corner{data + static_cast<std::size_t>(base.x) +
+                        x_size * static_cast<std::size_t>(base.y) +
+                        slice_size * static_cast<std::size_t>(base.z)};
+  const T c00{lerp(corner[0], corner[1], w.x)};
+  const T c10{lerp(corner[x_size], corner[x_size + 1], w.x)};
+  const T c01{lerp(corner[slice_size], corner[slice_size + 1], w.x)};
+  const T c11{
+      lerp(corner[slice_size + x_size], corner[slice_size + x_size + 1], w.x)};
+  return lerp(lerp(c00, c10, w.y), lerp(c01, c11, w.y), w.z);
+}
+
+template float sampleTexture(const float *, const glm::ivec3 &,
+                             const glm::vec3 &) noexcept;
+template glm::vec3 sampleTexture(const glm::vec3 *, const glm::ivec3 &,
+                                 const glm::vec3 &) noexcept;
+
+#if defined(__AVX2__)
+
+void samplePacket8(const float *values, const glm::vec3 *normals,
+                   const glm::ivec3 &num_elements, const float *x,
+                   const float *y, const float *z, float *value, float *nx,
+                   float *ny, float *nz) noexcept {
+  const glm::vec3 size{num_elements};
+  __m256i i, j, k;
+  __m256 tx, ty, tz;
+  trilinearAxis(_mm256_load_ps(x), 0.5f / size.x, size.x, num_elements.x, i,
+                tx);
+  trilinearAxis(_mm256_load_ps(y), 0.5f / size.y, size.y, num_elements.y, j,
+                ty);
+  trilinearAxis(_mm256_load_ps(z), 0.5f / size.z, size.z, num_elements.z, k,
+                tz);
+  const int y_stride{num_elements.x};
+  const int z_stride{num_elements.x * num_elements.y};
+  const __m256i index{_mm256_add_epi32(
+      i, _mm256_add_epi32(_mm256_mullo_epi32(j, _mm256_set1_epi32(y_stride)),
+                          _mm256_mullo_epi32(k, _mm256_set1_epi32(z_stride))))};
+
+  // Interpolate the 8 corners of the cells of the lanes, corner offsets are
+  // in elements of stride floats
+  const auto interpolate{[&](const float *data, const int stride,
+                             const __m256i first) -> __m256 {
+    const auto gather{[&](const int offset) -> __m256 {
+      return _mm256_i32gather_ps(
+          data, _mm256_add_epi32(first, _mm256_set1_epi32(offset * stride)),
+          4);
+    }};
+    const __m256 c00{lerp(gather(0), gather(1), tx)};
+    const __m256 c10{lerp(gather(y_stride), gather(y_stride + 1), tx)};
+    const __m256 c01{lerp(gather(z_stride), gather(z_stride + 1), tx)};
+    const __m256 c11{
+        lerp(gather(z_stride + y_stride), gather(z_stride + y_stride + 1), tx)};
+    return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz);
+  }};
+  _mm256_store_ps(value, interpolate(values, 1, index));
+  // Normals are interleaved, one gather per component
+  const float *const normal_data{&normals[0].x};
+  const __m256i normal_index{
+      _mm256_mullo_epi32(index, _mm256_set1_epi32(3))};
+  _mm256_store_ps(nx, interpolate(normal_data, 3, normal_index));
+  _mm256_store_ps(ny, interpolate(normal_data, 3,
+                                  _mm256_add_epi32(normal_index,
+                                                   _mm256_set1_epi32(1))));
+  _mm256_store_ps(nz, interpolate(normal_data, 3,
+                                  _mm256_add_epi32(normal_index,
+                                                   _mm256_set1_epi32(2))));
+}
+
+#endif
+
+} // namespace Detail
+
+namespace {
+
+// Tiles are square, small enough to balance the threads and large enough
+// for the rays of a tile to share the cache
+constexpr int TILE_SIZE{16};
+// Rays marched together, one per SIMD lane
+constexpr int PACKET_SIZE{8};
+#if defined(__AVX2__)
+static_assert(PACKET_SIZE == Detail::RAY_PACKET_SIZE);
+#endif
+// Same threshold as the shader
+constexpr float OPAQUE_ALPHA{0.99f};
+
+using Lanes = std::array<float, PACKET_SIZE>;
+
+// State of the rays of a packet, one lane per ray
+struct Packet {
+  alignas(32) Lanes t, t_end;
+  alignas(32) Lanes x, y, z;
+  alignas(32) Lanes alpha, r, g, b;
+  // Sampled at (x, y, z)
+  alignas(32) Lanes value, nx, ny, nz;
+  std::array<glm::vec3, PACKET_SIZE> direction, inv_direction;
+  std::array<bool, PACKET_SIZE> active;
+};
+
+// computeBoundsHit() of the shader
+[[nodiscard]] glm::vec2 computeBoundsHit(const glm::vec3 &ray_origin,
+                                         const glm::vec3 &inv_ray_direction,
+                                         const glm::vec3 &bounds_min,
+                                         const glm::vec3 &bounds_max) noexcept {
+  const glm::vec3 bounds_min_intersection{(bounds_min - ray_origin) *
+                                          inv_ray_direction};
+  const glm::vec3 bounds_max_intersection{(bounds_max - ray_origin) *
+                                          inv_ray_direction};
+  const glm::vec3 slabs_min{
+      glm::min(bounds_min_intersection, bounds_max_intersection)};
+  const glm::vec3 slabs_max{
+      glm::max(bounds_min_intersection, bounds_max_intersection)};
+  return {std::max(slabs_min.x, std::max(slabs_min.y, slabs_min.z)),
+          std::min(slabs_max.x, std::min(slabs_max.y, slabs_max.z))};
+}
+
+void samplePacket(const float *values, const glm::vec3 *normals,
+                  const glm::ivec3 &num_elements, const bool simd,
+                  Packet &packet) noexcept {
+#if defined(__AVX2__)
+  if (simd) {
+    Detail::samplePacket8(values, normals, num_elements, packet.x.data(),
+                          packet.y.data(), packet.z.data(),
+                          packet.value.data(), packet.nx.data(),
+                          packet.ny.data(), packet.nz.data());
+    return;
+  }
+#else
+  static_cast<void>(simd);
+#endif
+  for (std::size_t l{0}; l != PACKET_SIZE; ++l) {
+    if (!packet.active[l]) {
+      continue;
+    }
+    const glm::vec3 p{packet.x[l], packet.y[l], packet.z[l]};
+    packet.value[l] = Detail::sampleTexture(values, num_elements, p);
+    const glm::vec3 normal{Detail::sampleTexture(normals, num_elements, p)};
+    packet.nx[l] = normal.x;
+    packet.ny[l] = normal.y;
+    packet.nz[l] = normal.z;
+  }
+}
+
+} // namespace
+
+CpuRaymarcher::CpuRaymarcher(const ScalarField<float> &field,
+                             const FieldStorage<glm::vec3> &normals,
+                             const Settings &settings)
+    : _field{field}, _normals{normals},
+      _macrocells{MacrocellGrid::createFromField(field,
+                                                 settings.macrocell_size)} {
+  if (_normals.size() != _field.totalElements()) {
+    throw std::runtime_error{
+        "The CPU raymarcher needs one normal per field element"};
+  }
+}
+
+void CpuRaymarcher::render(const glm::mat4 &MVP,
+                           const glm::vec3 &eye_model_space,
+                           const Shading &shading, const int width,
+                           const int height, std::uint8_t *pixels) const {
+  const glm::mat4 inv_MVP{glm::inverse(MVP)};
+  const glm::ivec3 num_elements{_field.xSize(), _field.ySize(),
+                                _field.zSize()};
+  const glm::vec3 volume_size{num_elements};
+  const auto macrocell_size{static_cast<float>(_macrocells.cellSize())};
+  const glm::ivec3 &num_cells{_macrocells.numCells()};
+  // Gather offsets of the normals are 32 bit
+  const bool simd{_field.totalElements() * 3 <
+                  static_cast<std::size_t>(
+                      std::numeric_limits<std::int32_t>::max())};
+
+  const auto write_pixel{[&](const int px, const int py,
+                             const glm::vec3 &color) -> void {
+    std::uint8_t *const pixel{
+        pixels + 4 * (static_cast<std::size_t>(px) +
+                      static_cast<std::size_t>(width) *
+                          static_cast<std::size_t>(py))};
+    for (int c{0}; c != 3; ++c) {
+      pixel[c] = static_cast<std::uint8_t>(
+          std::lround(std::clamp(color[c], 0.f, 1.f) * 255.f));
+    }
+    pixel[3] = 255;
+  }};
+
+  // Skip the empty macrocells in front of the lane, as the shader, and stop
+  // the lane if its ray is done
+  const auto skip_empty{[&](Packet &packet, const std::size_t l) -> void {
+    while (true) {
+      if (!(packet.t[l] <= packet.t_end[l] && packet.alpha[l] < OPAQUE_ALPHA)) {
+        packet.active[l] = false;
+        return;
+      }
+      const glm::vec3 point{packet.x[l], packet.y[l], packet.z[l]};
+      const glm::ivec3 cell{glm::clamp(
+          glm::ivec3{glm::floor((point * volume_size - 0.5f) / macrocell_size)},
+          glm::ivec3{0}, num_cells - glm::ivec3{1})};
+      const glm::vec2 &range{_macrocells.data()[_macrocells.cellIndex(cell)]};
+      if (!(range.x == 0.f && range.y == 0.f && shading.min_value > 0.f)) {
+        return;
+      }
+      glm::vec3 cell_min{(glm::vec3{cell} * macrocell_size + 0.5f) /
+                         volume_size};
+      glm::vec3 cell_max{
+          (glm::vec3{cell + glm::ivec3{1}} * macrocell_size + 0.5f) /
+          volume_size};
+      for (int a{0}; a != 3; ++a) {
+        cell_min[a] = cell[a] == 0 ? 0.f : cell_min[a];
+        cell_max[a] = cell[a] == num_cells[a] - 1 ? 1.f : cell_max[a];
+      }
+      const float cell_exit_t{computeBoundsHit(eye_model_space,
+                                               packet.inv_direction[l],
+                                               cell_min, cell_max)
+                                  .y};
+      packet.t[l] += std::max(1.f, std::ceil((cell_exit_t - packet.t[l]) /
+                                             shading.step_size)) *
+                     shading.step_size;
+      const glm::vec3 next{eye_model_space +
+                           packet.t[l] * packet.direction[l]};
+      packet.x[l] = next.x;
+      packet.y[l] = next.y;
+      packet.z[l] = next.z;
+    }
+  }};
+
+  // March the rays of up to PACKET_SIZE pixels of a row
+  const auto render_packet{[&](const int px_first, const int px_last,
+                               const int py) -> void {
+    Packet packet;
+    for (std::size_t l{0}; l != PACKET_SIZE; ++l) {
+      const int px{px_first + static_cast<int>(l)};
+      packet.active[l] = false;
+      packet.x[l] = packet.y[l] = packet.z[l] = 0.f;
+      if (px >= px_last) {
+        continue;
+      }
+      // Ray through the pixel center
+      const glm::vec4 ndc{
+          2.f * (static_cast<float>(px) + 0.5f) / static_cast<float>(width) -
+              1.f,
+          2.f * (static_cast<float>(py) + 0.5f) / static_cast<float>(height) -
+              1.f,
+          0.f, 1.f};
+      const glm::vec4 point{inv_MVP * ndc};
+      const glm::vec3 direction{
+          glm::normalize(glm::vec3{point} / point.w - eye_model_space)};
+      const glm::vec3 inv_direction{1.f / direction};
+      const glm::vec2 t{computeBoundsHit(eye_model_space, inv_direction,
+                                         glm::vec3{0.f}, glm::vec3{1.f})};
+      // Only front faces of the cube are rasterized
+      if (!(t.x > 0.f && t.x <= t.y)) {
+        write_pixel(px, py, shading.background);
+        continue;
+      }
+      const glm::vec3 start{eye_model_space + t.x * direction};
+      packet.t[l] = t.x;
+      packet.t_end[l] = t.y;
+      packet.x[l] = start.x;
+      packet.y[l] = start.y;
+      packet.z[l] = start.z;
+      packet.alpha[l] = packet.r[l] = packet.g[l] = packet.b[l] = 0.f;
+      packet.direction[l] = direction;
+      packet.inv_direction[l] = inv_direction;
+      packet.active[l] = true;
+    }
+    const std::array<bool, PACKET_SIZE> covered{packet.active};
+
+    while (true) {
+      bool any_active{false};
+      for (std::size_t l{0}; l != PACKET_SIZE; ++l) {
+        if (packet.active[l]) {
+          skip_empty(packet, l);
+          any_active = any_active || packet.active[l];
+        }
+      }
+      if (!any_active) {
+        break;
+      }
+      samplePacket(_field.data(), _normals.data(), num_elements, simd,
+                   packet);
+
+      for (std::size_t l{0}; l != PACKET_SIZE; ++l) {
+        if (!packet.active[l]) {
+          continue;
+        }
+        const glm::vec3 &direction{packet.direction[l]};
+        const glm::vec3 n{packet.nx[l], packet.ny[l], packet.nz[l]};
+        const float length{glm::length(n)};
+        // Normals vanish where the gradient does, the shader would get NaNs
+        const glm::vec3 normal{length > 0.f ? n / length : glm::vec3{0.f}};
+        const float score_value{packet.value[l]};
+        glm::vec4 tf_value;
+        if (score_value >= shading.min_value) {
+          tf_value = glm::vec4{shading.mult *
+                                   std::abs(glm::dot(-direction, normal)) *
+                                   glm::abs(normal),
+                               1.f};
+        } else {
+          tf_value = glm::vec4{glm::vec3{0.1f * shading.mult * score_value},
+                               score_value};
+        }
+        // Correct based on step size
+        const float alpha_p{
+            1.f - std::pow(1.f - tf_value.a, shading.step_size)};
+        const float transmittance{1.f - packet.alpha[l]};
+        packet.r[l] += transmittance * tf_value.r * shading.step_size;
+        packet.g[l] += transmittance * tf_value.g * shading.step_size;
+        packet.b[l] += transmittance * tf_value.b * shading.step_size;
+        packet.alpha[l] += transmittance * alpha_p;
+
+        packet.t[l] += shading.step_size;
+        packet.x[l] += shading.step_size * direction.x;
+        packet.y[l] += shading.step_size * direction.y;
+        packet.z[l] += shading.step_size * direction.z;
+      }
+    }
+
+    for (std::size_t l{0}; l != PACKET_SIZE; ++l) {
+      if (covered[l]) {
+        write_pixel(px_first + static_cast<int>(l), py,
+                    glm::vec3{packet.r[l], packet.g[l], packet.b[l]});
+      }
+    }
+  }};
+
+  // Rays through empty space cost little, the tiles are stolen by the idle
+  // workers instead of splitting the image evenly
+  parallelFor3D(glm::ivec3{0}, glm::ivec3{width, height, 1},
+                glm::ivec3{TILE_SIZE, TILE_SIZE, 1},
+                [&](const glm::ivec3 &first, const glm::ivec3 &last) -> void {
+                  for (int py{first.y}; py != last.y; ++py) {
+                    for (int px{first.x}; px < last.x; px += PACKET_SIZE) {
+                      render_packet(px, last.x, py);
+                    }
+                  }
+                });
+}
+
+} // namespace Gecko
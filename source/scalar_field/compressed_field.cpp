@@ -0,0 +1,525 @@
+#include "scalar_field/compressed_field.hpp"
+#include "utils/parallel.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+namespace Gecko {
+
+namespace {
+
+constexpr std::size_t BLOCK_ELEMENTS{CompressedScalarField::BLOCK_ELEMENTS};
+// Block values are converted to integers with two bits of headroom for the
+// growth of the transform
+constexpr int INT_PRECISION{32};
+constexpr int EXPONENT_BITS{8};
+constexpr int EXPONENT_BIAS{127};
+// Non zero flag followed by the biased block exponent
+constexpr unsigned HEADER_BITS{1 + EXPONENT_BITS};
+constexpr std::uint32_t NEGABINARY_MASK{0xAAAAAAAAu};
+
+using BlockValues = std::array<float, BLOCK_ELEMENTS>;
+using BlockInts = std::array<std::int32_t, BLOCK_ELEMENTS>;
+using BlockCoefficients = std::array<std::uint32_t, BLOCK_ELEMENTS>;
+
+// Writes bits least significant first to zeroed words
+class BitWriter {
+public:
+  explicit BitWriter(std::uint64_t *words) noexcept : _words{words} {}
+
+  void writeBit(const bool bit) noexcept {
+    _words[_position >> 6u] |= std::uint64_t{bit} << (_position & 63u);
+    ++_position;
+  }
+
+  // Write the n lowest bits of value, the others must be 0
+  void writeBits(const std::uint64_t value, const unsigned n) noexcept {
+    if (n == 0) {
+      return;
+    }
+    const unsigned offset{_position & 63u};
+    std::uint64_t *const word{_words + (_position >> 6u)};
+    word[0] |= value << offset;
+    if (offset + n > 64) {
+      word[1] |= value >> (64 - offset);
+    }
+    _position += n;
+  }
+
+private:
+  std::uint64_t *_words;
+  unsigned _position{0};
+};
+
+class BitReader {
+public:
+  explicit BitReader(const std::uint64_t *words) noexcept : _words{words} {}
+
+  [[nodiscard]] bool readBit() noexcept {
+    const bool bit{((_words[_position >> 6u] >> (_position & 63u)) & 1u) !=
+                   0};
+    ++_position;
+    return bit;
+  }
+
+  [[nodiscard]] std::uint64_t readBits(const unsigned n) noexcept {
+    if (n == 0) {
+      return 0;
+    }
+    const unsigned offset{_position & 63u};
+    const std::uint64_t *const word{_words + (_position >> 6u)};
+    std::uint64_t value{word[0] >> offset};
+    if (offset + n > 64) {
+      value |= word[1] << (64 - offset);
+    }
+    _position += n;
+    return n == 64 ? value : value & ((std::uint64_t{1} << n) - 1);
+  }
+
+private:
+  const std::uint64_t *_words;
+  unsigned _position{0};
+};
+
+// Coefficients ordered by increasing sequency, i.e. from the smooth ones,
+// which carry most of the energy, to the high frequency ones
+[[nodiscard]] const std::array<std::uint8_t, BLOCK_ELEMENTS> &
+sequencyOrder() {
+  static const std::array<std::uint8_t, BLOCK_ELEMENTS> order{[]() {
+    std::array<std::uint8_t, BLOCK_ELEMENTS> indices{};
+    for (std::size_t e{0}; e != BLOCK_ELEMENTS; ++e) {
+      indices[e] = static_cast<std::uint8_t>(e);
+    }
+    const auto key{[](const std::uint8_t e) -> std::pair<int, int> {
+      const int i{e & 3}, j{(e >> 2) & 3}, k{e >> 4};
+      return {i + j + k, i * i + j * j + k * k};
+    }};
+    std::stable_sort(indices.begin(), indices.end(),
+                     [&](const std::uint8_t a, const std::uint8_t b) -> bool {
+                       return key(a) < key(b);
+                     });
+    return indices;
+  }()};
+  return order;
+}
+
+// Orthogonal decorrelating transform of 4 values with stride s, and its
+// inverse. Only additions and shifts, so it is exactly invertible up to the
+// bits lost in the shifts.
+void forwardLift(std::int32_t *p, const std::size_t s) noexcept {
+  std::int32_t x{p[0]}, y{p[s]}, z{p[2 * s]}, w{p[3 * s]};
+  x += w;
+  x >>= 1;
+  w -= x;
+  z += y;
+  z >>= 1;
+  y -= z;
+  x += z;
+  x >>= 1;
+  z -= x;
+  w += y;
+  w >>= 1;
+  y -= w;
+  w += y >> 1;
+  y -= w >> 1;
+  p[0] = x;
+  p[s] = y;
+  p[2 * s] = z;
+  p[3 * s] = w;
+}
+
+void inverseLift(std::int32_t *p, const std::size_t s) noexcept {
+  std::int32_t x{p[0]}, y{p[s]}, z{p[2 * s]}, w{p[3 * s]};
+  y += w >> 1;
+  w -= y >> 1;
+  y += w;
+  w *= 2;
+  w -= y;
+  z += x;
+  x *= 2;
+  x -= z;
+  y += z;
+  z *= 2;
+  z -= y;
+  w += x;
+  x *= 2;
+  x -= w;
+  p[0] = x;
+  p[s] = y;
+  p[2 * s] = z;
+  p[3 * s] = w;
+}
+
+void forwardTransform(BlockInts &ints) noexcept {
+  for (std::size_t k{0}; k != 4; ++k) {
+    for (std::size_t j{0}; j != 4; ++j) {
+      forwardLift(ints.data() + 4 * j + 16 * k, 1);
+    }
+  }
+  for (std::size_t k{0}; k != 4; ++k) {
+    for (std::size_t i{0}; i != 4; ++i) {
+      forwardLift(ints.data() + i + 16 * k, 4);
+    }
+  }
+  for (std::size_t j{0}; j != 4; ++j) {
+    for (std::size_t i{0}; i != 4; ++i) {
+      forwardLift(ints.data() + i + 4 * j, 16);
+    }
+  }
+}
+
+void inverseTransform(BlockInts &ints) noexcept {
+  for (std::size_t j{0}; j != 4; ++j) {
+    for (std::size_t i{0}; i != 4; ++i) {
+      inverseLift(ints.data() + i + 4 * j, 16);
+    }
+  }
+  for (std::size_t k{0}; k != 4; ++k) {
+    for (std::size_t i{0}; i != 4; ++i) {
+      inverseLift(ints.data() + i + 16 * k, 4);
+    }
+  }
+  for (std::size_t k{0}; k != 4; ++k) {
+    for (std::size_t j{0}; j != 4; ++j) {
+      inverseLift(ints.data() + 4 * j + 16 * k, 1);
+    }
+  }
+}
+
+// Code the coefficients bit plane by bit plane. The bits of a plane for the
+// coefficients already known to be significant are written as is, the others
+// are coded as runs of zeros ended by a one, as coefficients become
+// significant in sequency order most of the time.
+void encodeCoefficients(const BlockCoefficients &coefficients, unsigned bits,
+                        BitWriter &writer) noexcept {
+  unsigned n{0};
+  for (unsigned k{INT_PRECISION}; bits != 0 && k-- != 0;) {
+    std::uint64_t x{0};
+    for (std::size_t e{0}; e != BLOCK_ELEMENTS; ++e) {
+      x |= std::uint64_t{(coefficients[e] >> k) & 1u} << e;
+    }
+    const unsigned m{std::min(n, bits)};
+    bits -= m;
+    writer.writeBits(m == 64 ? x : x & ((std::uint64_t{1} << m) - 1), m);
+    x = m == 64 ? 0 : x >> m;
+    for (; n != BLOCK_ELEMENTS && bits != 0; x >>= 1, ++n) {
+      --bits;
+      writer.writeBit(x != 0);
+      if (x == 0) {
+        break;
+      }
+      for (; n != BLOCK_ELEMENTS - 1 && bits != 0; x >>= 1, ++n) {
+        --bits;
+        writer.writeBit((x & 1u) != 0);
+        if ((x & 1u) != 0) {
+          break;
+        }
+      }
+    }
+  }
+}
+
+void decodeCoefficients(BlockCoefficients &coefficients, unsigned bits,
+                        BitReader &reader) noexcept {
+  coefficients.fill(0);
+  unsigned n{0};
+  for (unsigned k{INT_PRECISION}; bits != 0 && k-- != 0;) {
+    const unsigned m{std::min(n, bits)};
+    bits -= m;
+    std::uint64_t x{reader.readBits(m)};
+    for (; n != BLOCK_ELEMENTS && bits != 0; ++n) {
+      --bits;
+      if (!reader.readBit()) {
+        break;
+      }
+      for (; n != BLOCK_ELEMENTS - 1 && bits != 0; ++n) {
+        --bits;
+        if (reader.readBit()) {
+          break;
+        }
+      }
+      x += std::uint64_t{1} << n;
+    }
+    for (std::size_t e{0}; x != 0; ++e, x >>= 1) {
+      coefficients[e] += static_cast<std::uint32_t>(x & 1u) << k;
+    }
+  }
+}
+
+// Encode a block in rate words
+void encodeBlockValues(const BlockValues &values, const int rate,
+                       std::uint64_t *words) noexcept {
+  std::fill_n(words, rate, 0);
+  float max_abs{0.f};
+  for (const float value : values) {
+    max_abs = std::max(max_abs, std::abs(value));
+  }
+  // Blocks of zeros are a single 0 bit
+  if (max_abs == 0.f) {
+    return;
+  }
+  BitWriter writer{words};
+  int exponent;
+  std::frexp(max_abs, &exponent);
+  exponent = std::max(exponent, 1 - EXPONENT_BIAS);
+  writer.writeBits(1u | static_cast<std::uint64_t>(exponent + EXPONENT_BIAS)
+                            << 1u,
+                   HEADER_BITS);
+
+  // Integers of at most 30 bits relative to the block exponent
+  const double scale{std::ldexp(1., INT_PRECISION - 2 - exponent)};
+  BlockInts ints;
+  for (std::size_t e{0}; e != BLOCK_ELEMENTS; ++e) {
+    ints[e] = static_cast<std::int32_t>(static_cast<double>(values[e]) * scale);
+  }
+  forwardTransform(ints);
+  // Negabinary makes the magnitude of the coefficients show in their leading
+  // bits without a separate sign
+  const std::array<std::uint8_t, BLOCK_ELEMENTS> &order{sequencyOrder()};
+  BlockCoefficients coefficients;
+  for (std::size_t e{0}; e != BLOCK_ELEMENTS; ++e) {
+    coefficients[e] =
+        (static_cast<std::uint32_t>(ints[order[e]]) + NEGABINARY_MASK) ^
+        NEGABINARY_MASK;
+  }
+  encodeCoefficients(coefficients,
+                     static_cast<unsigned>(rate) * 64u - HEADER_BITS, writer);
+}
+
+void decodeBlockValues(const std::uint64_t *words, const int rate,
+                       BlockValues &values) noexcept {
+  BitReader reader{words};
+  if (!reader.readBit()) {
+    values.fill(0.f);
+    return;
+  }
+  const int exponent{static_cast<int>(reader.readBits(EXPONENT_BITS)) -
+                     EXPONENT_BIAS};
+  BlockCoefficients coefficients;
+  decodeCoefficients(coefficients,
+                     static_cast<unsigned>(rate) * 64u - HEADER_BITS, reader);
+  const std::array<std::uint8_t, BLOCK_ELEMENTS> &order{sequencyOrder()};
+  BlockInts ints;
+  for (std::size_t e{0}; e != BLOCK_ELEMENTS; ++e) {
+    ints[order[e]] = static_cast<std::int32_t>(
+        (coefficients[e] ^ NEGABINARY_MASK) - NEGABINARY_MASK);
+  }
+  inverseTransform(ints);
+  const double scale{std::ldexp(1., exponent - (INT_PRECISION - 2))};
+  for (std::size_t e{0}; e != BLOCK_ELEMENTS; ++e) {
+    values[e] = static_cast<float>(static_cast<double>(ints[e]) * scale);
+  }
+}
+
+// Copy the part of a decoded block inside the box [origin, origin + size) to
+// values, which stores the box x fastest
+void scatterBlock(const glm::ivec3 &block, const BlockValues &block_values,
+                  const glm::ivec3 &origin, const glm::ivec3 &size,
+                  float *values) noexcept {
+  constexpr int BLOCK_SIZE{CompressedScalarField::BLOCK_SIZE};
+  const glm::ivec3 block_origin{block * BLOCK_SIZE};
+  const glm::ivec3 first{glm::max(block_origin, origin)};
+  const glm::ivec3 last{
+      glm::min(block_origin + glm::ivec3{BLOCK_SIZE}, origin + size)};
+  for (int k{first.z}; k < last.z; ++k) {
+    for (int j{first.y}; j < last.y; ++j) {
+      const auto *const block_row{
+          block_values.data() +
+          static_cast<std::size_t>((first.x - block_origin.x) +
+                                   BLOCK_SIZE * ((j - block_origin.y) +
+                                                 BLOCK_SIZE *
+                                                     (k - block_origin.z)))};
+      std::copy(block_row, block_row + (last.x - first.x),
+                values + static_cast<std::size_t>(first.x - origin.x) +
+                    static_cast<std::size_t>(size.x) *
+                        (static_cast<std::size_t>(j - origin.y) +
+                         static_cast<std::size_t>(size.y) *
+                             static_cast<std::size_t>(k - origin.z)));
+    }
+  }
+}
+
+} // namespace
+
+CompressedScalarField
+CompressedScalarField::compress(const ScalarField<float> &field,
+                                const int rate) {
+  if (rate < MIN_RATE || rate > MAX_RATE) {
+    throw std::runtime_error{fmt::format(
+        "Invalid compression rate {}, it must be between {} and {} bits",
+        rate, MIN_RATE, MAX_RATE)};
+  }
+  CompressedScalarField compressed{
+      field.min(), field.max(),
+      glm::ivec3{field.xSize(), field.ySize(), field.zSize()},
+      field.getVoxelSize(), rate};
+  const glm::ivec3 last{compressed._num_elements - glm::ivec3{1}};
+  parallelFor(
+      0, static_cast<std::size_t>(compressed._num_blocks.z),
+      [&](const std::size_t first, const std::size_t end) -> void {
+        BlockValues values;
+        for (auto bk{static_cast<int>(first)}; bk != static_cast<int>(end);
+             ++bk) {
+          for (int bj{0}; bj != compressed._num_blocks.y; ++bj) {
+            for (int bi{0}; bi != compressed._num_blocks.x; ++bi) {
+              // Border blocks are padded with the last element
+              const glm::ivec3 block{bi, bj, bk};
+              const glm::ivec3 origin{block * BLOCK_SIZE};
+              std::size_t e{0};
+              for (int k{0}; k != BLOCK_SIZE; ++k) {
+                for (int j{0}; j != BLOCK_SIZE; ++j) {
+                  for (int i{0}; i != BLOCK_SIZE; ++i) {
+                    const glm::ivec3 element{
+                        glm::min(origin + glm::ivec3{i, j, k}, last)};
+                    const float value{
+                        field(element.x, element.y, element.z)};
+                    // The block exponent needs finite values
+                    if (!std::isfinite(value)) {
+                      throw std::runtime_error{fmt::format(
+                          "Can not compress the value {} of element ({}, {}, "
+                          "{}), values must be finite",
+                          value, element.x, element.y, element.z)};
+                    }
+                    values[e++] = value;
+                  }
+                }
+              }
+              encodeBlockValues(values, rate,
+                          compressed._blocks.data() +
+                              compressed.blockIndex(block) *
+                                  static_cast<std::size_t>(rate));
+            }
+          }
+        }
+      });
+  return compressed;
+}
+
+CompressedScalarField::CompressedScalarField(const glm::vec3 &bounds_min,
+                                             const glm::vec3 &bounds_max,
+                                             const glm::ivec3 &num_elements,
+                                             const glm::vec3 &voxel_size,
+                                             const int rate)
+    : _bounds_min{bounds_min}, _bounds_max{bounds_max},
+      _num_elements{num_elements}, _voxel_size{voxel_size}, _rate{rate},
+      _num_blocks{(num_elements + glm::ivec3{BLOCK_SIZE - 1}) /
+                  glm::ivec3{BLOCK_SIZE}},
+      _blocks{FieldStorage<std::uint64_t>::allocate(
+          static_cast<std::size_t>(_num_blocks.x) *
+          static_cast<std::size_t>(_num_blocks.y) *
+          static_cast<std::size_t>(_num_blocks.z) *
+          static_cast<std::size_t>(rate))} {}
+
+float CompressedScalarField::at(const int i, const int j, const int k) const {
+  if (i >= xSize() || i < 0 || j >= ySize() || j < 0 || k >= zSize() ||
+      k < 0) {
+    throw std::out_of_range{"Invalid element index in CompressedScalarField"};
+  }
+  return (*this)(i, j, k);
+}
+
+float CompressedScalarField::operator()(const int i, const int j,
+                                        const int k) const noexcept {
+  BlockValues values;
+  decodeBlock(glm::ivec3{i, j, k} / BLOCK_SIZE, values.data());
+  constexpr int MASK{BLOCK_SIZE - 1};
+  return values[static_cast<std::size_t>(
+      (i & MASK) + BLOCK_SIZE * ((j & MASK) + BLOCK_SIZE * (k & MASK)))];
+}
+
+float CompressedScalarField::sample(const glm::vec3 &position) const noexcept {
+  // Same as ScalarField::sample(), NaN ends up at 0
+  const glm::vec3 upper{_num_elements - glm::ivec3{1}};
+  glm::vec3 u{(position - min()) / getVoxelSize()};
+  for (int c{0}; c != 3; ++c) {
+    u[c] = u[c] > 0.f ? std::min(u[c], upper[c]) : 0.f;
+  }
+  const glm::ivec3 base{
+      glm::min(glm::ivec3{glm::floor(u)}, _num_elements - glm::ivec3{2})};
+  const glm::vec3 t{u - glm::vec3{base}};
+
+  // The corners span at most 2 blocks along each axis, decoded on first use
+  const glm::ivec3 first_block{base / BLOCK_SIZE};
+  std::array<BlockValues, 8> blocks;
+  std::array<bool, 8> decoded{};
+  constexpr int MASK{BLOCK_SIZE - 1};
+  const auto value{[&](const int di, const int dj, const int dk) -> float {
+    const glm::ivec3 element{base + glm::ivec3{di, dj, dk}};
+    const glm::ivec3 block{element / BLOCK_SIZE};
+    const glm::ivec3 slot{block - first_block};
+    const auto s{static_cast<std::size_t>(slot.x + 2 * (slot.y + 2 * slot.z))};
+    if (!decoded[s]) {
+      decodeBlock(block, blocks[s].data());
+      decoded[s] = true;
+    }
+    return blocks[s][static_cast<std::size_t>(
+        (element.x & MASK) +
+        BLOCK_SIZE * ((element.y & MASK) + BLOCK_SIZE * (element.z & MASK)))];
+  }};
+  const auto lerp{[](const float a, const float b, const float w) -> float {
+    return a + w * (b - a);
+  }};
+
+  const float c00{lerp(value(0, 0, 0), value(1, 0, 0), t.x)};
+  const float c10{lerp(value(0, 1, 0), value(1, 1, 0), t.x)};
+  const float c01{lerp(value(0, 0, 1), value(1, 0, 1), t.x)};
+  const float c11{lerp(value(0, 1, 1), value(1, 1, 1), t.x)};
+  return lerp(lerp(c00, c10, t.y), lerp(c01, c11, t.y), t.z);
+}
+
+void CompressedScalarField::decodeBlock(const glm::ivec3 &block,
+                                        float *values) const noexcept {
+  BlockValues block_values;
+  decodeBlockValues(blockWords(block), _rate, block_values);
+  std::copy(block_values.begin(), block_values.end(), values);
+}
+
+void CompressedScalarField::decompressRegion(const glm::ivec3 &origin,
+                                             const glm::ivec3 &size,
+                                             float *values) const {
+  if (glm::any(glm::lessThan(origin, glm::ivec3{0})) ||
+      glm::any(glm::lessThanEqual(size, glm::ivec3{0})) ||
+      glm::any(glm::greaterThan(origin + size, _num_elements))) {
+    throw std::out_of_range{"Invalid region of CompressedScalarField"};
+  }
+  const glm::ivec3 first_block{origin / BLOCK_SIZE};
+  const glm::ivec3 last_block{(origin + size - glm::ivec3{1}) / BLOCK_SIZE};
+  BlockValues block_values;
+  for (int bk{first_block.z}; bk <= last_block.z; ++bk) {
+    for (int bj{first_block.y}; bj <= last_block.y; ++bj) {
+      for (int bi{first_block.x}; bi <= last_block.x; ++bi) {
+        const glm::ivec3 block{bi, bj, bk};
+        decodeBlockValues(blockWords(block), _rate, block_values);
+        scatterBlock(block, block_values, origin, size, values);
+      }
+    }
+  }
+}
+
+ScalarField<float> CompressedScalarField::decompress() const {
+  auto field{ScalarField<float>::createUninitialized(
+      min(), max(), xSize(), ySize(), zSize())};
+  parallelFor(0, static_cast<std::size_t>(_num_blocks.z),
+              [&](const std::size_t first, const std::size_t last) -> void {
+                BlockValues block_values;
+                for (auto bk{static_cast<int>(first)};
+                     bk != static_cast<int>(last); ++bk) {
+                  for (int bj{0}; bj != _num_blocks.y; ++bj) {
+                    for (int bi{0}; bi != _num_blocks.x; ++bi) {
+                      const glm::ivec3 block{bi, bj, bk};
+                      decodeBlockValues(blockWords(block), _rate,
+                                         block_values);
+                      scatterBlock(block, block_values, glm::ivec3{0},
+                                   _num_elements, field.data());
+                    }
+                  }
+                }
+              });
+  return field;
+}
+
+} // namespace Gecko
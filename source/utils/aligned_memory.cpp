@@ -0,0 +1,61 @@
+#include "utils/aligned_memory.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace Gecko {
+
+namespace {
+
+[[nodiscard]] constexpr std::size_t roundUp(const std::size_t size,
+                                            const std::size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+void freeAligned(void *ptr) noexcept {
+#if defined(_WIN32)
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+} // namespace
+
+std::shared_ptr<void> allocateAligned(std::size_t size, std::size_t alignment,
+                                      const bool huge_pages) {
+  if (huge_pages) {
+    alignment = std::max(alignment, HUGE_PAGE_SIZE);
+    size = roundUp(size, HUGE_PAGE_SIZE);
+  }
+  // Zero sized requests still return a unique pointer
+  size = roundUp(std::max<std::size_t>(size, 1), alignment);
+
+#if defined(_WIN32)
+  void *const ptr{_aligned_malloc(size, alignment)};
+#else
+  void *ptr{nullptr};
+  if (::posix_memalign(&ptr, alignment, size) != 0) {
+    ptr = nullptr;
+  }
+#endif
+  if (ptr == nullptr) {
+    throw std::bad_alloc{};
+  }
+#if defined(MADV_HUGEPAGE)
+  if (huge_pages) {
+    // Only a hint, regular pages are used if it can not be honored
+    static_cast<void>(::madvise(ptr, size, MADV_HUGEPAGE));
+  }
+#endif
+  return {ptr, freeAligned};
+}
+
+} // namespace Gecko
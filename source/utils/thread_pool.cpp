@@ -0,0 +1,352 @@
+#include "utils/thread_pool.hpp"
+#include "utils/parallel.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <optional>
+#include <utility>
+
+#if defined(__linux__)
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Gecko {
+
+namespace {
+
+// Pool and deque of the calling thread if it is a worker
+thread_local const ThreadPool *current_pool{nullptr};
+thread_local std::size_t current_worker{0};
+
+#if defined(__linux__)
+// CPUs of a sysfs cpulist, e.g. "0-3,8,10-11"
+[[nodiscard]] std::vector<unsigned int> parseCpuList(const std::string &list) {
+  std::vector<unsigned int> cpus;
+  const char *current{list.data()};
+  const char *const end{list.data() + list.size()};
+  while (current != end) {
+    unsigned int first, last;
+    std::from_chars_result result{std::from_chars(current, end, first)};
+    if (result.ec != std::errc{}) {
+      break;
+    }
+    last = first;
+    if (result.ptr != end && *result.ptr == '-') {
+      result = std::from_chars(result.ptr + 1, end, last);
+      if (result.ec != std::errc{}) {
+        break;
+      }
+    }
+    for (unsigned int cpu{first}; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    current = result.ptr != end && *result.ptr == ',' ? result.ptr + 1 : end;
+  }
+  return cpus;
+}
+#endif
+
+} // namespace
+
+std::vector<std::vector<unsigned int>> cpusPerNode() {
+#if defined(__linux__)
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (::sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    const auto is_allowed{[&allowed](const unsigned int cpu) -> bool {
+      return cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed);
+    }};
+    // Nodes ordered by number
+    std::map<unsigned int, std::vector<unsigned int>> nodes;
+    std::error_code error;
+    for (const std::filesystem::directory_entry &entry :
+         std::filesystem::directory_iterator{"/sys/devices/system/node",
+                                             error}) {
+      const std::string name{entry.path().filename().string()};
+      unsigned int node;
+      if (name.compare(0, 4, "node") != 0 ||
+          std::from_chars(name.data() + 4, name.data() + name.size(), node)
+                  .ptr != name.data() + name.size()) {
+        continue;
+      }
+      std::ifstream file{entry.path() / "cpulist"};
+      std::string list;
+      std::getline(file, list);
+      std::vector<unsigned int> cpus{parseCpuList(list)};
+      cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                [&](const unsigned int cpu) -> bool {
+                                  return !is_allowed(cpu);
+                                }),
+                 cpus.end());
+      if (!cpus.empty()) {
+        nodes.emplace(node, std::move(cpus));
+      }
+    }
+    std::vector<std::vector<unsigned int>> node_cpus;
+    for (auto &[node, cpus] : nodes) {
+      node_cpus.push_back(std::move(cpus));
+    }
+    if (!node_cpus.empty()) {
+      return node_cpus;
+    }
+    // No topology, all the allowed CPUs
+    std::vector<unsigned int> cpus;
+    for (unsigned int cpu{0}; cpu != CPU_SETSIZE; ++cpu) {
+      if (is_allowed(cpu)) {
+        cpus.push_back(cpu);
+      }
+    }
+    return {cpus};
+  }
+#endif
+  std::vector<unsigned int> cpus(defaultThreadCount());
+  for (unsigned int cpu{0}; cpu != cpus.size(); ++cpu) {
+    cpus[cpu] = cpu;
+  }
+  return {cpus};
+}
+
+ThreadPool::ThreadPool(const unsigned int num_workers) {
+  // Without workers a single deque holds the tasks for the waiting threads
+  _deques.resize(std::max(1u, num_workers));
+  for (std::unique_ptr<Deque> &deque : _deques) {
+    deque = std::make_unique<Deque>();
+  }
+  _threads.reserve(num_workers);
+  for (unsigned int w{0}; w != num_workers; ++w) {
+    _threads.emplace_back(&ThreadPool::workerLoop, this, w);
+  }
+
+#if defined(__linux__)
+  // Worker w runs on the node of the w-th CPU in node order, the OS still
+  // moves it between the CPUs of the node
+  const std::vector<std::vector<unsigned int>> nodes{cpusPerNode()};
+  if (nodes.size() > 1) {
+    std::vector<const std::vector<unsigned int> *> cpu_nodes;
+    for (const std::vector<unsigned int> &cpus : nodes) {
+      cpu_nodes.insert(cpu_nodes.end(), cpus.size(), &cpus);
+    }
+    for (std::size_t w{0}; w != _threads.size(); ++w) {
+      cpu_set_t node_set;
+      CPU_ZERO(&node_set);
+      for (const unsigned int cpu : *cpu_nodes[w % cpu_nodes.size()]) {
+        CPU_SET(cpu, &node_set);
+      }
+      // Only a hint, the worker runs anywhere if it fails
+      static_cast<void>(::pthread_setaffinity_np(
+          _threads[w].native_handle(), sizeof(node_set), &node_set));
+    }
+  }
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    const std::lock_guard<std::mutex> lock{_sleep_mutex};
+    _stop = true;
+  }
+  _sleep_condition.notify_all();
+  for (std::thread &thread : _threads) {
+    thread.join();
+  }
+}
+
+ThreadPool &ThreadPool::global() {
+  static ThreadPool pool{defaultThreadCount() - 1};
+  return pool;
+}
+
+void ThreadPool::submit(Task task, const std::size_t hint) {
+  Deque &deque{*_deques[current_pool == this ? current_worker
+                                             : hint % _deques.size()]};
+  {
+    const std::lock_guard<std::mutex> lock{deque.mutex};
+    deque.tasks.push_back(std::move(task));
+  }
+  _queued_tasks.fetch_add(1);
+  // Taking the lock orders the count with a worker about to sleep
+  { const std::lock_guard<std::mutex> lock{_sleep_mutex}; }
+  _sleep_condition.notify_one();
+}
+
+void ThreadPool::submitPinned(Task task, const std::size_t worker) {
+  Deque &deque{*_deques[worker]};
+  {
+    const std::lock_guard<std::mutex> lock{deque.mutex};
+    deque.pinned_tasks.push_back(std::move(task));
+  }
+  deque.num_pinned_tasks.fetch_add(1);
+  { const std::lock_guard<std::mutex> lock{_sleep_mutex}; }
+  // The worker may not be the one notify_one() would wake
+  _sleep_condition.notify_all();
+}
+
+bool ThreadPool::runOne() {
+  std::optional<Task> task;
+  if (current_pool == this) {
+    Deque &deque{*_deques[current_worker]};
+    if (deque.num_pinned_tasks.load() != 0) {
+      const std::lock_guard<std::mutex> lock{deque.mutex};
+      task.emplace(std::move(deque.pinned_tasks.front()));
+      deque.pinned_tasks.pop_front();
+      deque.num_pinned_tasks.fetch_sub(1);
+    }
+  }
+  if (!task && _queued_tasks.load() == 0) {
+    return false;
+  }
+  const std::size_t own{current_pool == this ? current_worker : 0};
+  const bool pinned{task.has_value()};
+  for (std::size_t d{0}; d != _deques.size() && !task; ++d) {
+    Deque &deque{*_deques[(own + d) % _deques.size()]};
+    const std::lock_guard<std::mutex> lock{deque.mutex};
+    if (deque.tasks.empty()) {
+      continue;
+    }
+    // Newest task of the own deque, oldest one of the others
+    if (d == 0 && current_pool == this) {
+      task.emplace(std::move(deque.tasks.back()));
+      deque.tasks.pop_back();
+    } else {
+      task.emplace(std::move(deque.tasks.front()));
+      deque.tasks.pop_front();
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  if (!pinned) {
+    _queued_tasks.fetch_sub(1);
+  }
+
+  std::exception_ptr exception;
+  try {
+    task->function();
+  } catch (...) {
+    exception = std::current_exception();
+  }
+  task->group->finishTask(exception);
+  return true;
+}
+
+void ThreadPool::workerLoop(const std::size_t index) {
+  current_pool = this;
+  current_worker = index;
+  while (true) {
+    if (runOne()) {
+      continue;
+    }
+    const Deque &deque{*_deques[index]};
+    std::unique_lock<std::mutex> lock{_sleep_mutex};
+    _sleep_condition.wait(lock, [this, &deque]() -> bool {
+      return _stop || _queued_tasks.load() != 0 ||
+             deque.num_pinned_tasks.load() != 0;
+    });
+    if (_stop) {
+      return;
+    }
+  }
+}
+
+TaskGroup::~TaskGroup() { waitTasks(); }
+
+void TaskGroup::run(std::function<void()> function, const std::size_t hint) {
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    ++_pending;
+  }
+  _pool.submit({std::move(function), this}, hint);
+}
+
+void TaskGroup::runOnWorker(const std::size_t worker,
+                            std::function<void()> function) {
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    ++_pending;
+  }
+  _pool.submitPinned({std::move(function), this}, worker);
+}
+
+void TaskGroup::then(std::function<void()> continuation) {
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    if (_pending != 0) {
+      // After the continuation already waiting, if any
+      _continuation = _continuation
+                          ? [first{std::move(_continuation)},
+                             second{std::move(continuation)}]() -> void {
+                              first();
+                              second();
+                            }
+                          : std::move(continuation);
+      return;
+    }
+    if (_exception) {
+      return;
+    }
+  }
+  run(std::move(continuation));
+}
+
+void TaskGroup::wait() {
+  waitTasks();
+  const std::lock_guard<std::mutex> lock{_mutex};
+  if (_exception) {
+    std::rethrow_exception(std::exchange(_exception, nullptr));
+  }
+}
+
+void TaskGroup::finishTask(std::exception_ptr exception) {
+  std::function<void()> continuation;
+  {
+    const std::lock_guard<std::mutex> lock{_mutex};
+    if (exception && !_exception) {
+      _exception = std::move(exception);
+    }
+    if (_pending == 1 && _continuation) {
+      // The continuation takes over the count of the last task
+      continuation = std::move(_continuation);
+      _continuation = nullptr;
+      if (_exception) {
+        continuation = nullptr;
+      }
+    }
+    if (!continuation) {
+      --_pending;
+      if (_pending == 0) {
+        _done_condition.notify_all();
+      }
+      return;
+    }
+  }
+  _pool.submit({std::move(continuation), this}, 0);
+}
+
+void TaskGroup::waitTasks() {
+  constexpr static std::chrono::microseconds POLL_INTERVAL{100};
+  while (true) {
+    {
+      const std::lock_guard<std::mutex> lock{_mutex};
+      if (_pending == 0) {
+        return;
+      }
+    }
+    // Help with any queued task, possibly of another group, else wait for the
+    // tasks of the group running on other threads, checking for new tasks
+    // from time to time
+    if (!_pool.runOne()) {
+      std::unique_lock<std::mutex> lock{_mutex};
+      _done_condition.wait_for(lock, POLL_INTERVAL,
+                               [this]() -> bool { return _pending == 0; });
+    }
+  }
+}
+
+} // namespace Gecko
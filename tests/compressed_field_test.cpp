@@ -0,0 +1,216 @@
+// CompressedScalarField: the error falling with the rate, blocks on the border
+// padded with the last element, samples and regions agreeing with the whole
+// field decoded, and fields with values that are not finite rejected.
+
+#include "scalar_field/compressed_field.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+// Sizes not multiple of the block size along any axis, 10x8x6 blocks
+const glm::ivec3 NUM_ELEMENTS{37, 29, 23};
+
+[[nodiscard]] Gecko::ScalarField<float> createField() {
+  auto field{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{-2.f, 0.f, 1.f}, glm::vec3{3.f, 2.f, 4.f}, NUM_ELEMENTS.x,
+      NUM_ELEMENTS.y, NUM_ELEMENTS.z, 0.f)};
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        field(i, j, k) = 10.f * std::sin(0.3f * static_cast<float>(i)) *
+                             std::cos(0.2f * static_cast<float>(j)) +
+                         0.5f * static_cast<float>(k);
+      }
+    }
+  }
+  return field;
+}
+
+// Largest error of the decoded field relative to the value range
+[[nodiscard]] float relativeError(const Gecko::ScalarField<float> &field,
+                                  const Gecko::ScalarField<float> &decoded) {
+  const auto [value_min, value_max]{std::minmax_element(
+      field.data(), field.data() + field.totalElements())};
+  float error{0.f};
+  for (std::size_t e{0}; e != field.totalElements(); ++e) {
+    error = std::max(error, std::abs(field.data()[e] - decoded.data()[e]));
+  }
+  return error / (*value_max - *value_min);
+}
+
+void testRates(const Gecko::ScalarField<float> &field) {
+  // Bounds a little above the errors measured, at 16 bits the error is
+  // already that of the floats
+  const std::vector<std::pair<int, float>> rates{
+      {4, 5e-4f}, {8, 1e-5f}, {16, 1e-7f}, {24, 1e-7f}, {32, 1e-7f}};
+  float previous_error{std::numeric_limits<float>::max()};
+  for (const auto &[rate, bound] : rates) {
+    const auto compressed{Gecko::CompressedScalarField::compress(field, rate)};
+    check(compressed.numBlocks() == glm::ivec3{10, 8, 6} &&
+              compressed.compressedSize() ==
+                  10 * 8 * 6 * static_cast<std::size_t>(rate) *
+                      sizeof(std::uint64_t),
+          fmt::format("Wrong size of the field at rate {}", rate));
+    const Gecko::ScalarField<float> decoded{compressed.decompress()};
+    check(decoded.min() == field.min() && decoded.max() == field.max() &&
+              decoded.xSize() == NUM_ELEMENTS.x &&
+              decoded.ySize() == NUM_ELEMENTS.y &&
+              decoded.zSize() == NUM_ELEMENTS.z,
+          "Decoded field changed bounds or size");
+    const float error{relativeError(field, decoded)};
+    check(error <= bound,
+          fmt::format("Error {} at rate {} above {}", error, rate, bound));
+    // Flat past the rate where the float precision is reached
+    check(error <= std::max(previous_error, 1e-7f),
+          fmt::format("Error grew from {} to {} at rate {}", previous_error,
+                      error, rate));
+    previous_error = error;
+  }
+
+  // Zeros stay exact at any rate
+  const auto zeros{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{0.f}, glm::vec3{1.f}, 5, 6, 7, 0.f)};
+  const Gecko::ScalarField<float> decoded{
+      Gecko::CompressedScalarField::compress(zeros, 1).decompress()};
+  check(std::all_of(decoded.data(), decoded.data() + decoded.totalElements(),
+                    [](const float value) -> bool { return value == 0.f; }),
+        "Zeros not decoded exactly");
+}
+
+void testBorderPadding(const Gecko::ScalarField<float> &field) {
+  const auto compressed{Gecko::CompressedScalarField::compress(field, 16)};
+  constexpr int B{Gecko::CompressedScalarField::BLOCK_SIZE};
+  // Last block along every axis, covering 1x1x3 elements of the field
+  const glm::ivec3 block{compressed.numBlocks() - glm::ivec3{1}};
+  const glm::ivec3 origin{block * B};
+  std::vector<float> values(Gecko::CompressedScalarField::BLOCK_ELEMENTS);
+  compressed.decodeBlock(block, values.data());
+  const float tolerance{1e-4f};
+  for (int k{0}; k != B; ++k) {
+    for (int j{0}; j != B; ++j) {
+      for (int i{0}; i != B; ++i) {
+        // Padding repeats the last element along each axis
+        const glm::ivec3 element{glm::min(origin + glm::ivec3{i, j, k},
+                                          NUM_ELEMENTS - glm::ivec3{1})};
+        check(std::abs(values[static_cast<std::size_t>(i + B * (j + B * k))] -
+                       field(element.x, element.y, element.z)) <= tolerance,
+              fmt::format("Wrong padding ({}, {}, {}) of a border block", i,
+                          j, k));
+      }
+    }
+  }
+}
+
+void testAccessors(const Gecko::ScalarField<float> &field) {
+  const auto compressed{Gecko::CompressedScalarField::compress(field, 12)};
+  const Gecko::ScalarField<float> decoded{compressed.decompress()};
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        check(compressed(i, j, k) == decoded(i, j, k),
+              fmt::format("Wrong element ({}, {}, {})", i, j, k));
+      }
+    }
+  }
+  Gecko::Test::checkThrows(
+      [&]() -> void { static_cast<void>(compressed.at(0, 29, 0)); },
+      "at() past the field");
+
+  std::mt19937 generator{13};
+  // Also past the bounds, clamped to the border
+  std::uniform_real_distribution<float> x{-2.5f, 3.5f};
+  std::uniform_real_distribution<float> y{-0.5f, 2.5f};
+  std::uniform_real_distribution<float> z{0.5f, 4.5f};
+  for (int s{0}; s != 10000; ++s) {
+    const glm::vec3 position{x(generator), y(generator), z(generator)};
+    check(compressed.sample(position) == decoded.sample(position),
+          "Compressed and decoded samples differ");
+  }
+  const float nan{std::numeric_limits<float>::quiet_NaN()};
+  const float inf{std::numeric_limits<float>::infinity()};
+  for (const glm::vec3 &position :
+       {glm::vec3{nan}, glm::vec3{nan, 1.f, -inf}, glm::vec3{inf, nan, 2.f}}) {
+    check(compressed.sample(position) == decoded.sample(position),
+          "Compressed and decoded samples at non-finite positions differ");
+  }
+
+  // Regions across blocks and along the border
+  const std::vector<std::pair<glm::ivec3, glm::ivec3>> regions{
+      {glm::ivec3{0}, NUM_ELEMENTS},
+      {glm::ivec3{5, 7, 6}, glm::ivec3{20, 3, 11}},
+      {glm::ivec3{36, 28, 22}, glm::ivec3{1}},
+      {glm::ivec3{30, 0, 15}, glm::ivec3{7, 29, 8}}};
+  for (const auto &[origin, size] : regions) {
+    std::vector<float> values(static_cast<std::size_t>(size.x) *
+                              static_cast<std::size_t>(size.y) *
+                              static_cast<std::size_t>(size.z));
+    compressed.decompressRegion(origin, size, values.data());
+    std::size_t v{0};
+    for (int k{0}; k != size.z; ++k) {
+      for (int j{0}; j != size.y; ++j) {
+        for (int i{0}; i != size.x; ++i) {
+          check(values[v++] ==
+                    decoded(origin.x + i, origin.y + j, origin.z + k),
+                "Region differs from the whole field decoded");
+        }
+      }
+    }
+  }
+  std::vector<float> values(8);
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        compressed.decompressRegion(glm::ivec3{36, 0, 0}, glm::ivec3{2},
+                                    values.data());
+      },
+      "decompressRegion() past the field");
+}
+
+void testInvalid(const Gecko::ScalarField<float> &field) {
+  for (const int rate : {Gecko::CompressedScalarField::MIN_RATE - 1,
+                         Gecko::CompressedScalarField::MAX_RATE + 1}) {
+    Gecko::Test::checkThrows(
+        [&]() -> void {
+          static_cast<void>(
+              Gecko::CompressedScalarField::compress(field, rate));
+        },
+        fmt::format("Rate {}", rate));
+  }
+  // Inside the field and in the last element, repeated in the padding
+  for (const float value : {std::numeric_limits<float>::quiet_NaN(),
+                            std::numeric_limits<float>::infinity(),
+                            -std::numeric_limits<float>::infinity()}) {
+    for (const glm::ivec3 &element :
+         {glm::ivec3{17, 3, 9}, NUM_ELEMENTS - glm::ivec3{1}}) {
+      Gecko::ScalarField<float> non_finite{field};
+      non_finite(element.x, element.y, element.z) = value;
+      Gecko::Test::checkThrows(
+          [&]() -> void {
+            static_cast<void>(
+                Gecko::CompressedScalarField::compress(non_finite, 8));
+          },
+          fmt::format("Field with the value {}", value));
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("compressed_field_test", []() -> void {
+    const Gecko::ScalarField<float> field{createField()};
+    testRates(field);
+    testBorderPadding(field);
+    testAccessors(field);
+    testInvalid(field);
+  });
+}
@@ -0,0 +1,189 @@
+// CpuRaymarcher: pixels missing the cube and fields composited to nothing
+// left as the shader leaves them, a constant field under the threshold
+// composited to the analytic color of the opacity corrected steps, and the
+// AVX2 packets sampling bit for bit as the scalar lookups.
+
+#include "render/cpu_raymarcher.hpp"
+#include "test_utils.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+// Odd, the ray of the center pixel goes through the center of the cube
+constexpr int IMAGE_SIZE{33};
+constexpr int CENTER{IMAGE_SIZE / 2};
+// Same threshold as the raymarcher
+constexpr float OPAQUE_ALPHA{0.99f};
+const glm::vec3 EYE{0.5f, 0.5f, 3.f};
+
+[[nodiscard]] Gecko::ScalarField<float> createField(const float value) {
+  return Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{0.f}, glm::vec3{1.f}, 19, 21, 17, value);
+}
+
+// Pixels of the unit cube seen along -z, the corners miss it
+[[nodiscard]] std::vector<std::uint8_t>
+render(const Gecko::ScalarField<float> &field,
+       const Gecko::CpuRaymarcher::Shading &shading) {
+  const Gecko::FieldStorage<glm::vec3> normals{field.computeNormals()};
+  const Gecko::CpuRaymarcher raymarcher{field, normals, {}};
+  const glm::mat4 MVP{
+      glm::perspective(glm::radians(60.f), 1.f, 0.1f, 10.f) *
+      glm::lookAt(EYE, glm::vec3{0.5f}, glm::vec3{0.f, 1.f, 0.f})};
+  std::vector<std::uint8_t> pixels(4 * IMAGE_SIZE * IMAGE_SIZE);
+  raymarcher.render(MVP, EYE, shading, IMAGE_SIZE, IMAGE_SIZE, pixels.data());
+  return pixels;
+}
+
+[[nodiscard]] glm::ivec3 pixel(const std::vector<std::uint8_t> &pixels,
+                               const int x, const int y) {
+  const std::uint8_t *const p{
+      &pixels[4 * static_cast<std::size_t>(x + IMAGE_SIZE * y)]};
+  return {p[0], p[1], p[2]};
+}
+
+[[nodiscard]] int level(const float color) {
+  return static_cast<int>(std::lround(color * 255.f));
+}
+
+void testEmpty() {
+  Gecko::CpuRaymarcher::Shading shading;
+  shading.min_value = 0.5f;
+  shading.background = glm::vec3{0.2f, 0.4f, 0.6f};
+  const glm::ivec3 background{level(0.2f), level(0.4f), level(0.6f)};
+  const std::vector<std::uint8_t> pixels{render(createField(0.f), shading)};
+  int covered{0};
+  for (int y{0}; y != IMAGE_SIZE; ++y) {
+    for (int x{0}; x != IMAGE_SIZE; ++x) {
+      // The shader writes the color composited over the cube without
+      // blending, nothing for an empty field
+      const glm::ivec3 color{pixel(pixels, x, y)};
+      check(color == background || color == glm::ivec3{0},
+            fmt::format("Pixel ({}, {}) of an empty field composited", x, y));
+      covered += color == glm::ivec3{0} ? 1 : 0;
+      check(pixels[4 * static_cast<std::size_t>(x + IMAGE_SIZE * y) + 3] ==
+                255,
+            "Pixels not opaque");
+    }
+  }
+  check(pixel(pixels, CENTER, CENTER) == glm::ivec3{0} && covered > 0 &&
+            covered < IMAGE_SIZE * IMAGE_SIZE,
+        "Cube not covering the center of the image only");
+  // Rays missing the cube
+  for (const auto &[x, y] : {std::pair{0, 0}, std::pair{IMAGE_SIZE - 1, 0},
+                             std::pair{0, IMAGE_SIZE - 1},
+                             std::pair{IMAGE_SIZE - 1, IMAGE_SIZE - 1}}) {
+    check(pixel(pixels, x, y) == background,
+          fmt::format("Ray through ({}, {}) hit the cube", x, y));
+  }
+}
+
+void testConstant() {
+  Gecko::CpuRaymarcher::Shading shading;
+  shading.step_size = 0.03f;
+  shading.min_value = 1.f;
+  shading.mult = 20.f;
+  // The center ray crosses the cube from z = 1 to z = 0 with samples at
+  // z = 1 - s * step_size, 34 of them
+  const int cube_samples{34};
+  // Leaving the cube first, and stopped by the opacity in 23 samples
+  for (const float value : {0.5f, 0.999f}) {
+    const std::vector<std::uint8_t> pixels{render(createField(value),
+                                                  shading)};
+    // Each sample keeps (1 - value)^step_size of the light, after n samples
+    // the opacity is 1 - (1 - value)^(n step_size)
+    const double step{static_cast<double>(shading.step_size)};
+    const double transparency{1. - static_cast<double>(value)};
+    const double alpha_p{1. - std::pow(transparency, step)};
+    int samples{0};
+    double alpha{0.};
+    while (samples != cube_samples &&
+           alpha < static_cast<double>(OPAQUE_ALPHA)) {
+      ++samples;
+      alpha = 1. - std::pow(transparency, samples * step);
+    }
+    check(samples == (value == 0.5f ? cube_samples : 23),
+          fmt::format("Wrong number of samples {} of the value {}", samples,
+                      value));
+    // Geometric sum of the colors of the samples, each attenuated by the
+    // opacity in front of it
+    const double color{0.1 * static_cast<double>(shading.mult) *
+                       (1. - transparency) * step * alpha / alpha_p};
+    const int expected{
+        static_cast<int>(std::lround(std::min(color, 1.) * 255.))};
+    const glm::ivec3 center{pixel(pixels, CENTER, CENTER)};
+    for (int c{0}; c != 3; ++c) {
+      check(std::abs(center[c] - expected) <= 1,
+            fmt::format("Value {} composited to {} instead of {}", value,
+                        center[c], expected));
+    }
+  }
+}
+
+void testPackets() {
+#if defined(__AVX2__)
+  auto field{createField(0.f)};
+  std::mt19937 generator{23};
+  std::uniform_real_distribution<float> values{-1.f, 1.f};
+  for (std::size_t e{0}; e != field.totalElements(); ++e) {
+    field.data()[e] = values(generator);
+  }
+  const Gecko::FieldStorage<glm::vec3> normals{field.computeNormals()};
+  const glm::ivec3 num_elements{field.xSize(), field.ySize(), field.zSize()};
+
+  constexpr std::size_t N{Gecko::Detail::RAY_PACKET_SIZE};
+  alignas(32) float x[N], y[N], z[N];
+  alignas(32) float value[N], nx[N], ny[N], nz[N];
+  // Also past the cube, clamped to the border as GL_CLAMP_TO_EDGE
+  std::uniform_real_distribution<float> positions{-0.1f, 1.1f};
+  for (int p{0}; p != 2000; ++p) {
+    for (std::size_t l{0}; l != N; ++l) {
+      x[l] = positions(generator);
+      y[l] = positions(generator);
+      z[l] = positions(generator);
+    }
+    // Element centers and the border of the cube
+    if (p == 0) {
+      x[0] = y[0] = z[0] = 0.f;
+      x[1] = y[1] = z[1] = 1.f;
+      x[2] = 0.5f / static_cast<float>(num_elements.x);
+      x[3] = 1.f - 0.5f / static_cast<float>(num_elements.x);
+    }
+    Gecko::Detail::samplePacket8(field.data(), normals.data(), num_elements,
+                                 x, y, z, value, nx, ny, nz);
+    for (std::size_t l{0}; l != N; ++l) {
+      const glm::vec3 position{x[l], y[l], z[l]};
+      const float scalar{
+          Gecko::Detail::sampleTexture(field.data(), num_elements, position)};
+      const glm::vec3 normal{Gecko::Detail::sampleTexture(
+          normals.data(), num_elements, position)};
+      const glm::vec3 packet_normal{nx[l], ny[l], nz[l]};
+      check(std::memcmp(&scalar, &value[l], sizeof(float)) == 0 &&
+                std::memcmp(&normal, &packet_normal, sizeof(glm::vec3)) == 0,
+            fmt::format("Packet and scalar samples at ({}, {}, {}) differ",
+                        x[l], y[l], z[l]));
+    }
+  }
+#endif
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("cpu_raymarcher_test", []() -> void {
+    testEmpty();
+    testConstant();
+    testPackets();
+  });
+}
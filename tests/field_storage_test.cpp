@@ -0,0 +1,105 @@
+// Allocation policies of FieldStorage: alignment of the owned memory, huge
+// page blocks, file backed storage writing through to its file and borrowed
+// memory keeping its owner alive.
+
+#include "io/mapped_file.hpp"
+#include "scalar_field/scalar_field.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+[[nodiscard]] bool isAligned(const void *pointer, const std::size_t alignment) {
+  return reinterpret_cast<std::uintptr_t>(pointer) % alignment == 0;
+}
+
+void testAllocate() {
+  // Sizes not multiple of the alignment
+  for (const std::size_t size : {std::size_t{1}, std::size_t{1000003}}) {
+    auto storage{Gecko::FieldStorage<float>::allocate(size, 2.5f)};
+    check(storage.size() == size, "Wrong size of allocated storage");
+    check(isAligned(storage.data(), Gecko::FIELD_ALIGNMENT),
+          "Allocated storage not aligned");
+    check(std::all_of(storage.data(), storage.data() + size,
+                      [](const float value) -> bool { return value == 2.5f; }),
+          "Allocated storage not filled");
+  }
+}
+
+void testHugePages() {
+  // Not a multiple of the huge page size, the block is rounded up
+  const std::size_t size{3 * Gecko::HUGE_PAGE_SIZE / sizeof(std::uint32_t) +
+                         17};
+  auto storage{Gecko::FieldStorage<std::uint32_t>::allocate(
+      size, Gecko::StoragePolicy::HugePages)};
+  check(storage.size() == size, "Wrong size of huge page storage");
+  check(isAligned(storage.data(), Gecko::HUGE_PAGE_SIZE),
+        "Huge page storage not aligned to huge pages");
+  std::iota(storage.data(), storage.data() + size, std::uint32_t{0});
+  check(storage[size - 1] == size - 1, "Huge page storage not writable");
+
+  auto field{Gecko::ScalarField<float>::createUninitialized(
+      glm::vec3{0.f}, glm::vec3{1.f}, 65, 33, 17,
+      Gecko::StoragePolicy::HugePages)};
+  check(isAligned(field.data(), Gecko::HUGE_PAGE_SIZE),
+        "Huge page field not aligned to huge pages");
+  std::fill(field.data(), field.data() + field.totalElements(), 1.f);
+  check(field.at(64, 32, 16) == 1.f, "Huge page field not writable");
+}
+
+void testFileBacked() {
+  const Gecko::Test::TemporaryFile file{"gecko_field_storage_test.bin"};
+  const std::size_t size{100003};
+  {
+    auto storage{Gecko::FieldStorage<std::uint32_t>::createFileBacked(
+        file.path(), size)};
+    check(storage.size() == size, "Wrong size of file backed storage");
+    check(std::all_of(storage.data(), storage.data() + size,
+                      [](const std::uint32_t value) -> bool {
+                        return value == 0;
+                      }),
+          "File backed storage not zeroed");
+    std::iota(storage.data(), storage.data() + size, std::uint32_t{7});
+  }
+  // Written through to the file once the storage is gone
+  const Gecko::MappedFile mapped{
+      Gecko::MappedFile::createFromFile(file.path())};
+  check(mapped.size() == size * sizeof(std::uint32_t),
+        "Wrong size of the backing file");
+  std::vector<std::uint32_t> values(size);
+  std::memcpy(values.data(), mapped.data(), mapped.size());
+  for (std::size_t e{0}; e != size; ++e) {
+    check(values[e] == e + 7, "Wrong value in the backing file");
+  }
+}
+
+void testWrap() {
+  auto owner{std::make_shared<std::vector<float>>(16, 3.f)};
+  const std::weak_ptr<std::vector<float>> observer{owner};
+  auto storage{Gecko::FieldStorage<float>::wrap(owner->data(), owner->size(),
+                                                owner)};
+  owner.reset();
+  check(!observer.expired(), "Wrapped storage does not keep its owner");
+  check(storage[15] == 3.f, "Wrong value in wrapped storage");
+  storage = Gecko::FieldStorage<float>{};
+  check(observer.expired(), "Wrapped storage does not release its owner");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("field_storage_test", []() -> void {
+    testAllocate();
+    testHugePages();
+    testFileBacked();
+    testWrap();
+  });
+}
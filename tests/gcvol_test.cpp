@@ -0,0 +1,313 @@
+// The brick codec and the .gcvol container: bit exact round trips of constant
+// bricks, random bricks and non-finite bit patterns, truncated or corrupt
+// payloads and files rejected, and regions of a .gcvol file agreeing with the
+// whole field decoded.
+
+#include "io/brick_codec.hpp"
+#include "io/gcvol.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+constexpr int BRICK_SIZE_LOG2{3};
+constexpr int BRICK_SIZE{1 << BRICK_SIZE_LOG2};
+constexpr std::size_t BRICK_ELEMENTS{std::size_t{BRICK_SIZE} * BRICK_SIZE *
+                                     BRICK_SIZE};
+// Sizes not multiple of the brick size, 5x4x3 bricks
+const glm::ivec3 NUM_ELEMENTS{37, 29, 23};
+
+[[nodiscard]] std::vector<float>
+fromBits(const std::vector<std::uint32_t> &bits) {
+  std::vector<float> values(bits.size());
+  std::memcpy(values.data(), bits.data(), bits.size() * sizeof(float));
+  return values;
+}
+
+// Compare bit patterns, so that NaNs and signed zeros count
+[[nodiscard]] bool sameBits(const std::vector<float> &a,
+                            const std::vector<float> &b) {
+  return a.size() == b.size() &&
+         std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+[[nodiscard]] std::vector<float> roundTrip(const std::vector<float> &values) {
+  std::vector<unsigned char> encoded;
+  const std::size_t size{
+      Gecko::compressBrick(values.data(), values.size(), encoded)};
+  check(size == encoded.size(), "Wrong size of the encoding");
+  std::vector<float> decoded(values.size());
+  std::vector<unsigned char> scratch;
+  Gecko::decompressBrick(encoded.data(), encoded.size(), decoded.data(),
+                         decoded.size(), scratch);
+  return decoded;
+}
+
+void testCodecRoundTrip() {
+  const std::vector<float> constant(BRICK_ELEMENTS, 1.5f);
+  check(sameBits(roundTrip(constant), constant),
+        "Constant brick not decoded as is");
+  std::vector<unsigned char> encoded;
+  check(Gecko::compressBrick(constant.data(), constant.size(), encoded) <
+            BRICK_ELEMENTS * sizeof(float) / 50,
+        "Constant brick not compressed");
+
+  // Any bit pattern, over several chunks of the decoder and not a multiple of
+  // its chunk size
+  std::mt19937 generator{3};
+  std::vector<std::uint32_t> bits(3000);
+  std::generate(bits.begin(), bits.end(), std::ref(generator));
+  check(sameBits(roundTrip(fromBits(bits)), fromBits(bits)),
+        "Random brick not decoded as is");
+
+  const std::vector<float> special{fromBits(std::vector<std::uint32_t>{
+      0x7fc00000u, // quiet NaN
+      0x7f800001u, // signaling NaN
+      0xffc00001u, // negative NaN with payload
+      0x7f800000u, // +inf
+      0xff800000u, // -inf
+      0x80000000u, // -0
+      0x00000001u, // smallest denormal
+      0x807fffffu, // largest negative denormal
+      0x7f7fffffu, // largest float
+      0x00000000u, 0x7fc00000u, 0x7fc00000u, 0x7fc00000u, 0x7fc00000u})};
+  check(sameBits(roundTrip(special), special),
+        "Non-finite or denormal values not decoded as is");
+  const std::vector<float> nans(BRICK_ELEMENTS,
+                                std::numeric_limits<float>::quiet_NaN());
+  check(sameBits(roundTrip(nans), nans), "NaN brick not decoded as is");
+
+  // Bricks appended one after the other decode from their own bytes
+  std::vector<unsigned char> both;
+  const std::size_t first_size{
+      Gecko::compressBrick(special.data(), special.size(), both)};
+  const std::size_t second_size{
+      Gecko::compressBrick(constant.data(), constant.size(), both)};
+  check(first_size + second_size == both.size(),
+        "Appended encodings of the wrong size");
+  std::vector<float> decoded(constant.size());
+  std::vector<unsigned char> scratch;
+  Gecko::decompressBrick(both.data() + first_size, second_size,
+                         decoded.data(), decoded.size(), scratch);
+  check(sameBits(decoded, constant), "Appended brick not decoded as is");
+}
+
+void testCodecCorrupt() {
+  std::mt19937 generator{5};
+  std::uniform_real_distribution<float> noise{-1.f, 1.f};
+  std::vector<float> values(BRICK_ELEMENTS);
+  for (std::size_t v{0}; v != values.size(); ++v) {
+    // Runs and literals both
+    values[v] = v < values.size() / 2 ? 2.f : noise(generator);
+  }
+  std::vector<unsigned char> encoded;
+  static_cast<void>(
+      Gecko::compressBrick(values.data(), values.size(), encoded));
+  std::vector<float> decoded(values.size());
+  std::vector<unsigned char> scratch;
+  // Every truncation, whether it cuts a run or falls between runs
+  for (std::size_t size{0}; size != encoded.size(); ++size) {
+    Gecko::Test::checkThrows(
+        [&]() -> void {
+          Gecko::decompressBrick(encoded.data(), size, decoded.data(),
+                                 decoded.size(), scratch);
+        },
+        fmt::format("Payload truncated to {} bytes", size));
+  }
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        Gecko::decompressBrick(encoded.data(), encoded.size(), decoded.data(),
+                               decoded.size() - 1, scratch);
+      },
+      "Payload of more values than asked");
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        Gecko::decompressBrick(encoded.data(), encoded.size(), decoded.data(),
+                               decoded.size() + 1, scratch);
+      },
+      "Payload of fewer values than asked");
+}
+
+[[nodiscard]] Gecko::ScalarField<float> createField() {
+  auto field{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{-2.f, 0.f, 1.f}, glm::vec3{3.f, 2.f, 4.f}, NUM_ELEMENTS.x,
+      NUM_ELEMENTS.y, NUM_ELEMENTS.z, 0.f)};
+  std::mt19937 generator{11};
+  std::uniform_real_distribution<float> noise{-1.f, 1.f};
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        // Constant, smooth and noisy bricks, the noisy ones stored as is
+        field(i, j, k) = k < 8    ? 0.25f
+                         : k < 16 ? std::sin(0.3f * static_cast<float>(i)) +
+                                        0.01f * static_cast<float>(j)
+                                  : noise(generator);
+      }
+    }
+  }
+  return field;
+}
+
+[[nodiscard]] std::vector<char> readBytes(const std::string &filename) {
+  std::ifstream file{filename, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file},
+          std::istreambuf_iterator<char>{}};
+}
+
+void writeBytes(const std::string &filename, const std::vector<char> &bytes,
+                const std::size_t size) {
+  std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+  file.write(bytes.data(), static_cast<std::streamsize>(size));
+}
+
+void testFile(const Gecko::ScalarField<float> &field,
+              const std::string &filename) {
+  const Gecko::GCVolFile file{Gecko::GCVolFile::createFromFile(filename)};
+  check(file.boundsMin() == field.min() && file.boundsMax() == field.max() &&
+            file.numElements() == NUM_ELEMENTS &&
+            file.brickSize() == BRICK_SIZE &&
+            file.numBricks() == glm::ivec3{5, 4, 3},
+        "Wrong bounds or size of the .gcvol file");
+  const auto [value_min, value_max]{file.valueRange()};
+  check(value_min == *std::min_element(field.data(),
+                                       field.data() + field.totalElements()) &&
+            value_max ==
+                *std::max_element(field.data(),
+                                  field.data() + field.totalElements()),
+        "Wrong value range of the .gcvol file");
+  check(file.brickEntry(glm::ivec3{0}).encoding ==
+                Gecko::GCVolBrickEncoding::DeltaRLE &&
+            file.brickEntry(glm::ivec3{0, 0, 2}).encoding ==
+                Gecko::GCVolBrickEncoding::Stored,
+        "Constant brick not compressed or noisy brick not stored");
+
+  const Gecko::ScalarField<float> whole{file.readField()};
+  check(whole.min() == field.min() && whole.max() == field.max() &&
+            std::equal(field.data(), field.data() + field.totalElements(),
+                       whole.data()),
+        "Decoded field differs from the one written");
+
+  // Padding of a border brick repeats the last element
+  std::vector<float> brick(BRICK_ELEMENTS);
+  file.readBrick(glm::ivec3{4, 3, 2}, brick.data());
+  check(brick.back() == field(NUM_ELEMENTS.x - 1, NUM_ELEMENTS.y - 1,
+                              NUM_ELEMENTS.z - 1),
+        "Wrong padding of a border brick");
+
+  // Regions across bricks, across encodings and along the border
+  const std::vector<std::pair<glm::ivec3, glm::ivec3>> regions{
+      {glm::ivec3{5, 7, 6}, glm::ivec3{20, 3, 11}},
+      {glm::ivec3{36, 28, 22}, glm::ivec3{1}},
+      {glm::ivec3{30, 0, 15}, glm::ivec3{7, 29, 8}},
+      {glm::ivec3{8, 8, 8}, glm::ivec3{8, 8, 8}}};
+  for (const auto &[origin, size] : regions) {
+    for (const unsigned int num_threads : {1u, 3u}) {
+      std::vector<float> values(static_cast<std::size_t>(size.x) *
+                                static_cast<std::size_t>(size.y) *
+                                static_cast<std::size_t>(size.z));
+      file.readRegion(origin, size, values.data(), num_threads);
+      std::size_t v{0};
+      for (int k{0}; k != size.z; ++k) {
+        for (int j{0}; j != size.y; ++j) {
+          for (int i{0}; i != size.x; ++i) {
+            check(values[v++] ==
+                      whole(origin.x + i, origin.y + j, origin.z + k),
+                  "Region differs from the whole field decoded");
+          }
+        }
+      }
+    }
+  }
+  const glm::ivec3 origin{5, 7, 6};
+  const glm::ivec3 size{20, 3, 11};
+  const Gecko::ScalarField<float> region{file.readRegion(origin, size)};
+  check(region(0, 0, 0) == whole(5, 7, 6) &&
+            region(19, 2, 10) == whole(24, 9, 16),
+        "Region field differs from the whole field decoded");
+  check(glm::all(glm::lessThan(
+            glm::abs(region.min() - whole.computeElementPosition(5, 7, 6)),
+            glm::vec3{1e-5f})) &&
+            glm::all(glm::lessThan(
+                glm::abs(region.max() -
+                         whole.computeElementPosition(24, 9, 16)),
+                glm::vec3{1e-5f})),
+        "Wrong bounds of a region");
+
+  std::vector<float> values(8);
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        file.readRegion(glm::ivec3{36, 0, 0}, glm::ivec3{2}, values.data());
+      },
+      "readRegion() past the field");
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        file.readRegion(glm::ivec3{-1, 0, 0}, glm::ivec3{2}, values.data());
+      },
+      "readRegion() before the field");
+}
+
+void testCorruptFile(const std::string &filename) {
+  const std::vector<char> bytes{readBytes(filename)};
+  const Gecko::Test::TemporaryFile corrupt{"gecko_gcvol_corrupt_test.gcvol"};
+
+  // Cut in the header and in the index
+  for (const std::size_t size :
+       {std::size_t{0}, sizeof(Gecko::GCVolHeader) - 1, bytes.size() - 1}) {
+    writeBytes(corrupt.path(), bytes, size);
+    Gecko::Test::checkThrows(
+        [&]() -> void {
+          static_cast<void>(Gecko::GCVolFile::createFromFile(corrupt.path()));
+        },
+        fmt::format("File truncated to {} bytes", size));
+  }
+
+  // The entry of a compressed brick one byte short of its payload
+  Gecko::GCVolHeader header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  std::vector<char> patched{bytes};
+  Gecko::GCVolBrickEntry entry;
+  char *const first_entry{patched.data() + header.index_offset};
+  std::memcpy(&entry, first_entry, sizeof(entry));
+  check(entry.encoding == Gecko::GCVolBrickEncoding::DeltaRLE,
+        "First brick not compressed");
+  --entry.size;
+  std::memcpy(first_entry, &entry, sizeof(entry));
+  writeBytes(corrupt.path(), patched, patched.size());
+  const Gecko::GCVolFile file{
+      Gecko::GCVolFile::createFromFile(corrupt.path())};
+  std::vector<float> brick(BRICK_ELEMENTS);
+  Gecko::Test::checkThrows(
+      [&]() -> void { file.readBrick(glm::ivec3{0}, brick.data()); },
+      "Truncated brick payload");
+  Gecko::Test::checkThrows(
+      [&]() -> void { static_cast<void>(file.readField()); },
+      "Field with a truncated brick payload");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("gcvol_test", []() -> void {
+    testCodecRoundTrip();
+    testCodecCorrupt();
+    const Gecko::Test::TemporaryFile file{"gecko_gcvol_test.gcvol"};
+    const Gecko::ScalarField<float> field{createField()};
+    Gecko::GCVolFile::writeToFile(file.path(), field, BRICK_SIZE_LOG2);
+    testFile(field, file.path());
+    testCorruptFile(file.path());
+  });
+}
@@ -0,0 +1,238 @@
+// The .gtvol container: steps played in order and steps read out of order
+// through readStep() decoding bit for bit the fields written, across
+// keyframes, steps storing only the bricks that changed and steps that did not
+// change at all, and invalid steps and files rejected.
+
+#include "io/gtvol.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+constexpr int BRICK_SIZE_LOG2{3};
+constexpr int BRICK_SIZE{1 << BRICK_SIZE_LOG2};
+constexpr int KEYFRAME_INTERVAL{3};
+constexpr std::size_t NUM_STEPS{8};
+// Sizes not multiple of the brick size, 5x4x3 bricks
+const glm::ivec3 NUM_ELEMENTS{37, 29, 23};
+const glm::ivec3 NUM_BRICKS{5, 4, 3};
+
+[[nodiscard]] Gecko::ScalarField<float> createStep(const std::size_t step) {
+  auto field{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{-2.f, 0.f, 1.f}, glm::vec3{3.f, 2.f, 4.f}, NUM_ELEMENTS.x,
+      NUM_ELEMENTS.y, NUM_ELEMENTS.z, 0.f)};
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        field(i, j, k) = std::sin(0.3f * static_cast<float>(i)) +
+                         0.01f * static_cast<float>(j * k) + 2.f;
+      }
+    }
+  }
+  // Step 4 is the same as step 3
+  const std::size_t change_step{step == 4 ? 3 : step};
+  // A box moving along x, changing a few bricks per step
+  const glm::ivec3 origin{4 * static_cast<int>(change_step), 10, 3};
+  for (int k{0}; k != 6; ++k) {
+    for (int j{0}; j != 6; ++j) {
+      for (int i{0}; i != 6; ++i) {
+        field(origin.x + i, origin.y + j, origin.z + k) +=
+            static_cast<float>(change_step);
+      }
+    }
+  }
+  // Only the sign of a zero changes, a change of the bits all the same
+  field(30, 20, 20) = change_step == 2 ? -0.f : 0.f;
+  if (change_step == 5) {
+    // Noise over a whole brick, which does not compress
+    std::mt19937 generator{17};
+    std::uniform_real_distribution<float> noise{-1.f, 1.f};
+    for (int k{16}; k != 16 + BRICK_SIZE; ++k) {
+      for (int j{0}; j != BRICK_SIZE; ++j) {
+        for (int i{0}; i != BRICK_SIZE; ++i) {
+          field(i, j, k) = noise(generator);
+        }
+      }
+    }
+  }
+  return field;
+}
+
+[[nodiscard]] bool sameBits(const Gecko::ScalarField<float> &a,
+                            const Gecko::ScalarField<float> &b) {
+  return a.totalElements() == b.totalElements() &&
+         std::memcmp(a.data(), b.data(), a.totalElements() * sizeof(float)) ==
+             0;
+}
+
+// Indices of the bricks with an element whose bits differ, in increasing
+// order
+[[nodiscard]] std::vector<std::size_t>
+changedBricks(const Gecko::ScalarField<float> &a,
+              const Gecko::ScalarField<float> &b) {
+  std::vector<std::size_t> bricks;
+  for (int bk{0}; bk != NUM_BRICKS.z; ++bk) {
+    for (int bj{0}; bj != NUM_BRICKS.y; ++bj) {
+      for (int bi{0}; bi != NUM_BRICKS.x; ++bi) {
+        const glm::ivec3 origin{glm::ivec3{bi, bj, bk} * BRICK_SIZE};
+        const glm::ivec3 end{
+            glm::min(origin + glm::ivec3{BRICK_SIZE}, NUM_ELEMENTS)};
+        bool changed{false};
+        for (int k{origin.z}; k != end.z && !changed; ++k) {
+          for (int j{origin.y}; j != end.y && !changed; ++j) {
+            changed = std::memcmp(&a(origin.x, j, k), &b(origin.x, j, k),
+                                  static_cast<std::size_t>(end.x - origin.x) *
+                                      sizeof(float)) != 0;
+          }
+        }
+        if (changed) {
+          bricks.push_back(static_cast<std::size_t>(
+              bi + NUM_BRICKS.x * (bj + NUM_BRICKS.y * bk)));
+        }
+      }
+    }
+  }
+  return bricks;
+}
+
+void testLayout(const Gecko::GTVolFile &file,
+                const std::vector<Gecko::ScalarField<float>> &steps) {
+  check(file.numSteps() == NUM_STEPS && file.numElements() == NUM_ELEMENTS &&
+            file.boundsMin() == steps[0].min() &&
+            file.boundsMax() == steps[0].max() &&
+            file.brickSize() == BRICK_SIZE &&
+            file.numBricks() == NUM_BRICKS,
+        "Wrong size of the .gtvol file");
+  check(file.brickOrigin(23) == glm::ivec3{3, 0, 1} * BRICK_SIZE,
+        "Wrong brick origin");
+  float value_min{steps[0].data()[0]};
+  float value_max{value_min};
+  for (std::size_t s{0}; s != NUM_STEPS; ++s) {
+    const bool keyframe{s % KEYFRAME_INTERVAL == 0};
+    check(file.isKeyframe(s) == keyframe &&
+              file.previousKeyframe(s) == s - s % KEYFRAME_INTERVAL,
+          fmt::format("Wrong keyframe of step {}", s));
+    // Keyframes store every brick, the other steps the ones that changed
+    const std::size_t stored{
+        keyframe ? file.totalBricks()
+                 : changedBricks(steps[s - 1], steps[s]).size()};
+    check(file.numStepBricks(s) == stored,
+          fmt::format("Step {} stores {} bricks instead of {}", s,
+                      file.numStepBricks(s), stored));
+    const auto [step_min, step_max]{std::minmax_element(
+        steps[s].data(), steps[s].data() + steps[s].totalElements())};
+    check(file.stepValueRange(s) == std::pair{*step_min, *step_max},
+          fmt::format("Wrong value range of step {}", s));
+    value_min = std::min(value_min, *step_min);
+    value_max = std::max(value_max, *step_max);
+  }
+  check(file.numStepBricks(4) == 0 && file.stepBytes(4) == 0,
+        "Step without changes stores bricks");
+  check(file.numStepBricks(2) < file.totalBricks() / 4,
+        "Step stores more than the bricks that changed");
+  check(file.valueRange() == std::pair{value_min, value_max},
+        "Wrong value range of the .gtvol file");
+}
+
+void testPlayback(const Gecko::GTVolFile &file,
+                  const std::vector<Gecko::ScalarField<float>> &steps) {
+  Gecko::ScalarField<float> field{file.readStep(0)};
+  check(sameBits(field, steps[0]), "Wrong first step");
+  for (std::size_t s{1}; s != NUM_STEPS; ++s) {
+    std::vector<std::size_t> changed;
+    file.applyStep(s, field, changed);
+    check(sameBits(field, steps[s]),
+          fmt::format("Wrong step {} played in order", s));
+    check(changed == changedBricks(steps[s - 1], steps[s]),
+          fmt::format("Wrong bricks changed by step {}", s));
+  }
+}
+
+void testSeek(const Gecko::GTVolFile &file,
+              const std::vector<Gecko::ScalarField<float>> &steps) {
+  // Backwards and then jumping around, each one from its own keyframe
+  for (const std::size_t s : {7u, 6u, 5u, 4u, 3u, 2u, 1u, 0u, 5u, 1u, 7u,
+                              3u}) {
+    const Gecko::ScalarField<float> field{file.readStep(s)};
+    check(field.min() == steps[s].min() && field.max() == steps[s].max() &&
+              sameBits(field, steps[s]),
+          fmt::format("Wrong step {} read on its own", s));
+  }
+  Gecko::Test::checkThrows(
+      [&]() -> void { static_cast<void>(file.readStep(NUM_STEPS)); },
+      "readStep() past the last step");
+  auto wrong_size{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{0.f}, glm::vec3{1.f}, 8, 8, 8, 0.f)};
+  std::vector<std::size_t> changed;
+  Gecko::Test::checkThrows(
+      [&]() -> void { file.applyStep(0, wrong_size, changed); },
+      "applyStep() to a field of another size");
+}
+
+void testInvalid(const std::string &filename) {
+  const Gecko::Test::TemporaryFile other{"gecko_gtvol_invalid_test.gtvol"};
+  {
+    Gecko::GTVolWriter writer{Gecko::GTVolWriter::createFile(
+        other.path(), BRICK_SIZE_LOG2, KEYFRAME_INTERVAL)};
+    Gecko::Test::checkThrows([&]() -> void { writer.finish(); },
+                             "finish() without steps");
+    writer.appendStep(createStep(0));
+    Gecko::Test::checkThrows(
+        [&]() -> void {
+          writer.appendStep(Gecko::ScalarField<float>::createFromMinMax(
+              glm::vec3{0.f}, glm::vec3{1.f}, 8, 8, 8, 0.f));
+        },
+        "Step of another size");
+  }
+
+  // Cut in the step index
+  std::vector<char> bytes;
+  {
+    std::ifstream file{filename, std::ios::binary};
+    bytes.assign(std::istreambuf_iterator<char>{file},
+                 std::istreambuf_iterator<char>{});
+  }
+  {
+    std::ofstream file{other.path(), std::ios::binary | std::ios::trunc};
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 1));
+  }
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        static_cast<void>(Gecko::GTVolFile::createFromFile(other.path()));
+      },
+      "Truncated .gtvol file");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("gtvol_test", []() -> void {
+    const Gecko::Test::TemporaryFile file{"gecko_gtvol_test.gtvol"};
+    std::vector<Gecko::ScalarField<float>> steps;
+    Gecko::GTVolWriter writer{Gecko::GTVolWriter::createFile(
+        file.path(), BRICK_SIZE_LOG2, KEYFRAME_INTERVAL)};
+    for (std::size_t s{0}; s != NUM_STEPS; ++s) {
+      steps.push_back(createStep(s));
+      writer.appendStep(steps.back());
+    }
+    writer.finish();
+    check(writer.numSteps() == NUM_STEPS, "Steps missing from the writer");
+
+    const Gecko::GTVolFile gtvol{Gecko::GTVolFile::createFromFile(file.path())};
+    testLayout(gtvol, steps);
+    testPlayback(gtvol, steps);
+    testSeek(gtvol, steps);
+    testInvalid(file.path());
+  });
+}
@@ -0,0 +1,157 @@
+// The .gvol container: linear channels read in place agreeing with the field
+// and normals written, and headers with corrupt sizes rejected, among them
+// sizes whose product does not fit in 64 bits.
+
+#include "io/gvol.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+const glm::ivec3 NUM_ELEMENTS{13, 9, 6};
+
+[[nodiscard]] Gecko::ScalarField<float> createField() {
+  auto field{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{-1.f}, glm::vec3{2.f, 1.f, 3.f}, NUM_ELEMENTS.x,
+      NUM_ELEMENTS.y, NUM_ELEMENTS.z, 0.f)};
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        field(i, j, k) = std::sin(0.4f * static_cast<float>(i + 2 * j)) +
+                         static_cast<float>(k);
+      }
+    }
+  }
+  return field;
+}
+
+[[nodiscard]] std::vector<char> readBytes(const std::string &filename) {
+  std::ifstream file{filename, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file},
+          std::istreambuf_iterator<char>{}};
+}
+
+void writeBytes(const std::string &filename, const std::vector<char> &bytes) {
+  std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+  file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+void testRoundTrip(const Gecko::ScalarField<float> &field,
+                   const std::string &filename) {
+  const Gecko::GVolFile file{Gecko::GVolFile::createFromFile(filename)};
+  check(file.numElements() == NUM_ELEMENTS &&
+            file.boundsMin() == field.min() && file.boundsMax() == field.max(),
+        "Wrong bounds or size of the .gvol file");
+  const Gecko::ScalarField<float> read{file.createScalarField()};
+  check(std::equal(field.data(), field.data() + field.totalElements(),
+                   read.data()),
+        "Scalars read differ from the ones written");
+  const Gecko::FieldStorage<glm::vec3> normals{file.createNormalStorage()};
+  check(normals.size() == field.totalElements() &&
+            normals[5] == glm::vec3{5.f, 1.f, 0.f},
+        "Normals read differ from the ones written");
+}
+
+// The header of the file patched by patch() must be rejected
+void checkRejected(const std::vector<char> &bytes,
+                   const std::string &corrupt_filename,
+                   const std::function<void(Gecko::GVolHeader &)> &patch,
+                   const std::string &message) {
+  Gecko::GVolHeader header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  patch(header);
+  std::vector<char> patched{bytes};
+  std::memcpy(patched.data(), &header, sizeof(header));
+  writeBytes(corrupt_filename, patched);
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        static_cast<void>(Gecko::GVolFile::createFromFile(corrupt_filename));
+      },
+      message);
+}
+
+void testCorruptHeaders(const std::string &filename) {
+  const std::vector<char> bytes{readBytes(filename)};
+  const Gecko::Test::TemporaryFile corrupt{"gecko_gvol_corrupt_test.gvol"};
+  // The file as is is accepted
+  writeBytes(corrupt.path(), bytes);
+  static_cast<void>(Gecko::GVolFile::createFromFile(corrupt.path()));
+
+  for (const std::uint32_t axis : {0u, 1u, 0x80000000u, 0xFFFFFFFFu}) {
+    checkRejected(
+        bytes, corrupt.path(),
+        [axis](Gecko::GVolHeader &header) -> void {
+          header.num_elements[1] = axis;
+        },
+        fmt::format("Axis of {} elements", axis));
+  }
+  // 2^30 * 2^30 * 16 floats wrap around to a size of 0
+  checkRejected(
+      bytes, corrupt.path(),
+      [](Gecko::GVolHeader &header) -> void {
+        header.num_elements = {1u << 30u, 1u << 30u, 16u};
+        for (std::uint32_t c{0}; c != header.num_channels; ++c) {
+          header.channels[c].size = 0;
+        }
+      },
+      "Channel size overflowing 64 bits");
+  // Padded to bricks of 2^7 the product overflows as well
+  checkRejected(
+      bytes, corrupt.path(),
+      [](Gecko::GVolHeader &header) -> void {
+        header.num_elements = {0x7FFFFFFFu, 0x7FFFFFFFu, 0x7FFFFFFFu};
+        header.channels[0].brick_size_log2 = 7;
+        header.channels[0].size = 0;
+      },
+      "Bricked channel size overflowing 64 bits");
+  checkRejected(
+      bytes, corrupt.path(),
+      [](Gecko::GVolHeader &header) -> void {
+        header.channels[1].components = 0;
+        header.channels[1].size = 0;
+      },
+      "Channel without components");
+  checkRejected(
+      bytes, corrupt.path(),
+      [](Gecko::GVolHeader &header) -> void {
+        header.channels[1].components = 0x80000000u;
+      },
+      "Channel of the wrong number of components");
+  checkRejected(
+      bytes, corrupt.path(),
+      [](Gecko::GVolHeader &header) -> void { header.channels[0].size -= 4; },
+      "Channel of the wrong size");
+  checkRejected(
+      bytes, corrupt.path(),
+      [](Gecko::GVolHeader &header) -> void {
+        header.channels[1].offset += Gecko::GVOL_PAYLOAD_ALIGNMENT;
+      },
+      "Channel past the end of the file");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("gvol_test", []() -> void {
+    const Gecko::Test::TemporaryFile file{"gecko_gvol_test.gvol"};
+    const Gecko::ScalarField<float> field{createField()};
+    std::vector<glm::vec3> normals(field.totalElements());
+    for (std::size_t n{0}; n != normals.size(); ++n) {
+      normals[n] = glm::vec3{static_cast<float>(n), 1.f, 0.f};
+    }
+    Gecko::GVolFile::writeToFile(file.path(), field, normals.data());
+    testRoundTrip(field, file.path());
+    testCorruptHeaders(file.path());
+  });
+}
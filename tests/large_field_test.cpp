@@ -0,0 +1,116 @@
+// Indexing of a field above 2^32 elements. The field lives in a sparse file
+// mapped through FieldStorage::createFileBacked(), so only the pages written
+// take memory or disk space. Elements are written at the corners and around
+// the linear indices 2^31 and 2^32, read back through the field and checked
+// at their byte offset in a new mapping of the file.
+
+#include "io/mapped_file.hpp"
+#include "scalar_field/scalar_field.hpp"
+#include "test_utils.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+void testLargeField() {
+  // 2048 x 2048 x 1030 elements, 16 GB of floats. Linear index 2^32 falls on
+  // slice 1024, before the last one.
+  const glm::ivec3 num_elements{2048, 2048, 1030};
+  const std::uint64_t total_elements{
+      static_cast<std::uint64_t>(num_elements.x) *
+      static_cast<std::uint64_t>(num_elements.y) *
+      static_cast<std::uint64_t>(num_elements.z)};
+  check(total_elements > std::uint64_t{1} << 32u,
+        "Field not above 2^32 elements");
+
+  const Gecko::Test::TemporaryFile file{"gecko_large_field_test.bin"};
+  std::vector<std::uint64_t> indices{0, total_elements - 1};
+  for (const std::uint64_t boundary :
+       {std::uint64_t{1} << 31u, std::uint64_t{1} << 32u}) {
+    indices.push_back(boundary - 1);
+    indices.push_back(boundary);
+    indices.push_back(boundary + 1);
+  }
+  const auto element_index{[&](const std::uint64_t index) -> glm::ivec3 {
+    const auto x_size{static_cast<std::uint64_t>(num_elements.x)};
+    const auto y_size{static_cast<std::uint64_t>(num_elements.y)};
+    return {static_cast<int>(index % x_size),
+            static_cast<int>(index / x_size % y_size),
+            static_cast<int>(index / (x_size * y_size))};
+  }};
+  const auto element_value{[](const std::uint64_t index) -> float {
+    return static_cast<float>(index % 1000003u) + 0.5f;
+  }};
+
+  {
+    auto field{Gecko::ScalarField<float>::createFromStorage(
+        glm::vec3{0.f}, glm::vec3{1.f}, num_elements.x, num_elements.y,
+        num_elements.z,
+        Gecko::FieldStorage<float>::createFileBacked(
+            file.path(), static_cast<std::size_t>(total_elements)))};
+    check(field.totalElements() == total_elements,
+          "Wrong number of elements");
+
+    for (const std::uint64_t index : indices) {
+      const glm::ivec3 e{element_index(index)};
+      field.at(e.x, e.y, e.z) = element_value(index);
+    }
+    // The far corners along each axis
+    for (int corner{0}; corner != 8; ++corner) {
+      const int i{(corner & 1) != 0 ? num_elements.x - 1 : 0};
+      const int j{(corner & 2) != 0 ? num_elements.y - 1 : 0};
+      const int k{(corner & 4) != 0 ? num_elements.z - 1 : 0};
+      field(i, j, k) = static_cast<float>(corner + 1);
+    }
+
+    for (const std::uint64_t index : indices) {
+      const glm::ivec3 e{element_index(index)};
+      // Corners are overwritten above
+      if (index == 0 || index == total_elements - 1) {
+        continue;
+      }
+      check(field(e.x, e.y, e.z) == element_value(index),
+            fmt::format("Wrong value at linear index {}", index));
+      // Positions are rounded, neighbours weigh in a little
+      check(std::abs(field.sample(field.computeElementPosition(e.x, e.y,
+                                                               e.z)) -
+                     element_value(index)) <= 1e-3f * element_value(index),
+            fmt::format("Wrong sample at linear index {}", index));
+    }
+    check(field.at(0, 0, 0) == 1.f, "Wrong value at the first corner");
+    check(field.at(num_elements.x - 1, num_elements.y - 1,
+                   num_elements.z - 1) == 8.f,
+          "Wrong value at the last corner");
+    check(std::abs(field.sample(field.max()) - 8.f) <= 1e-2f,
+          "Wrong sample at the last corner");
+  }
+
+  // The field wrote through to the file, at the 64 bit byte offsets
+  const Gecko::MappedFile mapped{
+      Gecko::MappedFile::createFromFile(file.path())};
+  check(mapped.size() == total_elements * sizeof(float), "Wrong file size");
+  const auto read_value{[&](const std::uint64_t index) -> float {
+    float value;
+    std::memcpy(&value, mapped.data() + index * sizeof(float), sizeof(float));
+    return value;
+  }};
+  for (const std::uint64_t index : indices) {
+    if (index != 0 && index != total_elements - 1) {
+      check(read_value(index) == element_value(index),
+            fmt::format("Wrong value in the file at linear index {}", index));
+    }
+  }
+  check(read_value(0) == 1.f && read_value(total_elements - 1) == 8.f,
+        "Wrong corner values in the file");
+  check(read_value(static_cast<std::uint64_t>(num_elements.x) - 1) == 2.f,
+        "Wrong x corner value in the file");
+}
+
+} // namespace
+
+int main() { return Gecko::Test::run("large_field_test", testLargeField); }
@@ -0,0 +1,152 @@
+// Octahedral normals: directions surviving a round trip through the 16 and 8
+// bit encodings within the angular error of their levels, the seams and
+// corners of the unfolding included, and zero normals stored out of band and
+// decoded back to zero instead of +z.
+
+#include "scalar_field/normal_encoding.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+// Directions along the axes, the diagonals and the seams of the unfolding,
+// and random ones. Not normalized, the encoding takes any length.
+[[nodiscard]] std::vector<glm::vec3> createDirections() {
+  std::vector<glm::vec3> directions;
+  for (int z{-1}; z <= 1; ++z) {
+    for (int y{-1}; y <= 1; ++y) {
+      for (int x{-1}; x <= 1; ++x) {
+        if (x != 0 || y != 0 || z != 0) {
+          directions.emplace_back(static_cast<float>(x),
+                                  static_cast<float>(y),
+                                  static_cast<float>(z));
+        }
+      }
+    }
+  }
+  // Close to -z on all sides, rounding to the corners of the encoding
+  for (const float e : {1e-3f, 1e-5f, 1e-7f}) {
+    for (const float sx : {-1.f, 1.f}) {
+      for (const float sy : {-1.f, 1.f}) {
+        directions.emplace_back(sx * e, sy * e, -1.f);
+        directions.emplace_back(sx * e, 0.f, -1.f);
+      }
+    }
+  }
+  std::mt19937 generator{29};
+  std::normal_distribution<float> gaussian;
+  for (int d{0}; d != 100000; ++d) {
+    const glm::vec3 direction{gaussian(generator), gaussian(generator),
+                              gaussian(generator)};
+    directions.push_back(3.f * direction);
+  }
+  return directions;
+}
+
+// Accurate for small angles, unlike the arc cosine of the dot product
+[[nodiscard]] float angle(const glm::vec3 &a, const glm::vec3 &b) {
+  const glm::vec3 u{glm::normalize(a)};
+  const glm::vec3 v{glm::normalize(b)};
+  return std::atan2(glm::length(glm::cross(u, v)), glm::dot(u, v));
+}
+
+// Largest angle between the directions and their round trips through the
+// encoding, decoded as the GPU reads signed normalized components
+template <Gecko::NormalFormat FORMAT>
+[[nodiscard]] float roundTripError(const std::vector<glm::vec3> &directions) {
+  using Type = typename Gecko::NormalFormatTraits<FORMAT>::Type;
+  constexpr auto MAX_LEVEL{
+      static_cast<float>(std::numeric_limits<Type>::max())};
+  std::vector<Type> encoded(2 * directions.size());
+  Gecko::encodeNormalsParallel<FORMAT>(directions.data(), directions.size(),
+                                       encoded.data());
+  float error{0.f};
+  for (std::size_t d{0}; d != directions.size(); ++d) {
+    const glm::vec2 e{std::max(static_cast<float>(encoded[2 * d]) / MAX_LEVEL,
+                               -1.f),
+                      std::max(static_cast<float>(encoded[2 * d + 1]) /
+                                   MAX_LEVEL,
+                               -1.f)};
+    const glm::vec3 decoded{Gecko::decodeOctahedral(e)};
+    check(std::abs(glm::length(decoded) - 1.f) < 1e-5f,
+          fmt::format("Direction ({}, {}, {}) decoded to a vector of length {}",
+                      directions[d].x, directions[d].y, directions[d].z,
+                      glm::length(decoded)));
+    error = std::max(error, angle(directions[d], decoded));
+  }
+  return error;
+}
+
+void testRoundTrips(const std::vector<glm::vec3> &directions) {
+  float error{0.f};
+  for (const glm::vec3 &direction : directions) {
+    error = std::max(error, angle(direction, Gecko::decodeOctahedral(
+                                                 Gecko::encodeOctahedral(
+                                                     direction))));
+  }
+  check(error < 1e-6f,
+        fmt::format("Round trip without quantization off by {} radians",
+                    error));
+
+  // Bounds a little above the errors measured, 6.4e-5 and 0.0163 radians
+  const float oct16{
+      roundTripError<Gecko::NormalFormat::Octahedral16>(directions)};
+  check(oct16 < 7e-5f,
+        fmt::format("16 bit round trip off by {} radians", oct16));
+  const float oct8{
+      roundTripError<Gecko::NormalFormat::Octahedral8>(directions)};
+  check(oct8 < 0.0175f,
+        fmt::format("8 bit round trip off by {} radians", oct8));
+}
+
+template <Gecko::NormalFormat FORMAT> void testZero() {
+  using Type = typename Gecko::NormalFormatTraits<FORMAT>::Type;
+  constexpr Type MAX_LEVEL{std::numeric_limits<Type>::max()};
+  const std::vector<glm::vec3> normals{glm::vec3{0.f}, glm::vec3{-0.f},
+                                       glm::vec3{0.f, 0.f, -1.f},
+                                       glm::vec3{1e-7f, 1e-7f, -1.f}};
+  std::vector<Type> encoded(2 * normals.size());
+  Gecko::encodeNormals<FORMAT>(normals.data(), normals.size(),
+                               encoded.data());
+  // Zero at the corner (-1, -1), -z and directions rounded to it elsewhere
+  for (std::size_t n{0}; n != normals.size(); ++n) {
+    const bool zero{n < 2};
+    const Type expected{zero ? static_cast<Type>(-MAX_LEVEL) : MAX_LEVEL};
+    check(encoded[2 * n] == expected && encoded[2 * n + 1] == expected,
+          fmt::format("Normal {} encoded as ({}, {})", n,
+                      static_cast<int>(encoded[2 * n]),
+                      static_cast<int>(encoded[2 * n + 1])));
+  }
+  // Both -1 and the level below, which the GPU clamps to -1, decode to zero
+  for (const float e : {-1.f, -1.f - 1.f / static_cast<float>(MAX_LEVEL)}) {
+    check(Gecko::decodeOctahedral(glm::vec2{std::max(e, -1.f)}) ==
+              glm::vec3{0.f},
+          "Zero normal not decoded to zero");
+  }
+  // One level away from the corner is a direction close to -z
+  const float level{1.f / static_cast<float>(MAX_LEVEL)};
+  check(angle(Gecko::decodeOctahedral(glm::vec2{-1.f + level, -1.f}),
+              glm::vec3{0.f, 0.f, -1.f}) < 4.f * level,
+        "Encoding next to the zero normal not close to -z");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("normal_encoding_test", []() -> void {
+    check(Gecko::encodeOctahedral(glm::vec3{0.f}) == glm::vec2{-1.f} &&
+              Gecko::decodeOctahedral(glm::vec2{-1.f}) == glm::vec3{0.f},
+          "Zero vector not encoded out of band");
+    testRoundTrips(createDirections());
+    testZero<Gecko::NormalFormat::Octahedral16>();
+    testZero<Gecko::NormalFormat::Octahedral8>();
+  });
+}
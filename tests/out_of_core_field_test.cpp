@@ -0,0 +1,255 @@
+// OutOfCoreScalarField on a bricked .gvol file: elements, samples and regions
+// agreeing with the field written, the brick cache evicting the least
+// recently used brick at its memory budget, the hit, miss, prefetch and
+// eviction counters, and the bricks kept by the threads never serving another
+// field or outliving an eviction under concurrent samples.
+
+#include "io/gvol.hpp"
+#include "io/out_of_core_field.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+constexpr int BRICK_SIZE_LOG2{3};
+constexpr int BRICK_SIZE{1 << BRICK_SIZE_LOG2};
+constexpr std::size_t BRICK_BYTES{std::size_t{BRICK_SIZE} * BRICK_SIZE *
+                                  BRICK_SIZE * sizeof(float)};
+// Sizes not multiple of the brick size, 5x4x3 bricks
+const glm::ivec3 NUM_ELEMENTS{37, 29, 23};
+
+[[nodiscard]] Gecko::ScalarField<float> createField() {
+  auto field{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{-2.f, 0.f, 1.f}, glm::vec3{3.f, 2.f, 4.f}, NUM_ELEMENTS.x,
+      NUM_ELEMENTS.y, NUM_ELEMENTS.z, 0.f)};
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        field(i, j, k) = std::sin(0.3f * static_cast<float>(i)) +
+                         0.01f * static_cast<float>(j * k);
+      }
+    }
+  }
+  return field;
+}
+
+[[nodiscard]] std::unique_ptr<Gecko::OutOfCoreScalarField>
+openField(const std::string &filename, const std::size_t budget_bricks) {
+  Gecko::OutOfCoreScalarField::Settings settings;
+  settings.memory_budget = budget_bricks * BRICK_BYTES;
+  settings.prefetch_distance = 2;
+  return Gecko::OutOfCoreScalarField::createFromFile(filename, settings);
+}
+
+// Touch the first element of a brick
+void touch(const Gecko::OutOfCoreScalarField &field, const glm::ivec3 &brick) {
+  static_cast<void>(field(brick.x * BRICK_SIZE, brick.y * BRICK_SIZE,
+                          brick.z * BRICK_SIZE));
+}
+
+void testAgreement(const Gecko::ScalarField<float> &field,
+                   const std::string &filename) {
+  // A budget far smaller than the field, bricks are evicted all along
+  const auto out_of_core{openField(filename, 4)};
+  check(out_of_core->min() == field.min() &&
+            out_of_core->max() == field.max() &&
+            out_of_core->xSize() == field.xSize() &&
+            out_of_core->ySize() == field.ySize() &&
+            out_of_core->zSize() == field.zSize() &&
+            out_of_core->brickSize() == BRICK_SIZE,
+        "Wrong bounds or size of the out of core field");
+  const auto [value_min, value_max]{out_of_core->valueRange()};
+  check(value_min == *std::min_element(field.data(),
+                                       field.data() + field.totalElements()) &&
+            value_max ==
+                *std::max_element(field.data(),
+                                  field.data() + field.totalElements()),
+        "Wrong value range of the out of core field");
+
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        check(out_of_core->at(i, j, k) == field(i, j, k),
+              fmt::format("Wrong element ({}, {}, {})", i, j, k));
+      }
+    }
+  }
+  Gecko::Test::checkThrows(
+      [&]() -> void { static_cast<void>(out_of_core->at(37, 0, 0)); },
+      "at() past the field");
+
+  std::mt19937 generator{7};
+  // Also past the bounds, clamped to the border
+  std::uniform_real_distribution<float> x{-2.5f, 3.5f};
+  std::uniform_real_distribution<float> y{-0.5f, 2.5f};
+  std::uniform_real_distribution<float> z{0.5f, 4.5f};
+  for (int s{0}; s != 10000; ++s) {
+    const glm::vec3 position{x(generator), y(generator), z(generator)};
+    check(out_of_core->sample(position) == field.sample(position),
+          "Out of core and in memory samples differ");
+  }
+  const float nan{std::numeric_limits<float>::quiet_NaN()};
+  check(out_of_core->sample(glm::vec3{nan, 1.f, nan}) ==
+            field.sample(glm::vec3{nan, 1.f, nan}),
+        "Out of core and in memory samples at NaN differ");
+
+  // Regions across bricks and along the border
+  const std::vector<std::pair<glm::ivec3, glm::ivec3>> regions{
+      {glm::ivec3{0}, NUM_ELEMENTS},
+      {glm::ivec3{5, 7, 6}, glm::ivec3{20, 3, 11}},
+      {glm::ivec3{36, 28, 22}, glm::ivec3{1}},
+      {glm::ivec3{30, 0, 15}, glm::ivec3{7, 29, 8}}};
+  for (const auto &[origin, size] : regions) {
+    std::vector<float> values(static_cast<std::size_t>(size.x) *
+                              static_cast<std::size_t>(size.y) *
+                              static_cast<std::size_t>(size.z));
+    out_of_core->readRegion(origin, size, values.data());
+    std::size_t v{0};
+    for (int k{0}; k != size.z; ++k) {
+      for (int j{0}; j != size.y; ++j) {
+        for (int i{0}; i != size.x; ++i) {
+          check(values[v++] ==
+                    field(origin.x + i, origin.y + j, origin.z + k),
+                "Wrong element of a region");
+        }
+      }
+    }
+  }
+  std::vector<float> values(8);
+  Gecko::Test::checkThrows(
+      [&]() -> void {
+        out_of_core->readRegion(glm::ivec3{36, 0, 0}, glm::ivec3{2, 2, 2},
+                                values.data());
+      },
+      "readRegion() past the field");
+}
+
+void testEviction(const std::string &filename) {
+  const auto field{openField(filename, 4)};
+  check(field->maxCachedBricks() == 4, "Wrong number of bricks in budget");
+  // Bricks apart from each other, so that no miss prefetches
+  const glm::ivec3 a{0, 0, 0};
+  const glm::ivec3 b{2, 0, 0};
+  const glm::ivec3 c{4, 0, 0};
+  const glm::ivec3 d{0, 2, 0};
+  const glm::ivec3 e{2, 2, 2};
+  for (const glm::ivec3 &brick : {a, b, c, d}) {
+    touch(*field, brick);
+  }
+  touch(*field, a);
+  // Evicts b, the least recently used
+  touch(*field, e);
+  check(field->cachedBricks() == 4, "Cache over its budget");
+  touch(*field, a);
+  touch(*field, c);
+  Gecko::OutOfCoreScalarField::Statistics statistics{field->statistics()};
+  check(statistics.misses == 5 && statistics.hits == 3 &&
+            statistics.evictions == 1,
+        "Least recently used brick not the one evicted");
+  // b reloaded, evicting d
+  touch(*field, b);
+  touch(*field, d);
+  statistics = field->statistics();
+  check(statistics.misses == 7 && statistics.evictions == 3 &&
+            statistics.prefetches == 0,
+        "Wrong statistics after reloading evicted bricks");
+
+  field->resetStatistics();
+  statistics = field->statistics();
+  check(statistics.hits == 0 && statistics.misses == 0 &&
+            statistics.prefetches == 0 && statistics.evictions == 0,
+        "Statistics not reset");
+  check(field->cachedBricks() == 4, "Reset statistics dropped bricks");
+}
+
+void testPrefetch(const std::string &filename) {
+  const auto field{openField(filename, 64)};
+  // The first miss gives no direction, the next ones along +x prefetch two
+  // bricks each, clipped to the 5 bricks along x
+  for (int bx{0}; bx != 5; ++bx) {
+    touch(*field, glm::ivec3{bx, 1, 1});
+  }
+  Gecko::OutOfCoreScalarField::Statistics statistics{field->statistics()};
+  check(statistics.misses == 5 && statistics.prefetches == 2 + 2 + 1 + 0,
+        fmt::format("Wrong prefetches along x: {}", statistics.prefetches));
+  // A jump gives no direction
+  touch(*field, glm::ivec3{0, 3, 2});
+  check(field->statistics().prefetches == statistics.prefetches,
+        "Prefetch after a jump");
+  // Down along z from there, one brick left below
+  touch(*field, glm::ivec3{0, 3, 1});
+  check(field->statistics().prefetches == statistics.prefetches + 1,
+        "Wrong prefetches along -z");
+}
+
+void testThreadBricks(const Gecko::ScalarField<float> &field,
+                      const std::string &filename) {
+  // A field opened where a destroyed one was, likely at the same address, the
+  // brick the thread kept of the first must not be read for the second
+  const Gecko::Test::TemporaryFile other{"gecko_out_of_core_other_test.gvol"};
+  Gecko::ScalarField<float> negated{field};
+  for (std::size_t e{0}; e != negated.totalElements(); ++e) {
+    negated.data()[e] = -negated.data()[e] - 1.f;
+  }
+  Gecko::GVolFile::writeToFile(other.path(), negated, nullptr,
+                               BRICK_SIZE_LOG2);
+  for (int f{0}; f != 4; ++f) {
+    const auto &expected{f % 2 == 0 ? field : negated};
+    const auto out_of_core{
+        openField(f % 2 == 0 ? filename : other.path(), 4)};
+    check((*out_of_core)(1, 2, 3) == expected(1, 2, 3),
+          "Element read from the brick of another field");
+  }
+
+  // Threads sampling while the others evict their bricks, a budget of 2
+  // bricks out of 60
+  const auto out_of_core{openField(filename, 2)};
+  std::vector<std::thread> threads;
+  std::vector<int> mismatches(4);
+  for (std::size_t t{0}; t != mismatches.size(); ++t) {
+    threads.emplace_back([&, t]() -> void {
+      std::mt19937 generator{static_cast<unsigned>(t)};
+      std::uniform_real_distribution<float> x{-2.f, 3.f};
+      std::uniform_real_distribution<float> y{0.f, 2.f};
+      std::uniform_real_distribution<float> z{1.f, 4.f};
+      for (int s{0}; s != 20000; ++s) {
+        const glm::vec3 position{x(generator), y(generator), z(generator)};
+        mismatches[t] +=
+            out_of_core->sample(position) == field.sample(position) ? 0 : 1;
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  check(std::all_of(mismatches.begin(), mismatches.end(),
+                    [](const int count) -> bool { return count == 0; }),
+        "Concurrent samples differ from the field in memory");
+  check(out_of_core->cachedBricks() <= 2, "Cache over its budget");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("out_of_core_field_test", []() -> void {
+    const Gecko::Test::TemporaryFile file{"gecko_out_of_core_test.gvol"};
+    const Gecko::ScalarField<float> field{createField()};
+    Gecko::GVolFile::writeToFile(file.path(), field, nullptr,
+                                 BRICK_SIZE_LOG2);
+    testAgreement(field, file.path());
+    testEviction(file.path());
+    testPrefetch(file.path());
+    testThreadBricks(field, file.path());
+  });
+}
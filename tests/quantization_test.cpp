@@ -0,0 +1,186 @@
+// Quantization of the volumes: every finite half surviving a round trip
+// through float, floats rounded to the nearest half with ties to even across
+// the subnormals and overflowing past the largest half, and the levels of the
+// normalized formats at the ends of the range and clamped outside of it.
+
+#include "scalar_field/quantization.hpp"
+#include "test_utils.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+[[nodiscard]] std::uint16_t halfBits(const float value) {
+  return Gecko::Half{value}.bits();
+}
+
+void testHalfRoundTrip() {
+  for (std::uint32_t bits{0}; bits != 0x10000u; ++bits) {
+    const auto half{
+        Gecko::Half::fromBits(static_cast<std::uint16_t>(bits))};
+    // Infinities and NaNs
+    if ((bits & 0x7C00u) == 0x7C00u) {
+      continue;
+    }
+    const auto value{static_cast<float>(half)};
+    check(halfBits(value) == bits,
+          fmt::format("Half {:#06x} read as {} and written as {:#06x}", bits,
+                      value, halfBits(value)));
+  }
+  // Values of a few encodings, zero of both signs and the subnormals
+  const std::vector<std::pair<std::uint16_t, float>> values{
+      {0x0000u, 0.f},
+      {0x8000u, -0.f},
+      {0x0001u, std::ldexp(1.f, -24)},
+      {0x03FFu, std::ldexp(1023.f, -24)},
+      {0x0400u, std::ldexp(1.f, -14)},
+      {0x3C00u, 1.f},
+      {0xC000u, -2.f},
+      {0x7BFFu, 65504.f}};
+  for (const auto &[bits, value] : values) {
+    const auto read{static_cast<float>(Gecko::Half::fromBits(bits))};
+    check(read == value && std::signbit(read) == std::signbit(value),
+          fmt::format("Half {:#06x} read as {} instead of {}", bits, read,
+                      value));
+  }
+}
+
+void testHalfRounding() {
+  const float tiny{std::ldexp(1.f, -24)};
+  const float inf{std::numeric_limits<float>::infinity()};
+  const std::vector<std::pair<float, std::uint16_t>> roundings{
+      // Ties at 2^-25, half of the smallest subnormal, go to zero
+      {0.5f * tiny, 0x0000u},
+      {-0.5f * tiny, 0x8000u},
+      {std::nextafter(0.5f * tiny, 1.f), 0x0001u},
+      {std::nextafter(0.5f * tiny, 0.f), 0x0000u},
+      {std::ldexp(1.f, -30), 0x0000u},
+      // Ties between subnormals
+      {1.5f * tiny, 0x0002u},
+      {2.5f * tiny, 0x0002u},
+      {1022.5f * tiny, 0x03FEu},
+      // Ties between the largest subnormal and the smallest normal, and
+      // between the two smallest normals
+      {1023.5f * tiny, 0x0400u},
+      {std::nextafter(1023.5f * tiny, 0.f), 0x03FFu},
+      {1024.5f * tiny, 0x0400u},
+      {std::nextafter(1024.5f * tiny, 1.f), 0x0401u},
+      {1025.5f * tiny, 0x0402u},
+      // Ties between normals
+      {1.f + std::ldexp(1.f, -11), 0x3C00u},
+      {1.f + 3.f * std::ldexp(1.f, -11), 0x3C02u},
+      // A carry of the mantissa into the exponent
+      {2.f - std::ldexp(1.f, -12), 0x4000u},
+      // The largest half, below the tie with 2^16 and at the tie
+      {65519.f, 0x7BFFu},
+      {-65519.f, 0xFBFFu},
+      {65520.f, 0x7C00u},
+      {-65520.f, 0xFC00u},
+      {1e10f, 0x7C00u},
+      {inf, 0x7C00u},
+      {-inf, 0xFC00u}};
+  for (const auto &[value, bits] : roundings) {
+    check(halfBits(value) == bits,
+          fmt::format("{} rounded to the half {:#06x} instead of {:#06x}",
+                      value, halfBits(value), bits));
+  }
+
+  for (const float nan : {std::numeric_limits<float>::quiet_NaN(),
+                          -std::numeric_limits<float>::quiet_NaN(),
+                          std::numeric_limits<float>::signaling_NaN()}) {
+    const Gecko::Half half{nan};
+    check((half.bits() & 0x7C00u) == 0x7C00u && (half.bits() & 0x3FFu) != 0u &&
+              std::isnan(static_cast<float>(half)),
+          fmt::format("NaN written as the half {:#06x}", half.bits()));
+  }
+}
+
+template <Gecko::VolumeFormat FORMAT> void testNormalizedLevels() {
+  using Type = typename Gecko::VolumeFormatTraits<FORMAT>::Type;
+  constexpr auto MAX_LEVEL{std::numeric_limits<Type>::max()};
+  const std::pair<float, float> range{-2.f, 6.f};
+  const std::pair<float, float> quantization{
+      Gecko::computeQuantization(FORMAT, range)};
+  check(quantization == std::pair{8.f, -2.f}, "Wrong scale and offset");
+  const float step{8.f / static_cast<float>(MAX_LEVEL)};
+  // Ends of the range, rounding to the nearest level, and values outside
+  const std::vector<std::pair<float, Type>> levels{
+      {-2.f, Type{0}},
+      {6.f, MAX_LEVEL},
+      {-2.f + 0.4f * step, Type{0}},
+      {-2.f + 0.6f * step, Type{1}},
+      {6.f - 0.4f * step, MAX_LEVEL},
+      {6.f - 0.6f * step, static_cast<Type>(MAX_LEVEL - 1)},
+      {-2.1f, Type{0}},
+      {-1e30f, Type{0}},
+      {6.1f, MAX_LEVEL},
+      {1e30f, MAX_LEVEL},
+      {-std::numeric_limits<float>::infinity(), Type{0}},
+      {std::numeric_limits<float>::infinity(), MAX_LEVEL}};
+  for (const auto &[value, level] : levels) {
+    Type stored;
+    Gecko::quantizeValues<FORMAT>(&value, 1, quantization, &stored);
+    check(stored == level,
+          fmt::format("{} stored as the level {} instead of {}", value,
+                      static_cast<int>(stored), static_cast<int>(level)));
+    // Through the format known at run time
+    Type dynamic;
+    Gecko::quantizeValues(FORMAT, &value, 1, quantization, &dynamic);
+    check(dynamic == level, "Formats known at run time quantize differently");
+  }
+  // A single value maps to the first level
+  const float value{3.f};
+  Type stored{1};
+  Gecko::quantizeValues<FORMAT>(
+      &value, 1, Gecko::computeQuantization(FORMAT, {3.f, 3.f}), &stored);
+  check(stored == Type{0}, "Empty range not mapped to the first level");
+}
+
+template <Gecko::VolumeFormat FORMAT> void testQuantizeField() {
+  using Type = typename Gecko::VolumeFormatTraits<FORMAT>::Type;
+  constexpr auto MAX_LEVEL{std::numeric_limits<Type>::max()};
+  auto field{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{0.f}, glm::vec3{1.f}, 7, 5, 9, 1.f)};
+  field(3, 2, 1) = -4.f;
+  field(6, 4, 8) = 12.f;
+
+  // The range of the field is mapped to the whole range of levels
+  const auto whole{Gecko::quantize<FORMAT>(field)};
+  check(whole.scale == 16.f && whole.offset == -4.f,
+        "Wrong scale and offset of the field");
+  check(whole.field(3, 2, 1) == Type{0} && whole.field(6, 4, 8) == MAX_LEVEL,
+        "Ends of the range of the field not at the first and last levels");
+  const float one{static_cast<float>(whole.field(0, 0, 0)) /
+                      static_cast<float>(MAX_LEVEL) * whole.scale +
+                  whole.offset};
+  check(std::abs(one - 1.f) <= 0.5f * whole.scale /
+                                   static_cast<float>(MAX_LEVEL),
+        "Quantized value off by more than half a level");
+
+  // Values outside a given range are clamped to it
+  const auto clamped{Gecko::quantize<FORMAT>(field, {0.f, 2.f})};
+  check(clamped.field(3, 2, 1) == Type{0} &&
+            clamped.field(6, 4, 8) == MAX_LEVEL,
+        "Values outside the range not clamped");
+  check(clamped.field(0, 0, 0) == static_cast<Type>(MAX_LEVEL / 2 + 1),
+        "Middle of the range not rounded to the nearest level");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("quantization_test", []() -> void {
+    testHalfRoundTrip();
+    testHalfRounding();
+    testNormalizedLevels<Gecko::VolumeFormat::UNorm8>();
+    testNormalizedLevels<Gecko::VolumeFormat::UNorm16>();
+    testQuantizeField<Gecko::VolumeFormat::UNorm8>();
+    testQuantizeField<Gecko::VolumeFormat::UNorm16>();
+  });
+}
@@ -0,0 +1,244 @@
+// ScalarField layouts: the bricked index covering its padded storage once,
+// conversions between linear and bricked fields keeping every element, and
+// brick traversal and copies of bricked fields. Sampling at non-finite
+// positions and of integer fields, and batches of samples, SIMD when built
+// with AVX2, agreeing with the scalar samples inside, on the border and
+// outside of the field.
+
+#include "scalar_field/scalar_field.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+using Bricked = Gecko::BrickedLayout<3>;
+
+// Sizes not multiple of the brick size along any axis
+const glm::ivec3 NUM_ELEMENTS{19, 13, 10};
+
+[[nodiscard]] float elementValue(const int i, const int j, const int k) {
+  return static_cast<float>(i + 100 * j + 10000 * k);
+}
+
+[[nodiscard]] Gecko::ScalarField<float> createLinearField() {
+  auto field{Gecko::ScalarField<float>::createFromMinMax(
+      glm::vec3{-1.f}, glm::vec3{2.f, 1.f, 3.f}, NUM_ELEMENTS.x,
+      NUM_ELEMENTS.y, NUM_ELEMENTS.z, 0.f)};
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        field(i, j, k) = elementValue(i, j, k);
+      }
+    }
+  }
+  return field;
+}
+
+template <typename Field>
+void checkElements(const Field &field, const std::string &name) {
+  for (int k{0}; k != NUM_ELEMENTS.z; ++k) {
+    for (int j{0}; j != NUM_ELEMENTS.y; ++j) {
+      for (int i{0}; i != NUM_ELEMENTS.x; ++i) {
+        check(field(i, j, k) == elementValue(i, j, k),
+              fmt::format("Wrong element ({}, {}, {}) of the {} field", i, j,
+                          k, name));
+      }
+    }
+  }
+}
+
+void testBrickedIndex() {
+  const Bricked layout{NUM_ELEMENTS};
+  check(layout.numBricks() == glm::ivec3{3, 2, 2}, "Wrong number of bricks");
+  check(layout.storageSize() == 12 * Bricked::BRICK_ELEMENTS,
+        "Wrong bricked storage size");
+  check(layout.numSlabs() * layout.slabElements() == layout.storageSize(),
+        "Slabs do not cover the bricked storage");
+
+  // Every element of the padded grid maps to its own storage index
+  std::vector<int> hits(layout.storageSize(), 0);
+  const glm::ivec3 padded{layout.numBricks() * Bricked::BRICK_SIZE};
+  for (int k{0}; k != padded.z; ++k) {
+    for (int j{0}; j != padded.y; ++j) {
+      for (int i{0}; i != padded.x; ++i) {
+        const std::size_t index{layout.index(i, j, k)};
+        check(index < layout.storageSize(), "Bricked index out of storage");
+        ++hits[index];
+      }
+    }
+  }
+  check(std::all_of(hits.begin(), hits.end(),
+                    [](const int count) -> bool { return count == 1; }),
+        "Bricked index not one to one");
+
+  // Neighbours along z inside a brick are a brick plane apart
+  check(layout.index(3, 4, 6) - layout.index(3, 4, 5) ==
+            Bricked::BRICK_SIZE * Bricked::BRICK_SIZE,
+        "Wrong z stride inside a brick");
+}
+
+void testConvertLayout() {
+  const Gecko::ScalarField<float> linear{createLinearField()};
+  const auto bricked{linear.convertLayout<Bricked>()};
+  check(bricked.min() == linear.min() && bricked.max() == linear.max() &&
+            bricked.xSize() == NUM_ELEMENTS.x &&
+            bricked.ySize() == NUM_ELEMENTS.y &&
+            bricked.zSize() == NUM_ELEMENTS.z,
+        "Converted field changed bounds or size");
+  checkElements(bricked, "bricked");
+  check(bricked.sample(glm::vec3{0.3f, 0.1f, 1.7f}) ==
+            linear.sample(glm::vec3{0.3f, 0.1f, 1.7f}),
+        "Bricked and linear samples differ");
+
+  const auto round_trip{bricked.convertLayout<Gecko::LinearLayout>()};
+  checkElements(round_trip, "round trip");
+  check(std::equal(linear.data(), linear.data() + linear.totalElements(),
+                   round_trip.data()),
+        "Round trip changed the linear storage");
+
+  // Copies cover the padding too
+  const Gecko::ScalarField<float, Bricked> copy{bricked};
+  check(std::equal(bricked.data(), bricked.data() + bricked.storageSize(),
+                   copy.data()),
+        "Copy of the bricked field differs");
+}
+
+void testForEachBrick() {
+  const auto bricked{createLinearField().convertLayout<Bricked>()};
+  std::size_t num_bricks{0};
+  bricked.forEachBrick([&](const glm::ivec3 &origin,
+                           const float *elements) -> void {
+    ++num_bricks;
+    // Element (x, y, z) of the brick, x fastest
+    for (int z{0}; z != Bricked::BRICK_SIZE; ++z) {
+      for (int y{0}; y != Bricked::BRICK_SIZE; ++y) {
+        for (int x{0}; x != Bricked::BRICK_SIZE; ++x) {
+          const glm::ivec3 e{origin + glm::ivec3{x, y, z}};
+          if (glm::all(glm::lessThan(e, NUM_ELEMENTS))) {
+            check(elements[x + Bricked::BRICK_SIZE *
+                                   (y + Bricked::BRICK_SIZE * z)] ==
+                      elementValue(e.x, e.y, e.z),
+                  "Wrong element in brick");
+          }
+        }
+      }
+    }
+  });
+  check(num_bricks == bricked.layout().totalBricks(), "Bricks missed");
+}
+
+void testSampleNonFinite() {
+  const Gecko::ScalarField<float> field{createLinearField()};
+  const float nan{std::numeric_limits<float>::quiet_NaN()};
+  const float inf{std::numeric_limits<float>::infinity()};
+  // Non-finite coordinates end up at the first or last element of their axis
+  const std::vector<glm::vec3> positions{
+      glm::vec3{nan}, glm::vec3{nan, 0.f, 0.f}, glm::vec3{-inf, inf, nan},
+      glm::vec3{inf}, glm::vec3{nan, nan, -inf}, glm::vec3{0.f},
+      glm::vec3{inf, nan, 1.f}, glm::vec3{nan, -inf, inf},
+      glm::vec3{2.f, 1.f, nan}};
+  const std::vector<float> expected{
+      elementValue(0, 0, 0),
+      field.sample(glm::vec3{-1.f, 0.f, 0.f}),
+      elementValue(0, NUM_ELEMENTS.y - 1, 0),
+      elementValue(NUM_ELEMENTS.x - 1, NUM_ELEMENTS.y - 1,
+                   NUM_ELEMENTS.z - 1),
+      elementValue(0, 0, 0),
+      field.sample(glm::vec3{0.f}),
+      field.sample(glm::vec3{2.f, -1.f, 1.f}),
+      elementValue(0, 0, NUM_ELEMENTS.z - 1),
+      elementValue(NUM_ELEMENTS.x - 1, NUM_ELEMENTS.y - 1, 0)};
+  for (std::size_t p{0}; p != positions.size(); ++p) {
+    check(field.sample(positions[p]) == expected[p],
+          fmt::format("Wrong sample at non-finite position {}", p));
+  }
+  // The batch, SIMD when built with AVX2, agrees
+  std::vector<float> values(positions.size());
+  field.sample(positions.data(), positions.size(), values.data());
+  check(values == expected, "Batch samples at non-finite positions differ");
+}
+
+void testSampleInteger() {
+  auto field{Gecko::ScalarField<std::uint8_t>::createFromMinMax(
+      glm::vec3{0.f}, glm::vec3{1.f}, 2, 2, 2, 0)};
+  for (int k{0}; k != 2; ++k) {
+    for (int j{0}; j != 2; ++j) {
+      field(1, j, k) = 255;
+    }
+  }
+  // 63.75 and 165.75, truncated to 63 and 165
+  check(field.sample(glm::vec3{0.25f, 0.5f, 0.5f}) == 64,
+        "Integer sample not rounded to nearest");
+  check(field.sample(glm::vec3{0.65f, 0.f, 1.f}) == 166,
+        "Integer sample not rounded to nearest");
+  check(field.sample(glm::vec3{1.f}) == 255, "Wrong integer border sample");
+}
+
+void testSampleBatch() {
+  auto field{createLinearField()};
+  std::mt19937 generator{11};
+  std::uniform_real_distribution<float> values{-1.f, 1.f};
+  for (std::size_t e{0}; e != field.totalElements(); ++e) {
+    field.data()[e] = values(generator);
+  }
+
+  // Not a multiple of the SIMD width, the last positions take the scalar path
+  constexpr std::size_t NUM_POSITIONS{1003};
+  std::vector<glm::vec3> positions;
+  const glm::vec3 extent{field.max() - field.min()};
+  std::uniform_real_distribution<float> inside{0.f, 1.f};
+  std::uniform_real_distribution<float> around{-0.2f, 1.2f};
+  std::uniform_int_distribution<int> side{0, 1};
+  for (std::size_t p{0}; p != NUM_POSITIONS; ++p) {
+    glm::vec3 position;
+    for (int c{0}; c != 3; ++c) {
+      position[c] = p % 3 == 2 ? around(generator) : inside(generator);
+    }
+    if (p % 3 == 1) {
+      // One coordinate on a face of the field
+      position[static_cast<int>(p / 3 % 3)] =
+          static_cast<float>(side(generator));
+    }
+    positions.push_back(field.min() + position * extent);
+  }
+  // Elements and the corners of the field
+  positions[0] = field.min();
+  positions[1] = field.max();
+  positions[2] = field.computeElementPosition(3, 4, 5);
+  positions[3] = field.computeElementPosition(NUM_ELEMENTS.x - 2,
+                                              NUM_ELEMENTS.y - 1, 0);
+
+  std::vector<float> batch(NUM_POSITIONS);
+  field.sample(positions.data(), NUM_POSITIONS, batch.data());
+  // The SIMD path multiplies by the inverse voxel size and may fuse the
+  // interpolation, a few ulps off the scalar samples
+  const float tolerance{1e-5f};
+  for (std::size_t p{0}; p != NUM_POSITIONS; ++p) {
+    const float scalar{field.sample(positions[p])};
+    check(std::abs(batch[p] - scalar) <= tolerance,
+          fmt::format("Batch sample {} at ({}, {}, {}) is {} instead of {}", p,
+                      positions[p].x, positions[p].y, positions[p].z,
+                      batch[p], scalar));
+  }
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("scalar_field_test", []() -> void {
+    testBrickedIndex();
+    testConvertLayout();
+    testForEachBrick();
+    testSampleNonFinite();
+    testSampleInteger();
+    testSampleBatch();
+  });
+}
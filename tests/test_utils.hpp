@@ -0,0 +1,66 @@
+#pragma once
+
+#include "fmt/format.h"
+
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace Gecko::Test {
+
+// Fail the test with the message if the condition does not hold
+inline void check(const bool condition, const std::string &message) {
+  if (!condition) {
+    throw std::runtime_error{message};
+  }
+}
+
+// Fail the test unless func throws std::exception
+template <typename Func>
+void checkThrows(Func &&func, const std::string &message) {
+  try {
+    func();
+  } catch (const std::exception &) {
+    return;
+  }
+  throw std::runtime_error{fmt::format("{}: nothing thrown", message)};
+}
+
+// Path of a file in the temporary directory, removed when going out of scope
+class TemporaryFile {
+public:
+  explicit TemporaryFile(const std::string &name)
+      : _path{(std::filesystem::temp_directory_path() / name).string()} {}
+
+  ~TemporaryFile() {
+    std::error_code error;
+    std::filesystem::remove(_path, error);
+  }
+
+  // Not copyable or assignable
+  TemporaryFile(const TemporaryFile &) = delete;
+  TemporaryFile &operator=(const TemporaryFile &) = delete;
+
+  [[nodiscard]] const std::string &path() const noexcept { return _path; }
+
+private:
+  std::string _path;
+};
+
+// Run the test body, reporting the exception failing it. Returns the exit code
+// of the test.
+template <typename Func> int run(const char *name, Func &&func) {
+  try {
+    func();
+  } catch (const std::exception &ex) {
+    fmt::print(stderr, "{} failed: {}\n", name, ex.what());
+    return 1;
+  }
+  fmt::print("{} passed\n", name);
+  return 0;
+}
+
+} // namespace Gecko::Test
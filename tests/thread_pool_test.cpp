@@ -0,0 +1,135 @@
+// Loops on the thread pool: every element visited once, exceptions reaching
+// the caller, and the pinned split running each range on the same worker
+// from call to call, nested or not, and its last range on the caller.
+
+#include "utils/parallel.hpp"
+#include "test_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Gecko::Test::check;
+
+void testCoverage(Gecko::ThreadPool &pool) {
+  constexpr std::size_t SIZE{100003};
+  std::vector<std::atomic<int>> visits(SIZE);
+  const auto visit{
+      [&](const std::size_t first, const std::size_t last) -> void {
+        for (std::size_t i{first}; i != last; ++i) {
+          visits[i].fetch_add(1);
+        }
+      }};
+  Gecko::parallelFor(0, SIZE, visit, 4, pool);
+  Gecko::parallelForGrain(0, SIZE, 1000, visit, pool);
+  Gecko::parallelForPinned(0, SIZE, visit, pool);
+  for (const std::atomic<int> &count : visits) {
+    check(count.load() == 3, "Element not visited once by each loop");
+  }
+}
+
+void testExceptions(Gecko::ThreadPool &pool) {
+  const auto throw_last{[](const std::size_t, const std::size_t last) -> void {
+    if (last == 1000) {
+      throw std::runtime_error{"Last range"};
+    }
+  }};
+  Gecko::Test::checkThrows(
+      [&]() -> void { Gecko::parallelFor(0, 1000, throw_last, 4, pool); },
+      "parallelFor");
+  Gecko::Test::checkThrows(
+      [&]() -> void { Gecko::parallelForPinned(0, 1000, throw_last, pool); },
+      "parallelForPinned");
+}
+
+// Thread of each range of a pinned split
+[[nodiscard]] std::vector<std::thread::id>
+pinnedThreads(Gecko::ThreadPool &pool, const std::size_t count) {
+  std::vector<std::thread::id> threads(count);
+  Gecko::parallelForPinned(
+      0, count,
+      [&](const std::size_t first, const std::size_t last) -> void {
+        for (std::size_t i{first}; i != last; ++i) {
+          threads[i] = std::this_thread::get_id();
+        }
+      },
+      pool);
+  return threads;
+}
+
+void testPinned(Gecko::ThreadPool &pool) {
+  // A range per worker and the last one for the calling thread
+  const std::size_t count{pool.numWorkers() + std::size_t{1}};
+  const std::vector<std::thread::id> first{pinnedThreads(pool, count)};
+  check(std::set<std::thread::id>(first.begin(), first.end()).size() == count,
+        "Pinned ranges not on a thread each");
+  check(first.back() == std::this_thread::get_id(),
+        "Last pinned range not run by the calling thread");
+
+  for (int call{0}; call != 20; ++call) {
+    // Tasks to steal meanwhile, which must not take the pinned ranges
+    Gecko::TaskGroup busy{pool};
+    for (int t{0}; t != 16; ++t) {
+      busy.run([]() -> void {
+        std::this_thread::sleep_for(std::chrono::microseconds{200});
+      });
+    }
+    check(pinnedThreads(pool, count) == first,
+          "Pinned ranges moved to other workers");
+    busy.wait();
+  }
+
+  // Nested in a task of a worker, the worker runs its own range and the last
+  std::vector<std::thread::id> nested;
+  std::thread::id caller;
+  Gecko::TaskGroup group{pool};
+  group.run([&]() -> void {
+    caller = std::this_thread::get_id();
+    nested = pinnedThreads(pool, count);
+  });
+  group.wait();
+  check(std::equal(first.begin(), first.end() - 1, nested.begin()) &&
+            nested.back() == caller,
+        "Nested pinned ranges moved to other workers");
+}
+
+void testNoWorkers() {
+  Gecko::ThreadPool pool{0};
+  const std::vector<std::thread::id> threads{pinnedThreads(pool, 4)};
+  check(std::all_of(threads.begin(), threads.end(),
+                    [](const std::thread::id id) -> bool {
+                      return id == std::this_thread::get_id();
+                    }),
+        "Pinned ranges not run by the caller without workers");
+  testCoverage(pool);
+}
+
+void testCpusPerNode() {
+  std::set<unsigned int> cpus;
+  std::size_t count{0};
+  for (const std::vector<unsigned int> &node : Gecko::cpusPerNode()) {
+    check(!node.empty(), "NUMA node without CPUs");
+    cpus.insert(node.begin(), node.end());
+    count += node.size();
+  }
+  check(count != 0 && cpus.size() == count, "CPUs missing or repeated");
+}
+
+} // namespace
+
+int main() {
+  return Gecko::Test::run("thread_pool_test", []() -> void {
+    Gecko::ThreadPool pool{3};
+    testCoverage(pool);
+    testExceptions(pool);
+    testPinned(pool);
+    testNoWorkers();
+    testCpusPerNode();
+  });
+}